@@ -0,0 +1,398 @@
+/***
+  This file is part of ratbagd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice (including the next
+  paragraph) shall be included in all copies or substantial portions of the
+  Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+  DEALINGS IN THE SOFTWARE.
+***/
+
+/*
+ * The Battery interface only ever returns the state we read last, a
+ * client query never talks to the device. Reading a wireless device's
+ * battery may wake it up or time out while it sleeps, so we do it as
+ * rarely as we can:
+ *
+ * - devices that send battery notifications are never polled, libratbag
+ *   updates the state from ratbag_dispatch()
+ * - otherwise we poll about once per percent the battery drops, going by
+ *   the discharge rate seen so far. An unchanged reading or a failed read
+ *   (the device is asleep or out of range) doubles the interval.
+ * - when one device on a receiver is polled, the other devices on that
+ *   receiver whose poll is due soon are polled along with it, so the
+ *   receiver's radio is woken up once for all of them.
+ *
+ * Polls run on a worker thread and don't count as activity for
+ * ratbagd's exit-on-idle.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <libratbag.h>
+#include <stdlib.h>
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+#include "ratbagd.h"
+#include "shared-macro.h"
+#include "libratbag-util.h"
+
+#define s2us(s_) ((uint64_t)(s_) * 1000000)
+
+#define RATBAGD_BATTERY_POLL_MIN	s2us(60)
+#define RATBAGD_BATTERY_POLL_DEFAULT	s2us(5 * 60)
+#define RATBAGD_BATTERY_POLL_MAX	s2us(60 * 60)
+/* while charging or low, clients want to know soon */
+#define RATBAGD_BATTERY_POLL_URGENT	s2us(5 * 60)
+#define RATBAGD_BATTERY_LOW_LEVEL	10
+
+struct ratbagd_battery_state {
+	int level;
+	uint32_t voltage;
+	uint32_t state;
+};
+
+struct ratbagd_battery {
+	struct ratbagd *ctx;
+	struct ratbagd_device *device;	/* owns us */
+	struct ratbag_device *lib_device;
+	char *path;
+	/* devices in the same group share a receiver */
+	char *group;
+
+	sd_event_source *timer;
+	uint64_t next_poll;
+	uint64_t interval;
+
+	/* poll running on a worker thread, see ratbagd_job_start() */
+	struct ratbagd_job *job;
+	enum ratbag_error_code result;
+
+	/* the reading the discharge rate is measured from */
+	int last_value;
+	uint64_t last_change;
+
+	/* property values as last sent to the bus */
+	struct ratbagd_battery_state published;
+};
+
+static void ratbagd_battery_get_state(struct ratbagd_battery *battery,
+				      struct ratbagd_battery_state *state)
+{
+	struct ratbag_device *lib_device = battery->lib_device;
+
+	state->level = ratbag_device_get_battery_level(lib_device);
+	state->voltage = ratbag_device_get_battery_voltage(lib_device);
+	state->state = ratbag_device_get_battery_state(lib_device);
+}
+
+/* Something that changes in steps of one, -1 if we know nothing */
+static int ratbagd_battery_get_value(struct ratbagd_battery *battery)
+{
+	const struct ratbagd_battery_state *state = &battery->published;
+
+	if (state->level >= 0)
+		return state->level;
+	if (state->voltage > 0)
+		return state->voltage / 10;
+
+	return -1;
+}
+
+int ratbagd_battery_flush(sd_bus *bus, struct ratbagd_battery *battery)
+{
+	struct ratbagd_battery_state state;
+	struct ratbagd_battery_state *published;
+	const char *changed[4];
+	size_t n = 0;
+
+	/* the worker thread is writing the state, the job flushes when
+	 * it's done */
+	if (!battery || battery->job)
+		return 0;
+
+	published = &battery->published;
+	ratbagd_battery_get_state(battery, &state);
+
+	if (state.level != published->level)
+		changed[n++] = "Level";
+	if (state.voltage != published->voltage)
+		changed[n++] = "Voltage";
+	if (state.state != published->state)
+		changed[n++] = "State";
+	changed[n] = NULL;
+
+	*published = state;
+
+	if (n == 0)
+		return 0;
+
+	(void) sd_bus_emit_properties_changed_strv(bus,
+						   battery->path,
+						   RATBAGD_NAME_ROOT ".Battery",
+						   (char **)changed);
+
+	return 0;
+}
+
+static uint64_t ratbagd_battery_next_interval(struct ratbagd_battery *battery,
+					      uint64_t now)
+{
+	uint64_t interval = battery->interval;
+	int value = ratbagd_battery_get_value(battery);
+
+	if (battery->result != RATBAG_SUCCESS) {
+		/* asleep or out of range, leave it alone for a while */
+		interval *= 2;
+	} else if (value < 0) {
+		interval = RATBAGD_BATTERY_POLL_MAX;
+	} else if (battery->last_value < 0) {
+		battery->last_value = value;
+		battery->last_change = now;
+		interval = RATBAGD_BATTERY_POLL_DEFAULT;
+	} else if (value == battery->last_value) {
+		interval *= 2;
+	} else {
+		/* one poll per step at the rate we've seen */
+		interval = (now - battery->last_change) /
+			   abs(value - battery->last_value);
+		battery->last_value = value;
+		battery->last_change = now;
+	}
+
+	interval = max(interval, RATBAGD_BATTERY_POLL_MIN);
+	interval = min(interval, RATBAGD_BATTERY_POLL_MAX);
+
+	if (battery->result == RATBAG_SUCCESS &&
+	    (battery->published.state == RATBAG_BATTERY_STATE_CHARGING ||
+	     (battery->published.level >= 0 &&
+	      battery->published.level <= RATBAGD_BATTERY_LOW_LEVEL)))
+		interval = min(interval, RATBAGD_BATTERY_POLL_URGENT);
+
+	return interval;
+}
+
+static void ratbagd_battery_poll(struct ratbagd_battery *battery);
+
+static int ratbagd_battery_timer_cb(sd_event_source *source,
+				    uint64_t usec,
+				    void *userdata)
+{
+	struct ratbagd_battery *battery = userdata;
+	struct ratbagd_battery *other;
+	struct ratbagd_device *device;
+
+	battery->ctx->background_activity = true;
+
+	/* the receiver is awake now, take the devices along that would
+	 * wake it up again soon */
+	RATBAGD_DEVICE_FOREACH(device, battery->ctx) {
+		other = ratbagd_device_get_battery(device);
+		if (!other || other == battery || !other->timer ||
+		    !streq(other->group, battery->group))
+			continue;
+
+		if (other->next_poll <= usec + other->interval / 2) {
+			log_verbose("%s: polling the battery along with %s\n",
+				    ratbagd_device_get_sysname(other->device),
+				    ratbagd_device_get_sysname(battery->device));
+			ratbagd_battery_poll(other);
+		}
+	}
+
+	ratbagd_battery_poll(battery);
+
+	return 0;
+}
+
+static void ratbagd_battery_schedule(struct ratbagd_battery *battery,
+				     uint64_t usec)
+{
+	int r;
+
+	battery->timer = sd_event_source_unref(battery->timer);
+	battery->next_poll = usec;
+
+	r = sd_event_add_time(battery->ctx->event,
+			      &battery->timer,
+			      CLOCK_MONOTONIC,
+			      usec,
+			      s2us(10), /* lets polls of other devices coincide */
+			      ratbagd_battery_timer_cb,
+			      battery);
+	if (r < 0) {
+		errno = -r;
+		log_error("%s: failed to schedule battery poll: %m\n",
+			  ratbagd_device_get_sysname(battery->device));
+		battery->timer = NULL;
+	}
+}
+
+static void ratbagd_battery_poll_work(void *data)
+{
+	struct ratbagd_battery *battery = data;
+
+	/* worker thread, only the lib_device may be touched here */
+	battery->result = ratbag_device_update_battery(battery->lib_device);
+}
+
+static void ratbagd_battery_poll_done(void *data)
+{
+	struct ratbagd_battery *battery = data;
+	struct ratbagd_device *device = battery->device;
+	uint64_t now;
+
+	battery->job = NULL;
+	battery->ctx->background_activity = true;
+
+	if (battery->result != RATBAG_SUCCESS)
+		log_verbose("%s: failed to read the battery (%d)\n",
+			    ratbagd_device_get_sysname(device),
+			    battery->result);
+
+	if (ratbagd_device_linked(device)) {
+		ratbagd_battery_flush(battery->ctx->bus, battery);
+
+		sd_event_now(battery->ctx->event, CLOCK_MONOTONIC, &now);
+		battery->interval = ratbagd_battery_next_interval(battery, now);
+		ratbagd_battery_schedule(battery, now + battery->interval);
+	}
+
+	ratbagd_device_unref(device);
+}
+
+static void ratbagd_battery_poll(struct ratbagd_battery *battery)
+{
+	int r;
+
+	battery->timer = sd_event_source_unref(battery->timer);
+	battery->next_poll = 0;
+
+	if (battery->job)
+		return;
+
+	/* ratbagd_battery_poll_done() drops it */
+	ratbagd_device_ref(battery->device);
+
+	r = ratbagd_job_start(battery->ctx,
+			      &battery->job,
+			      ratbagd_battery_poll_work,
+			      ratbagd_battery_poll_done,
+			      battery);
+	if (r < 0) {
+		errno = -r;
+		log_error("%s: failed to start battery poll: %m\n",
+			  ratbagd_device_get_sysname(battery->device));
+		battery->job = NULL;
+		battery->result = RATBAG_ERROR_SYSTEM;
+		ratbagd_battery_poll_done(battery);
+	}
+}
+
+/**
+ * Start polling the battery unless the device notifies us about changes.
+ * The probe read the battery already, so the first poll is only needed
+ * if that told us nothing.
+ */
+void ratbagd_battery_start(struct ratbagd_battery *battery)
+{
+	uint64_t now;
+
+	if (!battery)
+		return;
+
+	if (ratbag_device_has_battery_notifications(battery->lib_device)) {
+		log_verbose("%s: battery notifications enabled, not polling\n",
+			    ratbagd_device_get_sysname(battery->device));
+		return;
+	}
+
+	sd_event_now(battery->ctx->event, CLOCK_MONOTONIC, &now);
+
+	battery->last_value = ratbagd_battery_get_value(battery);
+	battery->last_change = now;
+	battery->interval = RATBAGD_BATTERY_POLL_DEFAULT;
+
+	if (battery->last_value < 0)
+		ratbagd_battery_schedule(battery, now);
+	else
+		ratbagd_battery_schedule(battery, now + battery->interval);
+}
+
+void ratbagd_battery_stop(struct ratbagd_battery *battery)
+{
+	if (!battery)
+		return;
+
+	ratbagd_battery_wait_idle(battery);
+	battery->timer = sd_event_source_unref(battery->timer);
+	battery->next_poll = 0;
+}
+
+void ratbagd_battery_wait_idle(struct ratbagd_battery *battery)
+{
+	if (battery && battery->job)
+		ratbagd_job_wait(battery->job);
+}
+
+const sd_bus_vtable ratbagd_battery_vtable[] = {
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_PROPERTY("Level", "i", NULL, offsetof(struct ratbagd_battery, published.level), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("Voltage", "u", NULL, offsetof(struct ratbagd_battery, published.voltage), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("State", "u", NULL, offsetof(struct ratbagd_battery, published.state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_VTABLE_END,
+};
+
+int ratbagd_battery_new(struct ratbagd_battery **out,
+			struct ratbagd *ctx,
+			struct ratbagd_device *device,
+			struct ratbag_device *lib_device)
+{
+	_cleanup_(ratbagd_battery_freep) struct ratbagd_battery *battery = NULL;
+
+	assert(out);
+	assert(lib_device);
+
+	battery = zalloc(sizeof(*battery));
+	battery->ctx = ctx;
+	battery->device = device;
+	battery->lib_device = lib_device;
+	battery->path = strdup_safe(ratbagd_device_get_path(device));
+	battery->group = ratbagd_get_device_group(ctx,
+						  ratbagd_device_get_sysname(device));
+	battery->last_value = -1;
+	ratbagd_battery_get_state(battery, &battery->published);
+
+	*out = battery;
+	battery = NULL;
+	return 0;
+}
+
+struct ratbagd_battery *ratbagd_battery_free(struct ratbagd_battery *battery)
+{
+	if (!battery)
+		return NULL;
+
+	assert(!battery->job);
+
+	battery->timer = sd_event_source_unref(battery->timer);
+	battery->group = mfree(battery->group);
+	battery->path = mfree(battery->path);
+
+	return mfree(battery);
+}
@@ -38,13 +38,29 @@
 #include "shared-macro.h"
 #include "libratbag-util.h"
 
+struct ratbagd_button_state {
+	enum ratbag_button_action_type type;
+	unsigned int value;
+	uint32_t macro_hash;
+};
+
 struct ratbagd_button {
 	struct ratbagd_device *device;
 	struct ratbag_button *lib_button;
 	unsigned int index;
 	char *path;
+
+	/* property values as last sent to the bus */
+	struct ratbagd_button_state published;
 };
 
+/* Button numbers a button can be mapped to, starting at 1 for the left
+ * button */
+bool ratbagd_button_is_valid_button(unsigned int map)
+{
+	return map > 0 && map <= 30;
+}
+
 static int ratbagd_button_get_button(sd_bus *bus,
 				     const char *path,
 				     const char *interface,
@@ -81,18 +97,13 @@ static int ratbagd_button_set_button(sd_bus *bus,
 	if (r < 0)
 		return r;
 
-	if (map == 0 || map > 30)
+	if (!ratbagd_button_is_valid_button(map))
 		return 0;
 
 	r = ratbag_button_set_button(button->lib_button, map);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       button->path,
-					       RATBAGD_NAME_ROOT ".Button",
-					       "Mapping",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(button->device);
 
 	return 0;
 }
@@ -138,13 +149,8 @@ static int ratbagd_button_set_special(sd_bus *bus,
 
 	r = ratbag_button_set_special(button->lib_button, special);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       button->path,
-					       RATBAGD_NAME_ROOT ".Button",
-					       "Mapping",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(button->device);
 
 	return 0;
 }
@@ -187,13 +193,8 @@ static int ratbagd_button_set_key(sd_bus *bus,
 
 	r = ratbag_button_set_key(button->lib_button, key);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       button->path,
-					       RATBAGD_NAME_ROOT ".Button",
-					       "Mapping",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(button->device);
 
 	return 0;
 }
@@ -295,13 +296,8 @@ static int ratbagd_button_set_macro(sd_bus *bus,
 			return r;
 	}
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       button->path,
-					       RATBAGD_NAME_ROOT ".Button",
-					       "Mapping",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(button->device);
 
 	return 0;
 }
@@ -342,13 +338,8 @@ static int ratbagd_button_set_none(sd_bus *bus,
 		if (r < 0)
 			return r;
 	}
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       button->path,
-					       RATBAGD_NAME_ROOT ".Button",
-					       "Mapping",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(button->device);
 
 	return 0;
 }
@@ -471,6 +462,54 @@ static int ratbagd_button_get_action_types(sd_bus *bus,
 	return 0;
 }
 
+static void ratbagd_button_get_state(struct ratbagd_button *button,
+				     struct ratbagd_button_state *state)
+{
+	_cleanup_(ratbag_button_macro_unrefp) struct ratbag_button_macro *macro = NULL;
+	struct ratbag_button *lib_button = button->lib_button;
+	unsigned int idx;
+
+	state->type = ratbag_button_get_action_type(lib_button);
+	state->value = 0;
+	state->macro_hash = 0;
+
+	switch (state->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		state->value = ratbag_button_get_button(lib_button);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		state->value = ratbag_button_get_special(lib_button);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		state->value = ratbag_button_get_key(lib_button);
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		/* FNV-1a over the events, we only need to know whether
+		 * the macro changed */
+		macro = ratbag_button_get_macro(lib_button);
+		if (!macro)
+			break;
+
+		state->macro_hash = 2166136261u;
+		for (idx = 0; idx < ratbag_button_macro_get_num_events(macro); idx++) {
+			enum ratbag_macro_event_type type;
+			uint32_t v = 0;
+
+			type = ratbag_button_macro_get_event_type(macro, idx);
+			if (type == RATBAG_MACRO_EVENT_WAIT)
+				v = ratbag_button_macro_get_event_timeout(macro, idx);
+			else
+				v = ratbag_button_macro_get_event_key(macro, idx);
+
+			state->macro_hash = (state->macro_hash ^ type) * 16777619u;
+			state->macro_hash = (state->macro_hash ^ v) * 16777619u;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
 const sd_bus_vtable ratbagd_button_vtable[] = {
 	SD_BUS_VTABLE_START(0),
 	SD_BUS_PROPERTY("Index", "u", NULL, offsetof(struct ratbagd_button, index), SD_BUS_VTABLE_PROPERTY_CONST),
@@ -500,6 +539,7 @@ int ratbagd_button_new(struct ratbagd_button **out,
 	button->device = device;
 	button->lib_button = lib_button;
 	button->index = index;
+	ratbagd_button_get_state(button, &button->published);
 
 	sprintf(profile_buffer, "p%u", ratbagd_profile_get_index(profile));
 	sprintf(button_buffer, "b%u", index);
@@ -533,15 +573,33 @@ struct ratbagd_button *ratbagd_button_free(struct ratbagd_button *button)
 	return mfree(button);
 }
 
-int ratbagd_button_resync(sd_bus *bus,
-			      struct ratbagd_button *button)
+int ratbagd_button_flush(sd_bus *bus,
+			 struct ratbagd_button *button)
 {
-	return sd_bus_emit_properties_changed(bus,
+	struct ratbagd_button_state state;
+	struct ratbagd_button_state *published;
+	bool changed;
+
+	if (!button)
+		return 0;
+
+	published = &button->published;
+	ratbagd_button_get_state(button, &state);
+
+	changed = state.type != published->type ||
+		  state.value != published->value ||
+		  state.macro_hash != published->macro_hash;
+
+	*published = state;
+
+	if (!changed)
+		return 0;
+
+	(void) sd_bus_emit_properties_changed(bus,
 					      button->path,
 					      RATBAGD_NAME_ROOT ".Button",
-					      "ButtonMapping",
-					      "SpecialMapping",
-					      "Macro",
-					      "ActionType",
+					      "Mapping",
 					      NULL);
+
+	return 0;
 }
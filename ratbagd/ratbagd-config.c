@@ -0,0 +1,1311 @@
+/***
+  This file is part of ratbagd.
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice (including the next
+  paragraph) shall be included in all copies or substantial portions of the
+  Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+  THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+  DEALINGS IN THE SOFTWARE.
+***/
+
+/*
+ * Device.ApplyConfiguration() takes the full desired state of a device
+ * in one a{sv}:
+ *
+ *   "Profiles" -> a{ua{sv}}, keyed by profile index:
+ *     "Name" s, "Disabled" b, "IsActive" b, "ReportRate" u,
+ *     "AngleSnapping" i, "Debounce" i,
+ *     "Resolutions" -> a{ua{sv}}:
+ *       "Resolution" v (u or (uu)), "IsDisabled" b, "IsActive" b,
+ *       "IsDefault" b
+ *     "Buttons" -> a{ua{sv}}:
+ *       "Mapping" (uv), as the Button.Mapping property
+ *     "Leds" -> a{ua{sv}}:
+ *       "Mode" u, "Color" (uuu), "EffectDuration" u, "Brightness" u
+ *
+ * Everything is optional, missing keys leave the current value alone.
+ * The whole configuration is validated against the device's capabilities
+ * before anything is changed: if any field is invalid nothing is applied
+ * and the errors are returned as a{si}, mapping the field (e.g.
+ * "Profiles.0.Resolutions.1.Resolution") to a ratbag_error_code.
+ * Otherwise only the fields that differ from the current state are set.
+ * Should libratbag still refuse a field, the caller puts back a
+ * ratbagd_config_snapshot() taken beforehand.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <libratbag.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <systemd/sd-bus.h>
+#include "ratbagd.h"
+#include "shared-macro.h"
+
+#include "libratbag-util.h"
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbag_button_macro *, ratbag_button_macro_unref);
+
+struct config_resolution {
+	bool has_dpi;
+	bool dpi_xy;
+	unsigned int dpi_x, dpi_y;
+	bool has_disabled;
+	bool disabled;
+	bool set_active;
+	bool set_default;
+};
+
+struct config_button {
+	bool has_mapping;
+	enum ratbag_button_action_type type;
+	unsigned int value; /* button, special or key */
+	struct ratbag_button_macro *macro;
+};
+
+struct config_led {
+	bool has_mode;
+	enum ratbag_led_mode mode;
+	bool has_color;
+	struct ratbag_color color;
+	bool has_duration;
+	unsigned int duration;
+	bool has_brightness;
+	unsigned int brightness;
+};
+
+struct config_profile {
+	struct ratbag_profile *lib_profile;
+	bool changed;
+	bool dirty; /* snapshot only, see ratbagd_config_restore() */
+
+	char *name;
+	bool has_disabled;
+	bool disabled;
+	bool set_active;
+	bool has_report_rate;
+	unsigned int report_rate;
+	bool has_angle_snapping;
+	int angle_snapping;
+	bool has_debounce;
+	int debounce;
+
+	unsigned int n_resolutions;
+	struct config_resolution *resolutions;
+	unsigned int n_buttons;
+	struct config_button *buttons;
+	unsigned int n_leds;
+	struct config_led *leds;
+};
+
+struct config_error {
+	struct list link;
+	char *field;
+	enum ratbag_error_code code;
+};
+
+struct ratbagd_config {
+	struct ratbag_device *lib_device;
+	unsigned int n_profiles;
+	struct config_profile *profiles;
+	struct list errors;
+};
+
+/* the object a{ua{sv}} entry is read into */
+struct config_object {
+	struct ratbagd_config *config;
+	struct config_profile *profile;
+	unsigned int index;
+};
+
+typedef int (*config_read_entry_t)(struct config_object *object,
+				   sd_bus_message *m,
+				   const char *field,
+				   const char *key);
+
+static void config_error(struct ratbagd_config *config,
+			 const char *field,
+			 enum ratbag_error_code code)
+{
+	struct config_error *error;
+
+	/* only the first error per field is of interest */
+	list_for_each(error, &config->errors, link) {
+		if (streq(error->field, field))
+			return;
+	}
+
+	error = zalloc(sizeof(*error));
+	error->field = strdup_safe(field);
+	error->code = code;
+	list_append(&config->errors, &error->link);
+}
+
+/**
+ * Enter the variant at the current position if it contains @signature.
+ * Otherwise skip it and record an error for @field.
+ *
+ * @return 1 if the variant was entered, 0 if it was skipped or a negative
+ * errno
+ */
+static int config_enter_variant(struct ratbagd_config *config,
+				sd_bus_message *m,
+				const char *field,
+				const char *signature)
+{
+	const char *contents;
+	char type;
+
+	CHECK_CALL(sd_bus_message_peek_type(m, &type, &contents));
+	if (type != SD_BUS_TYPE_VARIANT || !streq(contents, signature)) {
+		config_error(config, field, RATBAG_ERROR_VALUE);
+		CHECK_CALL(sd_bus_message_skip(m, "v"));
+		return 0;
+	}
+
+	CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, signature));
+
+	return 1;
+}
+
+static int config_read_basic(struct ratbagd_config *config,
+			     sd_bus_message *m,
+			     const char *field,
+			     char type,
+			     void *value)
+{
+	const char signature[] = { type, '\0' };
+	int r;
+
+	r = config_enter_variant(config, m, field, signature);
+	if (r <= 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_read_basic(m, type, value));
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	return 1;
+}
+
+static char *config_field(const char *prefix, const char *key)
+{
+	if (!prefix)
+		return strdup_safe(key);
+
+	return asprintf_safe("%s.%s", prefix, key);
+}
+
+/* Read an a{sv} at the current position, calling @read_entry for each
+ * key. Unknown keys are skipped and recorded as error */
+static int config_read_dict(struct config_object *object,
+			    sd_bus_message *m,
+			    const char *prefix,
+			    config_read_entry_t read_entry)
+{
+	int r;
+
+	CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}"));
+
+	while ((r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+		_cleanup_(freep) char *field = NULL;
+		const char *key;
+
+		CHECK_CALL(sd_bus_message_read(m, "s", &key));
+
+		field = config_field(prefix, key);
+		r = read_entry(object, m, field, key);
+		if (r < 0)
+			return r;
+		if (r == 0) {
+			config_error(object->config, field, RATBAG_ERROR_VALUE);
+			CHECK_CALL(sd_bus_message_skip(m, "v"));
+		}
+
+		CHECK_CALL(sd_bus_message_exit_container(m));
+	}
+	if (r < 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	return 0;
+}
+
+/* Read the a{ua{sv}} variant at the current position, calling
+ * @read_entry for the keys of each of the objects 0..@count-1 */
+static int config_read_objects(struct config_object *parent,
+			       sd_bus_message *m,
+			       const char *field,
+			       unsigned int count,
+			       config_read_entry_t read_entry)
+{
+	int r;
+
+	r = config_enter_variant(parent->config, m, field, "a{ua{sv}}");
+	if (r <= 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{ua{sv}}"));
+
+	while ((r = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "ua{sv}")) > 0) {
+		_cleanup_(freep) char *prefix = NULL;
+		struct config_object object = *parent;
+		unsigned int index;
+
+		CHECK_CALL(sd_bus_message_read(m, "u", &index));
+
+		prefix = asprintf_safe("%s.%u", field, index);
+		if (index >= count) {
+			config_error(parent->config, prefix, RATBAG_ERROR_VALUE);
+			CHECK_CALL(sd_bus_message_skip(m, "a{sv}"));
+		} else {
+			object.index = index;
+			if (!object.profile)
+				object.profile = &parent->config->profiles[index];
+			CHECK_CALL(config_read_dict(&object, m, prefix, read_entry));
+		}
+
+		CHECK_CALL(sd_bus_message_exit_container(m));
+	}
+	if (r < 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_exit_container(m));
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	return 1;
+}
+
+static int config_read_resolution(struct config_object *object,
+				  sd_bus_message *m,
+				  const char *field,
+				  const char *key)
+{
+	struct config_resolution *res = &object->profile->resolutions[object->index];
+	const char *contents;
+	char type;
+	int b, r;
+
+	if (streq(key, "Resolution")) {
+		r = config_enter_variant(object->config, m, field, "v");
+		if (r <= 0)
+			return r < 0 ? r : 1;
+
+		CHECK_CALL(sd_bus_message_peek_type(m, &type, &contents));
+		if (streq(contents, "u")) {
+			CHECK_CALL(sd_bus_message_read(m, "v", "u", &res->dpi_x));
+			res->dpi_y = res->dpi_x;
+			res->has_dpi = true;
+		} else if (streq(contents, "(uu)")) {
+			CHECK_CALL(sd_bus_message_read(m, "v", "(uu)",
+						       &res->dpi_x, &res->dpi_y));
+			res->dpi_xy = true;
+			res->has_dpi = true;
+		} else {
+			config_error(object->config, field, RATBAG_ERROR_VALUE);
+			CHECK_CALL(sd_bus_message_skip(m, "v"));
+		}
+
+		CHECK_CALL(sd_bus_message_exit_container(m));
+	} else if (streq(key, "IsDisabled")) {
+		r = config_read_basic(object->config, m, field, 'b', &b);
+		if (r > 0) {
+			res->has_disabled = true;
+			res->disabled = b;
+		}
+	} else if (streq(key, "IsActive")) {
+		r = config_read_basic(object->config, m, field, 'b', &b);
+		if (r > 0 && !b)
+			config_error(object->config, field, RATBAG_ERROR_VALUE);
+		res->set_active = r > 0 && b;
+	} else if (streq(key, "IsDefault")) {
+		r = config_read_basic(object->config, m, field, 'b', &b);
+		if (r > 0 && !b)
+			config_error(object->config, field, RATBAG_ERROR_VALUE);
+		res->set_default = r > 0 && b;
+	} else {
+		return 0;
+	}
+
+	return r < 0 ? r : 1;
+}
+
+static int config_read_macro(struct ratbagd_config *config,
+			     sd_bus_message *m,
+			     const char *field,
+			     struct config_button *button)
+{
+	unsigned int type, value;
+	unsigned int idx = 0;
+	int r;
+
+	CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "(uu)"));
+
+	button->macro = ratbag_button_macro_new("macro");
+	while ((r = sd_bus_message_read(m, "(uu)", &type, &value)) > 0) {
+		if (ratbag_button_macro_set_event(button->macro, idx++, type, value))
+			config_error(config, field, RATBAG_ERROR_VALUE);
+	}
+	if (r < 0)
+		return r;
+
+	CHECK_CALL(sd_bus_message_exit_container(m));
+
+	return 0;
+}
+
+static int config_read_button(struct config_object *object,
+			      sd_bus_message *m,
+			      const char *field,
+			      const char *key)
+{
+	struct config_button *button = &object->profile->buttons[object->index];
+	const char *contents;
+	char type;
+	int r;
+
+	if (!streq(key, "Mapping"))
+		return 0;
+
+	r = config_enter_variant(object->config, m, field, "(uv)");
+	if (r <= 0)
+		return r < 0 ? r : 1;
+
+	/* like any other key, a repeated Mapping replaces the earlier one */
+	button->macro = ratbag_button_macro_unref(button->macro);
+	button->has_mapping = false;
+
+	CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_STRUCT, "uv"));
+	CHECK_CALL(sd_bus_message_read(m, "u", &button->type));
+	CHECK_CALL(sd_bus_message_peek_type(m, &type, &contents));
+
+	switch (button->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_NONE:
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		if (!streq(contents, "u"))
+			goto invalid;
+		CHECK_CALL(sd_bus_message_read(m, "v", "u", &button->value));
+		break;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		if (!streq(contents, "a(uu)"))
+			goto invalid;
+		CHECK_CALL(sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, "a(uu)"));
+		CHECK_CALL(config_read_macro(object->config, m, field, button));
+		CHECK_CALL(sd_bus_message_exit_container(m));
+		break;
+	default:
+		goto invalid;
+	}
+
+	button->has_mapping = true;
+	goto out;
+
+invalid:
+	config_error(object->config, field, RATBAG_ERROR_VALUE);
+	CHECK_CALL(sd_bus_message_skip(m, "v"));
+out:
+	CHECK_CALL(sd_bus_message_exit_container(m)); /* (uv) */
+	CHECK_CALL(sd_bus_message_exit_container(m)); /* v */
+
+	return 1;
+}
+
+static int config_read_led(struct config_object *object,
+			   sd_bus_message *m,
+			   const char *field,
+			   const char *key)
+{
+	struct config_led *led = &object->profile->leds[object->index];
+	uint32_t value;
+	int r;
+
+	if (streq(key, "Mode")) {
+		r = config_read_basic(object->config, m, field, 'u', &value);
+		if (r > 0) {
+			led->has_mode = true;
+			led->mode = value;
+		}
+	} else if (streq(key, "Color")) {
+		r = config_enter_variant(object->config, m, field, "(uuu)");
+		if (r > 0) {
+			CHECK_CALL(sd_bus_message_read(m, "(uuu)",
+						       &led->color.red,
+						       &led->color.green,
+						       &led->color.blue));
+			CHECK_CALL(sd_bus_message_exit_container(m));
+			led->has_color = true;
+		}
+	} else if (streq(key, "EffectDuration")) {
+		r = config_read_basic(object->config, m, field, 'u', &led->duration);
+		led->has_duration = r > 0;
+	} else if (streq(key, "Brightness")) {
+		r = config_read_basic(object->config, m, field, 'u', &led->brightness);
+		led->has_brightness = r > 0;
+	} else {
+		return 0;
+	}
+
+	return r < 0 ? r : 1;
+}
+
+static int config_read_profile(struct config_object *object,
+			       sd_bus_message *m,
+			       const char *field,
+			       const char *key)
+{
+	struct config_profile *profile = object->profile;
+	const char *name;
+	int b, r;
+
+	if (streq(key, "Name")) {
+		r = config_read_basic(object->config, m, field, 's', &name);
+		if (r > 0) {
+			free(profile->name);
+			profile->name = strdup_safe(name);
+		}
+	} else if (streq(key, "Disabled")) {
+		r = config_read_basic(object->config, m, field, 'b', &b);
+		if (r > 0) {
+			profile->has_disabled = true;
+			profile->disabled = b;
+		}
+	} else if (streq(key, "IsActive")) {
+		r = config_read_basic(object->config, m, field, 'b', &b);
+		if (r > 0 && !b)
+			config_error(object->config, field, RATBAG_ERROR_VALUE);
+		profile->set_active = r > 0 && b;
+	} else if (streq(key, "ReportRate")) {
+		r = config_read_basic(object->config, m, field, 'u', &profile->report_rate);
+		profile->has_report_rate = r > 0;
+	} else if (streq(key, "AngleSnapping")) {
+		r = config_read_basic(object->config, m, field, 'i', &profile->angle_snapping);
+		profile->has_angle_snapping = r > 0;
+	} else if (streq(key, "Debounce")) {
+		r = config_read_basic(object->config, m, field, 'i', &profile->debounce);
+		profile->has_debounce = r > 0;
+	} else if (streq(key, "Resolutions")) {
+		r = config_read_objects(object, m, field, profile->n_resolutions,
+					config_read_resolution);
+	} else if (streq(key, "Buttons")) {
+		r = config_read_objects(object, m, field, profile->n_buttons,
+					config_read_button);
+	} else if (streq(key, "Leds")) {
+		r = config_read_objects(object, m, field, profile->n_leds,
+					config_read_led);
+	} else {
+		return 0;
+	}
+
+	return r < 0 ? r : 1;
+}
+
+static int config_read_device(struct config_object *object,
+			      sd_bus_message *m,
+			      const char *field,
+			      const char *key)
+{
+	int r;
+
+	if (!streq(key, "Profiles"))
+		return 0;
+
+	r = config_read_objects(object, m, field, object->config->n_profiles,
+				config_read_profile);
+
+	return r < 0 ? r : 1;
+}
+
+int ratbagd_config_read(struct ratbagd_config *config, sd_bus_message *m)
+{
+	struct config_object object = {
+		.config = config,
+	};
+
+	return config_read_dict(&object, m, NULL, config_read_device);
+}
+
+static bool config_in_list(unsigned int value,
+			   const unsigned int *list,
+			   size_t nelems)
+{
+	/* an empty list means the driver doesn't tell us */
+	if (nelems == 0)
+		return true;
+
+	for (size_t i = 0; i < nelems; i++) {
+		if (list[i] == value)
+			return true;
+	}
+
+	return false;
+}
+
+static void config_validate_resolutions(struct ratbagd_config *config,
+					struct config_profile *profile,
+					const char *prefix)
+{
+	struct config_resolution *res;
+	struct ratbag_resolution *lib_resolution;
+	unsigned int dpis[300];
+	size_t ndpis;
+	char field[128];
+	bool active_set = false, default_set = false;
+	bool is_active, is_default;
+
+	for (unsigned int i = 0; i < profile->n_resolutions; i++) {
+		res = &profile->resolutions[i];
+		active_set |= res->set_active;
+		default_set |= res->set_default;
+	}
+
+	for (unsigned int i = 0; i < profile->n_resolutions; i++) {
+		res = &profile->resolutions[i];
+		lib_resolution = ratbag_profile_get_resolution(profile->lib_profile, i);
+		if (!lib_resolution)
+			continue;
+
+		if (res->has_dpi) {
+			snprintf(field, sizeof(field), "%s.Resolutions.%u.Resolution", prefix, i);
+			ndpis = ratbag_resolution_get_dpi_list(lib_resolution, dpis, ARRAY_LENGTH(dpis));
+			if (res->dpi_xy &&
+			    !ratbag_resolution_has_capability(lib_resolution,
+							      RATBAG_RESOLUTION_CAP_SEPARATE_XY_RESOLUTION))
+				config_error(config, field, RATBAG_ERROR_CAPABILITY);
+			else if ((res->dpi_x == 0) != (res->dpi_y == 0) ||
+				 !config_in_list(res->dpi_x, dpis, ndpis) ||
+				 !config_in_list(res->dpi_y, dpis, ndpis))
+				config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+
+		/* the state once everything is applied */
+		is_active = res->set_active ||
+			    (!active_set && ratbag_resolution_is_active(lib_resolution));
+		is_default = res->set_default ||
+			     (!default_set && ratbag_resolution_is_default(lib_resolution));
+
+		if (res->has_disabled) {
+			snprintf(field, sizeof(field), "%s.Resolutions.%u.IsDisabled", prefix, i);
+			if (!ratbag_resolution_has_capability(lib_resolution,
+							      RATBAG_RESOLUTION_CAP_DISABLE))
+				config_error(config, field, RATBAG_ERROR_CAPABILITY);
+			else if (res->disabled && (is_active || is_default))
+				config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+
+		ratbag_resolution_unref(lib_resolution);
+	}
+
+	if (active_set) {
+		unsigned int n = 0;
+
+		for (unsigned int i = 0; i < profile->n_resolutions; i++)
+			n += profile->resolutions[i].set_active;
+		if (n > 1) {
+			snprintf(field, sizeof(field), "%s.Resolutions", prefix);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+	}
+	if (default_set) {
+		unsigned int n = 0;
+
+		for (unsigned int i = 0; i < profile->n_resolutions; i++)
+			n += profile->resolutions[i].set_default;
+		if (n > 1) {
+			snprintf(field, sizeof(field), "%s.Resolutions", prefix);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+	}
+}
+
+static void config_validate_buttons(struct ratbagd_config *config,
+				    struct config_profile *profile,
+				    const char *prefix)
+{
+	struct config_button *button;
+	struct ratbag_button *lib_button;
+	char field[128];
+
+	for (unsigned int i = 0; i < profile->n_buttons; i++) {
+		button = &profile->buttons[i];
+		if (!button->has_mapping)
+			continue;
+
+		lib_button = ratbag_profile_get_button(profile->lib_profile, i);
+		if (!lib_button)
+			continue;
+
+		snprintf(field, sizeof(field), "%s.Buttons.%u.Mapping", prefix, i);
+		if (!ratbag_button_has_action_type(lib_button, button->type))
+			config_error(config, field, RATBAG_ERROR_CAPABILITY);
+		else if (button->type == RATBAG_BUTTON_ACTION_TYPE_BUTTON &&
+			 !ratbagd_button_is_valid_button(button->value))
+			config_error(config, field, RATBAG_ERROR_VALUE);
+
+		ratbag_button_unref(lib_button);
+	}
+}
+
+static void config_validate_leds(struct ratbagd_config *config,
+				 struct config_profile *profile,
+				 const char *prefix)
+{
+	struct config_led *led;
+	struct ratbag_led *lib_led;
+	char field[128];
+
+	for (unsigned int i = 0; i < profile->n_leds; i++) {
+		led = &profile->leds[i];
+		lib_led = ratbag_profile_get_led(profile->lib_profile, i);
+		if (!lib_led)
+			continue;
+
+		if (led->has_mode && !ratbag_led_has_mode(lib_led, led->mode)) {
+			snprintf(field, sizeof(field), "%s.Leds.%u.Mode", prefix, i);
+			config_error(config, field, RATBAG_ERROR_CAPABILITY);
+		}
+		if (led->has_color &&
+		    (led->color.red > 255 || led->color.green > 255 || led->color.blue > 255)) {
+			snprintf(field, sizeof(field), "%s.Leds.%u.Color", prefix, i);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+		if (led->has_duration && led->duration > 10000) {
+			snprintf(field, sizeof(field), "%s.Leds.%u.EffectDuration", prefix, i);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+		if (led->has_brightness && led->brightness > 255) {
+			snprintf(field, sizeof(field), "%s.Leds.%u.Brightness", prefix, i);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+
+		ratbag_led_unref(lib_led);
+	}
+}
+
+static void config_validate_profile(struct ratbagd_config *config,
+				    struct config_profile *profile,
+				    unsigned int index,
+				    bool active_set)
+{
+	struct ratbag_profile *lib_profile = profile->lib_profile;
+	unsigned int values[64];
+	size_t nvalues;
+	char prefix[32], field[128];
+	bool is_active, is_enabled;
+
+	snprintf(prefix, sizeof(prefix), "Profiles.%u", index);
+
+	is_active = profile->set_active ||
+		    (!active_set && ratbag_profile_is_active(lib_profile));
+	is_enabled = profile->has_disabled ? !profile->disabled :
+		     ratbag_profile_is_enabled(lib_profile);
+
+	if (profile->name && !ratbag_profile_get_name(lib_profile)) {
+		snprintf(field, sizeof(field), "%s.Name", prefix);
+		config_error(config, field, RATBAG_ERROR_CAPABILITY);
+	}
+
+	if (profile->has_disabled) {
+		snprintf(field, sizeof(field), "%s.Disabled", prefix);
+		if (!ratbag_profile_has_capability(lib_profile, RATBAG_PROFILE_CAP_DISABLE))
+			config_error(config, field, RATBAG_ERROR_CAPABILITY);
+		else if (!is_enabled && is_active)
+			config_error(config, field, RATBAG_ERROR_VALUE);
+	}
+
+	if (profile->set_active && !is_enabled) {
+		snprintf(field, sizeof(field), "%s.IsActive", prefix);
+		config_error(config, field, RATBAG_ERROR_VALUE);
+	}
+
+	if (profile->has_report_rate) {
+		nvalues = ratbag_profile_get_report_rate_list(lib_profile, values,
+							      ARRAY_LENGTH(values));
+		if (!config_in_list(profile->report_rate, values, nvalues)) {
+			snprintf(field, sizeof(field), "%s.ReportRate", prefix);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+	}
+
+	if (profile->has_debounce) {
+		nvalues = ratbag_profile_get_debounce_list(lib_profile, values,
+							   ARRAY_LENGTH(values));
+		if (profile->debounce < 0 ||
+		    !config_in_list(profile->debounce, values, nvalues)) {
+			snprintf(field, sizeof(field), "%s.Debounce", prefix);
+			config_error(config, field, RATBAG_ERROR_VALUE);
+		}
+	}
+
+	config_validate_resolutions(config, profile, prefix);
+	config_validate_buttons(config, profile, prefix);
+	config_validate_leds(config, profile, prefix);
+}
+
+bool ratbagd_config_validate(struct ratbagd_config *config)
+{
+	unsigned int n_active = 0;
+
+	for (unsigned int i = 0; i < config->n_profiles; i++)
+		n_active += config->profiles[i].set_active;
+
+	if (n_active > 1)
+		config_error(config, "Profiles", RATBAG_ERROR_VALUE);
+
+	for (unsigned int i = 0; i < config->n_profiles; i++) {
+		if (!config->profiles[i].lib_profile)
+			continue;
+
+		config_validate_profile(config, &config->profiles[i], i,
+					n_active > 0);
+	}
+
+	return list_empty(&config->errors);
+}
+
+static bool config_macro_equal(const struct ratbag_button_macro *a,
+			       const struct ratbag_button_macro *b)
+{
+	unsigned int n = ratbag_button_macro_get_num_events(a);
+
+	if (!b || n != ratbag_button_macro_get_num_events(b))
+		return false;
+
+	for (unsigned int i = 0; i < n; i++) {
+		enum ratbag_macro_event_type type;
+
+		type = ratbag_button_macro_get_event_type(a, i);
+		if (type != ratbag_button_macro_get_event_type(b, i))
+			return false;
+
+		switch (type) {
+		case RATBAG_MACRO_EVENT_KEY_PRESSED:
+		case RATBAG_MACRO_EVENT_KEY_RELEASED:
+			if (ratbag_button_macro_get_event_key(a, i) !=
+			    ratbag_button_macro_get_event_key(b, i))
+				return false;
+			break;
+		case RATBAG_MACRO_EVENT_WAIT:
+			if (ratbag_button_macro_get_event_timeout(a, i) !=
+			    ratbag_button_macro_get_event_timeout(b, i))
+				return false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return true;
+}
+
+static bool config_button_equal(struct ratbag_button *lib_button,
+				const struct config_button *button)
+{
+	_cleanup_(ratbag_button_macro_unrefp) struct ratbag_button_macro *macro = NULL;
+
+	if (ratbag_button_get_action_type(lib_button) != button->type)
+		return false;
+
+	switch (button->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_NONE:
+		return true;
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		return ratbag_button_get_button(lib_button) == button->value;
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		return ratbag_button_get_special(lib_button) == button->value;
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		return ratbag_button_get_key(lib_button) == button->value;
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		macro = ratbag_button_get_macro(lib_button);
+		return config_macro_equal(button->macro, macro);
+	default:
+		return false;
+	}
+}
+
+static int config_set_button(struct ratbag_button *lib_button,
+			     const struct config_button *button)
+{
+	switch (button->type) {
+	case RATBAG_BUTTON_ACTION_TYPE_NONE:
+		return ratbag_button_disable(lib_button);
+	case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+		return ratbag_button_set_button(lib_button, button->value);
+	case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+		return ratbag_button_set_special(lib_button, button->value);
+	case RATBAG_BUTTON_ACTION_TYPE_KEY:
+		return ratbag_button_set_key(lib_button, button->value);
+	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+		return ratbag_button_set_macro(lib_button, button->macro);
+	default:
+		return RATBAG_ERROR_VALUE;
+	}
+}
+
+/* Records the error of a setter and whether something changed. Expects
+ * @config, @profile and @prefix in the caller's scope */
+#define config_apply(_field, _call) \
+	do { \
+		int _r = (_call); \
+		if (_r) { \
+			char _f[128]; \
+			snprintf(_f, sizeof(_f), "%s.%s", prefix, _field); \
+			config_error(config, _f, _r); \
+		} else { \
+			profile->changed = true; \
+		} \
+	} while (0)
+
+static void config_apply_resolutions(struct ratbagd_config *config,
+				     struct config_profile *profile,
+				     const char *prefix)
+{
+	struct config_resolution *res;
+	struct ratbag_resolution *lib_resolution;
+	char field[64];
+
+	/* Enable first and disable last, so setting the active or
+	 * default resolution never trips over a disabled one */
+	for (unsigned int pass = 0; pass < 2; pass++) {
+		for (unsigned int i = 0; i < profile->n_resolutions; i++) {
+			res = &profile->resolutions[i];
+			lib_resolution = ratbag_profile_get_resolution(profile->lib_profile, i);
+			if (!lib_resolution)
+				continue;
+
+			snprintf(field, sizeof(field), "Resolutions.%u.IsDisabled", i);
+			if (res->has_disabled && res->disabled == (pass == 1) &&
+			    res->disabled != ratbag_resolution_is_disabled(lib_resolution))
+				config_apply(field, ratbag_resolution_set_disabled(lib_resolution,
+										   res->disabled));
+
+			if (pass == 1) {
+				ratbag_resolution_unref(lib_resolution);
+				continue;
+			}
+
+			snprintf(field, sizeof(field), "Resolutions.%u.Resolution", i);
+			if (res->has_dpi &&
+			    (res->dpi_x != (unsigned int)ratbag_resolution_get_dpi_x(lib_resolution) ||
+			     res->dpi_y != (unsigned int)ratbag_resolution_get_dpi_y(lib_resolution))) {
+				if (res->dpi_xy)
+					config_apply(field, ratbag_resolution_set_dpi_xy(lib_resolution,
+											 res->dpi_x,
+											 res->dpi_y));
+				else
+					config_apply(field, ratbag_resolution_set_dpi(lib_resolution,
+										      res->dpi_x));
+			}
+
+			snprintf(field, sizeof(field), "Resolutions.%u.IsActive", i);
+			if (res->set_active && !ratbag_resolution_is_active(lib_resolution))
+				config_apply(field, ratbag_resolution_set_active(lib_resolution));
+
+			snprintf(field, sizeof(field), "Resolutions.%u.IsDefault", i);
+			if (res->set_default && !ratbag_resolution_is_default(lib_resolution))
+				config_apply(field, ratbag_resolution_set_default(lib_resolution));
+
+			ratbag_resolution_unref(lib_resolution);
+		}
+	}
+}
+
+static void config_apply_buttons(struct ratbagd_config *config,
+				 struct config_profile *profile,
+				 const char *prefix)
+{
+	struct config_button *button;
+	struct ratbag_button *lib_button;
+	char field[64];
+
+	for (unsigned int i = 0; i < profile->n_buttons; i++) {
+		button = &profile->buttons[i];
+		if (!button->has_mapping)
+			continue;
+
+		lib_button = ratbag_profile_get_button(profile->lib_profile, i);
+		if (!lib_button)
+			continue;
+
+		snprintf(field, sizeof(field), "Buttons.%u.Mapping", i);
+		if (!config_button_equal(lib_button, button))
+			config_apply(field, config_set_button(lib_button, button));
+
+		ratbag_button_unref(lib_button);
+	}
+}
+
+static void config_apply_leds(struct ratbagd_config *config,
+			      struct config_profile *profile,
+			      const char *prefix)
+{
+	struct config_led *led;
+	struct ratbag_led *lib_led;
+	struct ratbag_color color;
+	char field[64];
+
+	for (unsigned int i = 0; i < profile->n_leds; i++) {
+		led = &profile->leds[i];
+		lib_led = ratbag_profile_get_led(profile->lib_profile, i);
+		if (!lib_led)
+			continue;
+
+		snprintf(field, sizeof(field), "Leds.%u.Mode", i);
+		if (led->has_mode && led->mode != ratbag_led_get_mode(lib_led))
+			config_apply(field, ratbag_led_set_mode(lib_led, led->mode));
+
+		color = ratbag_led_get_color(lib_led);
+		snprintf(field, sizeof(field), "Leds.%u.Color", i);
+		if (led->has_color &&
+		    (led->color.red != color.red ||
+		     led->color.green != color.green ||
+		     led->color.blue != color.blue))
+			config_apply(field, ratbag_led_set_color(lib_led, led->color));
+
+		snprintf(field, sizeof(field), "Leds.%u.EffectDuration", i);
+		if (led->has_duration &&
+		    led->duration != (unsigned int)ratbag_led_get_effect_duration(lib_led))
+			config_apply(field, ratbag_led_set_effect_duration(lib_led, led->duration));
+
+		snprintf(field, sizeof(field), "Leds.%u.Brightness", i);
+		if (led->has_brightness &&
+		    led->brightness != ratbag_led_get_brightness(lib_led))
+			config_apply(field, ratbag_led_set_brightness(lib_led, led->brightness));
+
+		ratbag_led_unref(lib_led);
+	}
+}
+
+static void config_apply_profile(struct ratbagd_config *config,
+				 struct config_profile *profile,
+				 unsigned int index)
+{
+	struct ratbag_profile *lib_profile = profile->lib_profile;
+	const char *name;
+	char prefix[32];
+
+	snprintf(prefix, sizeof(prefix), "Profiles.%u", index);
+
+	name = ratbag_profile_get_name(lib_profile);
+	if (profile->name && !streq_ptr(profile->name, name))
+		config_apply("Name", ratbag_profile_set_name(lib_profile, profile->name));
+
+	if (profile->has_report_rate &&
+	    profile->report_rate != (unsigned int)ratbag_profile_get_report_rate(lib_profile))
+		config_apply("ReportRate", ratbag_profile_set_report_rate(lib_profile,
+									  profile->report_rate));
+
+	if (profile->has_angle_snapping &&
+	    profile->angle_snapping != ratbag_profile_get_angle_snapping(lib_profile))
+		config_apply("AngleSnapping", ratbag_profile_set_angle_snapping(lib_profile,
+										profile->angle_snapping));
+
+	if (profile->has_debounce &&
+	    profile->debounce != ratbag_profile_get_debounce(lib_profile))
+		config_apply("Debounce", ratbag_profile_set_debounce(lib_profile,
+								     profile->debounce));
+
+	config_apply_resolutions(config, profile, prefix);
+	config_apply_buttons(config, profile, prefix);
+	config_apply_leds(config, profile, prefix);
+}
+
+/* The profile-level Disabled and IsActive depend on each other across
+ * profiles: enable first, then switch the active profile, then disable */
+static void config_apply_profile_state(struct ratbagd_config *config,
+				       struct config_profile *profile,
+				       unsigned int index,
+				       unsigned int pass)
+{
+	struct ratbag_profile *lib_profile = profile->lib_profile;
+	char prefix[32];
+
+	snprintf(prefix, sizeof(prefix), "Profiles.%u", index);
+
+	switch (pass) {
+	case 0:
+		if (profile->has_disabled && !profile->disabled &&
+		    !ratbag_profile_is_enabled(lib_profile))
+			config_apply("Disabled", ratbag_profile_set_enabled(lib_profile, true));
+		break;
+	case 1:
+		if (profile->set_active && !ratbag_profile_is_active(lib_profile)) {
+			/* the previously active profile changes too */
+			for (unsigned int i = 0; i < config->n_profiles; i++) {
+				struct config_profile *p = &config->profiles[i];
+
+				if (p->lib_profile && ratbag_profile_is_active(p->lib_profile))
+					p->changed = true;
+			}
+			config_apply("IsActive", ratbag_profile_set_active(lib_profile));
+		}
+		break;
+	case 2:
+		if (profile->has_disabled && profile->disabled &&
+		    ratbag_profile_is_enabled(lib_profile))
+			config_apply("Disabled", ratbag_profile_set_enabled(lib_profile, false));
+		break;
+	}
+}
+
+int ratbagd_config_apply(struct ratbagd_config *config)
+{
+	int nchanged = 0;
+
+	assert(list_empty(&config->errors));
+
+	for (unsigned int pass = 0; pass < 3; pass++) {
+		for (unsigned int i = 0; i < config->n_profiles; i++) {
+			if (!config->profiles[i].lib_profile)
+				continue;
+
+			config_apply_profile_state(config, &config->profiles[i], i, pass);
+			if (pass == 1)
+				config_apply_profile(config, &config->profiles[i], i);
+		}
+	}
+
+	/* validation should have caught this, but libratbag has the
+	 * final word */
+	if (!list_empty(&config->errors))
+		return -EINVAL;
+
+	for (unsigned int i = 0; i < config->n_profiles; i++)
+		nchanged += config->profiles[i].changed;
+
+	return nchanged;
+}
+
+#undef config_apply
+
+int ratbagd_config_append_errors(struct ratbagd_config *config,
+				 sd_bus_message *reply)
+{
+	struct config_error *error;
+
+	CHECK_CALL(sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "{si}"));
+
+	list_for_each(error, &config->errors, link)
+		CHECK_CALL(sd_bus_message_append(reply, "{si}", error->field, error->code));
+
+	CHECK_CALL(sd_bus_message_close_container(reply));
+
+	return 0;
+}
+
+struct ratbagd_config *ratbagd_config_new(struct ratbag_device *lib_device)
+{
+	struct ratbagd_config *config;
+	struct config_profile *profile;
+	unsigned int n_buttons, n_leds;
+
+	config = zalloc(sizeof(*config));
+	config->lib_device = ratbag_device_ref(lib_device);
+	list_init(&config->errors);
+
+	n_buttons = ratbag_device_get_num_buttons(lib_device);
+	n_leds = ratbag_device_get_num_leds(lib_device);
+
+	config->n_profiles = ratbag_device_get_num_profiles(lib_device);
+	config->profiles = zalloc(config->n_profiles * sizeof(*config->profiles));
+
+	for (unsigned int i = 0; i < config->n_profiles; i++) {
+		profile = &config->profiles[i];
+		profile->lib_profile = ratbag_device_get_profile(lib_device, i);
+		if (!profile->lib_profile)
+			continue;
+
+		profile->n_resolutions = ratbag_profile_get_num_resolutions(profile->lib_profile);
+		profile->resolutions = zalloc(profile->n_resolutions * sizeof(*profile->resolutions));
+		profile->n_buttons = n_buttons;
+		profile->buttons = zalloc(n_buttons * sizeof(*profile->buttons));
+		profile->n_leds = n_leds;
+		profile->leds = zalloc(n_leds * sizeof(*profile->leds));
+	}
+
+	return config;
+}
+
+static void config_snapshot_profile(struct config_profile *profile)
+{
+	struct ratbag_profile *lib_profile = profile->lib_profile;
+
+	profile->dirty = ratbag_profile_is_dirty(lib_profile);
+	profile->name = strdup_safe(ratbag_profile_get_name(lib_profile));
+	profile->has_disabled = true;
+	profile->disabled = !ratbag_profile_is_enabled(lib_profile);
+	profile->set_active = ratbag_profile_is_active(lib_profile);
+	profile->has_report_rate = true;
+	profile->report_rate = ratbag_profile_get_report_rate(lib_profile);
+	profile->has_angle_snapping = true;
+	profile->angle_snapping = ratbag_profile_get_angle_snapping(lib_profile);
+	profile->has_debounce = true;
+	profile->debounce = ratbag_profile_get_debounce(lib_profile);
+
+	for (unsigned int i = 0; i < profile->n_resolutions; i++) {
+		struct config_resolution *res = &profile->resolutions[i];
+		struct ratbag_resolution *lib_resolution;
+
+		lib_resolution = ratbag_profile_get_resolution(lib_profile, i);
+		if (!lib_resolution)
+			continue;
+
+		res->has_dpi = true;
+		res->dpi_x = ratbag_resolution_get_dpi_x(lib_resolution);
+		res->dpi_y = ratbag_resolution_get_dpi_y(lib_resolution);
+		res->dpi_xy = res->dpi_x != res->dpi_y;
+		res->has_disabled = true;
+		res->disabled = ratbag_resolution_is_disabled(lib_resolution);
+		res->set_active = ratbag_resolution_is_active(lib_resolution);
+		res->set_default = ratbag_resolution_is_default(lib_resolution);
+
+		ratbag_resolution_unref(lib_resolution);
+	}
+
+	for (unsigned int i = 0; i < profile->n_buttons; i++) {
+		struct config_button *button = &profile->buttons[i];
+		struct ratbag_button *lib_button;
+
+		lib_button = ratbag_profile_get_button(lib_profile, i);
+		if (!lib_button)
+			continue;
+
+		button->has_mapping = true;
+		button->type = ratbag_button_get_action_type(lib_button);
+		switch (button->type) {
+		case RATBAG_BUTTON_ACTION_TYPE_NONE:
+			break;
+		case RATBAG_BUTTON_ACTION_TYPE_BUTTON:
+			button->value = ratbag_button_get_button(lib_button);
+			break;
+		case RATBAG_BUTTON_ACTION_TYPE_SPECIAL:
+			button->value = ratbag_button_get_special(lib_button);
+			break;
+		case RATBAG_BUTTON_ACTION_TYPE_KEY:
+			button->value = ratbag_button_get_key(lib_button);
+			break;
+		case RATBAG_BUTTON_ACTION_TYPE_MACRO:
+			button->macro = ratbag_button_get_macro(lib_button);
+			break;
+		default:
+			/* can't be set, leave it alone */
+			button->has_mapping = false;
+			break;
+		}
+
+		ratbag_button_unref(lib_button);
+	}
+
+	for (unsigned int i = 0; i < profile->n_leds; i++) {
+		struct config_led *led = &profile->leds[i];
+		struct ratbag_led *lib_led;
+
+		lib_led = ratbag_profile_get_led(lib_profile, i);
+		if (!lib_led)
+			continue;
+
+		led->has_mode = true;
+		led->mode = ratbag_led_get_mode(lib_led);
+		led->has_color = true;
+		led->color = ratbag_led_get_color(lib_led);
+		led->has_duration = true;
+		led->duration = ratbag_led_get_effect_duration(lib_led);
+		led->has_brightness = true;
+		led->brightness = ratbag_led_get_brightness(lib_led);
+
+		ratbag_led_unref(lib_led);
+	}
+}
+
+/**
+ * A configuration holding every setting of the device as it is now.
+ * ratbagd_config_restore() undoes a ratbagd_config_apply() that failed
+ * halfway.
+ */
+struct ratbagd_config *ratbagd_config_snapshot(struct ratbag_device *lib_device)
+{
+	struct ratbagd_config *config;
+
+	config = ratbagd_config_new(lib_device);
+
+	for (unsigned int i = 0; i < config->n_profiles; i++) {
+		if (config->profiles[i].lib_profile)
+			config_snapshot_profile(&config->profiles[i]);
+	}
+
+	return config;
+}
+
+/**
+ * Apply a snapshot taken with ratbagd_config_snapshot(). The setters mark
+ * every profile they touch dirty, those that weren't dirty when the
+ * snapshot was taken are marked clean again, they're back to what the
+ * device has.
+ */
+int ratbagd_config_restore(struct ratbagd_config *snapshot)
+{
+	int r;
+
+	r = ratbagd_config_apply(snapshot);
+	if (r < 0)
+		return r;
+
+	for (unsigned int i = 0; i < snapshot->n_profiles; i++) {
+		struct config_profile *profile = &snapshot->profiles[i];
+
+		if (profile->lib_profile && !profile->dirty)
+			ratbag_profile_mark_clean(profile->lib_profile);
+	}
+
+	return r;
+}
+
+struct ratbagd_config *ratbagd_config_free(struct ratbagd_config *config)
+{
+	struct config_error *error, *tmp;
+
+	if (!config)
+		return NULL;
+
+	for (unsigned int i = 0; i < config->n_profiles; i++) {
+		struct config_profile *profile = &config->profiles[i];
+
+		for (unsigned int b = 0; b < profile->n_buttons; b++)
+			ratbag_button_macro_unref(profile->buttons[b].macro);
+
+		mfree(profile->resolutions);
+		mfree(profile->buttons);
+		mfree(profile->leds);
+		mfree(profile->name);
+		ratbag_profile_unref(profile->lib_profile);
+	}
+
+	list_for_each_safe(error, tmp, &config->errors, link) {
+		list_remove(&error->link);
+		mfree(error->field);
+		mfree(error);
+	}
+
+	mfree(config->profiles);
+	ratbag_device_unref(config->lib_device);
+
+	return mfree(config);
+}
@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <libratbag.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +54,34 @@ struct ratbagd_device {
 	sd_bus_slot *profile_enum_slot;
 	unsigned int n_profiles;
 	struct ratbagd_profile **profiles;
+
+	/* NULL if the device has no battery */
+	struct ratbagd_battery *battery;
+
+	/* probe running on a worker thread, see ratbagd_device_start_probe() */
+	struct ratbagd_job *probe_job;
+	enum ratbag_error_code probe_result;
+
+	/* commit running on a worker thread, see ratbagd_job_start() */
+	struct ratbagd_job *commit_job;
+	bool commit_requested;
+	int commit_result;
+
+	/* Every Commit() bumps the generation, the committed generation is
+	 * the latest one that made it to the device. Commits are rate
+	 * limited to one per ctx->commit_interval, see
+	 * ratbagd_device_request_commit() */
+	uint32_t generation;
+	uint32_t commit_generation;
+	uint32_t committed_generation;
+	uint64_t last_commit;
+	sd_event_source *commit_timer;
+
+	/* a ratbagd_device_flush_task() is scheduled */
+	bool flush_pending;
+
+	/* Preview() waiting for the device, see ratbagd_device_preview() */
+	sd_bus_message *preview_message;
 };
 
 #define ratbagd_device_from_node(_ptr) \
@@ -188,39 +217,248 @@ static int ratbagd_device_get_profiles(sd_bus *bus,
 	return 0;
 }
 
-static void ratbagd_device_commit_pending(void *data)
+static void ratbagd_device_commit_work(void *data)
 {
 	struct ratbagd_device *device = data;
-	int r;
 
-	r = ratbag_device_commit(device->lib_device);
+	/* worker thread, only the lib_device may be touched here */
+	device->commit_result = ratbag_device_commit(device->lib_device);
+}
+
+static void ratbagd_device_arm_commit(struct ratbagd_device *device);
+
+static void ratbagd_device_commit_done(void *data)
+{
+	struct ratbagd_device *device = data;
+	int r = device->commit_result;
+
+	device->commit_job = NULL;
+
 	if (r)
 		log_error("error committing device (%d)\n", r);
-	if (r < 0)
+
+	/* the device was removed while we were committing, we only held
+	 * on to it until the worker thread let go */
+	if (!ratbagd_device_linked(device))
+		goto out;
+
+	if (r < 0) {
 		ratbagd_device_resync(device, device->ctx->bus);
+	} else {
+		device->committed_generation = device->commit_generation;
+		(void) sd_bus_emit_properties_changed(device->ctx->bus,
+						      device->path,
+						      RATBAGD_NAME_ROOT ".Device",
+						      "CommittedGeneration",
+						      NULL);
+		ratbagd_device_schedule_flush(device);
+	}
 
-	ratbagd_for_each_profile_signal(device->ctx->bus,
-					device,
-					ratbagd_profile_notify_dirty);
+	/* Commit was called again while we were busy, the device may
+	 * have changed since, so we need another round */
+	if (device->commit_requested)
+		ratbagd_device_arm_commit(device);
 
+out:
+	/* whatever the bus filter held back can go ahead now */
+	ratbagd_release_deferred(device->ctx);
 	ratbagd_device_unref(device);
 }
 
+static void ratbagd_device_start_commit(struct ratbagd_device *device)
+{
+	int r;
+
+	assert(!device->commit_job);
+
+	/* whatever was requested until now is part of this commit */
+	device->commit_requested = false;
+	device->commit_generation = device->generation;
+	sd_event_now(device->ctx->event, CLOCK_MONOTONIC, &device->last_commit);
+
+	r = ratbagd_job_start(device->ctx,
+			      &device->commit_job,
+			      ratbagd_device_commit_work,
+			      ratbagd_device_commit_done,
+			      ratbagd_device_ref(device));
+	if (r < 0) {
+		errno = -r;
+		log_error("%s: failed to start commit thread, committing synchronously: %m\n",
+			  device->sysname);
+		device->commit_job = NULL;
+		ratbagd_device_commit_work(device);
+		ratbagd_device_commit_done(device);
+	}
+}
+
+static int ratbagd_device_commit_timer_cb(sd_event_source *source,
+					  uint64_t usec,
+					  void *userdata)
+{
+	struct ratbagd_device *device = userdata;
+
+	device->commit_timer = sd_event_source_unref(device->commit_timer);
+
+	if (device->commit_requested && ratbagd_device_linked(device))
+		ratbagd_device_start_commit(device);
+
+	ratbagd_device_unref(device);
+
+	return 0;
+}
+
+/* Starts the requested commit once the current one is done and the
+ * commit interval has passed since it started */
+static void ratbagd_device_arm_commit(struct ratbagd_device *device)
+{
+	uint64_t usec, now;
+	int r;
+
+	if (device->commit_job || device->commit_timer)
+		return;
+
+	/* Even without a rate limit, go through the event loop so all
+	 * changes made in the current iteration end up in one commit */
+	sd_event_now(device->ctx->event, CLOCK_MONOTONIC, &now);
+	usec = max(now, device->last_commit + device->ctx->commit_interval);
+
+	r = sd_event_add_time(device->ctx->event,
+			      &device->commit_timer,
+			      CLOCK_MONOTONIC,
+			      usec,
+			      1000, /* 1ms */
+			      ratbagd_device_commit_timer_cb,
+			      ratbagd_device_ref(device));
+	if (r < 0) {
+		errno = -r;
+		log_error("%s: failed to schedule commit, committing now: %m\n",
+			  device->sysname);
+		device->commit_timer = NULL;
+		ratbagd_device_unref(device);
+		ratbagd_device_start_commit(device);
+	}
+}
+
+/**
+ * Queue a commit of the device's current state and return the generation
+ * it will be committed as. Requests made while a commit is pending or
+ * running are folded into a single follow-up commit, intermediate states
+ * are never written.
+ */
+uint32_t ratbagd_device_request_commit(struct ratbagd_device *device)
+{
+	assert(device);
+
+	device->generation++;
+	device->commit_requested = true;
+	ratbagd_device_arm_commit(device);
+
+	return device->generation;
+}
+
 static int ratbagd_device_commit(sd_bus_message *m,
 				 void *userdata,
 				 sd_bus_error *error)
 {
 	struct ratbagd_device *device = userdata;
+	uint32_t generation;
 
-	ratbagd_schedule_task(device->ctx,
-			      ratbagd_device_commit_pending,
-			      ratbagd_device_ref(device));
+	generation = ratbagd_device_request_commit(device);
 
-	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
+	CHECK_CALL(sd_bus_reply_method_return(m, "u", generation));
 
 	return 0;
 }
 
+static int ratbagd_device_preview(sd_bus_message *m,
+				  void *userdata,
+				  sd_bus_error *error)
+{
+	struct ratbagd_device *device = userdata;
+	enum ratbag_error_code r;
+
+	/* The requests are sent and answered from within ratbag_dispatch(),
+	 * the reply goes out from ratbagd_device_preview_done(). Until
+	 * then the bus filter holds back further calls to the device */
+	device->preview_message = sd_bus_message_ref(m);
+	ratbagd_device_ref(device);
+
+	r = ratbag_device_start_preview(device->lib_device);
+	if (r != RATBAG_SUCCESS)
+		ratbagd_device_preview_done(device, r);
+
+	return 0;
+}
+
+void ratbagd_device_preview_done(struct ratbagd_device *device,
+				 enum ratbag_error_code r)
+{
+	_cleanup_(sd_bus_message_unrefp) sd_bus_message *m = device->preview_message;
+	int ret;
+
+	assert(m);
+	device->preview_message = NULL;
+
+	if (r != RATBAG_SUCCESS && r != RATBAG_ERROR_CAPABILITY)
+		log_error("%s: failed to preview changes (%d)\n",
+			  device->sysname, r);
+
+	ret = sd_bus_reply_method_return(m, "i", r);
+	if (ret < 0) {
+		errno = -ret;
+		log_error("%s: failed to reply to Preview: %m\n",
+			  device->sysname);
+	}
+
+	ratbagd_release_deferred(device->ctx);
+	ratbagd_device_unref(device);
+}
+
+bool ratbagd_device_previewing(struct ratbagd_device *device)
+{
+	return device->preview_message != NULL;
+}
+
+static int ratbagd_device_apply_configuration(sd_bus_message *m,
+					      void *userdata,
+					      sd_bus_error *error)
+{
+	struct ratbagd_device *device = userdata;
+	sd_bus *bus = sd_bus_message_get_bus(m);
+	_cleanup_(ratbagd_config_freep) struct ratbagd_config *config = NULL;
+	_cleanup_(ratbagd_config_freep) struct ratbagd_config *snapshot = NULL;
+	_cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+	int r;
+
+	config = ratbagd_config_new(device->lib_device);
+	CHECK_CALL(ratbagd_config_read(config, m));
+
+	/* nothing is applied unless the whole configuration is valid */
+	if (ratbagd_config_validate(config)) {
+		snapshot = ratbagd_config_snapshot(device->lib_device);
+
+		r = ratbagd_config_apply(config);
+		if (r < 0) {
+			/* libratbag refused halfway, put the old configuration
+			 * back. If even that fails the device is neither, let
+			 * the clients refetch it */
+			if (ratbagd_config_restore(snapshot) < 0) {
+				log_error("%s: failed to restore the configuration\n",
+					  device->sysname);
+				ratbagd_device_resync(device, bus);
+			}
+		} else if (r > 0) {
+			ratbagd_device_schedule_flush(device);
+			ratbagd_device_request_commit(device);
+		}
+	}
+
+	CHECK_CALL(sd_bus_message_new_method_return(m, &reply));
+	CHECK_CALL(ratbagd_config_append_errors(config, reply));
+
+	return sd_bus_send(NULL, reply, NULL);
+}
+
 static int
 ratbagd_device_get_model(sd_bus *bus,
 			 const char *path,
@@ -268,52 +506,143 @@ const sd_bus_vtable ratbagd_device_vtable[] = {
 	SD_BUS_PROPERTY("Model", "s", ratbagd_device_get_model, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_PROPERTY("DeviceType", "u", ratbagd_device_get_device_type, 0, SD_BUS_VTABLE_PROPERTY_CONST),
 	SD_BUS_PROPERTY("Name", "s", ratbagd_device_get_device_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
-	SD_BUS_PROPERTY("FirmwareVersion", "s", ratbagd_device_get_firmware_version, 0, SD_BUS_VTABLE_PROPERTY_CONST),
-	SD_BUS_PROPERTY("Profiles", "ao", ratbagd_device_get_profiles, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+	SD_BUS_PROPERTY("FirmwareVersion", "s", ratbagd_device_get_firmware_version, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("Profiles", "ao", ratbagd_device_get_profiles, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+	SD_BUS_PROPERTY("CommittedGeneration", "u", NULL, offsetof(struct ratbagd_device, committed_generation), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 	SD_BUS_METHOD("Commit", "", "u", ratbagd_device_commit, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("Preview", "", "i", ratbagd_device_preview, SD_BUS_VTABLE_UNPRIVILEGED),
+	SD_BUS_METHOD("ApplyConfiguration", "a{sv}", "a{si}", ratbagd_device_apply_configuration, SD_BUS_VTABLE_UNPRIVILEGED),
 	SD_BUS_SIGNAL("Resync", "", 0),
 	SD_BUS_VTABLE_END,
 };
 
-int ratbagd_device_new(struct ratbagd_device **out,
-		       struct ratbagd *ctx,
-		       const char *sysname,
-		       struct ratbag_device *lib_device)
+static const struct {
+	const char *property;
+	enum ratbag_stat stat;
+} ratbagd_device_stats[] = {
+	{ "Requests", RATBAG_STAT_REQUESTS },
+	{ "Writes", RATBAG_STAT_WRITES },
+	{ "Reads", RATBAG_STAT_READS },
+	{ "BytesWritten", RATBAG_STAT_BYTES_WRITTEN },
+	{ "BytesRead", RATBAG_STAT_BYTES_READ },
+	{ "Retries", RATBAG_STAT_RETRIES },
+	{ "Timeouts", RATBAG_STAT_TIMEOUTS },
+	{ "IoErrors", RATBAG_STAT_IO_ERRORS },
+	{ "ProtocolErrors", RATBAG_STAT_PROTOCOL_ERRORS },
+};
+
+static int ratbagd_device_get_stat(sd_bus *bus,
+				   const char *path,
+				   const char *interface,
+				   const char *property,
+				   sd_bus_message *reply,
+				   void *userdata,
+				   sd_bus_error *error)
 {
-	_cleanup_(ratbagd_device_unrefp) struct ratbagd_device *device = NULL;
-	struct ratbag_profile *profile;
+	struct ratbagd_device *device = userdata;
 	unsigned int i;
-	int r;
 
-	assert(out);
-	assert(ctx);
-	assert(sysname);
+	for (i = 0; i < ARRAY_LENGTH(ratbagd_device_stats); i++) {
+		if (streq(property, ratbagd_device_stats[i].property))
+			break;
+	}
+	assert(i < ARRAY_LENGTH(ratbagd_device_stats));
 
-	device = zalloc(sizeof(*device));
-	device->refcount = 1;
-	device->ctx = ctx;
-	rbnode_init(&device->node);
-	device->lib_device = ratbag_device_ref(lib_device);
+	/* the counters are atomic, no need to wait for a running commit */
+	return sd_bus_message_append(reply, "t",
+				     ratbag_device_get_stat(device->lib_device,
+							    ratbagd_device_stats[i].stat));
+}
 
-	device->sysname = strdup_safe(sysname);
+static int ratbagd_device_get_error_codes(sd_bus *bus,
+					  const char *path,
+					  const char *interface,
+					  const char *property,
+					  sd_bus_message *reply,
+					  void *userdata,
+					  sd_bus_error *error)
+{
+	struct ratbagd_device *device = userdata;
+	uint64_t count;
+	unsigned int code;
+	int r;
 
-	r = sd_bus_path_encode(RATBAGD_OBJ_ROOT "/device",
-			       device->sysname,
-			       &device->path);
+	r = sd_bus_message_open_container(reply, 'a', "{yt}");
 	if (r < 0)
 		return r;
 
+	/* only the codes the device actually sent, libratbag counts
+	 * everything from 31 up as 31 */
+	for (code = 0; code <= 31; code++) {
+		count = ratbag_device_get_protocol_error_count(device->lib_device,
+							       code);
+		if (count == 0)
+			continue;
+
+		r = sd_bus_message_append(reply, "{yt}", code, count);
+		if (r < 0)
+			return r;
+	}
+
+	return sd_bus_message_close_container(reply);
+}
+
+static int ratbagd_device_get_latency_histogram(sd_bus *bus,
+						const char *path,
+						const char *interface,
+						const char *property,
+						sd_bus_message *reply,
+						void *userdata,
+						sd_bus_error *error)
+{
+	struct ratbagd_device *device = userdata;
+	uint64_t buckets[32];
+	unsigned int n;
+
+	n = ratbag_device_get_latency_histogram(device->lib_device,
+						buckets,
+						ARRAY_LENGTH(buckets));
+
+	return sd_bus_message_append_array(reply, 't', buckets,
+					   n * sizeof(*buckets));
+}
+
+/* The counters change with every request, so no PropertiesChanged for
+ * them, clients poll */
+const sd_bus_vtable ratbagd_device_stats_vtable[] = {
+	SD_BUS_VTABLE_START(0),
+	SD_BUS_PROPERTY("Requests", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Writes", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Reads", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("BytesWritten", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("BytesRead", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Retries", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("Timeouts", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("IoErrors", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("ProtocolErrors", "t", ratbagd_device_get_stat, 0, 0),
+	SD_BUS_PROPERTY("ErrorCodes", "a{yt}", ratbagd_device_get_error_codes, 0, 0),
+	SD_BUS_PROPERTY("LatencyHistogram", "at", ratbagd_device_get_latency_histogram, 0, 0),
+	SD_BUS_VTABLE_END,
+};
+
+/* Create the profiles and the battery, once the lib_device is probed */
+static void ratbagd_device_populate(struct ratbagd_device *device)
+{
+	struct ratbag_device *lib_device = device->lib_device;
+	struct ratbag_profile *profile;
+	unsigned int i;
+	int r;
 
-	device->n_profiles = ratbag_device_get_num_profiles(device->lib_device);
+	device->n_profiles = ratbag_device_get_num_profiles(lib_device);
 	device->profiles = zalloc(device->n_profiles * sizeof(*device->profiles));
 
 	log_info("%s: \"%s\", %d profiles\n",
-		 sysname,
+		 device->sysname,
 		 ratbag_device_get_name(lib_device),
 		 device->n_profiles);
 
 	for (i = 0; i < device->n_profiles; ++i) {
-		profile = ratbag_device_get_profile(device->lib_device, i);
+		profile = ratbag_device_get_profile(lib_device, i);
 		if (!profile)
 			continue;
 
@@ -328,6 +657,50 @@ int ratbagd_device_new(struct ratbagd_device **out,
 		}
 	}
 
+	if (ratbag_device_has_battery(lib_device)) {
+		r = ratbagd_battery_new(&device->battery, device->ctx, device, lib_device);
+		if (r < 0) {
+			errno = -r;
+			log_error("%s: failed to allocate battery: %m\n",
+				  device->sysname);
+		}
+	}
+}
+
+int ratbagd_device_new(struct ratbagd_device **out,
+		       struct ratbagd *ctx,
+		       const char *sysname,
+		       struct ratbag_device *lib_device)
+{
+	_cleanup_(ratbagd_device_unrefp) struct ratbagd_device *device = NULL;
+	int r;
+
+	assert(out);
+	assert(ctx);
+	assert(sysname);
+
+	device = zalloc(sizeof(*device));
+	device->refcount = 1;
+	device->ctx = ctx;
+	rbnode_init(&device->node);
+	device->lib_device = ratbag_device_ref(lib_device);
+	ratbag_device_set_user_data(lib_device, device);
+
+	device->sysname = strdup_safe(sysname);
+
+	r = sd_bus_path_encode(RATBAGD_OBJ_ROOT "/device",
+			       device->sysname,
+			       &device->path);
+	if (r < 0)
+		return r;
+
+	if (ratbag_device_is_probed(lib_device))
+		ratbagd_device_populate(device);
+	else
+		log_verbose("%s: \"%s\", not probed yet\n",
+			    sysname,
+			    ratbag_device_get_name(lib_device));
+
 	*out = device;
 	device = NULL;
 	return 0;
@@ -346,6 +719,8 @@ static void ratbagd_device_free(struct ratbagd_device *device)
 		device->profiles[i] = ratbagd_profile_free(device->profiles[i]);
 
 	device->profiles = mfree(device->profiles);
+	device->battery = ratbagd_battery_free(device->battery);
+	ratbag_device_set_user_data(device->lib_device, NULL);
 	device->lib_device = ratbag_device_unref(device->lib_device);
 	device->path = mfree(device->path);
 	device->sysname = mfree(device->sysname);
@@ -398,13 +773,59 @@ unsigned int ratbagd_device_get_num_leds(struct ratbagd_device *device)
 	return ratbag_device_get_num_leds(device->lib_device);
 }
 
+struct ratbagd_battery *ratbagd_device_get_battery(struct ratbagd_device *device)
+{
+	assert(device);
+	return device->battery;
+}
+
+static void ratbagd_device_flush(struct ratbagd_device *device, sd_bus *bus)
+{
+	ratbagd_for_each_profile_signal(bus, device, ratbagd_profile_flush);
+	ratbagd_battery_flush(bus, device->battery);
+}
+
+static void ratbagd_device_flush_task(void *data)
+{
+	struct ratbagd_device *device = data;
+
+	device->flush_pending = false;
+
+	/* a commit is running on the worker thread, we can't read the
+	 * lib_device now. ratbagd_device_commit_done() schedules another
+	 * flush once it's finished */
+	if (ratbagd_device_linked(device) && !ratbagd_device_busy(device))
+		ratbagd_device_flush(device, device->ctx->bus);
+
+	ratbagd_device_unref(device);
+}
+
+/**
+ * Send PropertiesChanged for everything that changed on the device's
+ * profiles, resolutions, buttons, leds and battery since the last flush. The flush
+ * runs once the current event loop iteration is done, so a batch of
+ * changes results in one signal per object that carries only the
+ * properties that actually changed.
+ */
+void ratbagd_device_schedule_flush(struct ratbagd_device *device)
+{
+	assert(device);
+
+	if (device->flush_pending)
+		return;
+
+	device->flush_pending = true;
+	ratbagd_schedule_task(device->ctx,
+			      ratbagd_device_flush_task,
+			      ratbagd_device_ref(device));
+}
+
 int ratbagd_device_resync(struct ratbagd_device *device, sd_bus *bus)
 {
 	assert(device);
 	assert(bus);
 
-	ratbagd_for_each_profile_signal(bus, device,
-					ratbagd_profile_resync);
+	ratbagd_device_flush(device, bus);
 
 	return sd_bus_emit_signal(bus,
 				  device->path,
@@ -413,11 +834,80 @@ int ratbagd_device_resync(struct ratbagd_device *device, sd_bus *bus)
 				  NULL);
 }
 
+bool ratbagd_device_busy(struct ratbagd_device *device)
+{
+	return device->commit_job != NULL || device->probe_job != NULL;
+}
+
+/**
+ * Wait for any job running on the device's worker thread, including a
+ * commit queued while it was running. Afterwards the lib_device may be
+ * accessed from the main loop again. This blocks the main loop, it's only
+ * for shutdown.
+ *
+ * A battery poll doesn't make the device busy, it only touches the
+ * battery state. It's waited for here all the same.
+ */
+void ratbagd_device_wait_idle(struct ratbagd_device *device)
+{
+	/* a preview is done from within ratbag_dispatch(), at the latest
+	 * when its request times out */
+	while (device->preview_message) {
+		struct pollfd fd = {
+			.fd = ratbag_get_fd(device->ctx->lib_ctx),
+			.events = POLLIN,
+		};
+
+		(void) poll(&fd, 1, -1);
+		(void) ratbag_dispatch(device->ctx->lib_ctx);
+	}
+
+	if (device->probe_job)
+		ratbagd_job_wait(device->probe_job);
+
+	while (device->commit_job)
+		ratbagd_job_wait(device->commit_job);
+
+	ratbagd_battery_wait_idle(device->battery);
+}
+
 bool ratbagd_device_linked(struct ratbagd_device *device)
 {
 	return device && rbnode_linked(&device->node);
 }
 
+static void ratbagd_device_register_profiles(struct ratbagd_device *device)
+{
+	unsigned int i;
+	int r;
+
+	for (i = 0; i < device->n_profiles; i++) {
+		r = ratbagd_profile_register_resolutions(device->ctx->bus,
+							 device,
+							 device->profiles[i]);
+		if (r < 0) {
+			log_error("%s: failed to register resolutions: %m\n",
+				  device->sysname);
+		}
+
+		r = ratbagd_profile_register_buttons(device->ctx->bus,
+						     device,
+						     device->profiles[i]);
+		if (r < 0) {
+			log_error("%s: failed to register buttons: %m\n",
+				  device->sysname);
+		}
+
+		r = ratbagd_profile_register_leds(device->ctx->bus,
+						  device,
+						  device->profiles[i]);
+		if (r < 0) {
+			log_error("%s: failed to register leds: %m\n",
+				  device->sysname);
+		}
+	}
+}
+
 void ratbagd_device_link(struct ratbagd_device *device)
 {
 	_cleanup_(freep) char *prefix = NULL;
@@ -476,38 +966,124 @@ void ratbagd_device_link(struct ratbagd_device *device)
 		return;
 	}
 
-	for (i = 0; i < device->n_profiles; i++) {
-		r = ratbagd_profile_register_resolutions(device->ctx->bus,
-							 device,
-							 device->profiles[i]);
-		if (r < 0) {
-			log_error("%s: failed to register resolutions: %m\n",
-				  device->sysname);
-		}
+	ratbagd_device_register_profiles(device);
 
-		r = ratbagd_profile_register_buttons(device->ctx->bus,
-						     device,
-						     device->profiles[i]);
-		if (r < 0) {
-			log_error("%s: failed to register buttons: %m\n",
-				  device->sysname);
-		}
+	(void) sd_bus_emit_object_added(device->ctx->bus, device->path);
+	for (i = 0; i < device->n_profiles; i++)
+		ratbagd_profile_emit_objects_added(device->ctx->bus,
+						   device->profiles[i]);
 
-		r = ratbagd_profile_register_leds(device->ctx->bus,
-						  device,
-						  device->profiles[i]);
-		if (r < 0) {
-			log_error("%s: failed to register leds: %m\n",
-				  device->sysname);
-		}
+	ratbagd_battery_start(device->battery);
+}
+
+bool ratbagd_device_probed(struct ratbagd_device *device)
+{
+	return ratbag_device_is_probed(device->lib_device);
+}
+
+bool ratbagd_device_probing(struct ratbagd_device *device)
+{
+	return device->probe_job != NULL;
+}
+
+static void ratbagd_device_probe_work(void *data)
+{
+	struct ratbagd_device *device = data;
+
+	/* worker thread, only the lib_device may be touched here */
+	device->probe_result = ratbag_device_probe(device->lib_device);
+}
+
+static void ratbagd_device_probe_done(void *data)
+{
+	struct ratbagd_device *device = data;
+	sd_bus *bus = device->ctx->bus;
+	bool success = device->probe_result == RATBAG_SUCCESS;
+	unsigned int i;
+
+	device->probe_job = NULL;
+
+	if (!success)
+		log_verbose("%s: probe failed (%d)\n", device->sysname,
+			    device->probe_result);
+
+	/* removed while we were probing, nobody is interested anymore */
+	if (!success || !ratbagd_device_linked(device))
+		goto out;
+
+	ratbagd_device_populate(device);
+	ratbagd_device_register_profiles(device);
+
+	for (i = 0; i < device->n_profiles; i++)
+		ratbagd_profile_emit_objects_added(bus, device->profiles[i]);
+	if (device->battery)
+		(void) sd_bus_emit_interfaces_added(bus,
+						    device->path,
+						    RATBAGD_NAME_ROOT ".Battery",
+						    NULL);
+	(void) sd_bus_emit_properties_changed(bus,
+					      device->path,
+					      RATBAGD_NAME_ROOT ".Device",
+					      "Profiles",
+					      "FirmwareVersion",
+					      NULL);
+
+	ratbagd_battery_start(device->battery);
+
+out:
+	ratbagd_probe_finished(device->ctx, device, success);
+	ratbagd_device_unref(device);
+}
+
+/**
+ * Probe a device that was linked before it was probed, see
+ * ratbagd_process_device(). The probe runs on a worker thread, the device
+ * is busy until it's done.
+ *
+ * The profiles then appear on the bus like those of a device that was
+ * just added, and ratbagd_probe_finished() is called. If the probe
+ * failed, the device is not supported after all, and it's up to that
+ * function to remove it.
+ */
+void ratbagd_device_start_probe(struct ratbagd_device *device)
+{
+	int r;
+
+	if (ratbagd_device_probed(device) || device->probe_job)
+		return;
+
+	log_verbose("%s: probing\n", device->sysname);
+
+	r = ratbagd_job_start(device->ctx,
+			      &device->probe_job,
+			      ratbagd_device_probe_work,
+			      ratbagd_device_probe_done,
+			      ratbagd_device_ref(device));
+	if (r < 0) {
+		errno = -r;
+		log_error("%s: failed to start probe thread, probing synchronously: %m\n",
+			  device->sysname);
+		device->probe_job = NULL;
+		ratbagd_device_probe_work(device);
+		ratbagd_device_probe_done(device);
 	}
 }
 
 void ratbagd_device_unlink(struct ratbagd_device *device)
 {
+	unsigned int i;
+
 	if (!ratbagd_device_linked(device))
 		return;
 
+	ratbagd_battery_stop(device->battery);
+
+	/* announce the removal while the objects can still be looked up */
+	for (i = 0; i < device->n_profiles; i++)
+		ratbagd_profile_emit_objects_removed(device->ctx->bus,
+						     device->profiles[i]);
+	(void) sd_bus_emit_object_removed(device->ctx->bus, device->path);
+
 	device->profile_enum_slot = sd_bus_slot_unref(device->profile_enum_slot);
 	device->profile_vtable_slot = sd_bus_slot_unref(device->profile_vtable_slot);
 
@@ -542,6 +1118,34 @@ struct ratbagd_device *ratbagd_device_lookup(struct ratbagd *ctx,
 	return NULL;
 }
 
+struct ratbagd_device *ratbagd_device_lookup_by_path(struct ratbagd *ctx,
+						     const char *path)
+{
+	_cleanup_(freep) char *sysname = NULL;
+	int r;
+
+	if (!path)
+		return NULL;
+
+	r = sd_bus_path_decode_many(path, RATBAGD_OBJ_ROOT "/device/%", &sysname);
+	if (r == 0)
+		r = sd_bus_path_decode_many(path, RATBAGD_OBJ_ROOT "/profile/%/%",
+					    &sysname, NULL);
+	if (r == 0)
+		r = sd_bus_path_decode_many(path, RATBAGD_OBJ_ROOT "/resolution/%/%/%",
+					    &sysname, NULL, NULL);
+	if (r == 0)
+		r = sd_bus_path_decode_many(path, RATBAGD_OBJ_ROOT "/button/%/%/%",
+					    &sysname, NULL, NULL);
+	if (r == 0)
+		r = sd_bus_path_decode_many(path, RATBAGD_OBJ_ROOT "/led/%/%/%",
+					    &sysname, NULL, NULL);
+	if (r <= 0)
+		return NULL;
+
+	return ratbagd_device_lookup(ctx, sysname);
+}
+
 struct ratbagd_device *ratbagd_device_first(struct ratbagd *ctx)
 {
 	struct RBNode *node;
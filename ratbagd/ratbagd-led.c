@@ -33,13 +33,33 @@
 #include "shared-macro.h"
 #include "libratbag-util.h"
 
+struct ratbagd_led_state {
+	enum ratbag_led_mode mode;
+	struct ratbag_color color;
+	int effect_duration;
+	unsigned int brightness;
+};
+
 struct ratbagd_led {
+	struct ratbagd_device *device;
 	struct ratbag_led *lib_led;
 	unsigned int index;
 	char *path;
 	enum ratbag_led_colordepth colordepth;
+
+	/* property values as last sent to the bus */
+	struct ratbagd_led_state published;
 };
 
+static void ratbagd_led_get_state(struct ratbagd_led *led,
+				  struct ratbagd_led_state *state)
+{
+	state->mode = ratbag_led_get_mode(led->lib_led);
+	state->color = ratbag_led_get_color(led->lib_led);
+	state->effect_duration = ratbag_led_get_effect_duration(led->lib_led);
+	state->brightness = ratbag_led_get_brightness(led->lib_led);
+}
+
 static int ratbagd_led_get_modes(sd_bus *bus,
 				const char *path,
 				const char *interface,
@@ -101,13 +121,8 @@ static int ratbagd_led_set_mode(sd_bus *bus,
 
 	r = ratbag_led_set_mode(led->lib_led, mode);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       led->path,
-					       RATBAGD_NAME_ROOT ".Led",
-					       "Mode",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(led->device);
 
 	return 0;
 }
@@ -152,13 +167,8 @@ static int ratbagd_led_set_color(sd_bus *bus,
 
 	r = ratbag_led_set_color(led->lib_led, c);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       led->path,
-					       RATBAGD_NAME_ROOT ".Led",
-					       "Color",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(led->device);
 
 	return 0;
 }
@@ -202,13 +212,8 @@ static int ratbagd_led_set_effect_duration(sd_bus *bus,
 
 	r = ratbag_led_set_effect_duration(led->lib_led, rate);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       led->path,
-					       RATBAGD_NAME_ROOT ".Led",
-					       "EffectDuration",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(led->device);
 
 	return 0;
 }
@@ -252,13 +257,8 @@ static int ratbagd_led_set_brightness(sd_bus *bus,
 
 	r = ratbag_led_set_brightness(led->lib_led, brightness);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       led->path,
-					       RATBAGD_NAME_ROOT ".Led",
-					       "Brightness",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(led->device);
 
 	return 0;
 }
@@ -299,9 +299,11 @@ int ratbagd_led_new(struct ratbagd_led **out,
 	assert(lib_led);
 
 	led = zalloc(sizeof(*led));
+	led->device = device;
 	led->lib_led = lib_led;
 	led->index = index;
 	led->colordepth = ratbag_led_get_colordepth(lib_led);
+	ratbagd_led_get_state(led, &led->published);
 
 	sprintf(profile_buffer, "p%u", ratbagd_profile_get_index(profile));
 	sprintf(led_buffer, "l%u", index);
@@ -335,15 +337,41 @@ struct ratbagd_led *ratbagd_led_free(struct ratbagd_led *led)
 	return mfree(led);
 }
 
-int ratbagd_led_resync(sd_bus *bus,
-		       struct ratbagd_led *led)
+int ratbagd_led_flush(sd_bus *bus,
+		      struct ratbagd_led *led)
 {
-	return sd_bus_emit_properties_changed(bus,
-					      led->path,
-					      RATBAGD_NAME_ROOT ".Led",
-					      "Mode",
-					      "Color",
-					      "EffectDuration",
-					      "Brightness",
-					      NULL);
+	struct ratbagd_led_state state;
+	struct ratbagd_led_state *published;
+	const char *changed[5];
+	size_t n = 0;
+
+	if (!led)
+		return 0;
+
+	published = &led->published;
+	ratbagd_led_get_state(led, &state);
+
+	if (state.mode != published->mode)
+		changed[n++] = "Mode";
+	if (state.color.red != published->color.red ||
+	    state.color.green != published->color.green ||
+	    state.color.blue != published->color.blue)
+		changed[n++] = "Color";
+	if (state.effect_duration != published->effect_duration)
+		changed[n++] = "EffectDuration";
+	if (state.brightness != published->brightness)
+		changed[n++] = "Brightness";
+	changed[n] = NULL;
+
+	*published = state;
+
+	if (n == 0)
+		return 0;
+
+	(void) sd_bus_emit_properties_changed_strv(bus,
+						   led->path,
+						   RATBAGD_NAME_ROOT ".Led",
+						   (char **)changed);
+
+	return 0;
 }
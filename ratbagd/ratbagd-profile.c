@@ -40,6 +40,16 @@
 #include "shared-macro.h"
 #include "libratbag-util.h"
 
+struct ratbagd_profile_state {
+	char *name;
+	bool is_active;
+	bool is_dirty;
+	bool disabled;
+	unsigned int report_rate;
+	int angle_snapping;
+	int debounce;
+};
+
 struct ratbagd_profile {
 	struct ratbagd_device *device;
 	struct ratbag_profile *lib_profile;
@@ -60,8 +70,25 @@ struct ratbagd_profile {
 	sd_bus_slot *led_enum_slot;
 	unsigned int n_leds;
 	struct ratbagd_led **leds;
+
+	/* property values as last sent to the bus */
+	struct ratbagd_profile_state published;
 };
 
+static void ratbagd_profile_get_state(struct ratbagd_profile *profile,
+				      struct ratbagd_profile_state *state)
+{
+	struct ratbag_profile *lib_profile = profile->lib_profile;
+
+	state->name = strdup_safe(ratbag_profile_get_name(lib_profile) ?: "");
+	state->is_active = ratbag_profile_is_active(lib_profile);
+	state->is_dirty = ratbag_profile_is_dirty(lib_profile);
+	state->disabled = !ratbag_profile_is_enabled(lib_profile);
+	state->report_rate = ratbag_profile_get_report_rate(lib_profile);
+	state->angle_snapping = ratbag_profile_get_angle_snapping(lib_profile);
+	state->debounce = ratbag_profile_get_debounce(lib_profile);
+}
+
 static int ratbagd_profile_find_resolution(sd_bus *bus,
 					   const char *path,
 					   const char *interface,
@@ -277,20 +304,6 @@ static int ratbagd_profile_find_led(sd_bus *bus,
 	return 1;
 }
 
-static int ratbagd_profile_active_signal_cb(sd_bus *bus,
-					    struct ratbagd_profile *profile)
-{
-	/* FIXME: we should cache is active and only send the signal for
-	 * those profiles where it changed */
-	(void) sd_bus_emit_properties_changed(bus,
-					      profile->path,
-					      RATBAGD_NAME_ROOT ".Profile",
-					      "IsActive",
-					      NULL);
-
-	return 0;
-}
-
 static int ratbagd_profile_set_active(sd_bus_message *m,
 				      void *userdata,
 				      sd_bus_error *error)
@@ -308,11 +321,7 @@ static int ratbagd_profile_set_active(sd_bus_message *m,
 			return r;
 	}
 
-	ratbagd_for_each_profile_signal(bus,
-					profile->device,
-					ratbagd_profile_active_signal_cb);
-
-	ratbagd_profile_notify_dirty(bus, profile);
+	ratbagd_device_schedule_flush(profile->device);
 
 	CHECK_CALL(sd_bus_reply_method_return(m, "u", 0));
 
@@ -335,15 +344,8 @@ ratbagd_profile_set_disabled(sd_bus *bus,
 	CHECK_CALL(sd_bus_message_read(m, "b", &disabled));
 
 	r = ratbag_profile_set_enabled(profile->lib_profile, !disabled);
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       profile->path,
-					       RATBAGD_NAME_ROOT ".Profile",
-					       "Disabled",
-					       NULL);
-
-		ratbagd_profile_notify_dirty(bus, profile);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(profile->device);
 
 	return 0;
 }
@@ -382,15 +384,8 @@ ratbagd_profile_set_name(sd_bus *bus,
 
 	r = ratbag_profile_set_name(profile->lib_profile, name);
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       profile->path,
-					       RATBAGD_NAME_ROOT ".Profile",
-					       "Name",
-					       NULL);
-
-		ratbagd_profile_notify_dirty(bus, profile);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(profile->device);
 
 	return 0;
 }
@@ -601,15 +596,8 @@ ratbagd_profile_set_report_rate(sd_bus *bus,
 	}
 
 	r = ratbag_profile_set_report_rate(profile->lib_profile, rate);
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       profile->path,
-					       RATBAGD_NAME_ROOT ".Profile",
-					       "ReportRate",
-					       NULL);
-
-		ratbagd_profile_notify_dirty(bus, profile);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(profile->device);
 
 	return 0;
 }
@@ -632,16 +620,8 @@ ratbagd_profile_set_angle_snapping(sd_bus *bus,
 		return r;
 
 	r = ratbag_profile_set_angle_snapping(profile->lib_profile, value);
-	if (r == 0) {
-		sd_bus *bus = sd_bus_message_get_bus(m);
-		sd_bus_emit_properties_changed(bus,
-					       profile->path,
-					       RATBAGD_NAME_ROOT ".Profile",
-					       "AngleSnapping",
-					       NULL);
-
-		ratbagd_profile_notify_dirty(bus, profile);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(profile->device);
 
 	return 0;
 }
@@ -664,16 +644,8 @@ ratbagd_profile_set_debounce(sd_bus *bus,
 		return r;
 
 	r = ratbag_profile_set_debounce(profile->lib_profile, value);
-	if (r == 0) {
-		sd_bus *bus = sd_bus_message_get_bus(m);
-		sd_bus_emit_properties_changed(bus,
-					       profile->path,
-					       RATBAGD_NAME_ROOT ".Profile",
-					       "Debounce",
-					       NULL);
-
-		ratbagd_profile_notify_dirty(bus, profile);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(profile->device);
 
 	return 0;
 }
@@ -734,6 +706,7 @@ int ratbagd_profile_new(struct ratbagd_profile **out,
 	profile->device = device;
 	profile->lib_profile = lib_profile;
 	profile->index = index;
+	ratbagd_profile_get_state(profile, &profile->published);
 
 	sprintf(index_buffer, "p%u", index);
 	r = sd_bus_path_encode_many(&profile->path,
@@ -834,6 +807,7 @@ struct ratbagd_profile *ratbagd_profile_free(struct ratbagd_profile *profile)
 	mfree(profile->resolutions);
 
 	profile->path = mfree(profile->path);
+	profile->published.name = mfree(profile->published.name);
 	profile->lib_profile = ratbag_profile_unref(profile->lib_profile);
 
 	return mfree(profile);
@@ -1050,6 +1024,63 @@ int ratbagd_profile_register_leds(struct sd_bus *bus,
 	return 0;
 }
 
+/*
+ * InterfacesAdded/InterfacesRemoved for the profile and its children, for
+ * clients using the ObjectManager at RATBAGD_OBJ_ROOT. Parents are
+ * announced before and removed after their children.
+ */
+void ratbagd_profile_emit_objects_added(sd_bus *bus,
+					struct ratbagd_profile *profile)
+{
+	unsigned int i;
+
+	(void) sd_bus_emit_object_added(bus, profile->path);
+
+	for (i = 0; i < profile->n_resolutions; ++i) {
+		if (profile->resolutions[i])
+			(void) sd_bus_emit_object_added(bus,
+				ratbagd_resolution_get_path(profile->resolutions[i]));
+	}
+
+	for (i = 0; i < profile->n_buttons; ++i) {
+		if (profile->buttons[i])
+			(void) sd_bus_emit_object_added(bus,
+				ratbagd_button_get_path(profile->buttons[i]));
+	}
+
+	for (i = 0; i < profile->n_leds; ++i) {
+		if (profile->leds[i])
+			(void) sd_bus_emit_object_added(bus,
+				ratbagd_led_get_path(profile->leds[i]));
+	}
+}
+
+void ratbagd_profile_emit_objects_removed(sd_bus *bus,
+					  struct ratbagd_profile *profile)
+{
+	unsigned int i;
+
+	for (i = 0; i < profile->n_leds; ++i) {
+		if (profile->leds[i])
+			(void) sd_bus_emit_object_removed(bus,
+				ratbagd_led_get_path(profile->leds[i]));
+	}
+
+	for (i = 0; i < profile->n_buttons; ++i) {
+		if (profile->buttons[i])
+			(void) sd_bus_emit_object_removed(bus,
+				ratbagd_button_get_path(profile->buttons[i]));
+	}
+
+	for (i = 0; i < profile->n_resolutions; ++i) {
+		if (profile->resolutions[i])
+			(void) sd_bus_emit_object_removed(bus,
+				ratbagd_resolution_get_path(profile->resolutions[i]));
+	}
+
+	(void) sd_bus_emit_object_removed(bus, profile->path);
+}
+
 int ratbagd_for_each_resolution_signal(sd_bus *bus,
 				       struct ratbagd_profile *profile,
 				       int (*func)(sd_bus *bus,
@@ -1090,31 +1121,50 @@ int ratbagd_for_each_led_signal(sd_bus *bus,
 }
 
 
-int ratbagd_profile_resync(sd_bus *bus,
-			    struct ratbagd_profile *profile)
+int ratbagd_profile_flush(sd_bus *bus,
+			  struct ratbagd_profile *profile)
 {
-	ratbagd_for_each_resolution_signal(bus, profile, ratbagd_resolution_resync);
-	ratbagd_for_each_button_signal(bus, profile, ratbagd_button_resync);
-	ratbagd_for_each_led_signal(bus, profile, ratbagd_led_resync);
-
-	return sd_bus_emit_properties_changed(bus,
-					      profile->path,
-					      RATBAGD_NAME_ROOT ".Profile",
-					      "Resolutions",
-					      "Buttons",
-					      "Leds",
-					      "IsActive",
-					      NULL);
-}
+	struct ratbagd_profile_state state;
+	struct ratbagd_profile_state *published;
+	const char *changed[8];
+	size_t n = 0;
 
-int ratbagd_profile_notify_dirty(sd_bus *bus,
-				 struct ratbagd_profile *profile)
-{
-	(void)sd_bus_emit_properties_changed(bus,
-					     profile->path,
-					     RATBAGD_NAME_ROOT ".Profile",
-					     "IsDirty",
-					     NULL);
+	if (!profile)
+		return 0;
+
+	ratbagd_for_each_resolution_signal(bus, profile, ratbagd_resolution_flush);
+	ratbagd_for_each_button_signal(bus, profile, ratbagd_button_flush);
+	ratbagd_for_each_led_signal(bus, profile, ratbagd_led_flush);
+
+	published = &profile->published;
+	ratbagd_profile_get_state(profile, &state);
+
+	if (!streq(state.name, published->name))
+		changed[n++] = "Name";
+	if (state.is_active != published->is_active)
+		changed[n++] = "IsActive";
+	if (state.is_dirty != published->is_dirty)
+		changed[n++] = "IsDirty";
+	if (state.disabled != published->disabled)
+		changed[n++] = "Disabled";
+	if (state.report_rate != published->report_rate)
+		changed[n++] = "ReportRate";
+	if (state.angle_snapping != published->angle_snapping)
+		changed[n++] = "AngleSnapping";
+	if (state.debounce != published->debounce)
+		changed[n++] = "Debounce";
+	changed[n] = NULL;
+
+	free(published->name);
+	*published = state;
+
+	if (n == 0)
+		return 0;
+
+	(void) sd_bus_emit_properties_changed_strv(bus,
+						   profile->path,
+						   RATBAGD_NAME_ROOT ".Profile",
+						   (char **)changed);
 
 	return 0;
 }
@@ -37,39 +37,69 @@
 #include "shared-macro.h"
 #include "libratbag-util.h"
 
+struct ratbagd_resolution_state {
+	bool is_active;
+	bool is_default;
+	bool is_disabled;
+	int xres, yres;
+};
+
 struct ratbagd_resolution {
 	struct ratbagd_device *device;
 	struct ratbagd_profile *profile;
 	struct ratbag_resolution *lib_resolution;
 	unsigned int index;
 	char *path;
+
+	/* property values as last sent to the bus */
+	struct ratbagd_resolution_state published;
 };
 
-int ratbagd_resolution_resync(sd_bus *bus,
-			      struct ratbagd_resolution *resolution)
+static void ratbagd_resolution_get_state(struct ratbagd_resolution *resolution,
+					 struct ratbagd_resolution_state *state)
 {
-	return sd_bus_emit_properties_changed(bus,
-					      resolution->path,
-					      RATBAGD_NAME_ROOT ".Resolution",
-					      "Resolution",
-					      "ReportRate",
-					      "IsActive",
-					      "IsDefault",
-					      "IsDisabled",
-					      NULL);
+	struct ratbag_resolution *lib_resolution = resolution->lib_resolution;
+
+	state->is_active = ratbag_resolution_is_active(lib_resolution);
+	state->is_default = ratbag_resolution_is_default(lib_resolution);
+	state->is_disabled = ratbag_resolution_is_disabled(lib_resolution);
+	state->xres = ratbag_resolution_get_dpi_x(lib_resolution);
+	state->yres = ratbag_resolution_get_dpi_y(lib_resolution);
 }
 
-static int ratbagd_resolution_active_signal_cb(sd_bus *bus,
-						struct ratbagd_resolution *resolution)
+int ratbagd_resolution_flush(sd_bus *bus,
+			     struct ratbagd_resolution *resolution)
 {
-	/* FIXME: we should cache is_active and only send the signal for
-	 * those resolutions where it changed */
+	struct ratbagd_resolution_state state;
+	struct ratbagd_resolution_state *published;
+	const char *changed[5];
+	size_t n = 0;
+
+	if (!resolution)
+		return 0;
+
+	published = &resolution->published;
+	ratbagd_resolution_get_state(resolution, &state);
+
+	if (state.is_active != published->is_active)
+		changed[n++] = "IsActive";
+	if (state.is_default != published->is_default)
+		changed[n++] = "IsDefault";
+	if (state.is_disabled != published->is_disabled)
+		changed[n++] = "IsDisabled";
+	if (state.xres != published->xres || state.yres != published->yres)
+		changed[n++] = "Resolution";
+	changed[n] = NULL;
 
-	(void) sd_bus_emit_properties_changed(bus,
-					      resolution->path,
-					      RATBAGD_NAME_ROOT ".Resolution",
-					      "IsActive",
-					      NULL);
+	*published = state;
+
+	if (n == 0)
+		return 0;
+
+	(void) sd_bus_emit_properties_changed_strv(bus,
+						   resolution->path,
+						   RATBAGD_NAME_ROOT ".Resolution",
+						   (char **)changed);
 
 	return 0;
 }
@@ -89,28 +119,11 @@ static int ratbagd_resolution_set_active(sd_bus_message *m,
 			return r;
 	}
 
-	ratbagd_for_each_resolution_signal(sd_bus_message_get_bus(m),
-					   resolution->profile,
-					   ratbagd_resolution_active_signal_cb);
+	ratbagd_device_schedule_flush(resolution->device);
 
 	return sd_bus_reply_method_return(m, "u", 0);
 }
 
-static int ratbagd_resolution_default_signal_cb(sd_bus *bus,
-						struct ratbagd_resolution *resolution)
-{
-	/* FIXME: we should cache is default and only send the signal for
-	 * those resolutions where it changed */
-
-	(void) sd_bus_emit_properties_changed(bus,
-					      resolution->path,
-					      RATBAGD_NAME_ROOT ".Resolution",
-					      "IsDefault",
-					      NULL);
-
-	return 0;
-}
-
 static int ratbagd_resolution_set_default(sd_bus_message *m,
 					  void *userdata,
 					  sd_bus_error *error)
@@ -126,9 +139,7 @@ static int ratbagd_resolution_set_default(sd_bus_message *m,
 			return r;
 	}
 
-	ratbagd_for_each_resolution_signal(sd_bus_message_get_bus(m),
-					   resolution->profile,
-					   ratbagd_resolution_default_signal_cb);
+	ratbagd_device_schedule_flush(resolution->device);
 
 	return sd_bus_reply_method_return(m, "u", 0);
 }
@@ -202,13 +213,8 @@ static int ratbagd_resolution_set_disabled(sd_bus *bus,
 	CHECK_CALL(sd_bus_message_read(m, "b", &is_disabled));
 
 	r = ratbag_resolution_set_disabled(resolution->lib_resolution, !!is_disabled);
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       resolution->path,
-					       RATBAGD_NAME_ROOT ".Resolution",
-					       "IsDisabled",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(resolution->device);
 
 	return 0;
 }
@@ -297,13 +303,8 @@ ratbagd_resolution_set_resolution(sd_bus *bus,
 		r = ratbag_resolution_set_dpi(resolution->lib_resolution, xres);
 	}
 
-	if (r == 0) {
-		sd_bus_emit_properties_changed(bus,
-					       resolution->path,
-					       RATBAGD_NAME_ROOT ".Resolution",
-					       "Resolution",
-					       NULL);
-	}
+	if (r == 0)
+		ratbagd_device_schedule_flush(resolution->device);
 
 	return 0;
 }
@@ -382,6 +383,7 @@ int ratbagd_resolution_new(struct ratbagd_resolution **out,
 	resolution->profile = profile;
 	resolution->lib_resolution = lib_resolution;
 	resolution->index = index;
+	ratbagd_resolution_get_state(resolution, &resolution->published);
 
 	sprintf(profile_buffer, "p%u", ratbagd_profile_get_index(profile));
 	sprintf(resolution_buffer, "r%u", index);
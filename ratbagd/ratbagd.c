@@ -32,8 +32,10 @@
 #include <libgen.h>
 #include <libratbag.h>
 #include <libudev.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
 #include <systemd/sd-bus.h>
 #include <systemd/sd-event.h>
@@ -107,6 +109,25 @@ static int ratbagd_find_device(sd_bus *bus,
 	return 1;
 }
 
+static int ratbagd_find_battery(sd_bus *bus,
+				const char *path,
+				const char *interface,
+				void *userdata,
+				void **found,
+				sd_bus_error *error)
+{
+	struct ratbagd_device *device;
+	int r;
+
+	r = ratbagd_find_device(bus, path, interface, userdata,
+				(void **)&device, error);
+	if (r <= 0)
+		return r;
+
+	*found = ratbagd_device_get_battery(device);
+	return *found != NULL;
+}
+
 static int ratbagd_list_devices(sd_bus *bus,
 				const char *path,
 				void *userdata,
@@ -175,13 +196,498 @@ static const sd_bus_vtable ratbagd_vtable[] = {
 	SD_BUS_VTABLE_END,
 };
 
+static void ratbagd_add_device(struct ratbagd *ctx,
+			       const char *sysname,
+			       struct ratbag_device *lib_device)
+{
+	struct ratbagd_device *device;
+	int r;
+
+	r = ratbagd_device_new(&device, ctx, sysname, lib_device);
+	if (r < 0) {
+		log_error("%s: cannot track device\n", sysname);
+		return;
+	}
+
+	ratbagd_device_link(device);
+	(void) sd_bus_emit_properties_changed(ctx->bus,
+					      RATBAGD_OBJ_ROOT,
+					      RATBAGD_NAME_ROOT ".Manager",
+					      "Devices",
+					      NULL);
+}
+
+static void ratbagd_remove_device(struct ratbagd *ctx,
+				  struct ratbagd_device *device)
+{
+	/* a running job holds a reference, the device is freed once that
+	 * is done */
+	ratbagd_device_unlink(device);
+	ratbagd_device_unref(device);
+
+	(void) sd_bus_emit_properties_changed(ctx->bus,
+					      RATBAGD_OBJ_ROOT,
+					      RATBAGD_NAME_ROOT ".Manager",
+					      "Devices",
+					      NULL);
+}
+
+/*
+ * Lazy probes
+ *
+ * With --lazy-probe, a hidraw node that is in the device database is
+ * linked without talking to the device, only its Name, Model and
+ * DeviceType are known then. The driver probe runs once a client asks for
+ * more, see ratbagd_bus_filter(), or in the background after a delay.
+ * Either way, it runs on a worker thread and the device is busy until
+ * it's done, the client's call is held back until then.
+ *
+ * All hidraw nodes of a supported device are in the database, only the
+ * probe tells which of them we can talk to. The others disappear again
+ * once they're probed. libratbag opens the sibling nodes while probing,
+ * so only one node per physical device is probed at a time.
+ */
+
+static bool ratbagd_device_group_probing(struct ratbagd *ctx,
+					 struct ratbagd_device *device)
+{
+	_cleanup_(freep) char *group = NULL;
+	struct ratbagd_device *other;
+
+	group = ratbagd_get_device_group(ctx, ratbagd_device_get_sysname(device));
+
+	RATBAGD_DEVICE_FOREACH(other, ctx) {
+		_cleanup_(freep) char *other_group = NULL;
+
+		if (other == device || !ratbagd_device_probing(other))
+			continue;
+
+		other_group = ratbagd_get_device_group(ctx, ratbagd_device_get_sysname(other));
+		if (streq(group, other_group))
+			return true;
+	}
+
+	return false;
+}
+
+/* Start the probe unless the device or a sibling is busy, the caller
+ * tries again when the next probe finishes */
+static bool ratbagd_probe_device(struct ratbagd *ctx,
+				 struct ratbagd_device *device)
+{
+	if (ratbagd_device_busy(device) ||
+	    ratbagd_device_group_probing(ctx, device))
+		return false;
+
+	ratbagd_device_start_probe(device);
+	return true;
+}
+
+/* Returns true if some devices are not probed yet */
+static bool ratbagd_probe_all_devices(struct ratbagd *ctx)
+{
+	struct ratbagd_device *device;
+	bool pending = false;
+
+	RATBAGD_DEVICE_FOREACH(device, ctx) {
+		if (ratbagd_device_probed(device))
+			continue;
+
+		ratbagd_probe_device(ctx, device);
+		pending = true;
+	}
+
+	return pending;
+}
+
+static void ratbagd_background_probe_next(struct ratbagd *ctx)
+{
+	uint64_t now;
+
+	if (!ctx->background_probe_source)
+		return;
+
+	sd_event_now(ctx->event, CLOCK_MONOTONIC, &now);
+	sd_event_source_set_time(ctx->background_probe_source, now);
+	sd_event_source_set_enabled(ctx->background_probe_source,
+				    SD_EVENT_ONESHOT);
+}
+
+static int ratbagd_background_probe_cb(sd_event_source *source,
+				       uint64_t usec,
+				       void *userdata)
+{
+	struct ratbagd *ctx = userdata;
+	struct ratbagd_device *device;
+
+	ctx->background_probe_active = false;
+
+	RATBAGD_DEVICE_FOREACH(device, ctx) {
+		if (ratbagd_device_probed(device))
+			continue;
+
+		ctx->background_probe_active = true;
+
+		/* one device at a time, the source has idle priority so
+		 * anything a client wants is handled in between.
+		 * ratbagd_probe_finished() brings us back */
+		if (ratbagd_probe_device(ctx, device)) {
+			ctx->background_activity = true;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Called on the main loop when a probe started with
+ * ratbagd_device_start_probe() is done.
+ */
+void ratbagd_probe_finished(struct ratbagd *ctx,
+			    struct ratbagd_device *device,
+			    bool success)
+{
+	if (!success && ratbagd_device_linked(device))
+		ratbagd_remove_device(ctx, device);
+
+	/* calls waiting for this probe, or for a sibling's, go ahead now or
+	 * start the next probe */
+	ratbagd_release_deferred(ctx);
+
+	if (ctx->background_probe_active)
+		ratbagd_background_probe_next(ctx);
+}
+
+static void ratbagd_schedule_background_probe(struct ratbagd *ctx)
+{
+	uint64_t now;
+	int enabled;
+	int r;
+
+	if (ctx->background_probe_delay == 0)
+		return;
+
+	sd_event_now(ctx->event, CLOCK_MONOTONIC, &now);
+
+	if (ctx->background_probe_source) {
+		r = sd_event_source_get_enabled(ctx->background_probe_source,
+						&enabled);
+		if (r < 0 || enabled != SD_EVENT_OFF || ctx->background_probe_active)
+			return;
+
+		sd_event_source_set_time(ctx->background_probe_source,
+					 now + ctx->background_probe_delay);
+		sd_event_source_set_enabled(ctx->background_probe_source,
+					    SD_EVENT_ONESHOT);
+		return;
+	}
+
+	r = sd_event_add_time(ctx->event,
+			      &ctx->background_probe_source,
+			      CLOCK_MONOTONIC,
+			      now + ctx->background_probe_delay,
+			      0,
+			      ratbagd_background_probe_cb,
+			      ctx);
+	if (r < 0) {
+		errno = -r;
+		log_error("Failed to schedule the background probe: %m\n");
+		ctx->background_probe_source = NULL;
+		return;
+	}
+
+	sd_event_source_set_priority(ctx->background_probe_source,
+				     SD_EVENT_PRIORITY_IDLE);
+}
+
+/*
+ * Startup probes
+ *
+ * Probing a device can take hundreds of milliseconds, so at startup the
+ * hidraw nodes are grouped by physical device and each group is probed
+ * in a job of its own. Nodes of the same physical device are probed one
+ * after the other, libratbag opens the sibling nodes while probing.
+ * Devices are linked as their group finishes. Until all groups are done,
+ * calls to the Manager object are held back so Devices is complete when a
+ * client first sees it, see ratbagd_bus_filter().
+ *
+ * Not used with --lazy-probe, see above.
+ */
+
+#define RATBAGD_MAX_PROBE_JOBS 8
+
+struct ratbagd_probe {
+	struct ratbagd_probe *next;
+	struct ratbagd *ctx;
+	struct ratbagd_job *job;
+	char *group;
+
+	size_t n_nodes;
+	struct ratbagd_probe_node {
+		char *syspath;
+		char *sysname;
+		struct ratbag_device *lib_device;
+		bool removed;
+		/* added again after the removal, syspath is the new one */
+		bool readded;
+	} *nodes;
+};
+
+static void ratbagd_probe_free(struct ratbagd_probe *probe)
+{
+	for (size_t i = 0; i < probe->n_nodes; i++) {
+		free(probe->nodes[i].syspath);
+		free(probe->nodes[i].sysname);
+		ratbag_device_unref(probe->nodes[i].lib_device);
+	}
+	free(probe->nodes);
+	free(probe->group);
+	free(probe);
+}
+
+static bool ratbagd_probe_pending(struct ratbagd *ctx,
+				  struct udev_device *udevice,
+				  bool removed)
+{
+	const char *sysname = udev_device_get_sysname(udevice);
+	struct ratbagd_probe *probe;
+
+	for (probe = ctx->probes; probe; probe = probe->next) {
+		for (size_t i = 0; i < probe->n_nodes; i++) {
+			struct ratbagd_probe_node *node = &probe->nodes[i];
+
+			if (!streq(node->sysname, sysname))
+				continue;
+
+			if (removed) {
+				node->removed = true;
+				node->readded = false;
+			} else if (node->removed) {
+				/* replugged, whatever the probe opened is
+				 * gone. ratbagd_probe_done() queues it again */
+				node->readded = true;
+				free(node->syspath);
+				node->syspath = strdup_safe(udev_device_get_syspath(udevice));
+			}
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void ratbagd_probe_work(void *data)
+{
+	struct ratbagd_probe *probe = data;
+	struct udev *udev;
+
+	/* libudev contexts must not be shared between threads */
+	udev = udev_new();
+	if (!udev)
+		return;
+
+	for (size_t i = 0; i < probe->n_nodes; i++) {
+		struct udev_device *udevice;
+		enum ratbag_error_code error;
+
+		udevice = udev_device_new_from_syspath(udev, probe->nodes[i].syspath);
+		if (!udevice)
+			continue;
+
+		error = ratbag_device_new_from_udev_device(probe->ctx->lib_ctx,
+							   udevice,
+							   &probe->nodes[i].lib_device);
+		if (error != RATBAG_SUCCESS)
+			probe->nodes[i].lib_device = NULL; /* unsupported device */
+
+		udev_device_unref(udevice);
+	}
+
+	udev_unref(udev);
+}
+
+static void ratbagd_probe_start_next(struct ratbagd *ctx);
+static void ratbagd_probe_add(struct ratbagd *ctx,
+			      struct udev_device *udevice);
+
+static void ratbagd_probe_done(void *data)
+{
+	struct ratbagd_probe *probe = data;
+	struct ratbagd *ctx = probe->ctx;
+	struct ratbagd_probe **p;
+
+	for (p = &ctx->probes; *p; p = &(*p)->next) {
+		if (*p == probe) {
+			*p = probe->next;
+			break;
+		}
+	}
+	ctx->n_probe_jobs--;
+
+	for (size_t i = 0; i < probe->n_nodes; i++) {
+		if (probe->nodes[i].readded) {
+			struct udev_device *udevice;
+
+			udevice = udev_device_new_from_syspath(udev_monitor_get_udev(ctx->monitor),
+							       probe->nodes[i].syspath);
+			if (udevice) {
+				ratbagd_probe_add(ctx, udevice);
+				udev_device_unref(udevice);
+			}
+			continue;
+		}
+
+		if (!probe->nodes[i].lib_device || probe->nodes[i].removed)
+			continue;
+
+		if (ratbagd_device_lookup(ctx, probe->nodes[i].sysname))
+			continue;
+
+		ratbagd_add_device(ctx,
+				   probe->nodes[i].sysname,
+				   probe->nodes[i].lib_device);
+	}
+
+	ratbagd_probe_free(probe);
+
+	ratbagd_probe_start_next(ctx);
+
+	/* the startup batch is done, the Manager can answer now */
+	if (!ctx->probes)
+		ratbagd_release_deferred(ctx);
+}
+
+static bool ratbagd_probe_group_busy(struct ratbagd *ctx, const char *group)
+{
+	struct ratbagd_probe *probe;
+
+	for (probe = ctx->probes; probe; probe = probe->next) {
+		if (probe->job && streq(probe->group, group))
+			return true;
+	}
+
+	return false;
+}
+
+static void ratbagd_probe_start_next(struct ratbagd *ctx)
+{
+	struct ratbagd_probe *probe;
+	int r;
+
+	for (probe = ctx->probes; probe; probe = probe->next) {
+		if (ctx->n_probe_jobs >= RATBAGD_MAX_PROBE_JOBS)
+			return;
+
+		/* a node added while its group was being probed waits for
+		 * that job, see ratbagd_probe_add() */
+		if (probe->job || ratbagd_probe_group_busy(ctx, probe->group))
+			continue;
+
+		ctx->n_probe_jobs++;
+		r = ratbagd_job_start(ctx,
+				      &probe->job,
+				      ratbagd_probe_work,
+				      ratbagd_probe_done,
+				      probe);
+		if (r < 0) {
+			errno = -r;
+			log_error("Failed to start probe thread, probing synchronously: %m\n");
+			ratbagd_probe_work(probe);
+			ratbagd_probe_done(probe);
+			return;
+		}
+	}
+}
+
+static void ratbagd_probe_wait_all(struct ratbagd *ctx)
+{
+	while (ctx->probes) {
+		struct ratbagd_probe *probe = ctx->probes;
+
+		if (probe->job) {
+			ratbagd_job_wait(probe->job);
+		} else {
+			ctx->probes = probe->next;
+			ratbagd_probe_free(probe);
+		}
+	}
+}
+
+/* The syspath of the physical device a hidraw node belongs to. For devices
+ * paired with a receiver, that's the receiver */
+static const char *ratbagd_udev_group(struct udev_device *udevice)
+{
+	struct udev_device *parent;
+
+	parent = udev_device_get_parent_with_subsystem_devtype(udevice, "usb", "usb_device");
+	if (!parent)
+		parent = udev_device_get_parent_with_subsystem_devtype(udevice, "hid", NULL);
+
+	return udev_device_get_syspath(parent ? parent : udevice);
+}
+
+char *ratbagd_get_device_group(struct ratbagd *ctx, const char *sysname)
+{
+	struct udev_device *udevice;
+	char *group;
+
+	udevice = udev_device_new_from_subsystem_sysname(udev_monitor_get_udev(ctx->monitor),
+							 "hidraw",
+							 sysname);
+	if (!udevice)
+		return strdup_safe(sysname);
+
+	group = strdup_safe(ratbagd_udev_group(udevice));
+	udev_device_unref(udevice);
+
+	return group;
+}
+
+static void ratbagd_probe_add(struct ratbagd *ctx,
+			      struct udev_device *udevice)
+{
+	struct ratbagd_probe *probe, **tail;
+	const char *sysname, *group;
+	size_t n;
+
+	sysname = udev_device_get_sysname(udevice);
+	if (!sysname || !startswith(sysname, "hidraw"))
+		return;
+
+	group = ratbagd_udev_group(udevice);
+
+	/* a group whose job is running can't take more nodes, the worker
+	 * thread is going through them */
+	for (tail = &ctx->probes; *tail; tail = &(*tail)->next) {
+		if (streq((*tail)->group, group) && !(*tail)->job)
+			break;
+	}
+
+	probe = *tail;
+	if (!probe) {
+		probe = zalloc(sizeof(*probe));
+		probe->ctx = ctx;
+		probe->group = strdup_safe(group);
+		*tail = probe;
+	}
+
+	n = probe->n_nodes++;
+	probe->nodes = realloc(probe->nodes, probe->n_nodes * sizeof(*probe->nodes));
+	if (!probe->nodes)
+		abort();
+	memset(&probe->nodes[n], 0, sizeof(probe->nodes[n]));
+	probe->nodes[n].syspath = strdup_safe(udev_device_get_syspath(udevice));
+	probe->nodes[n].sysname = strdup_safe(sysname);
+}
+
 static void ratbagd_process_device(struct ratbagd *ctx,
 				   struct udev_device *udevice)
 {
 	struct ratbag_device *lib_device;
 	struct ratbagd_device *device;
 	const char *sysname;
-	int r;
+	bool removed;
 
 	/*
 	 * TODO: libratbag should provide some mechanism to allow
@@ -196,48 +702,57 @@ static void ratbagd_process_device(struct ratbagd *ctx,
 	if (!sysname || !startswith(sysname, "hidraw"))
 		return;
 
+	removed = streq_ptr("remove", udev_device_get_action(udevice));
+
+	/* still being probed at startup, the probe takes care of it */
+	if (ratbagd_probe_pending(ctx, udevice, removed))
+		return;
+
 	device = ratbagd_device_lookup(ctx, sysname);
 
-	if (streq_ptr("remove", udev_device_get_action(udevice))) {
+	if (removed) {
 		/* device was removed, unlink it and destroy our context */
-		if (device) {
-			ratbagd_device_unlink(device);
-			ratbagd_device_unref(device);
-
-			(void) sd_bus_emit_properties_changed(ctx->bus,
-							      RATBAGD_OBJ_ROOT,
-							      RATBAGD_NAME_ROOT ".Manager",
-							      "Devices",
-							      NULL);
-		}
+		if (device)
+			ratbagd_remove_device(ctx, device);
 	} else if (device) {
 		/* device already known, refresh our view of the device */
 	} else {
 		enum ratbag_error_code error;
 
 		/* device unknown, create new one and link it */
-		error = ratbag_device_new_from_udev_device(ctx->lib_ctx,
-							   udevice,
-							   &lib_device);
+		if (ctx->lazy_probe) {
+			struct udev_device *private = NULL;
+			struct udev *udev;
+
+			/* the probe runs on a worker thread, libudev contexts
+			 * must not be shared between threads */
+			udev = udev_new();
+			if (udev) {
+				private = udev_device_new_from_syspath(udev,
+								       udev_device_get_syspath(udevice));
+				udev_unref(udev);
+			}
+			if (!private)
+				return;
+
+			error = ratbag_device_new_from_udev_device_unprobed(ctx->lib_ctx,
+									    private,
+									    &lib_device);
+			udev_device_unref(private);
+		} else
+			error = ratbag_device_new_from_udev_device(ctx->lib_ctx,
+								   udevice,
+								   &lib_device);
 		if (error != RATBAG_SUCCESS)
 			return; /* unsupported device */
 
-		r = ratbagd_device_new(&device, ctx, sysname, lib_device);
+		ratbagd_add_device(ctx, sysname, lib_device);
 
 		/* the ratbagd_device takes its own reference, drop ours */
 		ratbag_device_unref(lib_device);
 
-		if (r < 0) {
-			log_error("%s: cannot track device\n", sysname);
-			return;
-		}
-
-		ratbagd_device_link(device);
-		(void) sd_bus_emit_properties_changed(ctx->bus,
-						      RATBAGD_OBJ_ROOT,
-						      RATBAGD_NAME_ROOT ".Manager",
-						      "Devices",
-						      NULL);
+		if (ctx->lazy_probe)
+			ratbagd_schedule_background_probe(ctx);
 	}
 }
 
@@ -259,6 +774,233 @@ static int ratbagd_monitor_event(sd_event_source *source,
 	return 0;
 }
 
+/* Whether a method call needs more than a device knows before the probe */
+static bool ratbagd_needs_probe(sd_bus_message *m)
+{
+	const char *interface, *property;
+	bool cheap;
+
+	if (!sd_bus_message_is_method_call(m, "org.freedesktop.DBus.Properties", "Get"))
+		return true;
+
+	if (sd_bus_message_read(m, "ss", &interface, &property) < 0)
+		return true;
+
+	cheap = streq(interface, RATBAGD_NAME_ROOT ".Device") &&
+		(streq(property, "Name") ||
+		 streq(property, "Model") ||
+		 streq(property, "DeviceType"));
+
+	(void) sd_bus_message_rewind(m, true);
+
+	return !cheap;
+}
+
+static bool ratbagd_any_device_busy(struct ratbagd *ctx)
+{
+	struct ratbagd_device *device;
+
+	RATBAGD_DEVICE_FOREACH(device, ctx) {
+		if (ratbagd_device_busy(device))
+			return true;
+	}
+
+	return false;
+}
+
+static void ratbagd_queue_append(struct ratbagd_message_queue *queue,
+				 sd_bus_message *m)
+{
+	queue->messages = realloc(queue->messages,
+				  (queue->n_messages + 1) * sizeof(*queue->messages));
+	if (!queue->messages)
+		abort();
+
+	queue->messages[queue->n_messages++] = sd_bus_message_ref(m);
+}
+
+/* Removes m from the queue, returns true if it was in there */
+static bool ratbagd_queue_take(struct ratbagd_message_queue *queue,
+			       sd_bus_message *m)
+{
+	for (size_t i = 0; i < queue->n_messages; i++) {
+		if (queue->messages[i] != m)
+			continue;
+
+		sd_bus_message_unref(m);
+		memmove(&queue->messages[i], &queue->messages[i + 1],
+			(queue->n_messages - i - 1) * sizeof(*queue->messages));
+		queue->n_messages--;
+		return true;
+	}
+
+	return false;
+}
+
+static void ratbagd_queue_clear(struct ratbagd_message_queue *queue)
+{
+	for (size_t i = 0; i < queue->n_messages; i++)
+		sd_bus_message_unref(queue->messages[i]);
+
+	queue->messages = mfree(queue->messages);
+	queue->n_messages = 0;
+}
+
+static void ratbagd_defer_message(struct ratbagd *ctx, sd_bus_message *m)
+{
+	ratbagd_queue_append(&ctx->deferred, m);
+}
+
+/**
+ * Put the method calls held back by ratbagd_bus_filter() back into the
+ * bus' read queue, in the order they arrived. Called whenever a device
+ * job finishes, the filter holds back again whatever still has to wait.
+ *
+ * sd-bus appends them to its read queue, behind calls that arrived since
+ * and haven't been dispatched yet. Until the filter saw all of them
+ * again, it holds back any other call, those are put back after them.
+ */
+void ratbagd_release_deferred(struct ratbagd *ctx)
+{
+	struct ratbagd_message_queue deferred;
+	int r;
+
+	/* the filter calls us again once these are through */
+	if (ctx->released.n_messages > 0) {
+		ctx->release_pending = true;
+		return;
+	}
+
+	ctx->release_pending = false;
+
+	/* the held calls arrived after all the deferred ones */
+	for (size_t i = 0; i < ctx->held.n_messages; i++)
+		ratbagd_queue_append(&ctx->deferred, ctx->held.messages[i]);
+	ratbagd_queue_clear(&ctx->held);
+
+	deferred = ctx->deferred;
+	ctx->deferred = (struct ratbagd_message_queue) {0};
+
+	for (size_t i = 0; i < deferred.n_messages; i++) {
+		r = sd_bus_enqueue_for_read(ctx->bus, deferred.messages[i]);
+		if (r < 0) {
+			errno = -r;
+			log_error("Failed to requeue a method call: %m\n");
+			(void) sd_bus_reply_method_errno(deferred.messages[i], r, NULL);
+		} else {
+			ratbagd_queue_append(&ctx->released, deferred.messages[i]);
+		}
+	}
+
+	ratbagd_queue_clear(&deferred);
+}
+
+/*
+ * Called for every incoming message before it is dispatched. Method calls
+ * for a device that has a job running on a worker thread would race with
+ * that thread. They are held back and put back into the read queue once
+ * the job is done, see ratbagd_release_deferred(). Calls that arrive
+ * while a Preview() waits for the device are held back the same way, so
+ * they're answered after it. The main loop never waits for a device.
+ * Commit is the exception, its handler only queues another commit.
+ * GetManagedObjects collects every device, so it waits until none is
+ * busy. Calls to the Manager object wait for the startup probes.
+ *
+ * With --lazy-probe, a device is probed before the first message that
+ * needs more than its name and model is dispatched to it. The message is
+ * held back until the probe job is done. The object tree must not change
+ * while GetManagedObjects collects it, so that one waits for all devices
+ * to be probed.
+ */
+static int ratbagd_bus_filter_call(struct ratbagd *ctx, sd_bus_message *m)
+{
+	struct ratbagd_device *device;
+
+	/* the startup probes aren't done, Devices would be incomplete */
+	if (ctx->probes && streq_ptr(sd_bus_message_get_path(m), RATBAGD_OBJ_ROOT)) {
+		ratbagd_defer_message(ctx, m);
+		return 1;
+	}
+
+	if (sd_bus_message_is_method_call(m,
+					  "org.freedesktop.DBus.ObjectManager",
+					  "GetManagedObjects") > 0) {
+		bool pending = ctx->lazy_probe && ratbagd_probe_all_devices(ctx);
+
+		if (!pending && !ratbagd_any_device_busy(ctx))
+			return 0;
+	} else {
+		device = ratbagd_device_lookup_by_path(ctx, sd_bus_message_get_path(m));
+		if (!device)
+			return 0;
+
+		if (ctx->lazy_probe && !ratbagd_device_probed(device) &&
+		    ratbagd_needs_probe(m)) {
+			/* the probe may have to wait for a sibling, we're
+			 * back here once that one's done */
+			ratbagd_probe_device(ctx, device);
+		} else {
+			if (!ratbagd_device_busy(device) &&
+			    !ratbagd_device_previewing(device))
+				return 0;
+
+			if (sd_bus_message_is_method_call(m, RATBAGD_NAME_ROOT ".Device", "Commit") > 0)
+				return 0;
+		}
+	}
+
+	ratbagd_defer_message(ctx, m);
+
+	/* handled, sd-bus doesn't dispatch it any further */
+	return 1;
+}
+
+static int ratbagd_bus_filter(sd_bus_message *m,
+			      void *userdata,
+			      sd_bus_error *error)
+{
+	struct ratbagd *ctx = userdata;
+	bool released;
+	int r;
+
+	ctx->client_activity = true;
+
+	if (sd_bus_message_is_method_call(m, NULL, NULL) <= 0)
+		return 0;
+
+	/* it must not overtake the calls put back before it */
+	released = ratbagd_queue_take(&ctx->released, m);
+	if (!released && ctx->released.n_messages > 0) {
+		ratbagd_queue_append(&ctx->held, m);
+		return 1;
+	}
+
+	r = ratbagd_bus_filter_call(ctx, m);
+
+	/* The last of the calls put back is through, the held ones go
+	 * next. Without any, the deferred ones wait for a job to finish */
+	if (released && ctx->released.n_messages == 0 &&
+	    (ctx->held.n_messages > 0 || ctx->release_pending))
+		ratbagd_release_deferred(ctx);
+
+	return r;
+}
+
+static int ratbagd_lib_event(sd_event_source *source,
+			     int fd,
+			     unsigned int mask,
+			     void *userdata)
+{
+	struct ratbagd *ctx = userdata;
+	int r;
+
+	r = ratbag_dispatch(ctx->lib_ctx);
+	if (r < 0)
+		log_error("Failed to dispatch libratbag events: %s\n", strerror(-r));
+
+	return 0;
+}
+
 static int ratbagd_lib_open_restricted(const char *path,
 				       int flags,
 				       void *userdata)
@@ -271,9 +1013,32 @@ static void ratbagd_lib_close_restricted(int fd, void *userdata)
 	safe_close(fd);
 }
 
+static void ratbagd_lib_device_changed(struct ratbag_device *lib_device,
+				       void *userdata)
+{
+	struct ratbagd_device *device = ratbag_device_get_user_data(lib_device);
+
+	/* the user pressed a profile or resolution button on the device,
+	 * the flush signals whatever changed */
+	if (ratbagd_device_linked(device))
+		ratbagd_device_schedule_flush(device);
+}
+
+static void ratbagd_lib_preview_done(struct ratbag_device *lib_device,
+				     enum ratbag_error_code rc,
+				     void *userdata)
+{
+	struct ratbagd_device *device = ratbag_device_get_user_data(lib_device);
+
+	/* Preview() holds a ref until it got here, device is still ours */
+	ratbagd_device_preview_done(device, rc);
+}
+
 static const struct ratbag_interface ratbagd_lib_interface = {
 	.open_restricted	= ratbagd_lib_open_restricted,
 	.close_restricted	= ratbagd_lib_close_restricted,
+	.device_changed		= ratbagd_lib_device_changed,
+	.preview_done		= ratbagd_lib_preview_done,
 };
 
 static struct ratbagd *ratbagd_free(struct ratbagd *ctx)
@@ -283,14 +1048,23 @@ static struct ratbagd *ratbagd_free(struct ratbagd *ctx)
 	if (!ctx)
 		return NULL;
 
+	ratbagd_probe_wait_all(ctx);
+
 	RATBAGD_DEVICE_FOREACH_SAFE(device, tmp, ctx) {
+		ratbagd_device_wait_idle(device);
 		ratbagd_device_unlink(device);
 		ratbagd_device_unref(device);
 	}
 
+	ratbagd_queue_clear(&ctx->deferred);
+	ratbagd_queue_clear(&ctx->released);
+	ratbagd_queue_clear(&ctx->held);
+
 	ctx->bus = sd_bus_flush_close_unref(ctx->bus);
+	ctx->background_probe_source = sd_event_source_unref(ctx->background_probe_source);
 	ctx->monitor_source = sd_event_source_unref(ctx->monitor_source);
 	ctx->monitor = udev_monitor_unref(ctx->monitor);
+	ctx->lib_source = sd_event_source_unref(ctx->lib_source);
 	ctx->lib_ctx = ratbag_unref(ctx->lib_ctx);
 	ctx->event = sd_event_unref(ctx->event);
 
@@ -372,6 +1146,15 @@ static int ratbagd_new(struct ratbagd **out)
 		ratbag_log_set_priority(ctx->lib_ctx,
 					RATBAG_LOG_PRIORITY_DEBUG);
 
+	r = sd_event_add_io(ctx->event,
+			    &ctx->lib_source,
+			    ratbag_get_fd(ctx->lib_ctx),
+			    EPOLLIN,
+			    ratbagd_lib_event,
+			    ctx);
+	if (r < 0)
+		return r;
+
 	r = ratbagd_init_monitor(ctx);
 	if (r < 0)
 		return r;
@@ -380,6 +1163,10 @@ static int ratbagd_new(struct ratbagd **out)
 	if (r < 0)
 		return r;
 
+	r = sd_bus_add_filter(ctx->bus, NULL, ratbagd_bus_filter, ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_object_vtable(ctx->bus,
 				     NULL,
 				     RATBAGD_OBJ_ROOT,
@@ -389,6 +1176,13 @@ static int ratbagd_new(struct ratbagd **out)
 	if (r < 0)
 		return r;
 
+	/* lets clients fetch the whole device tree with one
+	 * GetManagedObjects call, the node enumerators below provide the
+	 * objects */
+	r = sd_bus_add_object_manager(ctx->bus, NULL, RATBAGD_OBJ_ROOT);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_fallback_vtable(ctx->bus,
 				       NULL,
 				       RATBAGD_OBJ_ROOT "/device",
@@ -399,6 +1193,26 @@ static int ratbagd_new(struct ratbagd **out)
 	if (r < 0)
 		return r;
 
+	r = sd_bus_add_fallback_vtable(ctx->bus,
+				       NULL,
+				       RATBAGD_OBJ_ROOT "/device",
+				       RATBAGD_NAME_ROOT ".Battery",
+				       ratbagd_battery_vtable,
+				       ratbagd_find_battery,
+				       ctx);
+	if (r < 0)
+		return r;
+
+	r = sd_bus_add_fallback_vtable(ctx->bus,
+				       NULL,
+				       RATBAGD_OBJ_ROOT "/device",
+				       RATBAGD_NAME_ROOT ".Stats",
+				       ratbagd_device_stats_vtable,
+				       ratbagd_find_device,
+				       ctx);
+	if (r < 0)
+		return r;
+
 	r = sd_bus_add_node_enumerator(ctx->bus,
 				       NULL,
 				       RATBAGD_OBJ_ROOT "/device",
@@ -452,11 +1266,18 @@ static int ratbagd_run_enumerate(struct ratbagd *ctx)
 
 		p = udev_list_entry_get_name(iter);
 		udevice = udev_device_new_from_syspath(udev, p);
-		if (udevice)
+		if (!udevice)
+			continue;
+
+		if (ctx->lazy_probe)
 			ratbagd_process_device(ctx, udevice);
+		else
+			ratbagd_probe_add(ctx, udevice);
 		udev_device_unref(udevice);
 	}
 
+	ratbagd_probe_start_next(ctx);
+
 	r = 0;
 
 exit:
@@ -476,6 +1297,16 @@ static int before_idle_cb(sd_event_source *s, void *userdata)
 	struct ratbagd *ctx = userdata;
 	uint64_t usec;
 
+	/* battery polls alone don't keep us running, they would never
+	 * let us go idle */
+	if (ctx->background_activity && !ctx->client_activity) {
+		ctx->background_activity = false;
+		return 0;
+	}
+
+	ctx->background_activity = false;
+	ctx->client_activity = false;
+
 	sd_event_now(sd_event_source_get_event(s), CLOCK_MONOTONIC, &usec);
 #define min2us(us_) (us_ * 1000000 * 60)
 	usec += min2us(20);
@@ -507,8 +1338,9 @@ static int ratbagd_run(struct ratbagd *ctx)
 	sigprocmask(SIG_BLOCK, &sigset, NULL);
 	sd_event_add_signal(ctx->event, NULL, SIGINT, sighandler, NULL);
 
-	/* exit-on-idle: we set up a timer to simply exit. Since we don't
-	 * store anything, it doesn't matter and we can just restart next
+	/* exit-on-idle: we set up a timer to simply exit. Everything is
+	 * committed by then and the drivers keep what is expensive to read
+	 * in their caches (libratbag-cache.h), so we can just restart next
 	 * time someone wants us.
 	 *
 	 * since we don't want to monitor every single dbus call, we just
@@ -614,9 +1446,16 @@ static void remove_ratbagd_devel_dbus_policy(void)
 #endif
 }
 
+/* Sliders in a UI commit many times per second, there is no point in
+ * writing to the device's flash more often than this */
+#define DEFAULT_COMMIT_INTERVAL_MS 200
+
 int main(int argc, char *argv[])
 {
 	struct ratbagd *ctx = NULL;
+	unsigned int commit_interval = DEFAULT_COMMIT_INTERVAL_MS;
+	unsigned int background_probe_delay = 0;
+	bool lazy_probe = false;
 	int r = 0;
 
 #if DISABLE_COREDUMP
@@ -625,18 +1464,28 @@ int main(int argc, char *argv[])
 	setrlimit(RLIMIT_CORE, &corelimit);
 #endif
 
-	if (argc > 1) {
-		if (streq(argv[1], "--version")) {
+	for (int i = 1; i < argc; i++) {
+		const char *value;
+
+		if (streq(argv[i], "--version")) {
 			printf("%s\n", RATBAG_VERSION);
 			return 0;
-		} else if (streq(argv[1], "--quiet")) {
+		} else if (streq(argv[i], "--quiet")) {
 			log_level = LL_QUIET;
-		} else if (streq(argv[1], "--verbose") || streq(argv[1], "--verbose=raw")) {
+		} else if (streq(argv[i], "--verbose") || streq(argv[i], "--verbose=raw")) {
 			log_level = LL_RAW;
-		} else if (streq(argv[1], "--verbose=debug")) {
+		} else if (streq(argv[i], "--verbose=debug")) {
 			log_level = LL_VERBOSE;
+		} else if ((value = startswith(argv[i], "--commit-interval=")) &&
+			   safe_atou(value, &commit_interval) == 0) {
+			/* commit_interval is set */
+		} else if (streq(argv[i], "--lazy-probe")) {
+			lazy_probe = true;
+		} else if ((value = startswith(argv[i], "--lazy-probe=")) &&
+			   safe_atou(value, &background_probe_delay) == 0) {
+			lazy_probe = true;
 		} else {
-			fprintf(stderr, "Usage: %s [--version | --quiet | --verbose[=debug]]\n",
+			fprintf(stderr, "Usage: %s [--version | --quiet | --verbose[=debug]] [--commit-interval=<ms>] [--lazy-probe[=<s>]]\n",
 				program_invocation_short_name);
 			r = -EINVAL;
 			goto exit;
@@ -650,6 +1499,10 @@ int main(int argc, char *argv[])
 	if (r < 0)
 		goto exit;
 
+	ctx->commit_interval = (uint64_t)commit_interval * 1000;
+	ctx->lazy_probe = lazy_probe;
+	ctx->background_probe_delay = (uint64_t)background_probe_delay * 1000000;
+
 	ratbagd_init_test_device(ctx);
 
 	r = ratbagd_run(ctx);
@@ -702,3 +1555,101 @@ void ratbagd_schedule_task(struct ratbagd *ctx,
 
 	sd_event_add_defer(ctx->event, &source, ratbagd_callback_handler, cb);
 }
+
+struct ratbagd_job {
+	ratbagd_callback_t work;
+	ratbagd_callback_t done;
+	void *userdata;
+
+	pthread_t thread;
+	int eventfd;
+	sd_event_source *source;
+};
+
+static void ratbagd_job_free(struct ratbagd_job *job)
+{
+	job->source = sd_event_source_unref(job->source);
+	safe_close(job->eventfd);
+	free(job);
+}
+
+static void ratbagd_job_complete(struct ratbagd_job *job)
+{
+	pthread_join(job->thread, NULL);
+	job->done(job->userdata);
+	ratbagd_job_free(job);
+}
+
+static void *ratbagd_job_thread(void *data)
+{
+	struct ratbagd_job *job = data;
+	uint64_t one = 1;
+
+	job->work(job->userdata);
+
+	/* wake up the main loop, it joins us from there */
+	if (write(job->eventfd, &one, sizeof(one)) != sizeof(one))
+		log_error("Failed to signal job completion: %m\n");
+
+	return NULL;
+}
+
+static int ratbagd_job_event(sd_event_source *source,
+			     int fd,
+			     uint32_t mask,
+			     void *userdata)
+{
+	ratbagd_job_complete(userdata);
+
+	return 0;
+}
+
+int ratbagd_job_start(struct ratbagd *ctx,
+		      struct ratbagd_job **out,
+		      ratbagd_callback_t work,
+		      ratbagd_callback_t done,
+		      void *userdata)
+{
+	struct ratbagd_job *job = zalloc(sizeof(*job));
+	int r;
+
+	job->work = work;
+	job->done = done;
+	job->userdata = userdata;
+
+	job->eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (job->eventfd < 0) {
+		r = -errno;
+		free(job);
+		return r;
+	}
+
+	r = sd_event_add_io(ctx->event,
+			    &job->source,
+			    job->eventfd,
+			    EPOLLIN,
+			    ratbagd_job_event,
+			    job);
+	if (r < 0)
+		goto err;
+
+	r = -pthread_create(&job->thread, NULL, ratbagd_job_thread, job);
+	if (r < 0)
+		goto err;
+
+	*out = job;
+	return 0;
+
+err:
+	ratbagd_job_free(job);
+	return r;
+}
+
+/**
+ * Block until the job's work is finished and run its done callback. The
+ * job is freed afterwards.
+ */
+void ratbagd_job_wait(struct ratbagd_job *job)
+{
+	ratbagd_job_complete(job);
+}
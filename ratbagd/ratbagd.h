@@ -48,11 +48,13 @@
 #define RATBAGD_NAME_ROOT "org.freedesktop." RATBAG_DBUS_INTERFACE
 
 struct ratbagd;
+struct ratbagd_probe;
 struct ratbagd_device;
 struct ratbagd_profile;
 struct ratbagd_resolution;
 struct ratbagd_button;
 struct ratbagd_led;
+struct ratbagd_battery;
 
 void log_info(const char *fmt, ...) _printf_(1, 2);
 void log_verbose(const char *fmt, ...) _printf_(1, 2);
@@ -91,6 +93,10 @@ int ratbagd_profile_register_buttons(struct sd_bus *bus,
 int ratbagd_profile_register_leds(struct sd_bus *bus,
 				  struct ratbagd_device *device,
 				  struct ratbagd_profile *profile);
+void ratbagd_profile_emit_objects_added(struct sd_bus *bus,
+					struct ratbagd_profile *profile);
+void ratbagd_profile_emit_objects_removed(struct sd_bus *bus,
+					  struct ratbagd_profile *profile);
 
 int ratbagd_for_each_profile_signal(sd_bus *bus,
 				    struct ratbagd_device *device,
@@ -108,7 +114,7 @@ int ratbagd_for_each_led_signal(sd_bus *bus,
 				struct ratbagd_profile *profile,
 				int (*func)(sd_bus *bus,
 					    struct ratbagd_led *led));
-int ratbagd_profile_resync(sd_bus *bus, struct ratbagd_profile *profile);
+int ratbagd_profile_flush(sd_bus *bus, struct ratbagd_profile *profile);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_profile *, ratbagd_profile_free);
 
@@ -124,7 +130,7 @@ int ratbagd_resolution_new(struct ratbagd_resolution **out,
 			   unsigned int index);
 struct ratbagd_resolution *ratbagd_resolution_free(struct ratbagd_resolution *resolution);
 const char *ratbagd_resolution_get_path(struct ratbagd_resolution *resolution);
-int ratbagd_resolution_resync(sd_bus *bus, struct ratbagd_resolution *resolution);
+int ratbagd_resolution_flush(sd_bus *bus, struct ratbagd_resolution *resolution);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_resolution *, ratbagd_resolution_free);
 
@@ -140,7 +146,8 @@ int ratbagd_button_new(struct ratbagd_button **out,
 		       unsigned int index);
 struct ratbagd_button *ratbagd_button_free(struct ratbagd_button *button);
 const char *ratbagd_button_get_path(struct ratbagd_button *button);
-int ratbagd_button_resync(sd_bus *bus, struct ratbagd_button *button);
+int ratbagd_button_flush(sd_bus *bus, struct ratbagd_button *button);
+bool ratbagd_button_is_valid_button(unsigned int map);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_button *, ratbagd_button_free);
 
@@ -156,15 +163,52 @@ int ratbagd_led_new(struct ratbagd_led **out,
 		    unsigned int index);
 struct ratbagd_led *ratbagd_led_free(struct ratbagd_led *led);
 const char *ratbagd_led_get_path(struct ratbagd_led *led);
-int ratbagd_led_resync(sd_bus *bus, struct ratbagd_led *led);
+int ratbagd_led_flush(sd_bus *bus, struct ratbagd_led *led);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_led *, ratbagd_led_free);
 
+/*
+ * Configurations, see Device.ApplyConfiguration()
+ */
+
+struct ratbagd_config;
+
+struct ratbagd_config *ratbagd_config_new(struct ratbag_device *lib_device);
+struct ratbagd_config *ratbagd_config_snapshot(struct ratbag_device *lib_device);
+struct ratbagd_config *ratbagd_config_free(struct ratbagd_config *config);
+int ratbagd_config_read(struct ratbagd_config *config, sd_bus_message *m);
+bool ratbagd_config_validate(struct ratbagd_config *config);
+int ratbagd_config_apply(struct ratbagd_config *config);
+int ratbagd_config_restore(struct ratbagd_config *snapshot);
+int ratbagd_config_append_errors(struct ratbagd_config *config,
+				 sd_bus_message *reply);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_config *, ratbagd_config_free);
+
+/*
+ * Battery
+ */
+
+extern const sd_bus_vtable ratbagd_battery_vtable[];
+
+int ratbagd_battery_new(struct ratbagd_battery **out,
+			struct ratbagd *ctx,
+			struct ratbagd_device *device,
+			struct ratbag_device *lib_device);
+struct ratbagd_battery *ratbagd_battery_free(struct ratbagd_battery *battery);
+int ratbagd_battery_flush(sd_bus *bus, struct ratbagd_battery *battery);
+void ratbagd_battery_start(struct ratbagd_battery *battery);
+void ratbagd_battery_stop(struct ratbagd_battery *battery);
+void ratbagd_battery_wait_idle(struct ratbagd_battery *battery);
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_battery *, ratbagd_battery_free);
+
 /*
  * Devices
  */
 
 extern const sd_bus_vtable ratbagd_device_vtable[];
+extern const sd_bus_vtable ratbagd_device_stats_vtable[];
 
 int ratbagd_device_new(struct ratbagd_device **out,
 		       struct ratbagd *ctx,
@@ -176,16 +220,31 @@ const char *ratbagd_device_get_sysname(struct ratbagd_device *device);
 const char *ratbagd_device_get_path(struct ratbagd_device *device);
 unsigned int ratbagd_device_get_num_buttons(struct ratbagd_device *device);
 unsigned int ratbagd_device_get_num_leds(struct ratbagd_device *device);
+struct ratbagd_battery *ratbagd_device_get_battery(struct ratbagd_device *device);
 int ratbagd_device_resync(struct ratbagd_device *device, sd_bus *bus);
+void ratbagd_device_schedule_flush(struct ratbagd_device *device);
+uint32_t ratbagd_device_request_commit(struct ratbagd_device *device);
+void ratbagd_device_preview_done(struct ratbagd_device *device,
+				 enum ratbag_error_code r);
+bool ratbagd_device_previewing(struct ratbagd_device *device);
 
 bool ratbagd_device_linked(struct ratbagd_device *device);
 void ratbagd_device_link(struct ratbagd_device *device);
 void ratbagd_device_unlink(struct ratbagd_device *device);
 
+bool ratbagd_device_busy(struct ratbagd_device *device);
+void ratbagd_device_wait_idle(struct ratbagd_device *device);
+
+bool ratbagd_device_probed(struct ratbagd_device *device);
+bool ratbagd_device_probing(struct ratbagd_device *device);
+void ratbagd_device_start_probe(struct ratbagd_device *device);
+
 DEFINE_TRIVIAL_CLEANUP_FUNC(struct ratbagd_device *, ratbagd_device_unref);
 
 struct ratbagd_device *ratbagd_device_lookup(struct ratbagd *ctx,
 					     const char *name);
+struct ratbagd_device *ratbagd_device_lookup_by_path(struct ratbagd *ctx,
+						     const char *path);
 struct ratbagd_device *ratbagd_device_first(struct ratbagd *ctx);
 struct ratbagd_device *ratbagd_device_next(struct ratbagd_device *device);
 
@@ -217,6 +276,11 @@ struct ratbagd_device *ratbagd_device_next(struct ratbagd_device *device);
  * Context
  */
 
+struct ratbagd_message_queue {
+	sd_bus_message **messages;
+	size_t n_messages;
+};
+
 struct ratbagd {
 	int api_version;
 
@@ -225,19 +289,73 @@ struct ratbagd {
 	struct udev_monitor *monitor;
 	sd_event_source *timeout_source;
 	sd_event_source *monitor_source;
+	sd_event_source *lib_source;
 	sd_bus *bus;
 
 	RBTree device_map;
 	size_t n_devices;
 
+	/* method calls held back until a device job is done, see
+	 * ratbagd_bus_filter() */
+	struct ratbagd_message_queue deferred;
+	/* deferred calls put back into the bus' read queue that the filter
+	 * hasn't seen again yet, and the calls that arrived meanwhile. See
+	 * ratbagd_release_deferred() */
+	struct ratbagd_message_queue released;
+	struct ratbagd_message_queue held;
+	bool release_pending;
+
+	/* startup probes, see ratbagd_run_enumerate() */
+	struct ratbagd_probe *probes;
+	unsigned int n_probe_jobs;
+
+	/* devices are only probed once a client needs them, or in the
+	 * background after the delay (in us, 0 for never), see
+	 * ratbagd_bus_filter() */
+	bool lazy_probe;
+	uint64_t background_probe_delay;
+	sd_event_source *background_probe_source;
+	/* the delay is over, probe one device after the other */
+	bool background_probe_active;
+
 	const char **themes; /* NULL-terminated */
+
+	/* minimum time between two commits to a device, in us */
+	uint64_t commit_interval;
+
+	/* what happened since we last pushed back the exit-on-idle
+	 * timeout, see before_idle_cb() */
+	bool client_activity;
+	bool background_activity;
 };
 
+char *ratbagd_get_device_group(struct ratbagd *ctx, const char *sysname);
+void ratbagd_release_deferred(struct ratbagd *ctx);
+void ratbagd_probe_finished(struct ratbagd *ctx,
+			    struct ratbagd_device *device,
+			    bool success);
+
 typedef void (*ratbagd_callback_t)(void *userdata);
 
 void ratbagd_schedule_task(struct ratbagd *ctx,
 			   ratbagd_callback_t callback,
 			   void *userdata);
 
-int ratbagd_profile_notify_dirty(sd_bus *bus,
-				 struct ratbagd_profile *profile);
+/*
+ * Jobs
+ *
+ * A job runs its work callback on a separate thread and then its done
+ * callback on the main loop. The work callback must not touch anything
+ * but the libratbag device it operates on, everything else (D-Bus,
+ * ratbagd objects) belongs to the main loop.
+ */
+
+struct ratbagd_job;
+
+int ratbagd_job_start(struct ratbagd *ctx,
+		      struct ratbagd_job **out,
+		      ratbagd_callback_t work,
+		      ratbagd_callback_t done,
+		      void *userdata);
+void ratbagd_job_wait(struct ratbagd_job *job);
+
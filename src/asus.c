@@ -28,6 +28,7 @@
 #include <assert.h>
 
 #include "libratbag-data.h"
+#include "libratbag-keymap.h"
 #include "libratbag-private.h"
 
 /* ASUS commands */
@@ -46,35 +47,6 @@
 #define ASUS_FIELD_RESPONSE	1
 #define ASUS_FIELD_SNAPPING	2
 
-/* key mapping, the index is actual ASUS code */
-static const unsigned char ASUS_KEY_MAPPING[] = {
-/* 00 */	0,		0,		0,		0,
-/* 04 */	KEY_A,		KEY_B,		KEY_C,		KEY_D,
-/* 08 */	KEY_E,		KEY_F,		KEY_G,		KEY_H,
-/* 0C */	KEY_I,		KEY_J,		KEY_K,		KEY_L,
-/* 0E */	KEY_M,		KEY_N,		KEY_O,		KEY_P,
-/* 14 */	KEY_Q,		KEY_R,		KEY_S,		KEY_T,
-/* 18 */	KEY_U,		KEY_V,		KEY_W,		KEY_X,
-/* 1C */	KEY_Y,		KEY_Z,		KEY_1,		KEY_2,
-/* 1E */	KEY_3,		KEY_4,		KEY_5,		KEY_6,
-/* 24 */	KEY_7,		KEY_8,		KEY_9,		KEY_0,
-/* 28 */	KEY_ENTER,	KEY_ESC,	KEY_BACKSPACE,	KEY_TAB,
-/* 2C */	KEY_SPACE,	KEY_MINUS,	KEY_KPPLUS,	0,
-/* 2E */	0,		0,		0,		0,
-/* 34 */	0,		KEY_GRAVE,	KEY_EQUAL,	0,
-/* 38 */	KEY_SLASH,	0,		KEY_F1,		KEY_F2,
-/* 3C */	KEY_F3,		KEY_F4,		KEY_F5,		KEY_F6,
-/* 3E */	KEY_F7,		KEY_F8,		KEY_F9,		KEY_F10,
-/* 44 */	KEY_F11,	KEY_F12,	0,		0,
-/* 48 */	0,		0,		KEY_HOME,	KEY_PAGEUP,
-/* 4C */	KEY_DELETE,	0,		KEY_PAGEDOWN,	KEY_RIGHT,
-/* 4E */	KEY_LEFT,	KEY_DOWN,	KEY_UP,		0,
-/* 54 */	0,		0,		0,		0,
-/* 58 */	0,		KEY_KP1,	KEY_KP2,	KEY_KP3,
-/* 5C */	KEY_KP4,	KEY_KP5,	KEY_KP6,	KEY_KP7,
-/* 5E */	KEY_KP8,	KEY_KP9,	0,
-};
-
 static unsigned int ASUS_POLLING_RATES[] = { 125, 250, 500, 1000 };
 static unsigned int ASUS_DEBOUNCE_TIMES[] = { 4, 8, 12, 16, 20, 24, 28, 32 };
 
@@ -106,19 +78,18 @@ asus_find_button_by_code(uint8_t asus_code)
 int
 asus_find_key_code(unsigned int linux_code)
 {
-	for (unsigned int i = 0; i < ARRAY_LENGTH(ASUS_KEY_MAPPING); i++) {
-		if (ASUS_KEY_MAPPING[i] == linux_code)
-			return i;
-	}
-	return -1;
+	if (linux_code >= KEY_CNT || ratbag_keymap_asus_usages[linux_code] == 0)
+		return -1;
+
+	return ratbag_keymap_asus_usages[linux_code];
 }
 
 int
 asus_get_linux_key_code(uint8_t asus_code) {
-	if (asus_code > ARRAY_LENGTH(ASUS_KEY_MAPPING)) {
+	if (asus_code >= RATBAG_KEYMAP_ASUS_USAGE_COUNT) {
 		return -1;
 	}
-	return ASUS_KEY_MAPPING[asus_code];
+	return ratbag_keymap_asus_keycodes[asus_code];
 }
 
 int
@@ -50,6 +50,10 @@
 #define ETEKCITY_REPORT_SIZE_SPEED_SETTING	6
 #define ETEKCITY_REPORT_SIZE_MACRO		130
 
+/* time the device needs after a request before it takes the next one */
+#define ETEKCITY_SETTLE_MS			10
+#define ETEKCITY_SETTLE_CONFIG_MS		100
+
 #define ETEKCITY_CONFIG_SETTINGS		0x10
 #define ETEKCITY_CONFIG_KEY_MAPPING		0x20
 
@@ -249,7 +253,7 @@ etekcity_set_current_profile(struct ratbag_device *device, unsigned int index)
 	ret = ratbag_hidraw_raw_request(device, buf[0], buf, sizeof(buf),
 			HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
 
-	msleep(100);
+	ratbag_hidraw_settle(device, ETEKCITY_SETTLE_CONFIG_MS);
 
 	return ret == sizeof(buf) ? 0 : ret;
 }
@@ -266,7 +270,7 @@ etekcity_set_config_profile(struct ratbag_device *device, uint8_t profile, uint8
 	ret = ratbag_hidraw_raw_request(device, buf[0], buf, sizeof(buf),
 				 HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
 
-	msleep(100);
+	ratbag_hidraw_settle(device, ETEKCITY_SETTLE_CONFIG_MS);
 
 	return ret == sizeof(buf) ? 0 : ret;
 }
@@ -312,7 +316,7 @@ etekcity_write_profile(struct ratbag_profile *profile)
 			buf, ETEKCITY_REPORT_SIZE_PROFILE,
 			HID_FEATURE_REPORT, HID_REQ_SET_REPORT);
 
-	msleep(100);
+	ratbag_hidraw_settle(device, ETEKCITY_SETTLE_CONFIG_MS);
 
 	if (rc < ETEKCITY_REPORT_SIZE_PROFILE)
 		return -EIO;
@@ -382,7 +386,7 @@ etekcity_read_button(struct ratbag_button *button)
 			ratbag_button_copy_macro(button, m);
 			ratbag_button_macro_unref(m);
 		}
-		msleep(10);
+		ratbag_hidraw_settle(device, ETEKCITY_SETTLE_MS);
 	}
 }
 
@@ -453,7 +457,7 @@ etekcity_read_profile(struct ratbag_profile *profile)
 			buf, ETEKCITY_REPORT_SIZE_PROFILE,
 			HID_FEATURE_REPORT, HID_REQ_GET_REPORT);
 
-	msleep(10);
+	ratbag_hidraw_settle(device, ETEKCITY_SETTLE_MS);
 
 	if (rc < ETEKCITY_REPORT_SIZE_PROFILE)
 		return;
@@ -640,7 +644,7 @@ etekcity_probe(struct ratbag_device *device)
 		goto err;
 	}
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (profile->index == (unsigned int)active_idx) {
 			profile->is_active = true;
 			break;
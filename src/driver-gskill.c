@@ -49,6 +49,9 @@
 #define GSKILL_REPORT_SIZE_CMD        9
 #define GSKILL_REPORT_SIZE_MACRO   2052
 
+#define GSKILL_READY_MIN_DELAY_US 10000
+#define GSKILL_READY_TIMEOUT_MS     500
+
 #define GSKILL_CHECKSUM_OFFSET 3
 
 /* Command status codes */
@@ -355,11 +358,55 @@ gskill_calculate_checksum(const uint8_t *buf, size_t len)
 	return checksum;
 }
 
+static int
+gskill_check_cmd_status(struct ratbag_device *device, void *userdata)
+{
+	uint8_t *buf = userdata;
+	int rc;
+
+	rc = ratbag_hidraw_raw_request(device, 0, buf,
+				       GSKILL_REPORT_SIZE_CMD,
+				       HID_FEATURE_REPORT,
+				       HID_REQ_GET_REPORT);
+	/*
+	 * Sometimes the mouse just doesn't send anything when it wants
+	 * to tell us it's ready. In this case rc will be 0 and this
+	 * function will succeed.
+	 */
+	if (rc < GSKILL_REPORT_SIZE_CMD)
+		return rc;
+
+	/* Check the command status bit */
+	switch (buf[1]) {
+	case 0: /* sometimes the mouse gets lazy and just returns a
+		   blank buffer on success */
+	case GSKILL_CMD_SUCCESS:
+		return 0;
+
+	case GSKILL_CMD_IN_PROGRESS:
+		return -EAGAIN;
+
+	case GSKILL_CMD_IDLE:
+		log_error(device->ratbag,
+			  "Command response indicates idle status? Uh huh.\n");
+		return -EPROTO;
+
+	case GSKILL_CMD_FAILURE:
+		log_error(device->ratbag, "Command failed\n");
+		return -EIO;
+
+	default:
+		log_error(device->ratbag,
+			  "Received unknown command status from mouse: 0x%x\n",
+			  buf[1]);
+		return -EPROTO;
+	}
+}
+
 static int
 gskill_general_cmd(struct ratbag_device *device,
 		   uint8_t buf[GSKILL_REPORT_SIZE_CMD]) {
 	int rc;
-	int retries;
 
 	assert(buf[0] == GSKILL_GENERAL_CMD);
 
@@ -372,64 +419,19 @@ gskill_general_cmd(struct ratbag_device *device,
 		return rc < 0 ? rc : -EPROTO;
 	}
 
-	rc = -EAGAIN;
-	for (retries = 0; retries < 10 && rc == -EAGAIN; retries++) {
-		/*
-		 * Wait for the device to be ready
-		 * Spec says this should be 10ms, but 20ms seems to get the
-		 * mouse to return slightly less nonsense responses
-		 */
-		msleep(20);
-
-		rc = ratbag_hidraw_raw_request(device, 0, buf,
-					       GSKILL_REPORT_SIZE_CMD,
-					       HID_FEATURE_REPORT,
-					       HID_REQ_GET_REPORT);
-		/*
-		 * Sometimes the mouse just doesn't send anything when it wants
-		 * to tell us it's ready. In this case rc will be 0 and this
-		 * function will succeed.
-		 */
-		if (rc < GSKILL_REPORT_SIZE_CMD)
-			break;
-
-		/* Check the command status bit */
-		switch (buf[1]) {
-		case 0: /* sometimes the mouse gets lazy and just returns a
-			   blank buffer on success */
-		case GSKILL_CMD_SUCCESS:
-			rc = 0;
-			break;
-
-		case GSKILL_CMD_IN_PROGRESS:
-			rc = -EAGAIN;
-			continue;
-
-		case GSKILL_CMD_IDLE:
-			log_error(device->ratbag,
-				  "Command response indicates idle status? Uh huh.\n");
-			rc = -EPROTO;
-			break;
-
-		case GSKILL_CMD_FAILURE:
-			log_error(device->ratbag, "Command failed\n");
-			rc = -EIO;
-			break;
-
-		default:
-			log_error(device->ratbag,
-				  "Received unknown command status from mouse: 0x%x\n",
-				  buf[1]);
-			rc = -EPROTO;
-			break;
-		}
-	}
-
-	if (rc == -EAGAIN) {
+	/*
+	 * Spec says the device needs 10ms to be ready, reading the status
+	 * any earlier may get nonsense responses. Once the mouse turned out
+	 * to be faster, we check a little earlier and only believe a
+	 * success status until the 10ms are up
+	 */
+	rc = ratbag_hidraw_poll_ready(device, GSKILL_READY_MIN_DELAY_US,
+				      GSKILL_READY_TIMEOUT_MS,
+				      gskill_check_cmd_status, buf);
+	if (rc == -ETIMEDOUT) {
 		log_error(device->ratbag,
-			  "Failed to get command response from mouse after %d tries, giving up\n",
-			  retries);
-		rc = -ETIMEDOUT;
+			  "Failed to get command response from mouse after %dms, giving up\n",
+			  GSKILL_READY_TIMEOUT_MS);
 	} else if (rc) {
 		log_error(device->ratbag,
 			  "Failed to perform command on mouse: %d\n",
@@ -649,7 +651,7 @@ gskill_mouse_button_macro_code_to_keycode(uint8_t code)
 
 static uint8_t
 gskill_macro_code_from_event(struct ratbag_device *device,
-			     struct ratbag_macro_event *event)
+			     const struct ratbag_macro_event *event)
 {
 	uint8_t macro_code;
 
@@ -788,21 +790,16 @@ gskill_macro_from_report(struct ratbag_device *device,
 	return macro;
 }
 
-/* FIXME: the macro struct here should be a const, but it looks like there's a
- * couple of functions in ratbag that need to have a const qualifier added to
- * their function declarations
- */
 static struct gskill_macro_report *
 gskill_macro_to_report(struct ratbag_device *device,
-		       struct ratbag_button_macro *macro,
+		       const struct ratbag_macro *macro,
 		       unsigned int profile, unsigned int button)
 {
 	struct gskill_data *drv_data = ratbag_get_drv_data(device);
 	struct gskill_macro_report *report =
 		&drv_data->profile_data[profile].macros[button];
 	struct gskill_macro_delay *delay;
-	unsigned int event_num = ratbag_button_macro_get_num_events(macro);
-	struct ratbag_macro_event *event;
+	const struct ratbag_macro_event *event;
 	uint8_t *buf = report->macro_content;
 	int profile_pos, increment, event_idx;
 	ssize_t ret;
@@ -813,7 +810,7 @@ gskill_macro_to_report(struct ratbag_device *device,
 	 * G.Skill's configuration software will cry if we don't have a name,
 	 * so make sure we assign one
 	 */
-	if (!macro->macro.name || macro->macro.name[0] == '\0') {
+	if (!macro->name || macro->name[0] == '\0') {
 		ret = ratbag_utf8_to_enc(report->macro_name,
 					 sizeof(report->macro_name), "UTF-16LE",
 					 "Ratbag macro for profile %d button %d",
@@ -821,7 +818,7 @@ gskill_macro_to_report(struct ratbag_device *device,
 	} else {
 		ret = ratbag_utf8_to_enc(report->macro_name,
 					 sizeof(report->macro_name), "UTF-16LE",
-					 "%s", macro->macro.name);
+					 "%s", macro->name);
 	}
 
 	if (ret < 0)
@@ -834,9 +831,9 @@ gskill_macro_to_report(struct ratbag_device *device,
 	report->please_set_me_to_1_thank_you = 1; /* No prob! Happy to help :) */
 
 	for (profile_pos = 0, increment = 1, event_idx = 0;
-	     event_idx < (signed)event_num;
+	     event_idx < (signed)macro->nevents;
 	     event_idx++, profile_pos += increment, increment = 1) {
-		event = &macro->macro.events[event_idx];
+		event = &macro->events[event_idx];
 
 		switch (event->type) {
 		case RATBAG_MACRO_EVENT_WAIT:
@@ -1249,12 +1246,10 @@ gskill_update_button(struct ratbag_button *button)
 	struct ratbag_profile *profile = button->profile;
 	struct ratbag_device *device = profile->device;
 	struct ratbag_button_action *action = &button->action;
-	struct ratbag_button_macro *macro = NULL;
 	struct gskill_profile_data *pdata = profile_to_pdata(profile);
 	struct gskill_button_cfg *bcfg = &pdata->report.btn_cfgs[button->index];
 	uint16_t code = 0;
 
-	macro = container_of(action->macro, macro, macro);
 	memset(&bcfg->params, 0, sizeof(bcfg->params));
 
 	switch (action->type) {
@@ -1323,7 +1318,7 @@ gskill_update_button(struct ratbag_button *button)
 	case RATBAG_BUTTON_ACTION_TYPE_MACRO:
 		bcfg->type = GSKILL_BUTTON_FUNCTION_MACRO;
 		gskill_write_button_macro(
-		    device, gskill_macro_to_report(device, macro,
+		    device, gskill_macro_to_report(device, action->macro,
 						   profile->index,
 						   button->index));
 
@@ -1349,7 +1344,7 @@ gskill_update_profile(struct ratbag_profile *profile)
 
 	gskill_update_resolutions(profile);
 
-	list_for_each(button, &profile->buttons, link) {
+	ratbag_profile_for_each_button(profile, button) {
 		if (!button->dirty)
 			continue;
 
@@ -1469,7 +1464,7 @@ gskill_commit(struct ratbag_device *device)
 		drv_data->profile_count = profile_count;
 	}
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->is_enabled || !profile->dirty)
 			continue;
 
@@ -51,6 +51,8 @@
 
 struct hidpp10drv_data {
 	struct hidpp10_device *dev;
+	/* the device answers 0x0D, otherwise we read 0x07 */
+	bool battery_mileage;
 };
 
 static unsigned int
@@ -499,7 +501,7 @@ hidpp10drv_commit(struct ratbag_device *device)
 	struct hidpp10_profile p;
 	int rc;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
@@ -519,7 +521,7 @@ hidpp10drv_commit(struct ratbag_device *device)
 				active_resolution = resolution;
 		}
 
-		list_for_each(button, &profile->buttons, link) {
+		ratbag_profile_for_each_button(profile, button) {
 			struct ratbag_button_action action = button->action;
 
 			if (!button->dirty)
@@ -560,6 +562,82 @@ hidpp10drv_commit(struct ratbag_device *device)
 	return RATBAG_SUCCESS;
 }
 
+static enum ratbag_battery_state
+hidpp10drv_battery_state(enum hidpp10_battery_charge_state state)
+{
+	switch (state) {
+	case HIDPP10_BATTERY_CHARGE_STATE_UNKNOWN:
+	case HIDPP10_BATTERY_CHARGE_STATE_CHARGING_ERROR:
+		return RATBAG_BATTERY_STATE_UNKNOWN;
+	case HIDPP10_BATTERY_CHARGE_STATE_CHARGING:
+	case HIDPP10_BATTERY_CHARGE_STATE_CHARGING_FAST:
+	case HIDPP10_BATTERY_CHARGE_STATE_CHARGING_SLOW:
+	case HIDPP10_BATTERY_CHARGE_STATE_TOPPING_CHARGE:
+		return RATBAG_BATTERY_STATE_CHARGING;
+	case HIDPP10_BATTERY_CHARGE_STATE_CHARGING_COMPLETE:
+		return RATBAG_BATTERY_STATE_FULL;
+	default:
+		/* 0x01..0x1f are reserved but not charging */
+		if (state < HIDPP10_BATTERY_CHARGE_STATE_UNKNOWN)
+			return RATBAG_BATTERY_STATE_DISCHARGING;
+		return RATBAG_BATTERY_STATE_UNKNOWN;
+	}
+}
+
+static int
+hidpp10drv_read_battery(struct ratbag_device *device)
+{
+	struct hidpp10drv_data *drv_data = ratbag_get_drv_data(device);
+	enum hidpp10_battery_charge_state state;
+	int rc;
+
+	if (drv_data->battery_mileage) {
+		uint8_t level;
+		uint32_t max_seconds;
+
+		rc = hidpp10_get_battery_mileage(drv_data->dev, &level,
+						 &max_seconds, &state);
+		if (rc)
+			return rc;
+
+		device->battery.level = min(level, 100);
+	} else {
+		enum hidpp10_battery_level level;
+		uint8_t low_threshold;
+
+		rc = hidpp10_get_battery_status(drv_data->dev, &level,
+						&state, &low_threshold);
+		if (rc)
+			return rc;
+
+		/* 0x07 only has coarse levels, use what the kernel uses */
+		switch (level) {
+		case HIDPP10_BATTERY_LEVEL_CRITICAL:
+		case HIDPP10_BATTERY_LEVEL_CRITICAL_LEGACY:
+			device->battery.level = 5;
+			break;
+		case HIDPP10_BATTERY_LEVEL_LOW:
+		case HIDPP10_BATTERY_LEVEL_LOW_LEGACY:
+			device->battery.level = 20;
+			break;
+		case HIDPP10_BATTERY_LEVEL_GOOD:
+		case HIDPP10_BATTERY_LEVEL_GOOD_LEGACY:
+			device->battery.level = 50;
+			break;
+		case HIDPP10_BATTERY_LEVEL_FULL_LEGACY:
+			device->battery.level = 90;
+			break;
+		default:
+			device->battery.level = -1;
+			break;
+		}
+	}
+
+	device->battery.state = hidpp10drv_battery_state(state);
+
+	return 0;
+}
+
 static int
 hidpp10drv_probe(struct ratbag_device *device)
 {
@@ -578,7 +656,10 @@ hidpp10drv_probe(struct ratbag_device *device)
 
 	drv_data = zalloc(sizeof(*drv_data));
 	hidpp_device_init(&base, device->hidraw[0].fd);
-	hidpp_device_set_log_handler(&base, hidpp10_log, HIDPP_LOG_PRIORITY_RAW, device);
+	hidpp_device_set_stats(&base, &device->stats);
+	hidpp_device_set_log_handler(&base, hidpp10_log,
+				     (enum hidpp_log_priority)ratbag_log_get_priority(device->ratbag),
+				     device);
 
 	typestr = ratbag_device_data_hidpp10_get_profile_type(device->data);
 	if (typestr) {
@@ -684,6 +765,20 @@ hidpp10drv_probe(struct ratbag_device *device)
 		}
 	}
 
+	/* Wired devices answer neither battery register. We don't enable
+	 * the battery notifications, they are the receiver's to enable. */
+	drv_data->battery_mileage = true;
+	rc = hidpp10drv_read_battery(device);
+	if (rc) {
+		drv_data->battery_mileage = false;
+		rc = hidpp10drv_read_battery(device);
+	}
+	if (rc == 0) {
+		log_debug(device->ratbag, "%s: battery level is %d%%\n",
+			  device->name, device->battery.level);
+		device->battery.present = true;
+	}
+
 	return 0;
 err:
 	free(drv_data);
@@ -717,4 +812,5 @@ struct ratbag_driver hidpp10_driver = {
 	.remove = hidpp10drv_remove,
 	.set_active_profile = hidpp10drv_set_current_profile,
 	.commit = hidpp10drv_commit,
+	.read_battery = hidpp10drv_read_battery,
 };
@@ -44,6 +44,7 @@
 #include "hidpp20.h"
 
 #include "libratbag-private.h"
+#include "libratbag-cache.h"
 #include "libratbag-hidraw.h"
 #include "libratbag-data.h"
 
@@ -79,6 +80,10 @@ struct hidpp20drv_data {
 	unsigned int num_resolutions;
 	unsigned int num_buttons;
 	unsigned int num_leds;
+
+	struct ratbag_cache *cache;
+	/* the onboard profile sectors, for the next probe of the device */
+	struct ratbag_cache *snapshot;
 };
 
 static void
@@ -617,41 +622,53 @@ hidpp20drv_update_button(struct ratbag_button *button)
 }
 
 static int
-hidpp20drv_update_led_1300(struct ratbag_led *led, struct hidpp20drv_data *data)
+hidpp20drv_led_to_1300(struct ratbag_led *led, struct hidpp20drv_data *data,
+		       struct hidpp20_led_sw_ctrl_led_state *h_led)
 {
 	const uint16_t led_caps = data->led_infos.leds[led->index].caps;
-	struct hidpp20_led_sw_ctrl_led_state h_led;
-	int rc;
 
-	h_led.index = led->index;
+	h_led->index = led->index;
 
 	switch(led->mode)
 	{
 	case RATBAG_LED_BREATHING:
-		h_led.mode = HIDPP20_LED_MODE_BREATHING;
-		h_led.breathing.brightness = led->brightness;
-		h_led.breathing.period = led->ms;
-		h_led.breathing.timeout = 300;
+		h_led->mode = HIDPP20_LED_MODE_BREATHING;
+		h_led->breathing.brightness = led->brightness;
+		h_led->breathing.period = led->ms;
+		h_led->breathing.timeout = 300;
 		break;
 	case RATBAG_LED_OFF:
-		h_led.mode = HIDPP20_LED_MODE_OFF;
-		h_led.on.index = HIDPP20_LED_SW_CONTROL_LED_INDEX_ALL;
+		h_led->mode = HIDPP20_LED_MODE_OFF;
+		h_led->on.index = HIDPP20_LED_SW_CONTROL_LED_INDEX_ALL;
 		break;
 	case RATBAG_LED_ON:
-		h_led.mode = HIDPP20_LED_MODE_ON;
-		h_led.on.index = HIDPP20_LED_SW_CONTROL_LED_INDEX_ALL;
+		h_led->mode = HIDPP20_LED_MODE_ON;
+		h_led->on.index = HIDPP20_LED_SW_CONTROL_LED_INDEX_ALL;
 		break;
 	case RATBAG_LED_CYCLE:
 		return -ENOTSUP;
 	}
 
-	if (!(h_led.mode & led_caps)) {
+	if (!(h_led->mode & led_caps)) {
 		hidpp_log_error(&data->dev->base, "LED %d does not support effect %s(%04x), supports %04x\n",
-						led->index, hidpp20_sw_led_control_get_mode_string(h_led.mode),
-						h_led.mode, led_caps);
+						led->index, hidpp20_sw_led_control_get_mode_string(h_led->mode),
+						h_led->mode, led_caps);
 		return -ENOTSUP;
 	}
 
+	return 0;
+}
+
+static int
+hidpp20drv_update_led_1300(struct ratbag_led *led, struct hidpp20drv_data *data)
+{
+	struct hidpp20_led_sw_ctrl_led_state h_led;
+	int rc;
+
+	rc = hidpp20drv_led_to_1300(led, data, &h_led);
+	if (rc)
+		return rc;
+
 	if (!hidpp20_led_sw_control_get_sw_ctrl(data->dev)) {
 		rc = hidpp20_led_sw_control_set_sw_ctrl(data->dev, true);
 		if (rc)
@@ -679,22 +696,9 @@ hidpp20drv_update_led_1300(struct ratbag_led *led, struct hidpp20drv_data *data)
 	return RATBAG_SUCCESS;
 }
 
-static int
-hidpp20drv_update_led_8070_8071(struct ratbag_led *led, struct ratbag_profile* profile,
-				struct hidpp20drv_data *drv_data)
+static void
+hidpp20drv_led_to_hidpp20(struct ratbag_led *led, struct hidpp20_led *h_led)
 {
-	struct hidpp20_profile *h_profile;
-	struct hidpp20_led h_led_val = {0};
-	struct hidpp20_led *h_led = &h_led_val;
-
-	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
-		h_profile = &drv_data->profiles->profiles[profile->index];
-		h_led = &(h_profile->leds[led->index]);
-	}
-
-	if (!h_led)
-		return -EINVAL;
-
 	switch (led->mode) {
 	case RATBAG_LED_ON:
 		h_led->mode = HIDPP20_LED_ON;
@@ -714,12 +718,32 @@ hidpp20drv_update_led_8070_8071(struct ratbag_led *led, struct ratbag_profile* p
 	h_led->color.blue = led->color.blue;
 	h_led->period = led->ms;
 	h_led->brightness = led->brightness * 100 / 255;
+}
+
+static int
+hidpp20drv_update_led_8070_8071(struct ratbag_led *led, struct ratbag_profile* profile,
+				struct hidpp20drv_data *drv_data)
+{
+	struct hidpp20_profile *h_profile;
+	struct hidpp20_led h_led_val = {0};
+	struct hidpp20_led *h_led = &h_led_val;
+
+	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
+		h_profile = &drv_data->profiles->profiles[profile->index];
+		h_led = &(h_profile->leds[led->index]);
+	}
+
+	if (!h_led)
+		return -EINVAL;
+
+	hidpp20drv_led_to_hidpp20(led, h_led);
 
 	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100)) {
 		if (drv_data->capabilities & HIDPP_CAP_COLOR_LED_EFFECTS_8070)
 			hidpp20_color_led_effects_set_zone_effect(drv_data->dev,
 								  led->index,
-								  h_led_val);
+								  h_led_val,
+								  true);
 	}
 
 	return RATBAG_SUCCESS;
@@ -742,6 +766,75 @@ hidpp20drv_update_led(struct ratbag_led *led)
 	return RATBAG_ERROR_CAPABILITY;
 }
 
+static void
+hidpp20drv_load_snapshot(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	_cleanup_free_ uint8_t *data = NULL;
+	uint8_t sectors[2 * 256];
+	ssize_t len;
+
+	if (!drv_data->snapshot)
+		return;
+
+	len = ratbag_cache_get(drv_data->snapshot, "Sectors", sectors, sizeof(sectors));
+	if (len <= 0 || len % 2)
+		return;
+
+	data = hidpp20_onboard_profiles_allocate_sector(profiles);
+
+	for (ssize_t i = 0; i < len; i += 2) {
+		uint16_t address = get_unaligned_be_u16(&sectors[i]);
+		char key[16];
+
+		snprintf(key, sizeof(key), "Sector%04x", address);
+		if (ratbag_cache_get(drv_data->snapshot, key, data,
+				     profiles->sector_size) != profiles->sector_size)
+			continue;
+
+		hidpp20_onboard_profiles_add_snapshot(profiles, address, data);
+	}
+}
+
+/**
+ * Store the sectors we know the device has, called whenever they may have
+ * changed. Writing the snapshot right away instead of on exit keeps it
+ * valid if we don't exit cleanly.
+ */
+static void
+hidpp20drv_store_snapshot(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	uint8_t sectors[2 * 256];
+	unsigned int i, n = 0;
+
+	if (!drv_data->snapshot || !profiles)
+		return;
+
+	/* a sector that is no longer verified must not linger from the
+	 * last time */
+	ratbag_cache_clear(drv_data->snapshot);
+
+	for (i = 0; i < profiles->snapshot_count && n < ARRAY_LENGTH(sectors) / 2; i++) {
+		struct hidpp20_snapshot_sector *sector = &profiles->snapshot[i];
+		char key[16];
+
+		if (!sector->verified)
+			continue;
+
+		set_unaligned_be_u16(&sectors[2 * n++], sector->address);
+
+		snprintf(key, sizeof(key), "Sector%04x", sector->address);
+		ratbag_cache_set(drv_data->snapshot, key, sector->data,
+				 profiles->sector_size);
+	}
+
+	ratbag_cache_set(drv_data->snapshot, "Sectors", sectors, 2 * n);
+	ratbag_cache_save(drv_data->snapshot);
+}
+
 static int
 hidpp20drv_set_current_profile(struct ratbag_device *device, unsigned int index)
 {
@@ -759,6 +852,7 @@ hidpp20drv_set_current_profile(struct ratbag_device *device, unsigned int index)
 	if (!h_profile->enabled) {
 		h_profile->enabled = 1;
 		rc = hidpp20_onboard_profiles_commit(drv_data->dev, drv_data->profiles);
+		hidpp20drv_store_snapshot(device);
 		if (rc)
 			return rc;
 	}
@@ -1258,6 +1352,59 @@ hidpp20drv_init_leds_8070_8071(struct ratbag_device *device)
 	return 0;
 }
 
+static void
+hidpp20drv_load_rom_sectors(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	uint16_t sector_size = profiles->sector_size;
+	unsigned int i;
+
+	if (!drv_data->cache)
+		return;
+
+	for (i = 0; i < profiles->num_rom_profiles; i++) {
+		char key[16];
+		ssize_t len;
+
+		snprintf(key, sizeof(key), "Rom%u", i + 1);
+		len = ratbag_cache_get(drv_data->cache, key,
+				       profiles->rom + i * sector_size,
+				       sector_size);
+		profiles->rom_valid[i] = len == sector_size;
+	}
+}
+
+static void
+hidpp20drv_store_rom_sectors(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20_profiles *profiles = drv_data->profiles;
+	uint16_t sector_size = profiles->sector_size;
+	_cleanup_free_ uint8_t *data = NULL;
+	unsigned int i;
+
+	if (!drv_data->cache)
+		return;
+
+	data = hidpp20_onboard_profiles_allocate_sector(profiles);
+
+	for (i = 0; i < profiles->num_rom_profiles; i++) {
+		char key[16];
+
+		if (!profiles->rom_valid[i])
+			continue;
+
+		snprintf(key, sizeof(key), "Rom%u", i + 1);
+		if (ratbag_cache_get(drv_data->cache, key, data, sector_size) == sector_size)
+			continue;
+
+		ratbag_cache_set(drv_data->cache, key,
+				 profiles->rom + i * sector_size,
+				 sector_size);
+	}
+}
+
 static int
 hidpp20drv_init_profile_8100(struct ratbag_device *device)
 {
@@ -1270,10 +1417,16 @@ hidpp20drv_init_profile_8100(struct ratbag_device *device)
 	if (rc < 0)
 		return rc;
 
+	hidpp20drv_load_rom_sectors(device);
+	hidpp20drv_load_snapshot(device);
+
 	rc = hidpp20_onboard_profiles_initialize(drv_data->dev, drv_data->profiles);
 	if (rc < 0)
 		return rc;
 
+	hidpp20drv_store_rom_sectors(device);
+	hidpp20drv_store_snapshot(device);
+
 	drv_data->num_profiles = drv_data->profiles->num_profiles;
 	drv_data->num_buttons = drv_data->profiles->num_buttons;
 
@@ -1316,6 +1469,92 @@ hidpp20drv_read_profile(struct ratbag_profile *profile)
 		hidpp20drv_read_button(button);
 }
 
+static void
+hidpp20drv_update_battery_level(struct ratbag_device *device,
+				unsigned int level,
+				enum hidpp20_battery_status status)
+{
+	struct ratbag_battery *battery = &device->battery;
+
+	battery->present = true;
+	/* 0x1000 sends an event on every change */
+	battery->notifies = true;
+	battery->level = min(level, 100U);
+
+	switch (status) {
+	case BATTERY_STATUS_DISCHARGING:
+		battery->state = RATBAG_BATTERY_STATE_DISCHARGING;
+		break;
+	case BATTERY_STATUS_RECHARGING:
+	case BATTERY_STATUS_CHARGING_IN_FINAL_STATE:
+	case BATTERY_STATUS_RECHARGING_BELOW_OPTIMAL_SPEED:
+		battery->state = RATBAG_BATTERY_STATE_CHARGING;
+		break;
+	case BATTERY_STATUS_CHARGE_COMPLETE:
+		battery->state = RATBAG_BATTERY_STATE_FULL;
+		break;
+	default:
+		battery->state = RATBAG_BATTERY_STATE_UNKNOWN;
+		break;
+	}
+}
+
+static void
+hidpp20drv_update_battery_voltage(struct ratbag_device *device,
+				  unsigned int voltage,
+				  uint8_t status)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct ratbag_battery *battery = &device->battery;
+
+	battery->present = true;
+	/* 0x1001 sends an event on every change */
+	battery->notifies = true;
+	battery->voltage = voltage;
+
+	/* 0x1000 has the better idea of the state */
+	if (drv_data->capabilities & HIDPP_CAP_BATTERY_LEVEL_1000)
+		return;
+
+	if (status & (BATTERY_VOLTAGE_STATUS_CHARGING |
+		      BATTERY_VOLTAGE_STATUS_WIRELESS_CHARGING))
+		battery->state = RATBAG_BATTERY_STATE_CHARGING;
+	else
+		battery->state = RATBAG_BATTERY_STATE_DISCHARGING;
+}
+
+static int
+hidpp20drv_read_battery(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	int rc;
+
+	if (drv_data->capabilities & HIDPP_CAP_BATTERY_LEVEL_1000) {
+		uint16_t level, next_level;
+
+		rc = hidpp20_batterylevel_get_battery_level(drv_data->dev,
+							    &level,
+							    &next_level);
+		if (rc < 0)
+			return rc;
+
+		hidpp20drv_update_battery_level(device, level, rc);
+	}
+
+	if (drv_data->capabilities & HIDPP_CAP_BATTERY_VOLTAGE_1001) {
+		uint16_t voltage;
+
+		rc = hidpp20_batteryvoltage_get_battery_voltage(drv_data->dev,
+								&voltage);
+		if (rc < 0)
+			return rc;
+
+		hidpp20drv_update_battery_voltage(device, voltage, rc);
+	}
+
+	return 0;
+}
+
 static int
 hidpp20drv_init_feature(struct ratbag_device *device, uint16_t feature)
 {
@@ -1377,6 +1616,7 @@ hidpp20drv_init_feature(struct ratbag_device *device, uint16_t feature)
 			  level, next_level, status);
 
 		drv_data->capabilities |= HIDPP_CAP_BATTERY_LEVEL_1000;
+		hidpp20drv_update_battery_level(device, level, status);
 		break;
 	}
 	case HIDPP_PAGE_BATTERY_VOLTAGE: {
@@ -1393,6 +1633,7 @@ hidpp20drv_init_feature(struct ratbag_device *device, uint16_t feature)
 			  voltage, status);
 
 		drv_data->capabilities |= HIDPP_CAP_BATTERY_VOLTAGE_1001;
+		hidpp20drv_update_battery_voltage(device, voltage, status);
 		break;
 	}
 	case HIDPP_PAGE_KBD_REPROGRAMMABLE_KEYS: {
@@ -1469,7 +1710,7 @@ hidpp20drv_commit(struct ratbag_device *device)
 	struct ratbag_resolution *resolution;
 	int rc;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
@@ -1491,7 +1732,7 @@ hidpp20drv_commit(struct ratbag_device *device)
 			}
 		}
 
-		list_for_each(button, &profile->buttons, link) {
+		ratbag_profile_for_each_button(profile, button) {
 			if (!button->dirty)
 				continue;
 
@@ -1502,7 +1743,7 @@ hidpp20drv_commit(struct ratbag_device *device)
 			}
 		}
 
-		list_for_each(led, &profile->leds, link) {
+		ratbag_profile_for_each_led(profile, led) {
 			if (!led->dirty)
 				continue;
 
@@ -1515,17 +1756,19 @@ hidpp20drv_commit(struct ratbag_device *device)
 	}
 
 	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
-		list_for_each(profile, &device->profiles, link)
+		ratbag_device_for_each_profile(device, profile)
 			drv_data->profiles->profiles[profile->index].enabled = profile->is_enabled;
 
 		rc = hidpp20_onboard_profiles_commit(drv_data->dev,
 						     drv_data->profiles);
+		/* also after a failure, the sectors written so far changed */
+		hidpp20drv_store_snapshot(device);
 		if (rc) {
 			log_error(device->ratbag, "hidpp20: failed to commit profile (%d)\n", rc);
 			return RATBAG_ERROR_DEVICE;
 		}
 
-		list_for_each(profile, &device->profiles, link) {
+		ratbag_device_for_each_profile(device, profile) {
 			if (profile->is_active) {
 				ratbag_profile_for_each_resolution(profile, resolution) {
 					if (resolution->is_active)
@@ -1539,6 +1782,431 @@ hidpp20drv_commit(struct ratbag_device *device)
 	return RATBAG_SUCCESS;
 }
 
+/**
+ * 0x1000 and 0x1001 send an event whenever the battery changes, the event
+ * has the same layout as the reply to the get request.
+ */
+static int
+hidpp20drv_notify_battery(struct ratbag_device *device,
+			  const union hidpp20_message *msg)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	uint8_t feature_index;
+
+	if (msg->msg.address != HIDPP20_BATTERY_LEVEL_EVENT_STATUS_BROADCAST)
+		return 0;
+
+	if (drv_data->capabilities & HIDPP_CAP_BATTERY_LEVEL_1000) {
+		feature_index = hidpp_root_get_feature_idx(drv_data->dev,
+							   HIDPP_PAGE_BATTERY_LEVEL_STATUS);
+		if (feature_index != 0 && msg->msg.sub_id == feature_index) {
+			hidpp20drv_update_battery_level(device,
+							msg->msg.parameters[0],
+							msg->msg.parameters[2]);
+			return 1;
+		}
+	}
+
+	if (drv_data->capabilities & HIDPP_CAP_BATTERY_VOLTAGE_1001) {
+		feature_index = hidpp_root_get_feature_idx(drv_data->dev,
+							   HIDPP_PAGE_BATTERY_VOLTAGE);
+		if (feature_index != 0 && msg->msg.sub_id == feature_index) {
+			hidpp20drv_update_battery_voltage(device,
+							  get_unaligned_be_u16(msg->msg.parameters),
+							  msg->msg.parameters[2]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * The device tells us through 0x8100 events when the user switches
+ * profiles or resolutions with the buttons on the device. 0x2201 has no
+ * events, a resolution change always comes as a change of the current
+ * 0x8100 DPI index.
+ */
+static int
+hidpp20drv_notify(struct ratbag_device *device, const uint8_t *buf, size_t len)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	union hidpp20_message msg = {0};
+	struct ratbag_profile *profile;
+	struct ratbag_resolution *resolution;
+	uint8_t feature_index;
+	unsigned int index;
+
+	if (len < SHORT_MESSAGE_LENGTH ||
+	    (buf[0] != REPORT_ID_SHORT && buf[0] != REPORT_ID_LONG))
+		return 0;
+
+	memcpy(msg.data, buf, min(len, sizeof(msg.data)));
+
+	/* replies carry our software id, events have none */
+	if (msg.msg.device_idx != drv_data->dev->index ||
+	    (msg.msg.address & 0x0f) != 0)
+		return 0;
+
+	if (device->battery.present && hidpp20drv_notify_battery(device, &msg))
+		return 1;
+
+	if (!(drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100))
+		return 0;
+
+	feature_index = hidpp_root_get_feature_idx(drv_data->dev,
+						   HIDPP_PAGE_ONBOARD_PROFILES);
+	if (feature_index == 0 || msg.msg.sub_id != feature_index)
+		return 0;
+
+	switch (msg.msg.address) {
+	case HIDPP20_ONBOARD_PROFILES_EVENT_CURRENT_PROFILE_CHANGED:
+		/* same layout as the reply to getCurrentProfile, the
+		 * profile index on the wire starts at 1 */
+		if (msg.msg.parameters[1] == 0)
+			return 0;
+
+		index = msg.msg.parameters[1] - 1;
+		if (index >= device->num_profiles)
+			return 0;
+
+		log_debug(device->ratbag, "%s: profile %u activated on the device\n",
+			  device->name, index);
+
+		drv_data->profiles->active_profile_index = index;
+		ratbag_device_for_each_profile(device, profile) {
+			/* the device wins over a pending SetActive */
+			profile->is_active = (profile->index == index);
+			profile->is_active_dirty = false;
+			if (!profile->is_active)
+				continue;
+
+			/* a profile starts with its default resolution */
+			ratbag_profile_for_each_resolution(profile, resolution)
+				resolution->is_active = resolution->is_default;
+		}
+		return 1;
+	case HIDPP20_ONBOARD_PROFILES_EVENT_CURRENT_DPI_INDEX_CHANGED:
+		index = msg.msg.parameters[0];
+
+		log_debug(device->ratbag, "%s: resolution %u activated on the device\n",
+			  device->name, index);
+
+		ratbag_device_for_each_profile(device, profile) {
+			if (!profile->is_active)
+				continue;
+
+			ratbag_profile_for_each_resolution(profile, resolution)
+				resolution->is_active = (resolution->index == index);
+		}
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+#define HIDPP20DRV_PREVIEW_TIMEOUT_MS 1000
+
+/**
+ * The requests that apply a preview, built up front so the blocking and
+ * the asynchronous path send the same ones.
+ */
+struct hidpp20drv_preview {
+	size_t count;
+	size_t next;		/* the request in flight, async only */
+	int dpi_msg;		/* index of the 0x2201 request or -1 */
+	uint16_t dpi;		/* the dpi it sets, echoed by the device */
+	bool error_reply;	/* the device answered with an error */
+	union hidpp20_message msgs[];
+};
+
+/**
+ * Build the requests that apply the active profile's current resolution,
+ * report rate and LEDs through the features that only change the
+ * device's RAM state: 0x2201, 0x8060 and 0x8070 (or 0x1300, which is
+ * volatile anyway). The onboard profiles are left untouched until the
+ * next commit.
+ */
+static int
+hidpp20drv_preview_build(struct ratbag_device *device,
+			 struct hidpp20drv_preview **preview_out)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20drv_preview *preview;
+	struct ratbag_profile *p, *profile = NULL;
+	struct ratbag_resolution *resolution;
+	struct ratbag_led *led;
+	int rc;
+
+	ratbag_device_for_each_profile(device, p) {
+		if (p->is_active)
+			profile = p;
+	}
+	if (!profile)
+		return -EINVAL;
+
+	/* one for the dpi, one for the rate, up to three per LED */
+	preview = zalloc(sizeof(*preview) +
+			 (2 + 3 * device->num_leds) * sizeof(preview->msgs[0]));
+	preview->dpi_msg = -1;
+
+	if ((drv_data->capabilities & HIDPP_CAP_SWITCHABLE_RESOLUTION_2201) &&
+	    drv_data->num_sensors) {
+		ratbag_profile_for_each_resolution(profile, resolution) {
+			if (!resolution->is_active || !resolution->dirty ||
+			    resolution->is_disabled)
+				continue;
+
+			rc = hidpp20_adjustable_dpi_set_sensor_dpi_message(drv_data->dev,
+									   &drv_data->sensors[0],
+									   resolution->dpi_x,
+									   &preview->msgs[preview->count]);
+			if (rc)
+				goto err;
+
+			preview->dpi_msg = preview->count++;
+			preview->dpi = resolution->dpi_x;
+			break;
+		}
+	}
+
+	if ((drv_data->capabilities & HIDPP_CAP_ADJUSTABLE_REPORT_RATE_8060) &&
+	    profile->rate_dirty && profile->hz) {
+		rc = hidpp20_adjustable_report_rate_set_report_rate_message(drv_data->dev,
+									    1000/profile->hz,
+									    &preview->msgs[preview->count++]);
+		if (rc)
+			goto err;
+	}
+
+	ratbag_profile_for_each_led(profile, led) {
+		if (!led->dirty)
+			continue;
+
+		if (drv_data->capabilities & HIDPP_CAP_COLOR_LED_EFFECTS_8070) {
+			struct hidpp20_led h_led = {0};
+
+			hidpp20drv_led_to_hidpp20(led, &h_led);
+			rc = hidpp20_color_led_effects_set_zone_effect_message(drv_data->dev,
+									       led->index,
+									       h_led,
+									       false,
+									       &preview->msgs[preview->count++]);
+		} else if (drv_data->capabilities & HIDPP_CAP_LED_SW_CONTROL_1300) {
+			struct hidpp20_led_sw_ctrl_led_state h_led;
+
+			/* Take SW control, set the LED and hand the control
+			 * back, see hidpp20drv_update_led_1300() */
+			rc = hidpp20drv_led_to_1300(led, drv_data, &h_led);
+			if (rc == 0)
+				rc = hidpp20_led_sw_control_set_sw_ctrl_message(drv_data->dev, true,
+										&preview->msgs[preview->count++]);
+			if (rc == 0)
+				rc = hidpp20_led_sw_control_set_led_state_message(drv_data->dev, &h_led,
+										  &preview->msgs[preview->count++]);
+			if (rc == 0)
+				rc = hidpp20_led_sw_control_set_sw_ctrl_message(drv_data->dev, false,
+										&preview->msgs[preview->count++]);
+		} else {
+			continue;
+		}
+		if (rc)
+			goto err;
+	}
+
+	*preview_out = preview;
+
+	return 0;
+err:
+	free(preview);
+	return rc;
+}
+
+static int
+hidpp20drv_preview_check_reply(struct hidpp20drv_preview *preview, size_t idx,
+			       const union hidpp20_message *reply)
+{
+	if ((int)idx != preview->dpi_msg)
+		return 0;
+
+	return hidpp20_adjustable_dpi_check_sensor_dpi_reply(reply, preview->dpi);
+}
+
+static int
+hidpp20drv_preview(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	_cleanup_free_ struct hidpp20drv_preview *preview = NULL;
+	int rc;
+
+	rc = hidpp20drv_preview_build(device, &preview);
+	if (rc)
+		return rc;
+
+	for (size_t i = 0; i < preview->count; i++) {
+		rc = hidpp20_request_command(drv_data->dev, &preview->msgs[i]);
+		if (rc)
+			return rc;
+
+		rc = hidpp20drv_preview_check_reply(preview, i, &preview->msgs[i]);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+static int
+hidpp20drv_preview_send(struct ratbag_device *device, void *data)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20drv_preview *preview = data;
+
+	return hidpp20_send_request(drv_data->dev, &preview->msgs[preview->next]);
+}
+
+static bool
+hidpp20drv_preview_match(struct ratbag_device *device, const uint8_t *buf,
+			 size_t len, void *data)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20drv_preview *preview = data;
+	union hidpp20_message reply = {0};
+	int rc;
+
+	memcpy(reply.data, buf, min(len, sizeof(reply.data)));
+
+	rc = hidpp20_check_reply(drv_data->dev, &preview->msgs[preview->next], &reply);
+	if (rc == -EAGAIN)
+		return false;
+
+	preview->error_reply = rc != 0;
+
+	return true;
+}
+
+static void
+hidpp20drv_preview_done(struct ratbag_device *device, int rc,
+			const uint8_t *buf, size_t len, void *data);
+
+static const struct ratbag_request_ops hidpp20drv_preview_ops = {
+	.send = hidpp20drv_preview_send,
+	.match = hidpp20drv_preview_match,
+	.done = hidpp20drv_preview_done,
+};
+
+static void
+hidpp20drv_preview_done(struct ratbag_device *device, int rc,
+			const uint8_t *buf, size_t len, void *data)
+{
+	struct hidpp20drv_preview *preview = data;
+
+	if (rc == 0 && preview->error_reply) {
+		rc = -EPROTO;
+	} else if (rc == 0) {
+		union hidpp20_message reply = {0};
+
+		memcpy(reply.data, buf, min(len, sizeof(reply.data)));
+		rc = hidpp20drv_preview_check_reply(preview, preview->next, &reply);
+	}
+
+	if (rc == 0 && ++preview->next < preview->count) {
+		rc = ratbag_device_submit(device, &hidpp20drv_preview_ops,
+					  HIDPP20DRV_PREVIEW_TIMEOUT_MS, preview);
+		if (rc == 0)
+			return;
+	}
+
+	ratbag_device_preview_done(device, rc);
+	free(preview);
+}
+
+/**
+ * Like hidpp20drv_preview() but one request at a time from
+ * ratbag_dispatch(), so the caller isn't blocked while the device
+ * answers.
+ */
+static int
+hidpp20drv_preview_async(struct ratbag_device *device)
+{
+	struct hidpp20drv_preview *preview;
+	int rc;
+
+	rc = hidpp20drv_preview_build(device, &preview);
+	if (rc)
+		return rc;
+
+	if (preview->count == 0) {
+		free(preview);
+		ratbag_device_preview_done(device, 0);
+		return 0;
+	}
+
+	rc = ratbag_device_submit(device, &hidpp20drv_preview_ops,
+				  HIDPP20DRV_PREVIEW_TIMEOUT_MS, preview);
+	if (rc)
+		free(preview);
+
+	return rc;
+}
+
+/**
+ * Fill in the feature list, from the cache if it has one for this firmware
+ * version, otherwise from the device. The firmware version query also
+ * tells us the index of 0x0003, which must match the cached list.
+ */
+static int
+hidpp20drv_get_features(struct ratbag_device *device)
+{
+	struct hidpp20drv_data *drv_data = ratbag_get_drv_data(device);
+	struct hidpp20_device *dev = drv_data->dev;
+	struct hidpp20_fw_info fw = {0};
+	uint8_t buf[3 * 256];
+	ssize_t len;
+	unsigned int i;
+	int rc;
+
+	rc = hidpp20_device_info_get_fw_info(dev, 0, &fw);
+	if (rc == 0) {
+		_cleanup_free_ char *version = NULL;
+
+		version = asprintf_safe("%s %02x.%02x.B%04X",
+					fw.prefix, fw.number, fw.revision, fw.build);
+		ratbag_device_set_firmware_version(device, version);
+		drv_data->cache = ratbag_cache_load(device, "hidpp20", version);
+		drv_data->snapshot = ratbag_cache_load_runtime(device, "hidpp20", version);
+	}
+
+	if (drv_data->cache) {
+		len = ratbag_cache_get(drv_data->cache, "Features", buf, sizeof(buf));
+		if (len > 0 && len % 3 == 0 &&
+		    fw.feature_index < len / 3 &&
+		    get_unaligned_be_u16(&buf[3 * fw.feature_index]) == HIDPP_PAGE_DEVICE_INFO) {
+			dev->feature_count = len / 3;
+			dev->feature_list = zalloc((dev->feature_count + 1) * sizeof(struct hidpp20_feature));
+			for (i = 0; i < dev->feature_count; i++) {
+				dev->feature_list[i].feature = get_unaligned_be_u16(&buf[3 * i]);
+				dev->feature_list[i].type = buf[3 * i + 2];
+			}
+			return 0;
+		}
+	}
+
+	rc = hidpp20_feature_set_get(dev);
+	if (rc < 0)
+		return rc;
+
+	if (drv_data->cache) {
+		for (i = 0; i < dev->feature_count; i++) {
+			set_unaligned_be_u16(&buf[3 * i], dev->feature_list[i].feature);
+			buf[3 * i + 2] = dev->feature_list[i].type;
+		}
+		ratbag_cache_set(drv_data->cache, "Features", buf, 3 * dev->feature_count);
+	}
+
+	return 0;
+}
+
 static int
 hidpp20drv_20_probe(struct ratbag_device *device)
 {
@@ -1613,6 +2281,8 @@ hidpp20drv_remove(struct ratbag_device *device)
 	free(drv_data->leds);
 	if (drv_data->dev)
 		hidpp20_device_destroy(drv_data->dev);
+	ratbag_cache_destroy(drv_data->cache);
+	ratbag_cache_destroy(drv_data->snapshot);
 	free(drv_data);
 }
 
@@ -1647,7 +2317,7 @@ hidpp20drv_init_device(struct ratbag_device *device,
 
 	if (drv_data->capabilities & HIDPP_CAP_ONBOARD_PROFILES_8100) {
 		/* Fallback to the first profile if no profile is active */
-		list_for_each(profile, &device->profiles, link)
+		ratbag_device_for_each_profile(device, profile)
 			if (profile->is_active)
 				active_profile = true;
 
@@ -1674,7 +2344,10 @@ hidpp20drv_probe(struct ratbag_device *device)
 	drv_data = zalloc(sizeof(*drv_data));
 	ratbag_set_drv_data(device, drv_data);
 	hidpp_device_init(&base, device->hidraw[0].fd);
-	hidpp_device_set_log_handler(&base, hidpp20_log, HIDPP_LOG_PRIORITY_RAW, device);
+	hidpp_device_set_stats(&base, &device->stats);
+	hidpp_device_set_log_handler(&base, hidpp20_log,
+				     (enum hidpp_log_priority)ratbag_log_get_priority(device->ratbag),
+				     device);
 
 	device_idx = ratbag_device_data_hidpp20_get_index(device->data);
 	if (device_idx == -1)
@@ -1688,7 +2361,9 @@ hidpp20drv_probe(struct ratbag_device *device)
 	 * If there is a special need like for G900, we can add this in the
 	 * device data file.
 	 */
-	dev = hidpp20_device_new(&base, device_idx, (struct hidpp_hid_report*) device->hidraw[0].reports, device->hidraw[0].num_reports);
+	_Static_assert(sizeof(struct hidpp_hid_report) == sizeof(struct ratbag_hid_report),
+		       "Mismatching size");
+	dev = hidpp20_device_new_without_features(&base, device_idx, (struct hidpp_hid_report*) device->hidraw[0].reports, device->hidraw[0].num_reports);
 	if (!dev) {
 		rc = -ENODEV;
 		goto err;
@@ -1698,6 +2373,12 @@ hidpp20drv_probe(struct ratbag_device *device)
 
 	drv_data->dev = dev;
 
+	rc = hidpp20drv_get_features(device);
+	if (rc < 0) {
+		rc = -ENODEV;
+		goto err;
+	}
+
 	log_debug(device->ratbag, "'%s' is using protocol v%d.%d\n", ratbag_device_get_name(device), dev->proto_major, dev->proto_minor);
 
 	if(dev->quirk != HIDPP20_QUIRK_NONE)
@@ -1715,6 +2396,9 @@ hidpp20drv_probe(struct ratbag_device *device)
 
 	hidpp20drv_init_device(device, drv_data);
 
+	if (drv_data->cache)
+		ratbag_cache_save(drv_data->cache);
+
 	return rc;
 err:
 	hidpp20drv_remove(device);
@@ -1727,5 +2411,9 @@ struct ratbag_driver hidpp20_driver = {
 	.probe = hidpp20drv_probe,
 	.remove = hidpp20drv_remove,
 	.commit = hidpp20drv_commit,
+	.preview = hidpp20drv_preview,
+	.preview_async = hidpp20drv_preview_async,
+	.notify = hidpp20drv_notify,
+	.read_battery = hidpp20drv_read_battery,
 	.set_active_profile = hidpp20drv_set_current_profile,
 };
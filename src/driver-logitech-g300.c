@@ -246,7 +246,7 @@ logitech_g300_get_active_profile_and_resolution(struct ratbag_device *device)
 	if (ret != sizeof(buf))
 		return -EIO;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		struct ratbag_resolution *resolution;
 
 		if (profile->index != buf.profile)
@@ -278,7 +278,7 @@ logitech_g300_set_active_profile(struct ratbag_device *device, unsigned int inde
 		return ret;
 
 	/* Update the active resolution. After profile change the default is used. */
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		struct ratbag_resolution *resolution;
 
 		if (profile->index != index)
@@ -525,7 +525,7 @@ logitech_g300_write_profile(struct ratbag_profile *profile)
 							     resolution->index);
 	}
 
-	list_for_each(button, &profile->buttons, link) {
+	ratbag_profile_for_each_button(profile, button) {
 		struct ratbag_button_action *action = &button->action;
 		struct logitech_g300_button *raw_button;
 
@@ -556,7 +556,7 @@ logitech_g300_write_profile(struct ratbag_profile *profile)
 		}
 	}
 
-	list_for_each(led, &profile->leds, link) {
+	ratbag_profile_for_each_led(profile, led) {
 		if (!led->dirty)
 			continue;
 
@@ -590,7 +590,7 @@ logitech_g300_commit(struct ratbag_device *device)
 	struct ratbag_profile *profile;
 	int rc = 0;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
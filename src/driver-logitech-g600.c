@@ -208,7 +208,7 @@ logitech_g600_get_active_profile_and_resolution(struct ratbag_device *device)
 	if (ret != sizeof(buf))
 		return -EIO;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		struct ratbag_resolution *resolution;
 
 		if (profile->index != buf.profile)
@@ -257,7 +257,7 @@ logitech_g600_set_active_profile(struct ratbag_device *device, unsigned int inde
 		return ret;
 
 	/* Update the active resolution. After profile change the default is used. */
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		struct ratbag_resolution *resolution;
 
 		if (profile->index != index)
@@ -503,7 +503,7 @@ logitech_g600_write_profile(struct ratbag_profile *profile)
 			active_resolution = resolution->index;
 	}
 
-	list_for_each(button, &profile->buttons, link) {
+	ratbag_profile_for_each_button(profile, button) {
 		struct ratbag_button_action *action = &button->action;
 		struct logitech_g600_button *raw_button;
 
@@ -531,7 +531,7 @@ logitech_g600_write_profile(struct ratbag_profile *profile)
 		}
 	}
 
-	list_for_each(led, &profile->leds, link) {
+	ratbag_profile_for_each_led(profile, led) {
 		report->led_red = led->color.red;
 		report->led_green = led->color.green;
 		report->led_blue = led->color.blue;
@@ -595,7 +595,7 @@ logitech_g600_commit(struct ratbag_device *device)
 	struct ratbag_profile *profile;
 	int rc = 0;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
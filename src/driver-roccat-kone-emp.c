@@ -54,7 +54,7 @@
 #define ROCCAT_NUM_DPI              5
 #define ROCCAT_LED_MAX              4
 
-#define ROCCAT_MAX_RETRY_READY      10
+#define ROCCAT_READY_TIMEOUT_MS    1200
 
 #define ROCCAT_REPORT_ID_CONFIGURE_PROFILE  4
 #define ROCCAT_REPORT_ID_PROFILE            5
@@ -375,7 +375,7 @@ roccat_crc_is_valid(struct ratbag_device *device, uint8_t *buf, unsigned int len
 }
 
 static int
-roccat_is_ready(struct ratbag_device *device)
+roccat_is_ready(struct ratbag_device *device, void *userdata)
 {
 	uint8_t buf[3] = { 0 };
 	int rc;
@@ -387,38 +387,18 @@ roccat_is_ready(struct ratbag_device *device)
 	if (rc != sizeof(buf))
 		return -EIO;
 
-	if (buf[1] == 0x03)
-		msleep(100);
-
+	/* 0x00 and 0x03 (busy for longer) mean we have to wait */
 	if (buf[1] == 0x02)
 		return 2;
 
-	return buf[1] == 0x01;
+	return buf[1] == 0x01 ? 0 : -EAGAIN;
 }
 
 static int
 roccat_wait_ready(struct ratbag_device *device)
 {
-	unsigned count = 0;
-	int rc;
-
-	msleep(10);
-	while (count < ROCCAT_MAX_RETRY_READY) {
-		rc = roccat_is_ready(device);
-		if (rc < 0)
-			return rc;
-
-		if (rc == 1)
-			return 0;
-
-		if (rc == 2)
-			return 2;
-
-		msleep(10);
-		count++;
-	}
-
-	return -ETIMEDOUT;
+	return ratbag_hidraw_poll_ready(device, 0, ROCCAT_READY_TIMEOUT_MS,
+					roccat_is_ready, NULL);
 }
 
 static int
@@ -1051,7 +1031,7 @@ roccat_commit(struct ratbag_device *device)
 	struct ratbag_profile *profile;
 	int rc = 0;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
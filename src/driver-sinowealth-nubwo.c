@@ -297,7 +297,7 @@ static int
 sinowealthnubwo_commit(struct ratbag_device *device)
 {
 	struct ratbag_profile *profile;
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty) continue;
 
 		int error = sinowealthnubwo_write_profile(device, profile);
@@ -40,6 +40,9 @@
 #define STEELSERIES_INPUT_ENDPOINT	0
 #define STEELSERIES_INPUT_HIDRAW	1
 
+/* time the device needs between two requests */
+#define STEELSERIES_SETTLE_MS		10
+
 /* not sure these two are used for */
 #define STEELSERIES_REPORT_ID			0x00 // steelseries doesn't use numbered reports
 #define STEELSERIES_REPORT_ID_1			0x01
@@ -212,7 +215,6 @@ steelseries_get_firmware_version(struct ratbag_device *device, int *major_out, i
 		return -ENOTSUP;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, msg_len);
 	if (ret < 0)
 		return ret;
@@ -221,6 +223,8 @@ steelseries_get_firmware_version(struct ratbag_device *device, int *major_out, i
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	// TODO: check if these are in correct order.
 	// Rivalcfg - another configuration utility for SteelSeries mice -
 	// was updated to invert their order on 2022-08-26.
@@ -258,7 +262,6 @@ steelseries_read_settings(struct ratbag_device *device)
 		return -ENOTSUP;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, STEELSERIES_REPORT_SIZE);
 	if (ret < 0)
 		return ret;
@@ -267,6 +270,8 @@ steelseries_read_settings(struct ratbag_device *device)
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	if (device_version == 2) {
 		active_resolution = buf[1] - 1;
 		ratbag_device_for_each_profile(device, profile) {
@@ -486,11 +491,12 @@ steelseries_write_dpi(struct ratbag_resolution *resolution)
 		return -ENOTSUP;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, buf_len);
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	return 0;
 }
 
@@ -543,11 +549,12 @@ steelseries_write_report_rate(struct ratbag_profile *profile)
 		return -ENOTSUP;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, buf_len);
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	return 0;
 }
 
@@ -656,7 +663,6 @@ steelseries_write_buttons(struct ratbag_profile *profile)
 		}
 	}
 
-	msleep(10);
 	if (device_version == 3)
 		ret = ratbag_hidraw_raw_request(device, STEELSERIES_ID_BUTTONS,
 						msg.msg.parameters, report_size - 1,
@@ -667,6 +673,8 @@ steelseries_write_buttons(struct ratbag_profile *profile)
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	return 0;
 }
 
@@ -709,11 +717,12 @@ steelseries_write_led_v1(struct ratbag_led *led)
 		return -EINVAL;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, STEELSERIES_REPORT_SIZE_SHORT);
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	memset(msg.data, 0, STEELSERIES_REPORT_SIZE); // reset the msg buffer before reusing
 
 	if (quirk == STEELSERIES_QUIRK_SENSEIRAW) {
@@ -738,11 +747,12 @@ steelseries_write_led_v1(struct ratbag_led *led)
 		msg.msg.parameters[4] = led->color.blue;
 	}
 
-	msleep(10);
 	ret = ratbag_hidraw_output_report(device, msg.data, STEELSERIES_REPORT_SIZE_SHORT);
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	return 0;
 }
 
@@ -893,7 +903,6 @@ steelseries_write_led_cycle(struct ratbag_led *led,
 
 	construct_cycle_buffer(&cycle, cycle_spec, msg.msg.parameters, sizeof(msg.msg.parameters));
 
-	msleep(10);
 	if (device_version == 3)
 		ret = ratbag_hidraw_raw_request(device, cycle_spec->cmd_val, msg.msg.parameters,
 						sizeof(msg.msg.parameters), cycle_spec->hid_report_type,
@@ -904,6 +913,8 @@ steelseries_write_led_cycle(struct ratbag_led *led,
 	if (ret < 0)
 		return ret;
 
+	ratbag_hidraw_settle(device, STEELSERIES_SETTLE_MS);
+
 	return 0;
 }
 
@@ -1078,7 +1089,7 @@ steelseries_commit(struct ratbag_device *device)
 	struct ratbag_profile *profile;
 	int rc = 0;
 
-	list_for_each(profile, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, profile) {
 		if (!profile->dirty)
 			continue;
 
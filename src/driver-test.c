@@ -240,6 +240,8 @@ test_probe(struct ratbag_device *device, const void *data)
 	ratbag_device_for_each_profile(device, profile)
 		test_read_profile(profile);
 
+	device->battery.present = test_device->battery.present;
+
 	return 0;
 }
 
@@ -265,6 +267,26 @@ test_commit(struct ratbag_device *device)
 	return 0;
 }
 
+static int
+test_preview(struct ratbag_device *device)
+{
+	/* check if the device is still valid */
+	assert(ratbag_get_drv_data(device) != NULL);
+
+	return 0;
+}
+
+static int
+test_read_battery(struct ratbag_device *device)
+{
+	struct ratbag_test_device *d = ratbag_get_drv_data(device);
+
+	device->battery.level = d->battery.level;
+	device->battery.state = d->battery.state;
+
+	return 0;
+}
+
 struct ratbag_driver test_driver = {
 	.name = "Test driver",
 	.id = "test_driver",
@@ -272,5 +294,7 @@ struct ratbag_driver test_driver = {
 	.test_probe = test_probe,
 	.remove = test_remove,
 	.commit = test_commit,
+	.preview = test_preview,
+	.read_battery = test_read_battery,
 	.set_active_profile = test_set_active_profile,
 };
@@ -245,6 +245,10 @@ hidpp_write_command(struct hidpp_device *dev, uint8_t *cmd, int size)
 	if (res < 0) {
 		res = -errno;
 		hidpp_log_error(dev, "Error: %s (%d)\n", strerror(-res), -res);
+		ratbag_stats_inc(dev->stats, RATBAG_STAT_IO_ERRORS);
+	} else {
+		ratbag_stats_inc(dev->stats, RATBAG_STAT_WRITES);
+		ratbag_stats_add(dev->stats, RATBAG_STAT_BYTES_WRITTEN, res);
 	}
 
 	return res < 0 ? res : 0;
@@ -264,18 +268,47 @@ hidpp_read_response(struct hidpp_device *dev, uint8_t *buf, size_t size)
 	fds.events = POLLIN;
 
 	rc = poll(&fds, 1, 1000);
-	if (rc == -1)
+	if (rc == -1) {
+		ratbag_stats_inc(dev->stats, RATBAG_STAT_IO_ERRORS);
 		return -errno;
+	}
 
-	if (rc == 0)
+	if (rc == 0) {
+		ratbag_stats_inc(dev->stats, RATBAG_STAT_TIMEOUTS);
 		return -ETIMEDOUT;
+	}
 
 	rc = read(fd, buf, size);
+	if (rc < 0) {
+		rc = -errno;
+		ratbag_stats_inc(dev->stats, RATBAG_STAT_IO_ERRORS);
+		return rc;
+	}
+
+	ratbag_stats_inc(dev->stats, RATBAG_STAT_READS);
+	ratbag_stats_add(dev->stats, RATBAG_STAT_BYTES_READ, rc);
 
 	if (rc > 0)
 		hidpp_log_buf_raw(dev, "hidpp read:  ", buf, rc);
 
-	return rc >= 0 ? rc : -errno;
+	return rc;
+}
+
+/* Whether the device accepts the report as an output report of len bytes,
+ * report ID included. Callers that don't know the sizes leave them at 0 */
+static bool
+hidpp_report_has_length(struct hidpp_device *dev,
+			const struct hidpp_hid_report *report,
+			unsigned int len)
+{
+	unsigned int bits = report->size[1]; /* output */
+
+	if (bits == 0 || bits == (len - 1) * 8)
+		return true;
+
+	hidpp_log_debug(dev, "hidpp: report 0x%02x has %u bits, expected %u\n",
+			report->report_id, bits, (len - 1) * 8);
+	return false;
 }
 
 void
@@ -295,10 +328,14 @@ hidpp_get_supported_report_types(struct hidpp_device *dev, struct hidpp_hid_repo
 		if ((reports[i].usage_page & 0xff00) == 0xff00) /* vendor defined usage page (0xff00-0xffff) */
 			switch (reports[i].report_id) {
 				case REPORT_ID_SHORT:
+					if (!hidpp_report_has_length(dev, &reports[i], SHORT_MESSAGE_LENGTH))
+						break;
 					hidpp_log_debug(dev, "hidpp: device supports short reports\n");
 					dev->supported_report_types |= HIDPP_REPORT_SHORT;
 					break;
 				case REPORT_ID_LONG:
+					if (!hidpp_report_has_length(dev, &reports[i], LONG_MESSAGE_LENGTH))
+						break;
 					hidpp_log_debug(dev, "hidpp: device supports long reports\n");
 					dev->supported_report_types |= HIDPP_REPORT_LONG;
 					break;
@@ -313,7 +350,7 @@ hidpp_log(struct hidpp_device *dev,
 {
 	va_list args;
 
-	if (dev->log_priority > priority)
+	if (!hidpp_log_is_enabled(dev, priority))
 		return;
 
 	va_start(args, format);
@@ -345,6 +382,9 @@ hidpp_log_buffer(struct hidpp_device *dev,
 	_cleanup_free_ char *output_buf = NULL;
 	_cleanup_free_ char *bytes = NULL;
 
+	if (!hidpp_log_is_enabled(dev, priority))
+		return;
+
 	bytes = hidpp_buffer_to_string(buf, len);
 	asprintf(&output_buf, "%s %s", header ? header : "", bytes);
 
@@ -363,6 +403,13 @@ hidpp_device_init(struct hidpp_device *dev, int fd)
 	dev->hidraw_fd = fd;
 	hidpp_device_set_log_handler(dev, simple_log, HIDPP_LOG_PRIORITY_INFO, NULL);
 	dev->supported_report_types = 0;
+	dev->stats = NULL;
+}
+
+void
+hidpp_device_set_stats(struct hidpp_device *dev, struct ratbag_stats *stats)
+{
+	dev->stats = stats;
 }
 
 void
@@ -33,6 +33,7 @@
 #include <stddef.h>
 
 #include "libratbag-util.h"
+#include "libratbag-stats.h"
 
 #define HIDPP_RECEIVER_IDX			0xFF
 #define HIDPP_WIRED_DEVICE_IDX			0x00
@@ -95,10 +96,14 @@ typedef void (*hidpp_log_handler)(void *userdata,
 				  const char *format, va_list args)
 	__attribute__ ((format (printf, 3, 0)));
 
+/* same layout as struct ratbag_hid_report */
 struct hidpp_hid_report {
 	unsigned int report_id;
 	unsigned int usage_page;
 	unsigned int usage;
+	/* in bits without the report ID, 0 if unknown. Indexed by the
+	 * report type: input, output, feature */
+	unsigned int size[3];
 };
 
 struct hidpp_device {
@@ -107,6 +112,7 @@ struct hidpp_device {
 	hidpp_log_handler log_handler;
 	enum hidpp_log_priority log_priority;
 	unsigned supported_report_types;
+	struct ratbag_stats *stats;	/* may be NULL */
 };
 
 #define HIDPP_REPORT_SHORT	(1 << 0)
@@ -119,6 +125,8 @@ hidpp_device_set_log_handler(struct hidpp_device *dev,
 			     hidpp_log_handler log_handler,
 			     enum hidpp_log_priority priority,
 			     void *userdata);
+void
+hidpp_device_set_stats(struct hidpp_device *dev, struct ratbag_stats *stats);
 
 extern const char *hidpp10_errors[0x100];
 extern const char *hidpp20_errors[0x100];
@@ -156,6 +164,16 @@ hidpp_log(struct hidpp_device *dev,
 	  ...)
 	__attribute__ ((format (printf, 3, 4)));
 
+/**
+ * Use this to skip building log messages that would be discarded anyway,
+ * e.g. hex dumps of every message at RAW priority.
+ */
+static inline bool
+hidpp_log_is_enabled(struct hidpp_device *dev, enum hidpp_log_priority priority)
+{
+	return dev->log_priority <= priority;
+}
+
 char *
 hidpp_buffer_to_string(const uint8_t *buf, size_t len);
 
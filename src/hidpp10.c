@@ -170,6 +170,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 	int ret;
 	uint8_t hidpp_err = 0;
 	int command_size;
+	uint64_t start;
 	_cleanup_free_ char *rxdata = NULL, *txdata = NULL;
 
 	switch (msg->msg.report_id) {
@@ -184,16 +185,20 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		return -EINVAL;
 	}
 
+	start = ratbag_stats_begin(dev->base.stats);
+
 	/* create the expected header */
 	expected_header = *msg;
 
-	txdata = hidpp_buffer_to_string(&msg->data[4], command_size - 4);
-	hidpp_log_raw(&dev->base, "hidpp10 tx:  %02x | %02x | %02x | %02x | %s\n",
-		      msg->msg.report_id,
-		      msg->msg.device_idx,
-		      msg->msg.sub_id,
-		      msg->msg.address,
-		      txdata);
+	if (hidpp_log_is_enabled(&dev->base, HIDPP_LOG_PRIORITY_RAW)) {
+		txdata = hidpp_buffer_to_string(&msg->data[4], command_size - 4);
+		hidpp_log_raw(&dev->base, "hidpp10 tx:  %02x | %02x | %02x | %02x | %s\n",
+			      msg->msg.report_id,
+			      msg->msg.device_idx,
+			      msg->msg.sub_id,
+			      msg->msg.address,
+			      txdata);
+	}
 
 	/* response message length doesn't depend on request length */
 #if 0
@@ -215,6 +220,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 
 		/* Wait and retry if the USB timed out */
 		if (ret == -ETIMEDOUT) {
+			ratbag_stats_inc(dev->base.stats, RATBAG_STAT_RETRIES);
 			msleep(10);
 			ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
 		}
@@ -233,6 +239,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		/* error */
 		if (!memcmp(read_buffer.data, expected_error_dev.data, 5)) {
 			hidpp_err = read_buffer.msg.parameters[1];
+			ratbag_stats_protocol_error(dev->base.stats, hidpp_err);
 			hidpp_log_raw(&dev->base,
 				"    HID++ error from the %s (%d): %s (%02x)\n",
 				read_buffer.msg.device_idx == HIDPP_RECEIVER_IDX ? "receiver" : "device",
@@ -249,13 +256,15 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 		goto out_err;
 	}
 
-	rxdata = hidpp_buffer_to_string(&read_buffer.data[4], ret - 4);
-	hidpp_log_raw(&dev->base, "hidpp10 rx:  %02x | %02x | %02x | %02x | %s\n",
-		      read_buffer.msg.report_id,
-		      read_buffer.msg.device_idx,
-		      read_buffer.msg.sub_id,
-		      read_buffer.msg.address,
-		      rxdata);
+	if (hidpp_log_is_enabled(&dev->base, HIDPP_LOG_PRIORITY_RAW)) {
+		rxdata = hidpp_buffer_to_string(&read_buffer.data[4], ret - 4);
+		hidpp_log_raw(&dev->base, "hidpp10 rx:  %02x | %02x | %02x | %02x | %s\n",
+			      read_buffer.msg.report_id,
+			      read_buffer.msg.device_idx,
+			      read_buffer.msg.sub_id,
+			      read_buffer.msg.address,
+			      rxdata);
+	}
 
 	if (!hidpp_err) {
 		/* copy the answer for the caller */
@@ -265,6 +274,7 @@ hidpp10_request_command(struct hidpp10_device *dev, union hidpp10_message *msg)
 	ret = hidpp_err;
 
 out_err:
+	ratbag_stats_request(dev->base.stats, start);
 	return ret;
 }
 /* -------------------------------------------------------------------------- */
@@ -2531,13 +2541,120 @@ hidpp10_read_memory(struct hidpp10_device *dev, uint8_t page, uint16_t offset,
 	return 0;
 }
 
-int
-hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
-		  uint8_t bytes[HIDPP10_PAGE_SIZE])
+/* Number of memory reads hidpp10_read_page() keeps in flight. */
+#define HIDPP10_MAX_IN_FLIGHT 4
+
+static bool
+hidpp10_is_read_memory_reply(struct hidpp10_device *dev,
+			     union hidpp10_message *msg)
+{
+	return msg->msg.report_id == REPORT_ID_LONG &&
+	       msg->msg.device_idx == dev->index &&
+	       msg->msg.sub_id == GET_LONG_REGISTER_REQ &&
+	       msg->msg.address == __CMD_READ_MEMORY;
+}
+
+static bool
+hidpp10_is_read_memory_error(struct hidpp10_device *dev,
+			     union hidpp10_message *msg)
+{
+	return msg->msg.report_id == REPORT_ID_SHORT &&
+	       msg->msg.device_idx == dev->index &&
+	       msg->msg.sub_id == __ERROR_MSG &&
+	       msg->msg.address == GET_LONG_REGISTER_REQ &&
+	       msg->msg.parameters[0] == __CMD_READ_MEMORY;
+}
+
+/**
+ * Read a full page with several memory reads outstanding at a time.
+ *
+ * A HID++ 1.0 memory read reply does not say which page or offset it is
+ * for, the device answers in request order so replies are matched by
+ * their position. The page CRC checked by the caller catches a device
+ * that doesn't, the caller then re-reads the page sequentially.
+ *
+ * @return 0 on success or a negative errno if the device did not answer
+ * every request, in which case no replies are left pending
+ */
+static int
+hidpp10_read_page_pipelined(struct hidpp10_device *dev, uint8_t page,
+			    uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	const unsigned int count = HIDPP10_PAGE_SIZE / 16;
+	unsigned int sent = 0, received = 0;
+	uint64_t start[HIDPP10_MAX_IN_FLIGHT];
+	union hidpp10_message read_buffer;
+	int ret = 0;
+
+	while (received < count) {
+		while (sent < count && sent - received < HIDPP10_MAX_IN_FLIGHT) {
+			union hidpp10_message readmem = CMD_READ_MEMORY(dev->index, page, sent * 16 / 2);
+
+			start[sent % HIDPP10_MAX_IN_FLIGHT] = ratbag_stats_begin(dev->base.stats);
+			ret = hidpp_write_command(&dev->base, readmem.data, SHORT_MESSAGE_LENGTH);
+			if (ret) {
+				ratbag_stats_request(dev->base.stats,
+						     start[sent % HIDPP10_MAX_IN_FLIGHT]);
+				goto out_drain;
+			}
+			sent++;
+		}
+
+		ret = hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH);
+		if (ret < 0)
+			goto out_drain;
+
+		if (hidpp10_is_read_memory_reply(dev, &read_buffer)) {
+			ratbag_stats_request(dev->base.stats,
+					     start[received % HIDPP10_MAX_IN_FLIGHT]);
+			memcpy(bytes + received * 16, read_buffer.msg.string,
+			       sizeof(read_buffer.msg.string));
+			received++;
+		} else if (hidpp10_is_read_memory_error(dev, &read_buffer)) {
+			ratbag_stats_protocol_error(dev->base.stats,
+						    read_buffer.msg.parameters[1]);
+			ratbag_stats_request(dev->base.stats,
+					     start[received % HIDPP10_MAX_IN_FLIGHT]);
+			received++;
+			ret = -EPROTO;
+			goto out_drain;
+		}
+	}
+
+	return 0;
+
+out_drain:
+	/* Swallow the replies to the requests still in flight so they
+	 * can't be taken for the answer to a later request */
+	while (received < sent &&
+	       hidpp_read_response(&dev->base, read_buffer.data, LONG_MESSAGE_LENGTH) > 0) {
+		if (hidpp10_is_read_memory_error(dev, &read_buffer))
+			ratbag_stats_protocol_error(dev->base.stats,
+						    read_buffer.msg.parameters[1]);
+		else if (!hidpp10_is_read_memory_reply(dev, &read_buffer))
+			continue;
+
+		ratbag_stats_request(dev->base.stats,
+				     start[received % HIDPP10_MAX_IN_FLIGHT]);
+		received++;
+	}
+
+	/* Requests that never got an answer still count as sent */
+	while (received < sent) {
+		ratbag_stats_request(dev->base.stats,
+				     start[received % HIDPP10_MAX_IN_FLIGHT]);
+		received++;
+	}
+
+	return ret < 0 ? ret : -EPROTO;
+}
+
+static int
+hidpp10_read_page_sequential(struct hidpp10_device *dev, uint8_t page,
+			     uint8_t bytes[HIDPP10_PAGE_SIZE])
 {
 	unsigned int i;
 	int res;
-	uint16_t crc, read_crc;
 
 	for (i = 0; i < HIDPP10_PAGE_SIZE; i += 16) {
 		res = hidpp10_read_memory(dev, page, i, bytes + i);
@@ -2545,10 +2662,52 @@ hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
 			return res;
 	}
 
+	return 0;
+}
+
+static bool
+hidpp10_page_crc_valid(uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	uint16_t crc, read_crc;
+
 	crc = hidpp_crc_ccitt(bytes, HIDPP10_PAGE_SIZE - 2);
 	read_crc = get_unaligned_be_u16(&bytes[HIDPP10_PAGE_SIZE - 2]);
 
-	if (crc != read_crc)
+	return crc == read_crc;
+}
+
+int
+hidpp10_read_page(struct hidpp10_device *dev, uint8_t page,
+		  uint8_t bytes[HIDPP10_PAGE_SIZE])
+{
+	int res;
+
+	if (page > HIDPP10_MAX_PAGE_NUMBER)
+		return -EINVAL;
+
+	hidpp_log_raw(&dev->base, "Reading memory page %d\n", page);
+
+	res = hidpp10_read_page_pipelined(dev, page, bytes);
+	if (res == 0 && hidpp10_page_crc_valid(bytes))
+		return 0;
+
+	/* A failed batch or a bad CRC may be down to the device not
+	 * answering in request order, give it one more go with a
+	 * single request at a time before blaming the page content */
+	if (res < 0)
+		hidpp_log_debug(&dev->base,
+				"Batched read of page %d failed (%d), reading it sequentially\n",
+				page, res);
+	else
+		hidpp_log_debug(&dev->base,
+				"Batched read of page %d has a bad CRC, reading it sequentially\n",
+				page);
+
+	res = hidpp10_read_page_sequential(dev, page, bytes);
+	if (res < 0)
+		return res;
+
+	if (!hidpp10_page_crc_valid(bytes))
 		return -EILSEQ; /* return illegal sequence */
 
 	return 0;
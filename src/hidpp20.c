@@ -115,24 +115,43 @@ hidpp20_get_quirk_string(enum hidpp20_quirk quirk)
 	abort();
 }
 
-static int
-hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20_message *msg,
-				    bool allow_error)
+/* msg->address is 4 MSB: subcommand, 4 LSB: 4-bit SW identifier so
+ * the device knows who to respond to. The kernel uses 0x1, we rotate
+ * through the remaining IDs so a late reply to a request that timed out
+ * can't be mistaken for the reply to the next one, and so several
+ * requests can be in flight at the same time. */
+#define HIDPP20_SW_ID_MIN 0x2
+#define HIDPP20_SW_ID_MAX 0xf
+
+/* Number of requests hidpp20_request_commands() keeps in flight. The
+ * firmware queues them and replies in order, a small window is enough
+ * to hide the round-trip time. */
+#define HIDPP20_MAX_IN_FLIGHT 4
+
+static uint8_t
+hidpp20_next_sw_id(struct hidpp20_device *device)
 {
-	union hidpp20_message read_buffer;
-	int ret;
-	uint8_t hidpp_err = 0;
-	size_t msg_len;
+	if (device->sw_id < HIDPP20_SW_ID_MIN || device->sw_id >= HIDPP20_SW_ID_MAX)
+		device->sw_id = HIDPP20_SW_ID_MIN;
+	else
+		device->sw_id++;
 
-	/* msg->address is 4 MSB: subcommand, 4 LSB: 4-bit SW identifier so
-	 * the device knows who to respond to. kernel uses 0x1 */
-	const int DEVICE_SW_ID = 0x8;
+	return device->sw_id;
+}
 
+/**
+ * Assign a SW ID to the message and fix up its report type.
+ *
+ * @return the length of the message to write or a negative errno
+ */
+static int
+hidpp20_prepare_command(struct hidpp20_device *device, union hidpp20_message *msg)
+{
 	if (msg->msg.address & 0xf) {
 		hidpp_log_raw(&device->base, "hidpp20 error: sw address is already set\n");
 		return -EINVAL;
 	}
-	msg->msg.address |= DEVICE_SW_ID;
+	msg->msg.address |= hidpp20_next_sw_id(device);
 
 	/* some mice don't support short reports */
 	if (msg->msg.report_id == REPORT_ID_SHORT && !(device->base.supported_report_types & HIDPP_REPORT_SHORT))
@@ -144,7 +163,75 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 		return -EINVAL;
 	}
 
-	msg_len = msg->msg.report_id == REPORT_ID_SHORT ? SHORT_MESSAGE_LENGTH : LONG_MESSAGE_LENGTH;
+	return msg->msg.report_id == REPORT_ID_SHORT ? SHORT_MESSAGE_LENGTH : LONG_MESSAGE_LENGTH;
+}
+
+enum hidpp20_reply {
+	HIDPP20_REPLY_NONE,
+	HIDPP20_REPLY_ANSWER,
+	HIDPP20_REPLY_ERROR,
+};
+
+/**
+ * Check whether reply is the answer to msg, i.e. it has the same
+ * feature index, function and SW ID, or the error message for it.
+ */
+static enum hidpp20_reply
+hidpp20_match_reply(struct hidpp20_device *device,
+		    const union hidpp20_message *msg,
+		    const union hidpp20_message *reply,
+		    bool allow_error,
+		    uint8_t *hidpp_err)
+{
+	if (reply->msg.report_id != REPORT_ID_SHORT &&
+	    reply->msg.report_id != REPORT_ID_LONG)
+		return HIDPP20_REPLY_NONE;
+
+	/* actual answer */
+	if (reply->msg.sub_id == msg->msg.sub_id &&
+	    reply->msg.address == msg->msg.address)
+		return HIDPP20_REPLY_ANSWER;
+
+	/* error */
+	if ((reply->msg.sub_id == __ERROR_MSG ||
+	     reply->msg.sub_id == 0xff) &&
+	    reply->msg.address == msg->msg.sub_id &&
+	    reply->msg.parameters[0] == msg->msg.address) {
+		*hidpp_err = reply->msg.parameters[1];
+		ratbag_stats_protocol_error(device->base.stats, *hidpp_err);
+		if (allow_error)
+			hidpp_log_debug(&device->base,
+					"    HID++ error from the device (%d): %s (%02x)\n",
+					reply->msg.device_idx,
+					hidpp20_errors[*hidpp_err] ? hidpp20_errors[*hidpp_err] : "Undocumented error code",
+					*hidpp_err);
+		else
+			hidpp_log_error(&device->base,
+					"    HID++ error from the device (%d): %s (%02x)\n",
+					reply->msg.device_idx,
+					hidpp20_errors[*hidpp_err] ? hidpp20_errors[*hidpp_err] : "Undocumented error code",
+					*hidpp_err);
+		return HIDPP20_REPLY_ERROR;
+	}
+
+	return HIDPP20_REPLY_NONE;
+}
+
+static int
+hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20_message *msg,
+				    bool allow_error)
+{
+	union hidpp20_message read_buffer;
+	int ret;
+	uint8_t hidpp_err = 0;
+	int msg_len;
+	uint64_t start;
+
+	msg_len = hidpp20_prepare_command(device, msg);
+	if (msg_len < 0)
+		return msg_len;
+
+	start = ratbag_stats_begin(device->base.stats);
 
 	/* Send the message to the Device */
 	ret = hidpp_write_command(&device->base, msg->data, msg_len);
@@ -160,39 +247,17 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 
 		/* Wait and retry if the USB timed out */
 		if (ret == -ETIMEDOUT) {
+			ratbag_stats_inc(device->base.stats, RATBAG_STAT_RETRIES);
 			msleep(10);
 			ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
 		}
 
-		if (read_buffer.msg.report_id != REPORT_ID_SHORT &&
-		    read_buffer.msg.report_id != REPORT_ID_LONG)
-			continue;
-
-		/* actual answer */
-		if (read_buffer.msg.sub_id == msg->msg.sub_id &&
-		    read_buffer.msg.address == msg->msg.address)
+		if (ret < 0)
 			break;
 
-		/* error */
-		if ((read_buffer.msg.sub_id == __ERROR_MSG ||
-		     read_buffer.msg.sub_id == 0xff) &&
-		    read_buffer.msg.address == msg->msg.sub_id &&
-		    read_buffer.msg.parameters[0] == msg->msg.address) {
-			hidpp_err = read_buffer.msg.parameters[1];
-			if (allow_error)
-				hidpp_log_debug(&device->base,
-						"    HID++ error from the device (%d): %s (%02x)\n",
-						read_buffer.msg.device_idx,
-						hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
-						hidpp_err);
-			else
-				hidpp_log_error(&device->base,
-						"    HID++ error from the device (%d): %s (%02x)\n",
-						read_buffer.msg.device_idx,
-						hidpp20_errors[hidpp_err] ? hidpp20_errors[hidpp_err] : "Undocumented error code",
-						hidpp_err);
+		if (hidpp20_match_reply(device, msg, &read_buffer,
+					allow_error, &hidpp_err) != HIDPP20_REPLY_NONE)
 			break;
-		}
 	} while (ret > 0);
 
 	if (ret < 0) {
@@ -209,6 +274,194 @@ hidpp20_request_command_allow_error(struct hidpp20_device *device, union hidpp20
 	ret = hidpp_err;
 
 out_err:
+	ratbag_stats_request(device->base.stats, start);
+	return ret;
+}
+
+struct hidpp20_in_flight {
+	size_t msg_idx;
+	uint8_t address; /* function without the SW ID */
+	uint64_t start;
+	bool retried;
+};
+
+static int
+hidpp20_send_in_flight(struct hidpp20_device *device,
+		       union hidpp20_message *msg,
+		       struct hidpp20_in_flight *in_flight)
+{
+	int msg_len;
+	int ret;
+
+	msg->msg.address = in_flight->address;
+	msg_len = hidpp20_prepare_command(device, msg);
+	if (msg_len < 0)
+		return msg_len;
+
+	in_flight->start = ratbag_stats_begin(device->base.stats);
+
+	ret = hidpp_write_command(&device->base, msg->data, msg_len);
+	if (ret)
+		ratbag_stats_request(device->base.stats, in_flight->start);
+
+	return ret;
+}
+
+/**
+ * Wait for the replies to the requests still in flight and throw them
+ * away, so that none of them is taken for the answer to a later request
+ * with the same SW ID. Gives up on the first read that times out.
+ */
+static void
+hidpp20_drain_in_flight(struct hidpp20_device *device,
+			union hidpp20_message *msgs,
+			struct hidpp20_in_flight *in_flight,
+			size_t n_in_flight)
+{
+	union hidpp20_message read_buffer;
+	uint8_t hidpp_err = 0;
+
+	while (n_in_flight > 0 &&
+	       hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH) > 0) {
+		for (size_t i = 0; i < n_in_flight; i++) {
+			union hidpp20_message *msg = &msgs[in_flight[i].msg_idx];
+
+			if (hidpp20_match_reply(device, msg, &read_buffer,
+						true, &hidpp_err) == HIDPP20_REPLY_NONE)
+				continue;
+
+			ratbag_stats_request(device->base.stats, in_flight[i].start);
+			in_flight[i] = in_flight[--n_in_flight];
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < n_in_flight; i++)
+		ratbag_stats_request(device->base.stats, in_flight[i].start);
+}
+
+/**
+ * Send count requests to the device, keeping up to HIDPP20_MAX_IN_FLIGHT
+ * of them outstanding, and store each reply in place of its request.
+ * Replies are matched to their requests by feature index, function and
+ * SW ID, so they may arrive in any order.
+ *
+ * A request the device answers with ERR_BUSY is sent once more after a
+ * short wait. If the device stops answering, the requests without a reply
+ * are retried one by one through hidpp20_request_command().
+ *
+ * @return 0 on success, a negative errno on transport failure or -EPROTO
+ * if the device replied with an error to any of the requests. On error,
+ * the replies to the requests still in flight have been discarded.
+ */
+static int
+hidpp20_request_commands(struct hidpp20_device *device,
+			 union hidpp20_message *msgs,
+			 size_t count)
+{
+	struct hidpp20_in_flight in_flight[HIDPP20_MAX_IN_FLIGHT];
+	size_t n_in_flight = 0;
+	size_t next = 0;
+	size_t done = 0;
+	union hidpp20_message read_buffer;
+	uint8_t hidpp_err = 0;
+	int ret;
+
+	while (done < count) {
+		/* Fill the window */
+		while (n_in_flight < ARRAY_LENGTH(in_flight) && next < count) {
+			struct hidpp20_in_flight *f = &in_flight[n_in_flight];
+
+			f->msg_idx = next;
+			f->address = msgs[next].msg.address;
+			f->retried = false;
+
+			ret = hidpp20_send_in_flight(device, &msgs[next], f);
+			if (ret)
+				goto out_drain;
+
+			n_in_flight++;
+			next++;
+		}
+
+		ret = hidpp_read_response(&device->base, read_buffer.data, LONG_MESSAGE_LENGTH);
+		if (ret == -ETIMEDOUT)
+			break;
+		if (ret < 0) {
+			hidpp_log_error(&device->base, "    USB error: %s (%d)\n", strerror(-ret), -ret);
+			goto out_drain;
+		}
+
+		for (size_t i = 0; i < n_in_flight; i++) {
+			union hidpp20_message *msg = &msgs[in_flight[i].msg_idx];
+
+			switch (hidpp20_match_reply(device, msg, &read_buffer,
+						    false, &hidpp_err)) {
+			case HIDPP20_REPLY_NONE:
+				continue;
+			case HIDPP20_REPLY_ERROR:
+				ratbag_stats_request(device->base.stats,
+						     in_flight[i].start);
+				if (hidpp_err == HIDPP20_ERR_BUSY &&
+				    !in_flight[i].retried) {
+					/* Wait and retry if the device is busy */
+					ratbag_stats_inc(device->base.stats, RATBAG_STAT_RETRIES);
+					msleep(10);
+					in_flight[i].retried = true;
+					ret = hidpp20_send_in_flight(device, msg,
+								     &in_flight[i]);
+					if (ret) {
+						in_flight[i] = in_flight[--n_in_flight];
+						goto out_drain;
+					}
+					break;
+				}
+				in_flight[i] = in_flight[--n_in_flight];
+				ret = -EPROTO;
+				goto out_drain;
+			case HIDPP20_REPLY_ANSWER:
+				ratbag_stats_request(device->base.stats,
+						     in_flight[i].start);
+				*msg = read_buffer;
+				in_flight[i] = in_flight[--n_in_flight];
+				done++;
+				break;
+			}
+
+			break;
+		}
+	}
+
+	if (done == count)
+		return 0;
+
+	/* The device dropped some of our requests, fall back to sending
+	 * the remaining ones one at a time */
+	hidpp_log_debug(&device->base,
+			"hidpp20: %zu requests unanswered, retrying sequentially\n",
+			count - done);
+
+	for (size_t i = 0; i < n_in_flight; i++) {
+		union hidpp20_message *msg = &msgs[in_flight[i].msg_idx];
+
+		ratbag_stats_request(device->base.stats, in_flight[i].start);
+		msg->msg.address = in_flight[i].address;
+		ret = hidpp20_request_command(device, msg);
+		if (ret)
+			return ret;
+	}
+
+	for (; next < count; next++) {
+		ret = hidpp20_request_command(device, &msgs[next]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+
+out_drain:
+	hidpp20_drain_in_flight(device, msgs, in_flight, n_in_flight);
+
 	return ret;
 }
 
@@ -220,6 +473,37 @@ hidpp20_request_command(struct hidpp20_device *device, union hidpp20_message *ms
 	return ret > 0 ? -EPROTO : ret;
 }
 
+int
+hidpp20_send_request(struct hidpp20_device *device, union hidpp20_message *msg)
+{
+	int msg_len;
+
+	msg_len = hidpp20_prepare_command(device, msg);
+	if (msg_len < 0)
+		return msg_len;
+
+	return hidpp_write_command(&device->base, msg->data, msg_len);
+}
+
+int
+hidpp20_check_reply(struct hidpp20_device *device,
+		    const union hidpp20_message *msg,
+		    const union hidpp20_message *reply)
+{
+	uint8_t hidpp_err = 0;
+
+	switch (hidpp20_match_reply(device, msg, reply, false, &hidpp_err)) {
+	case HIDPP20_REPLY_ANSWER:
+		return 0;
+	case HIDPP20_REPLY_ERROR:
+		return -EPROTO;
+	case HIDPP20_REPLY_NONE:
+		break;
+	}
+
+	return -EAGAIN;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x0000: Root                                                               */
 /* -------------------------------------------------------------------------- */
@@ -229,10 +513,7 @@ hidpp20_request_command(struct hidpp20_device *device, union hidpp20_message *ms
 #define CMD_ROOT_GET_FEATURE				0x00
 #define CMD_ROOT_GET_PROTOCOL_VERSION			0x10
 
-/**
- * Returns the feature index or 0x00 if it is not found.
- */
-static uint8_t
+uint8_t
 hidpp_root_get_feature_idx(struct hidpp20_device *device,
 			   uint16_t feature)
 {
@@ -361,12 +642,7 @@ hidpp20_feature_set_get_feature_id(struct hidpp20_device *device,
 	return 0;
 }
 
-/**
- * allocates the list of features.
- *
- * returns 0 or a negative error
- */
-static int
+int
 hidpp20_feature_set_get(struct hidpp20_device *device)
 {
 	uint8_t feature_index, feature_type, feature_version;
@@ -407,6 +683,7 @@ hidpp20_feature_set_get(struct hidpp20_device *device)
 			goto err;
 	}
 
+	free(device->feature_list);
 	device->feature_list = flist;
 	device->feature_count = feature_count;
 
@@ -416,6 +693,56 @@ err:
 	return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+/* 0x0003: Device Info                                                        */
+/* -------------------------------------------------------------------------- */
+
+#define CMD_DEVICE_INFO_GET_FW_INFO			0x10
+
+int
+hidpp20_device_info_get_fw_info(struct hidpp20_device *device,
+				uint8_t entity,
+				struct hidpp20_fw_info *info)
+{
+	uint8_t feature_index, feature_type, feature_version;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_SHORT,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_DEVICE_INFO_GET_FW_INFO,
+		.msg.parameters[0] = entity,
+	};
+
+	/* Don't rely on the feature list, this may be called to decide
+	 * whether a cached feature list can be used */
+	rc = hidpp_root_get_feature(device,
+				    HIDPP_PAGE_DEVICE_INFO,
+				    &feature_index,
+				    &feature_type,
+				    &feature_version);
+	if (rc)
+		return rc;
+
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	msg.msg.sub_id = feature_index;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	info->feature_index = feature_index;
+	info->type = msg.msg.parameters[0] & 0x0f;
+	memcpy(info->prefix, &msg.msg.parameters[1], 3);
+	info->prefix[3] = '\0';
+	info->number = msg.msg.parameters[4];
+	info->revision = msg.msg.parameters[5];
+	info->build = get_unaligned_be_u16(&msg.msg.parameters[6]);
+
+	return 0;
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x1000: Battery level status                                               */
 /* -------------------------------------------------------------------------- */
@@ -650,24 +977,37 @@ bool hidpp20_led_sw_control_get_sw_ctrl(struct hidpp20_device* device)
 	return msg.msg.parameters[0];
 }
 
-int hidpp20_led_sw_control_set_sw_ctrl(struct hidpp20_device* device, bool ctrl)
+int hidpp20_led_sw_control_set_sw_ctrl_message(struct hidpp20_device* device, bool ctrl,
+		union hidpp20_message *msg)
 {
 	uint8_t feature_idx;
-	union hidpp20_message msg = {
+
+	feature_idx = hidpp_root_get_feature_idx(device, HIDPP_PAGE_LED_SW_CONTROL);
+
+	if (feature_idx == 0)
+		return -ENOTSUP;
+
+	*msg = (union hidpp20_message) {
 		.msg = {
 			.report_id = REPORT_ID_SHORT,
 			.address = CMD_LED_SW_CONTROL_SET_SW_CTRL,
 			.device_idx = device->index,
+			.sub_id = feature_idx,
+			.parameters[0] = ctrl,
 		},
 	};
 
-	feature_idx = hidpp_root_get_feature_idx(device, HIDPP_PAGE_LED_SW_CONTROL);
+	return 0;
+}
 
-	if (feature_idx == 0)
-		return -ENOTSUP;
+int hidpp20_led_sw_control_set_sw_ctrl(struct hidpp20_device* device, bool ctrl)
+{
+	union hidpp20_message msg;
+	int rc;
 
-	msg.msg.sub_id = feature_idx;
-	msg.msg.parameters[0] = ctrl;
+	rc = hidpp20_led_sw_control_set_sw_ctrl_message(device, ctrl, &msg);
+	if (rc)
+		return rc;
 
 	if (hidpp20_request_command(device, &msg))
 		return -EINVAL;
@@ -719,34 +1059,47 @@ int hidpp20_led_sw_control_get_led_state(struct hidpp20_device* device,
 	return 0;
 }
 
-int hidpp20_led_sw_control_set_led_state(struct hidpp20_device* device,
-		const struct hidpp20_led_sw_ctrl_led_state *state)
+int hidpp20_led_sw_control_set_led_state_message(struct hidpp20_device* device,
+		const struct hidpp20_led_sw_ctrl_led_state *state,
+		union hidpp20_message *msg)
 {
-	int rc;
 	uint8_t feature_idx;
-	union hidpp20_message msg = {
+
+	feature_idx = hidpp_root_get_feature_idx(device, HIDPP_PAGE_LED_SW_CONTROL);
+
+	if (feature_idx == 0)
+		return -ENOTSUP;
+
+	if (!hidpp20_led_sw_control_check_state(state->mode))
+		return -EINVAL;
+
+	*msg = (union hidpp20_message) {
 		.msg = {
 			.report_id = REPORT_ID_LONG,
 			.address = CMD_LED_SW_CONTROL_SET_LED_STATE,
 			.device_idx = device->index,
+			.sub_id = feature_idx,
+			.parameters[0] = state->index,
 		}
 	};
 
-	feature_idx = hidpp_root_get_feature_idx(device, HIDPP_PAGE_LED_SW_CONTROL);
+	set_unaligned_be_u16(&msg->msg.parameters[1], state->mode);
+	set_unaligned_be_u16(&msg->msg.parameters[3], state->blink.index);
+	set_unaligned_be_u16(&msg->msg.parameters[5], state->blink.on_time);
+	set_unaligned_be_u16(&msg->msg.parameters[7], state->blink.off_time);
 
-	if (feature_idx == 0)
-		return -ENOTSUP;
-
-	msg.msg.sub_id = feature_idx;
+	return 0;
+}
 
-	if (!hidpp20_led_sw_control_check_state(state->mode))
-		return -EINVAL;
+int hidpp20_led_sw_control_set_led_state(struct hidpp20_device* device,
+		const struct hidpp20_led_sw_ctrl_led_state *state)
+{
+	int rc;
+	union hidpp20_message msg;
 
-	msg.msg.parameters[0] = state->index;
-	set_unaligned_be_u16(&msg.msg.parameters[1], state->mode);
-	set_unaligned_be_u16(&msg.msg.parameters[3], state->blink.index);
-	set_unaligned_be_u16(&msg.msg.parameters[5], state->blink.on_time);
-	set_unaligned_be_u16(&msg.msg.parameters[7], state->blink.off_time);
+	rc = hidpp20_led_sw_control_set_led_state_message(device, state, &msg);
+	if (rc)
+		return rc;
 
 	rc = hidpp20_request_command(device, &msg);
 
@@ -1017,29 +1370,48 @@ hidpp20_color_led_effect_get_zone_effect_info(struct hidpp20_device *device,
 }
 
 int
-hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
-					  uint8_t zone_index,
-					  struct hidpp20_led led)
+hidpp20_color_led_effects_set_zone_effect_message(struct hidpp20_device *device,
+						  uint8_t zone_index,
+						  struct hidpp20_led led,
+						  bool persist,
+						  union hidpp20_message *msg)
 {
 	uint8_t feature_index;
-	union hidpp20_message msg = {
+	struct hidpp20_internal_led *internal_led;
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_COLOR_LED_EFFECTS);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	*msg = (union hidpp20_message) {
 		.msg.report_id = REPORT_ID_LONG,
 		.msg.address = CMD_COLOR_LED_EFFECTS_SET_ZONE_EFFECT,
 		.msg.device_idx = device->index,
+		.msg.sub_id = feature_index,
 		.msg.parameters[0] = zone_index,
-		.msg.parameters[12] = 1, /* write to RAM and flash */
+		.msg.parameters[12] = persist ? 1 : 0, /* 1: RAM and flash, 0: RAM only */
 	};
-	int rc;
-	struct hidpp20_internal_led *internal_led = (struct hidpp20_internal_led*) &msg.msg.parameters[1];
 
+	internal_led = (struct hidpp20_internal_led*) &msg->msg.parameters[1];
 	hidpp20_onboard_profiles_write_led(internal_led, &led);
 
-	feature_index = hidpp_root_get_feature_idx(device,
-						   HIDPP_PAGE_COLOR_LED_EFFECTS);
-	if (feature_index == 0)
-		return -ENOTSUP;
+	return 0;
+}
 
-	msg.msg.sub_id = feature_index;
+int
+hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
+					  uint8_t zone_index,
+					  struct hidpp20_led led,
+					  bool persist)
+{
+	union hidpp20_message msg;
+	int rc;
+
+	rc = hidpp20_color_led_effects_set_zone_effect_message(device, zone_index,
+							       led, persist, &msg);
+	if (rc)
+		return rc;
 
 	rc = hidpp20_request_command(device, &msg);
 	if (rc)
@@ -1647,36 +2019,39 @@ err:
 	return rc > 0 ? -EPROTO : rc;
 }
 
-int hidpp20_adjustable_dpi_set_sensor_dpi(struct hidpp20_device *device,
-					  struct hidpp20_sensor *sensor, uint16_t dpi)
+int hidpp20_adjustable_dpi_set_sensor_dpi_message(struct hidpp20_device *device,
+						  struct hidpp20_sensor *sensor, uint16_t dpi,
+						  union hidpp20_message *msg)
 {
 	uint8_t feature_index;
-	uint16_t returned_parameters;
-	int rc;
-	union hidpp20_message msg = {
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ADJUSTABLE_DPI);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	*msg = (union hidpp20_message) {
 		.msg.report_id = REPORT_ID_SHORT,
 		.msg.device_idx = device->index,
 		.msg.address = CMD_ADJUSTABLE_DPI_SET_SENSOR_DPI,
+		.msg.sub_id = feature_index,
 		.msg.parameters[0] = sensor->index,
 	};
 
 	if (device->quirk == HIDPP20_QUIRK_G602)
-		msg.msg.parameters[0] = 1;
+		msg->msg.parameters[0] = 1;
 
-	set_unaligned_be_u16(&msg.msg.parameters[1], dpi);
+	set_unaligned_be_u16(&msg->msg.parameters[1], dpi);
 
-	feature_index = hidpp_root_get_feature_idx(device,
-						   HIDPP_PAGE_ADJUSTABLE_DPI);
-	if (feature_index == 0)
-		return -ENOTSUP;
-
-	msg.msg.sub_id = feature_index;
+	return 0;
+}
 
-	rc = hidpp20_request_command(device, &msg);
-	if (rc)
-		return rc;
+int hidpp20_adjustable_dpi_check_sensor_dpi_reply(const union hidpp20_message *reply,
+						  uint16_t dpi)
+{
+	uint16_t returned_parameters;
 
-	returned_parameters = get_unaligned_be_u16(&msg.msg.parameters[1]);
+	returned_parameters = get_unaligned_be_u16(&reply->msg.parameters[1]);
 
 	/* version 0 of the protocol does not echo the parameters */
 	if (returned_parameters != dpi && returned_parameters)
@@ -1685,6 +2060,23 @@ int hidpp20_adjustable_dpi_set_sensor_dpi(struct hidpp20_device *device,
 	return 0;
 }
 
+int hidpp20_adjustable_dpi_set_sensor_dpi(struct hidpp20_device *device,
+					  struct hidpp20_sensor *sensor, uint16_t dpi)
+{
+	int rc;
+	union hidpp20_message msg;
+
+	rc = hidpp20_adjustable_dpi_set_sensor_dpi_message(device, sensor, dpi, &msg);
+	if (rc)
+		return rc;
+
+	rc = hidpp20_request_command(device, &msg);
+	if (rc)
+		return rc;
+
+	return hidpp20_adjustable_dpi_check_sensor_dpi_reply(&msg, dpi);
+}
+
 /* -------------------------------------------------------------------------- */
 /* 0x8060 - Adjustable Report Rate                                            */
 /* -------------------------------------------------------------------------- */
@@ -1748,24 +2140,37 @@ int hidpp20_adjustable_report_rate_get_report_rate(struct hidpp20_device *device
 	return 0;
 }
 
-int hidpp20_adjustable_report_rate_set_report_rate(struct hidpp20_device *device,
-						   uint8_t rate_ms)
+int hidpp20_adjustable_report_rate_set_report_rate_message(struct hidpp20_device *device,
+							   uint8_t rate_ms,
+							   union hidpp20_message *msg)
 {
 	uint8_t feature_index;
-	int rc;
-	union hidpp20_message msg = {
+
+	feature_index = hidpp_root_get_feature_idx(device,
+						   HIDPP_PAGE_ADJUSTABLE_REPORT_RATE);
+	if (feature_index == 0)
+		return -ENOTSUP;
+
+	*msg = (union hidpp20_message) {
 		.msg.report_id = REPORT_ID_SHORT,
 		.msg.device_idx = device->index,
 		.msg.address = CMD_ADJUSTABLE_REPORT_RATE_SET_REPORT_RATE,
+		.msg.sub_id = feature_index,
 		.msg.parameters[0] = rate_ms,
 	};
 
-	feature_index = hidpp_root_get_feature_idx(device,
-						   HIDPP_PAGE_ADJUSTABLE_REPORT_RATE);
-	if (feature_index == 0)
-		return -ENOTSUP;
+	return 0;
+}
 
-	msg.msg.sub_id = feature_index;
+int hidpp20_adjustable_report_rate_set_report_rate(struct hidpp20_device *device,
+						   uint8_t rate_ms)
+{
+	int rc;
+	union hidpp20_message msg;
+
+	rc = hidpp20_adjustable_report_rate_set_report_rate_message(device, rate_ms, &msg);
+	if (rc)
+		return rc;
 
 	rc = hidpp20_request_command(device, &msg);
 	if (rc)
@@ -1873,10 +2278,11 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 				     uint16_t sector_size,
 				     uint8_t *data)
 {
-	uint16_t offset;
+	union hidpp20_message msgs[HIDPP20_MAX_IN_FLIGHT * 4];
+	uint16_t offsets[ARRAY_LENGTH(msgs)];
+	uint16_t offset = 0;
 	uint8_t feature_index;
 	int rc = 0;
-	union hidpp20_message buf;
 	union hidpp20_message msg = {
 		.msg.report_id = REPORT_ID_LONG,
 		.msg.device_idx = device->index,
@@ -1893,23 +2299,155 @@ hidpp20_onboard_profiles_read_sector(struct hidpp20_device *device,
 	msg.msg.sub_id = feature_index;
 	set_unaligned_be_u16(&msg.msg.parameters[0], sector);
 
-	for (offset = 0; offset < sector_size; offset += 16) {
-		/*
-		 * the firmware replies with an ERR_INVALID_ARGUMENT error
-		 * if we try to read past sector_size - 16, so when we are left with
-		 * less than 16 bytes to read we need to read from sector_size - 16
-		 */
-		offset = (sector_size - offset < 16) ? sector_size - 16 : offset;
-		set_unaligned_be_u16(&msg.msg.parameters[2], offset);
-		buf = msg;
-		rc = hidpp20_request_command(device, &buf);
+	while (offset < sector_size) {
+		size_t count = 0;
+
+		/* Queue up a batch of 16 byte reads, they are pipelined by
+		 * hidpp20_request_commands() */
+		while (count < ARRAY_LENGTH(msgs) && offset < sector_size) {
+			/*
+			 * the firmware replies with an ERR_INVALID_ARGUMENT error
+			 * if we try to read past sector_size - 16, so when we are left with
+			 * less than 16 bytes to read we need to read from sector_size - 16
+			 */
+			offset = (sector_size - offset < 16) ? sector_size - 16 : offset;
+			set_unaligned_be_u16(&msg.msg.parameters[2], offset);
+			msgs[count] = msg;
+			offsets[count] = offset;
+			count++;
+			offset += 16;
+		}
+
+		rc = hidpp20_request_commands(device, msgs, count);
 		if (rc)
 			return rc;
 
 		/* msg.msg.parameters is guaranteed to have a size >= 16 */
-		memcpy(data + offset, buf.msg.parameters, 16);
+		for (size_t i = 0; i < count; i++)
+			memcpy(data + offsets[i], msgs[i].msg.parameters, 16);
+	}
+
+	return 0;
+}
+
+static struct hidpp20_snapshot_sector *
+hidpp20_onboard_profiles_find_snapshot(struct hidpp20_profiles *profiles,
+				       uint16_t address)
+{
+	for (unsigned int i = 0; i < profiles->snapshot_count; i++) {
+		if (profiles->snapshot[i].address == address)
+			return &profiles->snapshot[i];
+	}
+
+	return NULL;
+}
+
+static void
+hidpp20_onboard_profiles_set_snapshot(struct hidpp20_profiles *profiles,
+				      uint16_t address,
+				      const uint8_t *data,
+				      bool verified)
+{
+	struct hidpp20_snapshot_sector *sector;
+
+	sector = hidpp20_onboard_profiles_find_snapshot(profiles, address);
+	if (!sector) {
+		struct hidpp20_snapshot_sector *tmp;
+
+		tmp = zalloc((profiles->snapshot_count + 1) * sizeof(*tmp));
+		if (profiles->snapshot_count)
+			memcpy(tmp, profiles->snapshot,
+			       profiles->snapshot_count * sizeof(*tmp));
+		free(profiles->snapshot);
+		profiles->snapshot = tmp;
+
+		sector = &profiles->snapshot[profiles->snapshot_count++];
+		sector->address = address;
+		sector->data = hidpp20_onboard_profiles_allocate_sector(profiles);
+	}
+
+	memcpy(sector->data, data, profiles->sector_size);
+	sector->verified = verified;
+}
+
+void
+hidpp20_onboard_profiles_add_snapshot(struct hidpp20_profiles *profiles,
+				      uint16_t address,
+				      const uint8_t *data)
+{
+	hidpp20_onboard_profiles_set_snapshot(profiles, address, data, false);
+}
+
+static void
+hidpp20_onboard_profiles_drop_unverified_snapshot(struct hidpp20_profiles *profiles)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < profiles->snapshot_count; i++) {
+		if (!profiles->snapshot[i].verified) {
+			free(profiles->snapshot[i].data);
+			continue;
+		}
+		profiles->snapshot[n++] = profiles->snapshot[i];
 	}
 
+	profiles->snapshot_count = n;
+}
+
+/**
+ * Read a sector, using the snapshot if the device still has the same
+ * sector. Comparing the last 16 bytes, they end with the CRC of the
+ * sector, costs one request instead of one per 16 bytes.
+ */
+static int
+hidpp20_onboard_profiles_read_sector_snapshot(struct hidpp20_device *device,
+					      struct hidpp20_profiles *profiles,
+					      uint16_t address,
+					      uint8_t *data)
+{
+	uint16_t sector_size = profiles->sector_size;
+	struct hidpp20_snapshot_sector *sector;
+	uint8_t feature_index;
+	int rc;
+	union hidpp20_message msg = {
+		.msg.report_id = REPORT_ID_LONG,
+		.msg.device_idx = device->index,
+		.msg.address = CMD_ONBOARD_PROFILES_MEMORY_READ,
+	};
+
+	sector = hidpp20_onboard_profiles_find_snapshot(profiles, address);
+	if (sector && !sector->verified) {
+		feature_index = hidpp_root_get_feature_idx(device,
+							   HIDPP_PAGE_ONBOARD_PROFILES);
+		if (feature_index == 0)
+			return -ENOTSUP;
+
+		msg.msg.sub_id = feature_index;
+		set_unaligned_be_u16(&msg.msg.parameters[0], address);
+		set_unaligned_be_u16(&msg.msg.parameters[2], sector_size - 16);
+
+		rc = hidpp20_request_command(device, &msg);
+		if (rc)
+			return rc;
+
+		sector->verified = memcmp(msg.msg.parameters,
+					  sector->data + sector_size - 16,
+					  16) == 0;
+		hidpp_log_debug(&device->base, "Sector 0x%04x %s the snapshot\n",
+				address, sector->verified ? "matches" : "differs from");
+	}
+
+	if (sector && sector->verified) {
+		memcpy(data, sector->data, sector_size);
+		return 0;
+	}
+
+	rc = hidpp20_onboard_profiles_read_sector(device, address, sector_size, data);
+	if (rc)
+		return rc;
+
+	hidpp20_onboard_profiles_set_snapshot(profiles, address, data, true);
+
 	return 0;
 }
 
@@ -2275,6 +2813,10 @@ hidpp20_onboard_profiles_allocate(struct hidpp20_device *device,
 
 	profiles = zalloc(sizeof(struct hidpp20_profiles));
 	profiles->profiles = zalloc(info.profile_count * sizeof(struct hidpp20_profile));
+	profiles->shadow = zalloc((info.profile_count + 1) * info.sector_size);
+	profiles->shadow_valid = zalloc((info.profile_count + 1) * sizeof(bool));
+	profiles->rom = zalloc(info.profile_count_oob * info.sector_size);
+	profiles->rom_valid = zalloc(info.profile_count_oob * sizeof(bool));
 	profiles->sector_size = info.sector_size;
 	profiles->sector_count = info.sector_count;
 	profiles->num_profiles = info.profile_count;
@@ -2380,10 +2922,10 @@ hidpp20_onboard_profiles_read_macro(struct hidpp20_device *device,
 		}
 
 		if (rc == -ENOMEM) {
-			rc = hidpp20_onboard_profiles_read_sector(device,
-								  page,
-								  profiles->sector_size,
-								  memory);
+			rc = hidpp20_onboard_profiles_read_sector_snapshot(device,
+									   profiles,
+									   page,
+									   memory);
 			if (rc)
 				goto out_err;
 		}
@@ -2496,10 +3038,86 @@ hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list)
 		}
 	}
 
+	for (i = 0; i < profiles_list->snapshot_count; i++)
+		free(profiles_list->snapshot[i].data);
+	free(profiles_list->snapshot);
+	free(profiles_list->shadow);
+	free(profiles_list->shadow_valid);
+	free(profiles_list->rom);
+	free(profiles_list->rom_valid);
 	free(profiles_list->profiles);
 	free(profiles_list);
 }
 
+/**
+ * Sector slot in the shadow copy: 0 for the directory, i + 1 for the user
+ * profile i. Returns -1 for any other sector, e.g. the ROM profiles.
+ */
+static int
+hidpp20_onboard_profiles_shadow_index(struct hidpp20_profiles *profiles_list,
+				      uint16_t sector)
+{
+	if (sector > profiles_list->num_profiles)
+		return -1;
+
+	return sector;
+}
+
+static void
+hidpp20_onboard_profiles_update_shadow(struct hidpp20_profiles *profiles_list,
+				       uint16_t sector,
+				       const uint8_t *data)
+{
+	int idx = hidpp20_onboard_profiles_shadow_index(profiles_list, sector);
+
+	if (idx < 0)
+		return;
+
+	memcpy(profiles_list->shadow + idx * profiles_list->sector_size,
+	       data,
+	       profiles_list->sector_size);
+	profiles_list->shadow_valid[idx] = true;
+}
+
+/**
+ * Write a user sector, computing its CRC first, unless the device already
+ * has the exact same bytes in it.
+ */
+static int
+hidpp20_onboard_profiles_write_sector_if_changed(struct hidpp20_device *device,
+						 struct hidpp20_profiles *profiles_list,
+						 uint16_t sector,
+						 uint8_t *data)
+{
+	uint16_t sector_size = profiles_list->sector_size;
+	int idx = hidpp20_onboard_profiles_shadow_index(profiles_list, sector);
+	uint16_t crc;
+	int rc;
+
+	crc = hidpp_crc_ccitt(data, sector_size - 2);
+	set_unaligned_be_u16(&data[sector_size - 2], crc);
+
+	if (idx >= 0 && profiles_list->shadow_valid[idx] &&
+	    memcmp(profiles_list->shadow + idx * sector_size, data, sector_size) == 0) {
+		hidpp_log_debug(&device->base,
+				"sector 0x%04x unchanged, skipping write\n", sector);
+		return 0;
+	}
+
+	if (idx >= 0)
+		profiles_list->shadow_valid[idx] = false;
+
+	rc = hidpp20_onboard_profiles_write_sector(device, sector, sector_size,
+						   data, false);
+	if (rc)
+		return rc;
+
+	hidpp20_onboard_profiles_update_shadow(profiles_list, sector, data);
+	hidpp20_onboard_profiles_set_snapshot(profiles_list, sector, data, true);
+
+	return 0;
+}
+
 static int
 hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
 				    struct hidpp20_profiles *profiles_list)
@@ -2532,11 +3150,10 @@ hidpp20_onboard_profiles_write_dict(struct hidpp20_device *device,
 			   hidpp20_onboard_profiles_compute_dict_size(device,
 								      profiles_list));
 
-	rc = hidpp20_onboard_profiles_write_sector(device,
-						   0x0000,
-						   sector_size,
-						   data,
-						   true);
+	rc = hidpp20_onboard_profiles_write_sector_if_changed(device,
+							      profiles_list,
+							      0x0000,
+							      data);
 	if (rc)
 		hidpp_log_error(&device->base, "failed to write profile dictionary\n");
 
@@ -2700,6 +3317,43 @@ hidpp20_onboard_profiles_read_led(struct hidpp20_led *led,
 	led->brightness = brightness;
 }
 
+/**
+ * Read a profile sector. The ROM sectors never change for a given firmware
+ * so they are only read from the device if they are not in profiles->rom
+ * yet.
+ */
+static int
+hidpp20_onboard_profiles_read_profile_sector(struct hidpp20_device *device,
+					     struct hidpp20_profiles *profiles_list,
+					     uint16_t sector,
+					     uint8_t *data)
+{
+	unsigned int rom_index = sector - HIDPP20_ROM_PROFILES_G402 - 1;
+	uint16_t sector_size = profiles_list->sector_size;
+	int rc;
+
+	if (sector <= HIDPP20_ROM_PROFILES_G402 ||
+	    rom_index >= profiles_list->num_rom_profiles)
+		return hidpp20_onboard_profiles_read_sector_snapshot(device,
+								     profiles_list,
+								     sector,
+								     data);
+
+	if (profiles_list->rom_valid[rom_index]) {
+		memcpy(data, profiles_list->rom + rom_index * sector_size, sector_size);
+		return 0;
+	}
+
+	rc = hidpp20_onboard_profiles_read_sector(device, sector, sector_size, data);
+	if (rc < 0)
+		return rc;
+
+	memcpy(profiles_list->rom + rom_index * sector_size, data, sector_size);
+	profiles_list->rom_valid[rom_index] = true;
+
+	return 0;
+}
+
 static int
 hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 				       struct hidpp20_profiles *profiles_list,
@@ -2719,10 +3373,10 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 	pdata = (union hidpp20_internal_profile *)data;
 
-	rc = hidpp20_onboard_profiles_read_sector(device,
-						  sector,
-						  profiles_list->sector_size,
-						  data);
+	rc = hidpp20_onboard_profiles_read_profile_sector(device,
+							  profiles_list,
+							  sector,
+							  data);
 	if (rc < 0)
 		return rc;
 
@@ -2732,6 +3386,8 @@ hidpp20_onboard_profiles_parse_profile(struct hidpp20_device *device,
 							      data)) {
 			return -EAGAIN;
 		}
+
+		hidpp20_onboard_profiles_update_shadow(profiles_list, sector, data);
 	}
 
 	profile->report_rate = 1000 / max(1, pdata->profile.report_rate);
@@ -2788,10 +3444,10 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 
 	data = hidpp20_onboard_profiles_allocate_sector(profiles);
 
-	rc = hidpp20_onboard_profiles_read_sector(device,
-						  HIDPP20_USER_PROFILES_G402,
-						  profiles->sector_size,
-						  data);
+	rc = hidpp20_onboard_profiles_read_sector_snapshot(device,
+							   profiles,
+							   HIDPP20_USER_PROFILES_G402,
+							   data);
 
 	if (rc && device->quirk == HIDPP20_QUIRK_G305) {
 		/* The G305 has a bug where it throws an ERR_INVALID_ARGUMENT
@@ -2808,6 +3464,10 @@ hidpp20_onboard_profiles_initialize(struct hidpp20_device *device,
 							     profiles->sector_size,
 							     data);
 	if (crc_valid) {
+		hidpp20_onboard_profiles_update_shadow(profiles,
+						       HIDPP20_USER_PROFILES_G402,
+						       data);
+
 		for (i = 0; i < profiles->num_profiles; i++) {
 			uint8_t *d = data + 4 * i;
 
@@ -2866,6 +3526,8 @@ read_profiles:
 			return rc;
 	}
 
+	hidpp20_onboard_profiles_drop_unverified_snapshot(profiles);
+
 	return profiles->num_profiles;
 }
 
@@ -2923,10 +3585,10 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 {
 	union hidpp20_internal_profile *pdata;
 	_cleanup_free_ uint8_t *data = NULL;
-	uint16_t sector_size = profiles_list->sector_size;
 	uint16_t sector = index + 1;
 	struct hidpp20_profile *profile = &profiles_list->profiles[index];
 	unsigned i;
+	int idx;
 	int rc;
 
 	if (index >= profiles_list->num_profiles)
@@ -2935,7 +3597,15 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 	data = hidpp20_onboard_profiles_allocate_sector(profiles_list);
 	pdata = (union hidpp20_internal_profile *)data;
 
-	memset(data, 0xff, profiles_list->sector_size);
+	/* Start from what the device has, so the bytes we don't know
+	 * about stay the same and an unchanged profile is not rewritten */
+	idx = hidpp20_onboard_profiles_shadow_index(profiles_list, sector);
+	if (idx >= 0 && profiles_list->shadow_valid[idx])
+		memcpy(data,
+		       profiles_list->shadow + idx * profiles_list->sector_size,
+		       profiles_list->sector_size);
+	else
+		memset(data, 0xff, profiles_list->sector_size);
 
 	pdata->profile.report_rate = 1000 / profile->report_rate;
 	pdata->profile.default_dpi = profile->default_dpi;
@@ -2959,7 +3629,8 @@ hidpp20_onboard_profiles_write_profile(struct hidpp20_device *device,
 
 	memcpy(pdata->profile.name.txt, profile->name, sizeof(profile->name));
 
-	rc = hidpp20_onboard_profiles_write_sector(device, sector, sector_size, data, true);
+	rc = hidpp20_onboard_profiles_write_sector_if_changed(device, profiles_list,
+							      sector, data);
 	if (rc < 0) {
 		hidpp_log_error(&device->base, "failed to write profile\n");
 		return rc;
@@ -3046,7 +3717,10 @@ hidpp20_onboard_profiles_get_code_from_special(enum ratbag_button_action_special
 /* -------------------------------------------------------------------------- */
 
 struct hidpp20_device *
-hidpp20_device_new(const struct hidpp_device *base, unsigned int idx, struct hidpp_hid_report *reports, unsigned int num_reports)
+hidpp20_device_new_without_features(const struct hidpp_device *base,
+				    unsigned int idx,
+				    struct hidpp_hid_report *reports,
+				    unsigned int num_reports)
 {
 	struct hidpp20_device *dev;
 	int rc;
@@ -3076,16 +3750,29 @@ hidpp20_device_new(const struct hidpp_device *base, unsigned int idx, struct hid
 	if (dev->proto_major < 2)
 		goto err;
 
-	rc = hidpp20_feature_set_get(dev);
-	if (rc < 0)
-		goto err;
-
 	return dev;
 err:
 	free(dev);
 	return NULL;
 }
 
+struct hidpp20_device *
+hidpp20_device_new(const struct hidpp_device *base, unsigned int idx, struct hidpp_hid_report *reports, unsigned int num_reports)
+{
+	struct hidpp20_device *dev;
+
+	dev = hidpp20_device_new_without_features(base, idx, reports, num_reports);
+	if (!dev)
+		return NULL;
+
+	if (hidpp20_feature_set_get(dev) < 0) {
+		hidpp20_device_destroy(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
 void
 hidpp20_device_destroy(struct hidpp20_device *device)
 {
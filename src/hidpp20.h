@@ -66,10 +66,32 @@ struct hidpp20_device {
 	struct hidpp20_feature *feature_list;
 	enum hidpp20_quirk quirk;
 	unsigned int led_ext_caps;
+	uint8_t sw_id; /* last SW ID used, see hidpp20_next_sw_id() */
 };
 
 int hidpp20_request_command(struct hidpp20_device *dev, union hidpp20_message *msg);
 
+/**
+ * Assign a SW ID to msg and write it to the device without waiting for
+ * the reply. For callers that read the replies from their own event
+ * loop, msg must be kept around to match the reply with
+ * hidpp20_check_reply().
+ *
+ * @return 0 on success or a negative errno
+ */
+int hidpp20_send_request(struct hidpp20_device *dev, union hidpp20_message *msg);
+
+/**
+ * Check whether reply is the answer to msg as sent by
+ * hidpp20_send_request().
+ *
+ * @return 0 if reply is the answer, -EPROTO if it is the HID++ error
+ * for msg or -EAGAIN if it is unrelated
+ */
+int hidpp20_check_reply(struct hidpp20_device *dev,
+			const union hidpp20_message *msg,
+			const union hidpp20_message *reply);
+
 #define CASE_RETURN_STRING(a) case a: return #a; break
 
 const char *hidpp20_feature_get_name(uint16_t feature);
@@ -84,6 +106,18 @@ struct hidpp20_device *
 hidpp20_device_new(const struct hidpp_device *base, unsigned int idx,
 		   struct hidpp_hid_report *reports, unsigned int num_reports);
 
+/**
+ * Like hidpp20_device_new() but does not enumerate the features. The
+ * caller must call hidpp20_feature_set_get() or fill in feature_list and
+ * feature_count from a source it trusts, e.g. a cache validated with
+ * hidpp20_device_info_get_fw_info().
+ */
+struct hidpp20_device *
+hidpp20_device_new_without_features(const struct hidpp_device *base,
+				    unsigned int idx,
+				    struct hidpp_hid_report *reports,
+				    unsigned int num_reports);
+
 void
 hidpp20_device_destroy(struct hidpp20_device *device);
 
@@ -93,6 +127,12 @@ hidpp20_device_destroy(struct hidpp20_device *device);
 
 #define HIDPP_PAGE_ROOT					0x0000
 
+/**
+ * Returns the index of the feature from the device's feature list, without
+ * querying the device, or 0x00 if it is not found.
+ */
+uint8_t hidpp_root_get_feature_idx(struct hidpp20_device *device,
+				   uint16_t feature);
 int hidpp_root_get_feature(struct hidpp20_device *device,
 			   uint16_t feature,
 			   uint8_t *feature_index,
@@ -107,12 +147,40 @@ int hidpp20_root_get_protocol_version(struct hidpp20_device *dev,
 
 #define HIDPP_PAGE_FEATURE_SET				0x0001
 
+/**
+ * (Re)allocates the list of features in device->feature_list.
+ *
+ * returns 0 or a negative error
+ */
+int
+hidpp20_feature_set_get(struct hidpp20_device *device);
+
 /* -------------------------------------------------------------------------- */
 /* 0x0003: Device Info                                                        */
 /* -------------------------------------------------------------------------- */
 
 #define HIDPP_PAGE_DEVICE_INFO				0x0003
 
+struct hidpp20_fw_info {
+	uint8_t feature_index; /* index of 0x0003 as reported by the root feature */
+	uint8_t type;
+	char prefix[4];
+	uint8_t number; /* BCD */
+	uint8_t revision; /* BCD */
+	uint16_t build;
+};
+
+/**
+ * Query the firmware information of the given entity (0 is the main
+ * application on all devices seen so far).
+ *
+ * This does not use the device's feature list.
+ */
+int
+hidpp20_device_info_get_fw_info(struct hidpp20_device *device,
+				uint8_t entity,
+				struct hidpp20_fw_info *info);
+
 /* -------------------------------------------------------------------------- */
 /* 0x0005: Device Name                                                        */
 /* -------------------------------------------------------------------------- */
@@ -151,6 +219,10 @@ int hidpp20_batterylevel_get_battery_level(struct hidpp20_device *device,
 					   uint16_t *level,
 					   uint16_t *next_level);
 
+/* sent by the device whenever the level or status changes, same layout as
+ * the reply to getBatteryLevelStatus */
+#define HIDPP20_BATTERY_LEVEL_EVENT_STATUS_BROADCAST	0x00
+
 /* -------------------------------------------------------------------------- */
 /* 0x1001: Battery Voltage                                                    */
 /* -------------------------------------------------------------------------- */
@@ -170,6 +242,9 @@ enum hidpp20_battery_voltage_status {
 int hidpp20_batteryvoltage_get_battery_voltage(struct hidpp20_device *device,
 					       uint16_t *voltage);
 
+/* same layout as the reply to getBatteryVoltage */
+#define HIDPP20_BATTERY_VOLTAGE_EVENT_BROADCAST		0x00
+
 /* -------------------------------------------------------------------------- */
 /* 0x1300: LED software control                                               */
 /* -------------------------------------------------------------------------- */
@@ -279,6 +354,13 @@ bool hidpp20_led_sw_control_get_sw_ctrl(struct hidpp20_device* device);
  */
 int hidpp20_led_sw_control_set_sw_ctrl(struct hidpp20_device* device, bool ctrl);
 
+/**
+ * Fill msg with the request hidpp20_led_sw_control_set_sw_ctrl() sends
+ * @return 0 on success or a negative errno
+ */
+int hidpp20_led_sw_control_set_sw_ctrl_message(struct hidpp20_device* device, bool ctrl,
+	 union hidpp20_message *msg);
+
 /**
  * Gets the state of a LED
  * @return 0 on success or a negative errno
@@ -295,6 +377,14 @@ int hidpp20_led_sw_control_get_led_state(struct hidpp20_device* device,
 int hidpp20_led_sw_control_set_led_state(struct hidpp20_device* device,
 	 const struct hidpp20_led_sw_ctrl_led_state* state);
 
+/**
+ * Fill msg with the request hidpp20_led_sw_control_set_led_state() sends
+ * @return 0 on success or a negative errno
+ */
+int hidpp20_led_sw_control_set_led_state_message(struct hidpp20_device* device,
+	 const struct hidpp20_led_sw_ctrl_led_state* state,
+	 union hidpp20_message *msg);
+
 /* -------------------------------------------------------------------------- */
 /* 0x1b00: KBD reprogrammable keys and mouse buttons                          */
 /* -------------------------------------------------------------------------- */
@@ -420,6 +510,20 @@ int hidpp20_adjustable_dpi_get_sensors(struct hidpp20_device *device,
 int hidpp20_adjustable_dpi_set_sensor_dpi(struct hidpp20_device *device,
 					  struct hidpp20_sensor *sensor, uint16_t dpi);
 
+/**
+ * Fill msg with the request hidpp20_adjustable_dpi_set_sensor_dpi() sends
+ */
+int hidpp20_adjustable_dpi_set_sensor_dpi_message(struct hidpp20_device *device,
+						  struct hidpp20_sensor *sensor, uint16_t dpi,
+						  union hidpp20_message *msg);
+
+/**
+ * Check the dpi echoed in the reply to a set sensor dpi request
+ * @return 0 if the device took dpi, -EIO otherwise
+ */
+int hidpp20_adjustable_dpi_check_sensor_dpi_reply(const union hidpp20_message *reply,
+						  uint16_t dpi);
+
 /* -------------------------------------------------------------------------- */
 /* 0x8060 - Adjustable Report Rate                                            */
 /* -------------------------------------------------------------------------- */
@@ -439,6 +543,10 @@ int hidpp20_adjustable_report_rate_get_report_rate(struct hidpp20_device *device
 int hidpp20_adjustable_report_rate_set_report_rate(struct hidpp20_device *device,
 						   uint8_t rate_ms);
 
+int hidpp20_adjustable_report_rate_set_report_rate_message(struct hidpp20_device *device,
+							   uint8_t rate_ms,
+							   union hidpp20_message *msg);
+
 /* -------------------------------------------------------------------------- */
 /* 0x8070v4 - Color LED effects                                               */
 /* -------------------------------------------------------------------------- */
@@ -504,10 +612,26 @@ hidpp20_rgb_effects_get_effect_info(struct hidpp20_device *device,
 
 struct hidpp20_led;
 
+/**
+ * Set the zone's effect. With persist false the effect is only applied to
+ * RAM and lost on the next power cycle.
+ */
 int
 hidpp20_color_led_effects_set_zone_effect(struct hidpp20_device *device,
 					  uint8_t zone_index,
-					  struct hidpp20_led led);
+					  struct hidpp20_led led,
+					  bool persist);
+
+/**
+ * Fill msg with the request hidpp20_color_led_effects_set_zone_effect()
+ * sends
+ */
+int
+hidpp20_color_led_effects_set_zone_effect_message(struct hidpp20_device *device,
+						  uint8_t zone_index,
+						  struct hidpp20_led led,
+						  bool persist,
+						  union hidpp20_message *msg);
 
 int
 hidpp20_color_led_effects_get_zone_effect(struct hidpp20_device *device,
@@ -577,6 +701,10 @@ enum hidpp20_color_led_zone_effect {
 
 #define HIDPP_PAGE_ONBOARD_PROFILES			0x8100
 
+/* events, sent with a software id of 0 */
+#define HIDPP20_ONBOARD_PROFILES_EVENT_CURRENT_PROFILE_CHANGED		0x00
+#define HIDPP20_ONBOARD_PROFILES_EVENT_CURRENT_DPI_INDEX_CHANGED	0x10
+
 /* type */
 #define HIDPP20_BUTTON_HID_TYPE				0x80
 #define HIDPP20_BUTTON_SPECIAL				0x90
@@ -903,6 +1031,12 @@ struct hidpp20_onboard_profiles_info {
 } __attribute__((packed));
 _Static_assert(sizeof(struct hidpp20_onboard_profiles_info) == 16, "Invalid size");
 
+struct hidpp20_snapshot_sector {
+	uint16_t address;
+	bool verified;	/* matches the device */
+	uint8_t *data;
+};
+
 struct hidpp20_profiles {
 	uint8_t num_profiles;
 	uint8_t num_rom_profiles;
@@ -917,6 +1051,24 @@ struct hidpp20_profiles {
 	uint16_t sector_size;
 	uint8_t active_profile_index;
 	struct hidpp20_profile *profiles;
+
+	/* copy of the directory (index 0) and the user profile sectors
+	 * (index 1..num_profiles) as last read from or written to the
+	 * device, so commit can skip the sectors that did not change */
+	uint8_t *shadow;
+	bool *shadow_valid;
+
+	/* the ROM profile sectors (0x0101..), filled on first read or by the
+	 * caller before hidpp20_onboard_profiles_initialize() */
+	uint8_t *rom;
+	bool *rom_valid;
+
+	/* every other sector read while parsing the profiles: the directory,
+	 * the user profiles and the macros. The caller may add the sectors
+	 * of an earlier probe before hidpp20_onboard_profiles_initialize(),
+	 * see hidpp20_onboard_profiles_add_snapshot() */
+	struct hidpp20_snapshot_sector *snapshot;
+	unsigned int snapshot_count;
 };
 
 /**
@@ -943,6 +1095,20 @@ int hidpp20_onboard_profiles_allocate(struct hidpp20_device *device,
 void
 hidpp20_onboard_profiles_destroy(struct hidpp20_profiles *profiles_list);
 
+/**
+ * Add a sector as read from the device earlier, e.g. by a previous
+ * instance of the process. hidpp20_onboard_profiles_initialize() only
+ * reads the last 16 bytes of such a sector, they include its CRC, and
+ * only reads the full sector if they differ.
+ *
+ * Sectors that were not needed by hidpp20_onboard_profiles_initialize()
+ * are dropped, after it the snapshot matches the device.
+ */
+void
+hidpp20_onboard_profiles_add_snapshot(struct hidpp20_profiles *profiles,
+				      uint16_t address,
+				      const uint8_t *data);
+
 /**
  * initialize a struct hidpp20_profiles previous allocated with
  * hidpp20_onboard_profiles_allocate().
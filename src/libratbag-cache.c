@@ -0,0 +1,246 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "libratbag-cache.h"
+#include "libratbag-private.h"
+#include "shared-macro.h"
+
+#define GROUP_CACHE "Cache"
+#define GROUP_DATA "Data"
+
+struct ratbag_cache {
+	struct ratbag *ratbag;
+	char *path;
+	char *version;
+	GKeyFile *keyfile;
+	bool dirty;
+};
+
+static const char *
+ratbag_cache_get_dir(void)
+{
+	const char *cachedir;
+
+	cachedir = getenv("LIBRATBAG_CACHE_DIR");
+	if (!cachedir)
+		cachedir = LIBRATBAG_CACHE_DIR;
+
+	return cachedir;
+}
+
+static const char *
+ratbag_cache_get_runtime_dir(void)
+{
+	const char *rundir;
+
+	rundir = getenv("LIBRATBAG_RUNTIME_DIR");
+	if (!rundir)
+		rundir = LIBRATBAG_RUNTIME_DIR;
+
+	return rundir;
+}
+
+static struct ratbag_cache *
+ratbag_cache_load_file(struct ratbag_device *device,
+		       char *path,
+		       const char *version)
+{
+	struct ratbag_cache *cache;
+	_cleanup_free_ char *stored_version = NULL;
+
+	cache = zalloc(sizeof(*cache));
+	cache->ratbag = device->ratbag;
+	cache->version = strdup_safe(version);
+	cache->path = path;
+	cache->keyfile = g_key_file_new();
+
+	if (!g_key_file_load_from_file(cache->keyfile, cache->path,
+				       G_KEY_FILE_NONE, NULL))
+		return cache;
+
+	stored_version = g_key_file_get_string(cache->keyfile, GROUP_CACHE,
+					       "Version", NULL);
+	if (!stored_version || !streq(stored_version, version)) {
+		log_debug(device->ratbag,
+			  "Discarding cache %s for version '%s'\n",
+			  cache->path, stored_version ? stored_version : "");
+		g_key_file_free(cache->keyfile);
+		cache->keyfile = g_key_file_new();
+		return cache;
+	}
+
+	log_debug(device->ratbag, "Using cache %s\n", cache->path);
+
+	return cache;
+}
+
+struct ratbag_cache *
+ratbag_cache_load(struct ratbag_device *device,
+		  const char *name,
+		  const char *version)
+{
+	const char *cachedir = ratbag_cache_get_dir();
+	char *path;
+
+	if (access(cachedir, W_OK) != 0)
+		return NULL;
+
+	path = asprintf_safe("%s/%s-%04x-%04x-%04x.cache",
+			     cachedir,
+			     name,
+			     device->ids.bustype,
+			     device->ids.vendor,
+			     device->ids.product);
+
+	return ratbag_cache_load_file(device, path, version);
+}
+
+struct ratbag_cache *
+ratbag_cache_load_runtime(struct ratbag_device *device,
+			  const char *name,
+			  const char *version)
+{
+	const char *rundir = ratbag_cache_get_runtime_dir();
+	struct udev_device *hid_udev;
+	char *path;
+
+	if (!device->udev_device || access(rundir, W_OK) != 0)
+		return NULL;
+
+	/* The hidraw minor is handed out again after an unplug, but the
+	 * instance number in the HID device's bus:vid:pid.instance
+	 * sysname only ever goes up until the next reboot, so a device
+	 * plugged back in never gets the cache of the one it replaced */
+	hid_udev = udev_device_get_parent_with_subsystem_devtype(device->udev_device,
+								 "hid", NULL);
+	if (!hid_udev)
+		return NULL;
+
+	path = asprintf_safe("%s/%s-%s.cache",
+			     rundir,
+			     name,
+			     udev_device_get_sysname(hid_udev));
+
+	return ratbag_cache_load_file(device, path, version);
+}
+
+void
+ratbag_cache_destroy(struct ratbag_cache *cache)
+{
+	if (!cache)
+		return;
+
+	g_key_file_free(cache->keyfile);
+	free(cache->version);
+	free(cache->path);
+	free(cache);
+}
+
+ssize_t
+ratbag_cache_get(struct ratbag_cache *cache,
+		 const char *key,
+		 uint8_t *buf,
+		 size_t size)
+{
+	_cleanup_free_ char *hex = NULL;
+	size_t len, i;
+
+	hex = g_key_file_get_string(cache->keyfile, GROUP_DATA, key, NULL);
+	if (!hex)
+		return -ENOENT;
+
+	len = strlen(hex);
+	if (len % 2 || len / 2 > size)
+		return -EINVAL;
+
+	for (i = 0; i < len / 2; i++) {
+		unsigned int byte;
+
+		if (sscanf(&hex[2 * i], "%2x", &byte) != 1)
+			return -EINVAL;
+		buf[i] = byte;
+	}
+
+	return len / 2;
+}
+
+void
+ratbag_cache_set(struct ratbag_cache *cache,
+		 const char *key,
+		 const uint8_t *buf,
+		 size_t size)
+{
+	_cleanup_free_ char *hex = NULL;
+	size_t i;
+
+	hex = zalloc(2 * size + 1);
+	for (i = 0; i < size; i++)
+		snprintf(&hex[2 * i], 3, "%02x", buf[i]);
+
+	g_key_file_set_string(cache->keyfile, GROUP_DATA, key, hex);
+	cache->dirty = true;
+}
+
+void
+ratbag_cache_clear(struct ratbag_cache *cache)
+{
+	g_key_file_remove_group(cache->keyfile, GROUP_DATA, NULL);
+	cache->dirty = true;
+}
+
+int
+ratbag_cache_save(struct ratbag_cache *cache)
+{
+	_cleanup_free_ char *data = NULL;
+	GError *error = NULL;
+	gsize length;
+
+	if (!cache->dirty)
+		return 0;
+
+	g_key_file_set_string(cache->keyfile, GROUP_CACHE, "Version",
+			      cache->version);
+
+	data = g_key_file_to_data(cache->keyfile, &length, NULL);
+
+	/* g_file_set_contents() writes a temporary file and renames it, a
+	 * concurrent reader never sees a partial cache */
+	if (!g_file_set_contents(cache->path, data, length, &error)) {
+		log_debug(cache->ratbag, "Failed to write cache %s: %s\n",
+			  cache->path, error->message);
+		g_error_free(error);
+		return -EIO;
+	}
+
+	cache->dirty = false;
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "libratbag-private.h"
+
+/**
+ * A persistent, per-model store for data a driver would otherwise have to
+ * query from the device on every probe. The cache lives in
+ * LIBRATBAG_CACHE_DIR (or $LIBRATBAG_CACHE_DIR) and is only used if that
+ * directory exists and is writable.
+ *
+ * A cache file is keyed by the bus, vendor and product id of the device
+ * and the name passed in by the driver. The version string is typically
+ * the firmware version, a cache written for a different version is
+ * discarded on load.
+ */
+struct ratbag_cache;
+
+/**
+ * @return A new cache, possibly empty, or NULL if caching is not available
+ */
+struct ratbag_cache *
+ratbag_cache_load(struct ratbag_device *device,
+		  const char *name,
+		  const char *version);
+
+/**
+ * Like ratbag_cache_load() but for data about this very device, e.g. the
+ * contents of its writable memory. The cache lives in
+ * LIBRATBAG_RUNTIME_DIR (or $LIBRATBAG_RUNTIME_DIR), so it is gone after
+ * a reboot, and is keyed by the sysname of the HID parent of the hidraw
+ * node (bus:vid:pid.instance). The kernel does not reuse the instance
+ * number, so a device plugged in again starts with an empty cache.
+ *
+ * The device may still have been changed by someone else in between,
+ * the caller must verify the data before using it.
+ *
+ * @return A new cache, possibly empty, or NULL if caching is not available
+ */
+struct ratbag_cache *
+ratbag_cache_load_runtime(struct ratbag_device *device,
+			  const char *name,
+			  const char *version);
+
+void
+ratbag_cache_destroy(struct ratbag_cache *cache);
+
+/**
+ * Copy the blob stored as key into buf.
+ *
+ * @return The size of the blob or a negative errno if the key is missing
+ * or the blob does not fit into buf
+ */
+ssize_t
+ratbag_cache_get(struct ratbag_cache *cache,
+		 const char *key,
+		 uint8_t *buf,
+		 size_t size);
+
+void
+ratbag_cache_set(struct ratbag_cache *cache,
+		 const char *key,
+		 const uint8_t *buf,
+		 size_t size);
+
+/**
+ * Drop every key, for callers that store the whole set again.
+ */
+void
+ratbag_cache_clear(struct ratbag_cache *cache);
+
+/**
+ * Write the cache back to disk if any key was changed since it was
+ * loaded.
+ */
+int
+ratbag_cache_save(struct ratbag_cache *cache);
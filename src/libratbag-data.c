@@ -26,7 +26,12 @@
 #include <linux/input.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <glib.h>
 #include <limits.h>
 
@@ -45,6 +50,7 @@
 DEFINE_TRIVIAL_CLEANUP_FUNC(GKeyFile *, g_key_file_free);
 DEFINE_TRIVIAL_CLEANUP_FUNC(GError *, g_error_free);
 DEFINE_TRIVIAL_CLEANUP_FUNC(char **, g_strfreev);
+DEFINE_TRIVIAL_CLEANUP_FUNC(gchar *, g_free);
 
 enum driver {
 	NONE = 0,
@@ -659,18 +665,133 @@ filter_device_files(const struct dirent *entry)
 	return streq(&name[len - slen], SUFFIX);
 }
 
-struct ratbag_device_data *
-ratbag_device_data_new_for_id(struct ratbag *ratbag, const struct input_id *id)
+#define DEVICE_INDEX_FILE "devices.index"
+#define DEVICE_INDEX_MAGIC "RBDEVIDX"
+#define DEVICE_INDEX_VERSION 1
+#define DEVICE_INDEX_HEADER_SIZE 16
+#define DEVICE_INDEX_ENTRY_SIZE 12
+
+static inline uint64_t
+device_index_key(uint16_t bustype, uint16_t vendor, uint16_t product)
+{
+	return ((uint64_t)bustype << 32) | ((uint32_t)vendor << 16) | product;
+}
+
+/**
+ * Look up the data file for the given id in the devices.index file
+ * generated at install time by tools/gen-device-index.py.
+ *
+ * The index is only trusted if it is at least as new as the data
+ * directory, i.e. no .device file was added, removed or renamed since
+ * it was generated. Editing a file in place doesn't touch the
+ * directory, so the file an entry points to is checked again, and a
+ * device the index doesn't know may have been added to an existing
+ * file's DeviceMatch.
+ *
+ * @return 0 if the index had the device, in which case data_out is set
+ * to the matching data. A negative errno if the device is not in the
+ * index or the index is missing, stale or invalid and the caller must
+ * fall back to scanning the directory.
+ */
+static int
+device_data_from_index(struct ratbag *ratbag, const char *datadir,
+		       const struct input_id *id,
+		       struct ratbag_device_data **data_out)
+{
+	_cleanup_free_ char *path = NULL;
+	_cleanup_free_ char *file = NULL;
+	_cleanup_(g_freep) gchar *contents = NULL;
+	struct stat dir_st, index_st;
+	const uint8_t *buf, *entries;
+	const char *strings;
+	gsize len;
+	size_t count, strings_len, lo, hi;
+	uint64_t key;
+
+	*data_out = NULL;
+
+	if (xasprintf(&path, "%s/%s", datadir, DEVICE_INDEX_FILE) == -1)
+		return -ENOMEM;
+
+	if (stat(datadir, &dir_st) < 0 || stat(path, &index_st) < 0)
+		return -errno;
+
+	if (index_st.st_mtim.tv_sec < dir_st.st_mtim.tv_sec ||
+	    (index_st.st_mtim.tv_sec == dir_st.st_mtim.tv_sec &&
+	     index_st.st_mtim.tv_nsec < dir_st.st_mtim.tv_nsec)) {
+		log_debug(ratbag, "Ignoring stale device index %s\n", path);
+		return -ESTALE;
+	}
+
+	if (!g_file_get_contents(path, &contents, &len, NULL))
+		return -EIO;
+
+	buf = (const uint8_t *)contents;
+	if (len < DEVICE_INDEX_HEADER_SIZE ||
+	    memcmp(buf, DEVICE_INDEX_MAGIC, 8) != 0 ||
+	    get_unaligned_le_u32(&buf[8]) != DEVICE_INDEX_VERSION)
+		goto invalid;
+
+	count = get_unaligned_le_u32(&buf[12]);
+	if (count > (len - DEVICE_INDEX_HEADER_SIZE) / DEVICE_INDEX_ENTRY_SIZE)
+		goto invalid;
+
+	entries = &buf[DEVICE_INDEX_HEADER_SIZE];
+	strings = (const char *)&entries[count * DEVICE_INDEX_ENTRY_SIZE];
+	strings_len = len - DEVICE_INDEX_HEADER_SIZE - count * DEVICE_INDEX_ENTRY_SIZE;
+
+	key = device_index_key(id->bustype, id->vendor, id->product);
+	lo = 0;
+	hi = count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const uint8_t *entry = &entries[mid * DEVICE_INDEX_ENTRY_SIZE];
+		uint64_t k = device_index_key(get_unaligned_le_u16(&entry[0]),
+					      get_unaligned_le_u16(&entry[2]),
+					      get_unaligned_le_u16(&entry[4]));
+		uint32_t offset;
+
+		if (k < key) {
+			lo = mid + 1;
+			continue;
+		} else if (k > key) {
+			hi = mid;
+			continue;
+		}
+
+		offset = get_unaligned_le_u32(&entry[8]);
+		if (offset >= strings_len ||
+		    !memchr(&strings[offset], '\0', strings_len - offset))
+			goto invalid;
+
+		if (xasprintf(&file, "%s/%s", datadir, &strings[offset]) == -1)
+			return -ENOMEM;
+
+		/* The file may have been edited in place since the index was
+		 * generated, so the DeviceMatch is checked again here */
+		if (!file_data_matches(ratbag, file, id, data_out)) {
+			log_debug(ratbag, "Device index entry %s does not match %04x:%04x\n",
+				  &strings[offset], id->vendor, id->product);
+			return -ESTALE;
+		}
+
+		return 0;
+	}
+
+	return -ENOENT;
+
+invalid:
+	log_error(ratbag, "Invalid device index %s, ignoring\n", path);
+	return -EINVAL;
+}
+
+static struct ratbag_device_data *
+device_data_from_scan(struct ratbag *ratbag, const char *datadir,
+		      const struct input_id *id)
 {
 	struct ratbag_device_data *data = NULL;
 	struct dirent **files;
 	int n, nfiles;
-	const char *datadir;
-
-	datadir = getenv("LIBRATBAG_DATA_DIR");
-	if (!datadir)
-		datadir = LIBRATBAG_DATA_DIR;
-	log_debug(ratbag, "Using data directory '%s'\n", datadir);
 
 	n = scandir(datadir, &files, filter_device_files, alphasort);
 	if (n <= 0) {
@@ -686,20 +807,201 @@ ratbag_device_data_new_for_id(struct ratbag *ratbag, const struct input_id *id)
 
 		rc = xasprintf(&file, "%s/%s", datadir, files[n]->d_name);
 		if (rc == -1)
-			goto out;
+			break;
 		if (file_data_matches(ratbag, file, id, &data))
-			goto out;
+			break;
+	}
+
+	while(nfiles--)
+		free(files[nfiles]);
+	free(files);
+
+	return data;
+}
+
+struct device_data_cache_entry {
+	struct list link;
+	struct input_id id;
+	struct ratbag_device_data *data; /* NULL if no file matches */
+};
+
+static void
+device_data_cache_flush(struct ratbag *ratbag)
+{
+	struct device_data_cache_entry *entry, *tmp;
+
+	list_for_each_safe(entry, tmp, &ratbag->device_data_cache, link) {
+		list_remove(&entry->link);
+		ratbag_device_data_unref(entry->data);
+		free(entry);
 	}
+}
+
+void
+ratbag_device_data_cache_init(struct ratbag *ratbag)
+{
+	list_init(&ratbag->device_data_cache);
+	ratbag->device_data_inotify_fd = -1;
+	ratbag->device_data_source = NULL;
+	ratbag->device_data_dir = NULL;
+}
+
+void
+ratbag_device_data_cache_release(struct ratbag *ratbag)
+{
+	device_data_cache_flush(ratbag);
+
+	ratbag_remove_source(ratbag, ratbag->device_data_source);
+	ratbag->device_data_source = NULL;
+	if (ratbag->device_data_inotify_fd >= 0)
+		close(ratbag->device_data_inotify_fd);
+	ratbag->device_data_inotify_fd = -1;
+	ratbag->device_data_dir = mfree(ratbag->device_data_dir);
+}
+
+/**
+ * Drain the inotify fd, any pending event on it means a data file was
+ * added, removed or modified and the cache is dropped.
+ */
+static void
+device_data_cache_drain(struct ratbag *ratbag)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+
+	while (read(ratbag->device_data_inotify_fd, buf, sizeof(buf)) > 0)
+		changed = true;
+
+	if (changed) {
+		log_debug(ratbag, "Data directory %s changed, dropping cached device data\n",
+			  ratbag->device_data_dir);
+		device_data_cache_flush(ratbag);
+	}
+}
+
+static void
+device_data_cache_dispatch(void *data)
+{
+	device_data_cache_drain(data);
+}
+
+/**
+ * Make sure the cache is valid for datadir. The directory is watched
+ * through a non-blocking inotify fd that is part of the context's epoll
+ * fd. It is drained here too in case the caller doesn't use
+ * ratbag_dispatch().
+ *
+ * @return true if results for datadir may be cached, false if the
+ * directory cannot be watched.
+ */
+static bool
+device_data_cache_validate(struct ratbag *ratbag, const char *datadir)
+{
+	const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY |
+			      IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+			      IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+	int fd;
+
+	if (ratbag->device_data_dir && !streq(ratbag->device_data_dir, datadir))
+		ratbag_device_data_cache_release(ratbag);
+
+	if (ratbag->device_data_inotify_fd < 0) {
+		device_data_cache_flush(ratbag);
+
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			log_debug(ratbag, "Not caching device data: inotify failed (%s)\n",
+				  strerror(errno));
+			return false;
+		}
+
+		if (inotify_add_watch(fd, datadir, mask) < 0) {
+			log_debug(ratbag, "Not caching device data: unable to watch %s (%s)\n",
+				  datadir, strerror(errno));
+			close(fd);
+			return false;
+		}
+
+		ratbag->device_data_inotify_fd = fd;
+		ratbag->device_data_dir = strdup_safe(datadir);
+		ratbag->device_data_source = ratbag_add_fd(ratbag, fd,
+							   device_data_cache_dispatch,
+							   ratbag);
+		return true;
+	}
+
+	device_data_cache_drain(ratbag);
+
+	return true;
+}
+
+static struct device_data_cache_entry *
+device_data_cache_find(struct ratbag *ratbag, const struct input_id *id)
+{
+	struct device_data_cache_entry *entry;
+
+	list_for_each(entry, &ratbag->device_data_cache, link) {
+		if (entry->id.bustype == id->bustype &&
+		    entry->id.vendor == id->vendor &&
+		    entry->id.product == id->product)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static struct ratbag_device_data *
+device_data_lookup(struct ratbag *ratbag, const char *datadir,
+		   const struct input_id *id)
+{
+	struct ratbag_device_data *data = NULL;
+	int rc;
+
+	rc = device_data_from_index(ratbag, datadir, id, &data);
+	if (rc < 0)
+		data = device_data_from_scan(ratbag, datadir, id);
+
+	if (data)
+		return data;
 
 	if (id->vendor == USB_VENDOR_ID_LOGITECH && (id->product & 0xff00) == 0xc500)
 		log_debug(ratbag, "%04x:%04x is a Logitech receiver, not a device. Ignoring...\n", id->vendor, id->product);
-	else if (!data)
+	else
 		log_debug(ratbag, "No data file found for %04x:%04x\n", id->vendor, id->product);
 
-out:
-	while(nfiles--)
-		free(files[nfiles]);
-	free(files);
+	return NULL;
+}
+
+struct ratbag_device_data *
+ratbag_device_data_new_for_id(struct ratbag *ratbag, const struct input_id *id)
+{
+	struct device_data_cache_entry *entry;
+	struct ratbag_device_data *data;
+	const char *datadir;
+
+	datadir = getenv("LIBRATBAG_DATA_DIR");
+	if (!datadir)
+		datadir = LIBRATBAG_DATA_DIR;
+
+	if (!device_data_cache_validate(ratbag, datadir)) {
+		log_debug(ratbag, "Using data directory '%s'\n", datadir);
+		return device_data_lookup(ratbag, datadir, id);
+	}
+
+	entry = device_data_cache_find(ratbag, id);
+	if (entry) {
+		log_debug(ratbag, "Using cached device data for %04x:%04x\n",
+			  id->vendor, id->product);
+		return entry->data ? ratbag_device_data_ref(entry->data) : NULL;
+	}
+
+	log_debug(ratbag, "Using data directory '%s'\n", datadir);
+	data = device_data_lookup(ratbag, datadir, id);
+
+	entry = zalloc(sizeof(*entry));
+	entry->id = *id;
+	entry->data = data ? ratbag_device_data_ref(data) : NULL;
+	list_insert(&ratbag->device_data_cache, &entry->link);
 
 	return data;
 }
@@ -27,9 +27,19 @@
 
 struct ratbag_device_data;
 
+/**
+ * Look up the device data for the given id. Results (including misses)
+ * are cached in the context until a file in the data directory changes.
+ */
 struct ratbag_device_data *
 ratbag_device_data_new_for_id(struct ratbag *ratbag, const struct input_id *id);
 
+void
+ratbag_device_data_cache_init(struct ratbag *ratbag);
+
+void
+ratbag_device_data_cache_release(struct ratbag *ratbag);
+
 
 struct ratbag_device_data *
 ratbag_device_data_unref(struct ratbag_device_data *data);
@@ -304,3 +304,60 @@ enum ratbag_device_type {
 	 */
 	TYPE_KEYBOARD,
 };
+
+/**
+ * @ingroup enums
+ *
+ * The charging state of a device's battery, see
+ * ratbag_device_get_battery_state().
+ */
+enum ratbag_battery_state {
+	/**
+	 * The device doesn't tell or the state wasn't read yet
+	 */
+	RATBAG_BATTERY_STATE_UNKNOWN = 0,
+	RATBAG_BATTERY_STATE_DISCHARGING,
+	RATBAG_BATTERY_STATE_CHARGING,
+	/**
+	 * Connected to a charger and fully charged
+	 */
+	RATBAG_BATTERY_STATE_FULL,
+};
+
+/**
+ * @ingroup enums
+ *
+ * Transport counters of a device, see ratbag_device_get_stat(). They
+ * cover all communication with the device since it was probed.
+ */
+enum ratbag_stat {
+	/**
+	 * Request/reply exchanges with the device
+	 */
+	RATBAG_STAT_REQUESTS = 0,
+	/**
+	 * Reports written to and read from the device, including the ones
+	 * of exchanges and notifications
+	 */
+	RATBAG_STAT_WRITES,
+	RATBAG_STAT_READS,
+	RATBAG_STAT_BYTES_WRITTEN,
+	RATBAG_STAT_BYTES_READ,
+	/**
+	 * Reads retried because the device didn't answer in time
+	 */
+	RATBAG_STAT_RETRIES,
+	/**
+	 * Reads that timed out
+	 */
+	RATBAG_STAT_TIMEOUTS,
+	/**
+	 * Failed reads or writes, not counting timeouts
+	 */
+	RATBAG_STAT_IO_ERRORS,
+	/**
+	 * Requests the device replied to with a protocol error, see
+	 * ratbag_device_get_protocol_error_count()
+	 */
+	RATBAG_STAT_PROTOCOL_ERRORS,
+};
@@ -38,6 +38,8 @@ struct ratbag_hid_report {
 	unsigned int report_id;
 	unsigned int usage_page;
 	unsigned int usage;
+	/* in bits without the report ID, indexed by HID_*_REPORT */
+	unsigned int size[3];
 };
 
 struct ratbag_hidraw {
@@ -45,6 +47,11 @@ struct ratbag_hidraw {
 	struct ratbag_hid_report *reports;
 	unsigned num_reports;
 	char *sysname;
+
+	/* see ratbag_hidraw_poll_ready() */
+	unsigned int ready_latency_us;
+	/* see ratbag_hidraw_settle() */
+	uint64_t settle_until_us;
 };
 
 typedef bool (*ratbagd_hidraw_filter_t)(uint8_t *buf, size_t len);
@@ -191,6 +198,44 @@ int ratbag_hidraw_read_input_report(const struct ratbag_device *device, uint8_t
 int ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, uint8_t *buf, size_t len, int hidrawno,
 				 ratbagd_hidraw_filter_t filter);
 
+/**
+ * Readiness check for ratbag_hidraw_poll_ready().
+ *
+ * @return 0 if the device is ready, -EAGAIN if it is still busy, a
+ * negative errno on error or a positive value that is handed back to the
+ * caller of ratbag_hidraw_poll_ready() as-is.
+ */
+typedef int (*ratbag_hidraw_ready_func_t)(struct ratbag_device *device, void *userdata);
+
+/**
+ * Wait until the device has processed the last request, calling is_ready
+ * with an exponential backoff. The first check happens after min_delay_us
+ * or, once known, slightly before the time this device took last time,
+ * which may be earlier. Before min_delay_us has passed, only a ready
+ * device ends the wait, errors are taken as "not ready yet".
+ *
+ * @param min_delay_us the wait before the first check until the device's
+ * latency is known, 0 for the default
+ * @param timeout_ms time after which to give up
+ *
+ * @return the first non -EAGAIN value returned by is_ready or -ETIMEDOUT
+ */
+int
+ratbag_hidraw_poll_ready(struct ratbag_device *device,
+			 unsigned int min_delay_us,
+			 unsigned int timeout_ms,
+			 ratbag_hidraw_ready_func_t is_ready,
+			 void *userdata);
+
+/**
+ * For devices without a way to query whether they are ready: the device
+ * needs ms milliseconds before it accepts the next request. The next
+ * feature or output report request waits for whatever remains of that
+ * time, instead of the caller sleeping unconditionally.
+ */
+void
+ratbag_hidraw_settle(struct ratbag_device *device, unsigned int ms);
+
 /**
  * Tells if a given device has the specified report ID.
  *
@@ -202,6 +247,22 @@ int ratbag_hidraw_read_input_report_index(const struct ratbag_device *device, ui
 int
 ratbag_hidraw_has_report(const struct ratbag_device *device, unsigned int report_id);
 
+/**
+ * Gives the length of a report with the specified report ID as the
+ * device expects it, including the report ID byte for numbered reports.
+ *
+ * @param device the ratbag device which hidraw node is opened
+ * @param report_id the report ID we inquire about
+ * @param type HID_INPUT_REPORT, HID_OUTPUT_REPORT or HID_FEATURE_REPORT
+ *
+ * @return the length in bytes, 0 if the device doesn't have the report in
+ * that direction
+ */
+unsigned int
+ratbag_hidraw_get_report_length(const struct ratbag_device *device,
+				unsigned int report_id,
+				unsigned int type);
+
 /**
  * Gives the usage page of a report with the specified report ID.
  *
@@ -239,6 +300,9 @@ ratbag_hidraw_has_vendor_page(const struct ratbag_device *device);
 /**
  * Gives the input key code associated to the keyboard HID usage.
  *
+ * The keyboard and Consumer Control mappings are generated from
+ * src/libratbag-keymap.txt, lookups in either direction are constant-time.
+ *
  * @return the key code of the HID usage or 0.
  */
 unsigned int
@@ -271,3 +335,29 @@ ratbag_hidraw_get_keycode_from_consumer_usage(const struct ratbag_device *device
 uint16_t
 ratbag_hidraw_get_consumer_usage_from_keycode(const struct ratbag_device *device,
 					      unsigned keycode);
+
+/**
+ * Parse a HID report descriptor in one pass. Each report gets its size
+ * in each direction and the usage page and usage current at its Report ID
+ * item. A descriptor without report IDs yields a single report with the
+ * ID 0 and the usage of the first application collection.
+ *
+ * This is called when a hidraw node is opened, the result is cached in
+ * the context for nodes with the same descriptor.
+ *
+ * @param[out] reports the reports, to be freed by the caller
+ * @param[out] num_reports the number of reports
+ *
+ * @return 0 on success or -EPROTO if the descriptor is malformed
+ */
+int
+ratbag_hid_parse_report_descriptor(const uint8_t *desc, size_t len,
+				   struct ratbag_hid_report **reports,
+				   unsigned int *num_reports);
+
+/**
+ * Drop the parsed report descriptors, called when the context is
+ * destroyed.
+ */
+void
+ratbag_hidraw_cache_release(struct ratbag *ratbag);
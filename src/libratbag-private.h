@@ -25,6 +25,7 @@
 
 #include "config.h"
 #include <linux/input.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
@@ -32,6 +33,7 @@
 #include "libratbag.h"
 #include "libratbag-util.h"
 #include "libratbag-hidraw.h"
+#include "libratbag-stats.h"
 
 #ifdef NDEBUG
 #error "libratbag relies on assert(). Do not define NDEBUG"
@@ -120,11 +122,126 @@ struct ratbag {
 	struct list drivers;
 	struct list devices;
 
+	int epoll_fd;
+	struct list source_destroy_list;
+
+	/* finished asynchronous calls, see ratbag_device_preview_done(). The
+	 * wakeup eventfd makes ratbag_dispatch() run to report them */
+	struct list completions;
+	int wakeup_fd;
+	struct ratbag_source *wakeup_source;
+
+	/* protects the refcount, the devices list and the caches, so
+	 * devices can be probed from several threads */
+	pthread_mutex_t lock;
+
+	/* parsed HID report descriptors, see libratbag-hidraw.c */
+	struct list report_descriptor_cache;
+
+	/* parsed device data files, see libratbag-data.c */
+	struct list device_data_cache;
+	int device_data_inotify_fd;
+	struct ratbag_source *device_data_source;
+	char *device_data_dir;
+
 	int refcount;
 	ratbag_log_handler log_handler;
 	enum ratbag_log_priority log_priority;
 };
 
+typedef void (*ratbag_source_dispatch_t)(void *data);
+
+/**
+ * An fd watched by the context's epoll fd, see ratbag_get_fd(). The
+ * dispatch function is called from ratbag_dispatch() when the fd is
+ * readable, with the context lock held.
+ *
+ * ratbag_add_fd() and ratbag_remove_source() must be called with the
+ * context lock held.
+ */
+struct ratbag_source {
+	ratbag_source_dispatch_t dispatch;
+	void *user_data;
+	int fd;
+	struct list link;
+};
+
+struct ratbag_source *
+ratbag_add_fd(struct ratbag *ratbag,
+	      int fd,
+	      ratbag_source_dispatch_t dispatch,
+	      void *user_data);
+
+void
+ratbag_remove_source(struct ratbag *ratbag,
+		     struct ratbag_source *source);
+
+/**
+ * Stop or resume watching the source's fd. This does not need the context
+ * lock.
+ */
+void
+ratbag_source_set_enabled(struct ratbag *ratbag,
+			  struct ratbag_source *source,
+			  bool enabled);
+
+struct ratbag_device;
+
+/**
+ * A request/reply exchange with the device on hidraw[0] that doesn't
+ * block the caller, see ratbag_device_submit(). All three are called from
+ * ratbag_dispatch() with the context lock held.
+ */
+struct ratbag_request_ops {
+	/**
+	 * Write the request to the device. Called once the device is
+	 * not busy with another request. Returns 0 or a negative errno.
+	 */
+	int (*send)(struct ratbag_device *device, void *data);
+
+	/**
+	 * Returns true if the report is the reply to the request,
+	 * including an error reply. Other reports go to
+	 * ratbag_driver.notify().
+	 */
+	bool (*match)(struct ratbag_device *device, const uint8_t *buf,
+		      size_t len, void *data);
+
+	/**
+	 * The exchange is over, rc is 0 and buf holds the reply, or rc is
+	 * a negative errno and buf is NULL. May submit the next request.
+	 */
+	void (*done)(struct ratbag_device *device, int rc,
+		     const uint8_t *buf, size_t len, void *data);
+};
+
+/**
+ * Queue a request to the device. Requests are sent one at a time, in
+ * order, and only while no blocking exchange runs on another thread.
+ * The reply is read from within ratbag_dispatch(), ops->done() is
+ * called exactly once unless this returns an error.
+ *
+ * Must be called with the context lock held.
+ *
+ * @return 0 or a negative errno if the device can't take asynchronous
+ * requests
+ */
+int
+ratbag_device_submit(struct ratbag_device *device,
+		     const struct ratbag_request_ops *ops,
+		     unsigned int timeout_ms,
+		     void *data);
+
+/**
+ * Called by the driver when the exchange started by
+ * ratbag_driver.preview_async() is finished, with 0 or a negative errno.
+ * The caller is told from within ratbag_dispatch().
+ *
+ * Must be called with the context lock held.
+ */
+void
+ratbag_device_preview_done(struct ratbag_device *device, int rc);
+
 #define MAX_CAP 1000
 
 struct ratbag_device {
@@ -139,9 +256,17 @@ struct ratbag_device {
 	struct ratbag_driver *driver;
 	struct ratbag *ratbag;
 	struct ratbag_device_data *data;
+	/* the driver probe succeeded, see ratbag_device_probe() */
+	bool probed;
+
+	/* The profiles, their buttons, resolutions and LEDs and the value
+	 * lists live here until the device is destroyed */
+	struct ratbag_arena arena;
+	/* dpi, report rate and debounce lists, see ratbag_device_share_list() */
+	struct ratbag_value_list *value_lists;
 
 	unsigned num_profiles;
-	struct list profiles;
+	struct ratbag_profile *profiles;
 
 	unsigned num_buttons;
 	unsigned num_leds;
@@ -150,6 +275,40 @@ struct ratbag_device {
 
 	void *drv_data;
 
+	/* Held during any request/reply exchange after the probe, so
+	 * reading the device's notifications doesn't steal the replies.
+	 * While an asynchronous request is in flight, the thread calling
+	 * ratbag_dispatch() holds it */
+	pthread_mutex_t io_lock;
+	/* hidraw[0], watched while an asynchronous request is in flight
+	 * and, if the driver handles them, for notifications, see
+	 * ratbag_driver.notify() */
+	struct ratbag_source *hidraw_source;
+	bool watch_notifications;
+
+	/* Asynchronous requests, see ratbag_device_submit(). The first one
+	 * is in flight once it was sent. The timer fires when it times out
+	 * or, if it couldn't be sent yet, when it's time to try again */
+	struct list requests;
+	bool request_in_flight;
+	uint64_t request_deadline;	/* in us, CLOCK_MONOTONIC */
+	uint64_t request_start;		/* see ratbag_stats_begin() */
+	int timer_fd;
+	struct ratbag_source *timer_source;
+
+	/* Filled in by the driver during the probe, by
+	 * ratbag_driver.read_battery() and from notifications */
+	struct ratbag_battery {
+		bool present;
+		bool notifies;
+		int level;		/* in percent, -1 if unknown */
+		unsigned int voltage;	/* in mV, 0 if unknown */
+		enum ratbag_battery_state state;
+	} battery;
+
+	/* Updated by the transport layers, see libratbag-stats.h */
+	struct ratbag_stats stats;
+
 	struct list link;
 };
 
@@ -198,6 +357,25 @@ struct ratbag_driver {
 	 */
 	int (*commit)(struct ratbag_device *device);
 
+	/**
+	 * Callback called to apply the active profile's settings to the
+	 * device without storing them in its persistent memory, optional.
+	 *
+	 * The dirty flags must not be reset, a later commit still has to
+	 * write the changes.
+	 */
+	int (*preview)(struct ratbag_device *device);
+
+	/**
+	 * Like preview() but through ratbag_device_submit(), so the caller
+	 * doesn't wait for the device, optional.
+	 *
+	 * Returns 0 once the first request is queued, the driver then
+	 * calls ratbag_device_preview_done() when it's finished. On a
+	 * negative errno, ratbag_device_preview_done() is not called.
+	 */
+	int (*preview_async)(struct ratbag_device *device);
+
 	/**
 	 * Called to mark a previously written profile as active.
 	 *
@@ -206,20 +384,45 @@ struct ratbag_driver {
 	 */
 	int (*set_active_profile)(struct ratbag_device *device, unsigned int index);
 
+	/**
+	 * Callback called for every report the device sends on hidraw[0]
+	 * while the library isn't talking to the device, optional.
+	 *
+	 * If the report tells that the device changed its state on its
+	 * own, e.g. the user switched profiles with a button on the
+	 * device, the driver updates the profiles accordingly without
+	 * marking anything dirty and returns 1. Otherwise it returns 0.
+	 */
+	int (*notify)(struct ratbag_device *device, const uint8_t *buf, size_t len);
+
+	/**
+	 * Callback called when the caller wants to know the current
+	 * battery state, optional. The driver updates device->battery.
+	 * Only called if the driver set device->battery.present.
+	 *
+	 * A driver that updates device->battery in notify() sets
+	 * device->battery.notifies during the probe.
+	 */
+	int (*read_battery)(struct ratbag_device *device);
+
 	/* private */
 	int (*test_probe)(struct ratbag_device *device, const void *data);
 
 	struct list link;
 };
 
+/* The most values a dpi, report rate or debounce list may have */
+#define MAX_DPIS	300
+#define MAX_RATES	8
+#define MAX_DEBOUNCES	8
+
 struct ratbag_resolution {
 	struct ratbag_profile *profile;
 	int refcount;
 	void *userdata;
-	struct list link;
 	unsigned index;
 
-	unsigned int dpis[300];
+	const unsigned int *dpis;	/**< shared, see ratbag_device_share_list() */
 	size_t ndpis;
 
 	unsigned int dpi_x;	/**< x resolution in dpi */
@@ -236,7 +439,6 @@ struct ratbag_resolution {
 struct ratbag_led {
 	int refcount;
 	void *userdata;
-	struct list link;
 	struct ratbag_profile *profile;
 	unsigned index;
 	enum ratbag_led_mode mode;
@@ -253,17 +455,16 @@ struct ratbag_profile {
 	void *userdata;
 	char *name;
 
-	struct list link;
 	unsigned index;
 	struct ratbag_device *device;
-	struct list buttons;
+	struct ratbag_button *buttons;		/**< device->num_buttons */
 	void *drv_data;
 	void *user_data;
-	struct list resolutions;
-	struct list leds;
+	struct ratbag_resolution *resolutions;	/**< num_resolutions */
+	struct ratbag_led *leds;		/**< device->num_leds */
 
 	unsigned int hz;	/**< report rate in Hz */
-	unsigned int rates[8];	/**< report rates available */
+	const unsigned int *rates;	/**< report rates available, shared */
 	size_t nrates;		/**< number of entries in rates */
 	bool rate_dirty;
 
@@ -272,7 +473,7 @@ struct ratbag_profile {
 
 	int debounce;	/**< debounce time in ms */
 	bool debounce_dirty;
-	unsigned int debounces[8];	/**< debounce times available */
+	const unsigned int *debounces;	/**< debounce times available, shared */
 	size_t ndebounces;		/**< number of entries in debounces */
 
 	unsigned int num_resolutions;
@@ -286,16 +487,24 @@ struct ratbag_profile {
 };
 
 #define ratbag_device_for_each_profile(device_, profile_) \
-	list_for_each(profile_, &(device_)->profiles, link)
+	for (profile_ = (device_)->profiles; \
+	     profile_ < (device_)->profiles + (device_)->num_profiles; \
+	     profile_++)
 
 #define ratbag_profile_for_each_button(profile_, button_) \
-	list_for_each(button_, &(profile_)->buttons, link) \
+	for (button_ = (profile_)->buttons; \
+	     button_ < (profile_)->buttons + (profile_)->device->num_buttons; \
+	     button_++)
 
 #define ratbag_profile_for_each_led(profile_, led_) \
-	list_for_each(led_, &(profile_)->leds, link)
+	for (led_ = (profile_)->leds; \
+	     led_ < (profile_)->leds + (profile_)->device->num_leds; \
+	     led_++)
 
 #define ratbag_profile_for_each_resolution(profile_, resolution_) \
-	list_for_each(resolution_, &(profile_)->resolutions, link)
+	for (resolution_ = (profile_)->resolutions; \
+	     resolution_ < (profile_)->resolutions + (profile_)->num_resolutions; \
+	     resolution_++)
 
 #define BUTTON_ACTION_NONE \
  { .type = RATBAG_BUTTON_ACTION_TYPE_NONE }
@@ -323,15 +532,25 @@ struct ratbag_macro_event {
 };
 
 #define MAX_MACRO_EVENTS 256
+
+/**
+ * A button's macro. The events are allocated to the macro's length, plus
+ * a terminating RATBAG_MACRO_EVENT_NONE if there are fewer than
+ * MAX_MACRO_EVENTS. Don't look past the first RATBAG_MACRO_EVENT_NONE.
+ */
 struct ratbag_macro {
 	char *name;
 	char *group;
-	struct ratbag_macro_event events[MAX_MACRO_EVENTS];
+	unsigned int nevents;
+	struct ratbag_macro_event *events;
 };
 
+/* The macro a caller builds with ratbag_button_macro_set_event(), any
+ * event may be set until it is copied to the button */
 struct ratbag_button_macro {
 	int refcount;
 	struct ratbag_macro macro;
+	struct ratbag_macro_event events[MAX_MACRO_EVENTS];
 };
 
 #define MODIFIER_LEFTCTRL (1 << 0)
@@ -356,7 +575,6 @@ struct ratbag_button_action {
 struct ratbag_button {
 	int refcount;
 	void *userdata;
-	struct list link;
 	struct ratbag_profile *profile;
 	unsigned index;
 	struct ratbag_button_action action;
@@ -410,6 +628,23 @@ ratbag_device_init_profiles(struct ratbag_device *device,
 			    unsigned int num_buttons,
 			    unsigned int num_leds);
 
+struct ratbag_value_list {
+	struct ratbag_value_list *next;
+	size_t count;
+	unsigned int values[];
+};
+
+/**
+ * Most devices have the same dpi list for every resolution and the same
+ * report rates for every profile. Returns a copy of the given ascending
+ * list that is shared by everything on the device with the same list and
+ * stays valid until the device is destroyed.
+ */
+const unsigned int *
+ratbag_device_share_list(struct ratbag_device *device,
+			 const unsigned int *values,
+			 size_t count);
+
 static inline void
 ratbag_profile_set_drv_data(struct ratbag_profile *profile, void *drv_data)
 {
@@ -482,20 +717,21 @@ static inline void
 ratbag_resolution_set_dpi_list_from_range(struct ratbag_resolution *res,
 					  unsigned int min, unsigned int max)
 {
+	struct ratbag_device *device = res->profile->device;
+	unsigned int dpis[MAX_DPIS];
 	unsigned int stepsize = 50;
 	unsigned int dpi = min;
+	size_t ndpis = 0;
 	bool maxed_out = false;
 
-	res->ndpis = 0;
-
-	while (res->ndpis < ARRAY_LENGTH(res->dpis)) {
+	while (ndpis < ARRAY_LENGTH(dpis)) {
 		if (dpi > (unsigned)max) {
 			maxed_out = true;
 			break;
 		}
 
-		res->dpis[res->ndpis] = dpi;
-		res->ndpis++;
+		dpis[ndpis] = dpi;
+		ndpis++;
 
 		if (dpi < 1000)
 			stepsize = 50;
@@ -510,9 +746,12 @@ ratbag_resolution_set_dpi_list_from_range(struct ratbag_resolution *res,
 	}
 
 	if (!maxed_out)
-		log_bug_libratbag(res->profile->device->ratbag,
+		log_bug_libratbag(device->ratbag,
 				  "%s: resolution range exceeds available space.\n",
-				  res->profile->device->name);
+				  device->name);
+
+	res->dpis = ratbag_device_share_list(device, dpis, ndpis);
+	res->ndpis = ndpis;
 }
 
 static inline void
@@ -520,14 +759,10 @@ ratbag_resolution_set_dpi_list(struct ratbag_resolution *res,
 			       const unsigned int *dpis,
 			       size_t ndpis)
 {
-	assert(ndpis <= ARRAY_LENGTH(res->dpis));
+	assert(ndpis <= MAX_DPIS);
 	_Static_assert(sizeof(*dpis) == sizeof(*res->dpis), "Mismatching size");
 
-	for (size_t i = 0; i < ndpis; i++) {
-		res->dpis[i] = dpis[i];
-		if (i > 0)
-			assert(dpis[i] > dpis[i - 1]);
-	}
+	res->dpis = ratbag_device_share_list(res->profile->device, dpis, ndpis);
 	res->ndpis = ndpis;
 }
 
@@ -536,14 +771,10 @@ ratbag_profile_set_report_rate_list(struct ratbag_profile *profile,
 				    const unsigned int *rates,
 				    size_t nrates)
 {
-	assert(nrates <= ARRAY_LENGTH(profile->rates));
+	assert(nrates <= MAX_RATES);
 	_Static_assert(sizeof(*rates) == sizeof(*profile->rates), "Mismatching size");
 
-	for (size_t i = 0; i < nrates; i++) {
-		profile->rates[i] = rates[i];
-		if (i > 0)
-			assert(rates[i] > rates[i - 1]);
-	}
+	profile->rates = ratbag_device_share_list(profile->device, rates, nrates);
 	profile->nrates = nrates;
 }
 
@@ -552,14 +783,10 @@ ratbag_profile_set_debounce_list(struct ratbag_profile *profile,
 				 const unsigned int *values,
 				 size_t nvalues)
 {
-	assert(nvalues <= ARRAY_LENGTH(profile->debounces));
+	assert(nvalues <= MAX_DEBOUNCES);
 	_Static_assert(sizeof(*values) == sizeof(*profile->debounces), "Mismatching size");
 
-	for (size_t i = 0; i < nvalues; i++) {
-		profile->debounces[i] = values[i];
-		if (i > 0)
-			assert(values[i] > values[i - 1]);
-	}
+	profile->debounces = ratbag_device_share_list(profile->device, values, nvalues);
 	profile->ndebounces = nvalues;
 }
 
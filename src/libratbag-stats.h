@@ -0,0 +1,103 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include "libratbag-enums.h"
+#include "shared-macro.h"
+
+#define RATBAG_STAT_COUNT (RATBAG_STAT_PROTOCOL_ERRORS + 1)
+
+/* Bucket i counts the requests that took [2^i, 2^(i+1)) us, the last
+ * bucket everything from ~8.4s */
+#define RATBAG_STATS_LATENCY_BUCKETS 24
+
+/* Protocol error codes from here on share the last slot */
+#define RATBAG_STATS_PROTOCOL_ERRORS 32
+
+/*
+ * Transport statistics of a device. The transport layers update them
+ * from whichever thread talks to the device and the caller may read them
+ * at any time, so all accesses are atomic. Relaxed ordering is enough,
+ * nothing else depends on the counters.
+ *
+ * A NULL stats pointer means we don't keep statistics, e.g. for the tools
+ * that use the HID++ layer directly.
+ */
+struct ratbag_stats {
+	uint64_t counters[RATBAG_STAT_COUNT];
+	uint64_t protocol_errors[RATBAG_STATS_PROTOCOL_ERRORS];
+	uint64_t latency[RATBAG_STATS_LATENCY_BUCKETS];
+};
+
+static inline void
+ratbag_stats_add(struct ratbag_stats *stats, enum ratbag_stat stat, uint64_t n)
+{
+	if (stats)
+		__atomic_fetch_add(&stats->counters[stat], n, __ATOMIC_RELAXED);
+}
+
+static inline void
+ratbag_stats_inc(struct ratbag_stats *stats, enum ratbag_stat stat)
+{
+	ratbag_stats_add(stats, stat, 1);
+}
+
+static inline void
+ratbag_stats_protocol_error(struct ratbag_stats *stats, uint8_t error)
+{
+	unsigned int slot = min(error, RATBAG_STATS_PROTOCOL_ERRORS - 1);
+
+	if (!stats)
+		return;
+
+	ratbag_stats_inc(stats, RATBAG_STAT_PROTOCOL_ERRORS);
+	__atomic_fetch_add(&stats->protocol_errors[slot], 1, __ATOMIC_RELAXED);
+}
+
+/* Returns the start time of a request, pass it to ratbag_stats_request() */
+static inline uint64_t
+ratbag_stats_begin(struct ratbag_stats *stats)
+{
+	return stats ? now(CLOCK_MONOTONIC) / 1000 : 0;
+}
+
+static inline void
+ratbag_stats_request(struct ratbag_stats *stats, uint64_t start)
+{
+	uint64_t us;
+	unsigned int bucket = 0;
+
+	if (!stats)
+		return;
+
+	us = now(CLOCK_MONOTONIC) / 1000 - start;
+	while (us > 1 && bucket < RATBAG_STATS_LATENCY_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	ratbag_stats_inc(stats, RATBAG_STAT_REQUESTS);
+	__atomic_fetch_add(&stats->latency[bucket], 1, __ATOMIC_RELAXED);
+}
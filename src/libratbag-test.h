@@ -91,6 +91,11 @@ struct ratbag_test_device {
 	unsigned int num_buttons;
 	unsigned int num_leds;
 	struct ratbag_test_profile profiles[RATBAG_TEST_MAX_PROFILES];
+	struct ratbag_test_battery {
+		bool present;
+		int level;
+		enum ratbag_battery_state state;
+	} battery;
 	void (*destroyed)(struct ratbag_device *device, void *data);
 	void *destroyed_data;
 };
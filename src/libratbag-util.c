@@ -191,6 +191,62 @@ err:
 	return ret;
 }
 
+/* most devices fit into one or two of those */
+#define ARENA_CHUNK_SIZE	4096
+#define ARENA_ALIGN		16
+
+struct ratbag_arena_chunk {
+	struct ratbag_arena_chunk *next;
+	size_t size;
+	size_t used;
+	unsigned char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+void *
+ratbag_arena_alloc(struct ratbag_arena *arena, size_t size)
+{
+	struct ratbag_arena_chunk *chunk = arena->chunks;
+	void *p;
+
+	size = max(size, 1);
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!chunk || chunk->size - chunk->used < size) {
+		size_t chunk_size = max(size, ARENA_CHUNK_SIZE);
+
+		chunk = zalloc(sizeof(*chunk) + chunk_size);
+		chunk->size = chunk_size;
+
+		/* an oversized allocation goes behind the current chunk, so
+		 * what's left in that one can still be used */
+		if (arena->chunks && chunk_size > ARENA_CHUNK_SIZE) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+
+	p = chunk->data + chunk->used;
+	chunk->used += size;
+
+	return p;
+}
+
+void
+ratbag_arena_release(struct ratbag_arena *arena)
+{
+	struct ratbag_arena_chunk *chunk, *next;
+
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	arena->chunks = NULL;
+}
+
 int mkdir_p(const char *dir, mode_t mode)
 {
     struct stat sb;
@@ -64,6 +64,19 @@ int list_empty(const struct list *list);
 	     pos = tmp,							\
 	     tmp = container_of(pos->member.next, tmp, member))
 
+/**
+ * A bump allocator for objects that all go away at the same time.
+ * Allocations are zeroed and can't be freed one by one,
+ * ratbag_arena_release() frees all of them at once. An all-zero struct is
+ * an empty arena.
+ */
+struct ratbag_arena {
+	struct ratbag_arena_chunk *chunks;
+};
+
+void *ratbag_arena_alloc(struct ratbag_arena *arena, size_t size);
+void ratbag_arena_release(struct ratbag_arena *arena);
+
 int mkdir_p(const char *dir, mode_t mode);
 
 static inline char*
@@ -367,6 +380,12 @@ get_unaligned_be_u32(const uint8_t *buf)
 	return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
 }
 
+static inline uint32_t
+get_unaligned_le_u32(const uint8_t *buf)
+{
+	return ((uint32_t)buf[3] << 24) | (buf[2] << 16) | (buf[1] << 8) | buf[0];
+}
+
 static inline bool
 ratbag_key_is_modifier(const unsigned int key)
 {
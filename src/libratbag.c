@@ -25,11 +25,15 @@
 #include <assert.h>
 #include <errno.h>
 #include <libudev.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <limits.h>
@@ -58,12 +62,6 @@ error_code(enum ratbag_error_code code)
 
 static void
 ratbag_profile_destroy(struct ratbag_profile *profile);
-static void
-ratbag_button_destroy(struct ratbag_button *button);
-static void
-ratbag_led_destroy(struct ratbag_led *led);
-static void
-ratbag_resolution_destroy(struct ratbag_resolution *resolution);
 
 static void
 ratbag_default_log_func(struct ratbag *ratbag,
@@ -195,22 +193,307 @@ ratbag_device_new(struct ratbag *ratbag, struct udev_device *udev_device,
 	device->refcount = 1;
 	device->udev_device = udev_device_ref(udev_device);
 	device->ids = *id;
+
+	pthread_mutex_lock(&ratbag->lock);
 	device->data = ratbag_device_data_new_for_id(ratbag, id);
+	list_insert(&ratbag->devices, &device->link);
+	pthread_mutex_unlock(&ratbag->lock);
 
 	if (device->data != NULL)
 		device->devicetype = ratbag_device_data_get_device_type(device->data);
 
-	list_init(&device->profiles);
-
-	list_insert(&ratbag->devices, &device->link);
+	pthread_mutex_init(&device->io_lock, NULL);
+	list_init(&device->requests);
+	device->timer_fd = -1;
+	device->battery.level = -1;
 
 	return device;
 }
 
+/* see ratbag_device_submit() */
+struct ratbag_request {
+	const struct ratbag_request_ops *ops;
+	unsigned int timeout_ms;
+	void *data;
+	int rc;		/* for done() if no reply arrives */
+	struct list link;
+};
+
+/* A finished asynchronous call, reported from ratbag_dispatch() */
+struct ratbag_completion {
+	struct ratbag_device *device;	/* holds a reference */
+	enum ratbag_error_code rc;
+	struct list link;
+};
+
+static void
+ratbag_device_start_request(struct ratbag_device *device);
+
+/* Fire the timer after us, or as soon as possible for 0 */
+static void
+ratbag_device_arm_timer(struct ratbag_device *device, uint64_t us)
+{
+	struct itimerspec its = {
+		.it_value.tv_sec = us / 1000000,
+		.it_value.tv_nsec = us % 1000000 * 1000,
+	};
+
+	/* an all-zero it_value disarms the timer */
+	if (us == 0)
+		its.it_value.tv_nsec = 1;
+
+	timerfd_settime(device->timer_fd, 0, &its, NULL);
+}
+
+static void
+ratbag_device_disarm_timer(struct ratbag_device *device)
+{
+	struct itimerspec its = {0};
+
+	timerfd_settime(device->timer_fd, 0, &its, NULL);
+}
+
+/* Ends the request in flight and sends the next one */
+static void
+ratbag_device_finish_request(struct ratbag_device *device, int rc,
+			     const uint8_t *buf, size_t len)
+{
+	struct ratbag_request *request;
+
+	request = container_of(device->requests.next, request, link);
+	list_remove(&request->link);
+
+	ratbag_stats_request(&device->stats, device->request_start);
+	if (rc == -ETIMEDOUT)
+		ratbag_stats_inc(&device->stats, RATBAG_STAT_TIMEOUTS);
+
+	device->request_in_flight = false;
+	ratbag_device_disarm_timer(device);
+	if (!device->watch_notifications)
+		ratbag_source_set_enabled(device->ratbag, device->hidraw_source, false);
+	pthread_mutex_unlock(&device->io_lock);
+
+	request->ops->done(device, rc, buf, len, request->data);
+	free(request);
+
+	ratbag_device_start_request(device);
+}
+
+static void
+ratbag_device_start_request(struct ratbag_device *device)
+{
+	struct ratbag_request *request;
+	int rc;
+
+	if (device->request_in_flight || list_empty(&device->requests))
+		return;
+
+	/* A blocking exchange runs on another thread, it kicks the timer
+	 * when it's done. Look again in a bit in case we missed that */
+	if (pthread_mutex_trylock(&device->io_lock) != 0) {
+		ratbag_device_arm_timer(device, 10 * 1000);
+		return;
+	}
+
+	request = container_of(device->requests.next, request, link);
+
+	device->request_in_flight = true;
+	device->request_start = ratbag_stats_begin(&device->stats);
+	ratbag_source_set_enabled(device->ratbag, device->hidraw_source, true);
+
+	rc = request->ops->send(device, request->data);
+	if (rc) {
+		/* finish it from the timer, the caller of
+		 * ratbag_device_submit() doesn't expect done() yet */
+		request->rc = rc;
+		device->request_deadline = 0;
+		ratbag_device_arm_timer(device, 0);
+		return;
+	}
+
+	device->request_deadline = now(CLOCK_MONOTONIC) / 1000 +
+				   request->timeout_ms * 1000ULL;
+	ratbag_device_arm_timer(device, request->timeout_ms * 1000ULL);
+}
+
+int
+ratbag_device_submit(struct ratbag_device *device,
+		     const struct ratbag_request_ops *ops,
+		     unsigned int timeout_ms,
+		     void *data)
+{
+	struct ratbag_request *request;
+
+	if (!device->hidraw_source || device->timer_fd < 0)
+		return -ENODEV;
+
+	request = zalloc(sizeof(*request));
+	request->ops = ops;
+	request->timeout_ms = timeout_ms;
+	request->data = data;
+	request->rc = -ETIMEDOUT;
+	list_append(&device->requests, &request->link);
+
+	ratbag_device_start_request(device);
+
+	return 0;
+}
+
+static void
+ratbag_device_dispatch_timer(void *data)
+{
+	struct ratbag_device *device = data;
+	struct ratbag_request *request;
+	uint64_t expirations, now_us;
+
+	(void) read(device->timer_fd, &expirations, sizeof(expirations));
+
+	if (!device->request_in_flight) {
+		ratbag_device_start_request(device);
+		return;
+	}
+
+	/* kicked by ratbag_device_io_end() while the request is running */
+	now_us = now(CLOCK_MONOTONIC) / 1000;
+	if (now_us < device->request_deadline) {
+		ratbag_device_arm_timer(device, device->request_deadline - now_us);
+		return;
+	}
+
+	request = container_of(device->requests.next, request, link);
+	if (request->rc == -ETIMEDOUT)
+		log_debug(device->ratbag, "%s: request timed out\n", device->name);
+	ratbag_device_finish_request(device, request->rc, NULL, 0);
+}
+
+static void
+ratbag_device_dispatch_hidraw(void *data)
+{
+	struct ratbag_device *device = data;
+	struct ratbag *ratbag = device->ratbag;
+	struct pollfd fds = {
+		.fd = device->hidraw[0].fd,
+		.events = POLLIN,
+	};
+	uint8_t buf[256]; /* plenty for any vendor report */
+	bool in_flight = device->request_in_flight;
+	int rc;
+
+	/* Someone is talking to the device on another thread and reads
+	 * the reports itself. Its source is disabled until it's done.
+	 * With a request of ours in flight, we hold the lock already. */
+	if (!in_flight && pthread_mutex_trylock(&device->io_lock) != 0)
+		return;
+
+	/* the report may have been read since epoll told us about it */
+	if (poll(&fds, 1, 0) <= 0)
+		goto out;
+
+	rc = read(device->hidraw[0].fd, buf, sizeof(buf));
+	if (rc <= 0)
+		goto out;
+
+	ratbag_stats_inc(&device->stats, RATBAG_STAT_READS);
+	ratbag_stats_add(&device->stats, RATBAG_STAT_BYTES_READ, rc);
+
+	if (in_flight) {
+		struct ratbag_request *request;
+
+		request = container_of(device->requests.next, request, link);
+		if (request->ops->match(device, buf, rc, request->data)) {
+			log_buf_raw(ratbag, "reply: ", buf, rc);
+			/* this lets go of the io_lock */
+			ratbag_device_finish_request(device, 0, buf, rc);
+			return;
+		}
+	}
+
+	if (!device->watch_notifications)
+		goto out;
+
+	log_buf_raw(ratbag, "notification: ", buf, rc);
+
+	if (device->driver->notify(device, buf, rc) > 0 &&
+	    ratbag->interface->device_changed)
+		ratbag->interface->device_changed(device, ratbag->userdata);
+
+out:
+	if (!in_flight)
+		pthread_mutex_unlock(&device->io_lock);
+}
+
+/* Called once the probe succeeded */
+static void
+ratbag_device_init_sources(struct ratbag_device *device)
+{
+	struct ratbag *ratbag = device->ratbag;
+	struct ratbag_hidraw *hidraw = &device->hidraw[0];
+
+	if (hidraw->fd < 0)
+		return;
+
+	device->watch_notifications = device->driver->notify != NULL;
+
+	/* If the node carries the pointer reports too, we would wake up
+	 * for every motion event, that's too high a price */
+	for (unsigned int i = 0; device->watch_notifications && i < hidraw->num_reports; i++) {
+		if (hidraw->reports[i].usage_page == 0x01 && /* Generic Desktop */
+		    hidraw->reports[i].usage == 0x02) { /* Mouse */
+			log_debug(ratbag, "%s: not watching for notifications\n",
+				  device->name);
+			device->watch_notifications = false;
+		}
+	}
+
+	device->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (device->timer_fd < 0) {
+		device->watch_notifications = false;
+		return;
+	}
+
+	pthread_mutex_lock(&ratbag->lock);
+	device->hidraw_source = ratbag_add_fd(ratbag,
+					      hidraw->fd,
+					      ratbag_device_dispatch_hidraw,
+					      device);
+	device->timer_source = ratbag_add_fd(ratbag,
+					     device->timer_fd,
+					     ratbag_device_dispatch_timer,
+					     device);
+	pthread_mutex_unlock(&ratbag->lock);
+
+	if (!device->hidraw_source)
+		device->watch_notifications = false;
+	else if (!device->watch_notifications)
+		ratbag_source_set_enabled(ratbag, device->hidraw_source, false);
+}
+
+/* Must wrap any blocking request to the device once the sources exist */
+static void
+ratbag_device_io_begin(struct ratbag_device *device)
+{
+	pthread_mutex_lock(&device->io_lock);
+	if (device->hidraw_source)
+		ratbag_source_set_enabled(device->ratbag, device->hidraw_source, false);
+}
+
+static void
+ratbag_device_io_end(struct ratbag_device *device)
+{
+	if (device->hidraw_source && device->watch_notifications)
+		ratbag_source_set_enabled(device->ratbag, device->hidraw_source, true);
+	/* send the asynchronous requests queued in the meantime. This
+	 * happens before the unlock so it can't be taken for the
+	 * timeout of a request sent after it */
+	if (device->timer_fd >= 0)
+		ratbag_device_arm_timer(device, 0);
+	pthread_mutex_unlock(&device->io_lock);
+}
+
 void
 ratbag_device_destroy(struct ratbag_device *device)
 {
-	struct ratbag_profile *profile, *next;
+	struct ratbag_profile *profile;
 
 	if (!device)
 		return;
@@ -218,19 +501,37 @@ ratbag_device_destroy(struct ratbag_device *device)
 	/* if we get to the point where the device is destroyed, profiles,
 	 * buttons, etc. are at a refcount of 0, so we can destroy
 	 * everything */
+	/* every asynchronous call holds a reference to the device */
+	assert(list_empty(&device->requests));
+
+	if (device->hidraw_source || device->timer_source) {
+		pthread_mutex_lock(&device->ratbag->lock);
+		ratbag_remove_source(device->ratbag, device->hidraw_source);
+		ratbag_remove_source(device->ratbag, device->timer_source);
+		device->hidraw_source = NULL;
+		device->timer_source = NULL;
+		pthread_mutex_unlock(&device->ratbag->lock);
+	}
+	if (device->timer_fd >= 0)
+		close(device->timer_fd);
+
 	if (device->driver && device->driver->remove)
 		device->driver->remove(device);
 
-	list_for_each_safe(profile, next, &device->profiles, link)
+	ratbag_device_for_each_profile(device, profile)
 		ratbag_profile_destroy(profile);
+	ratbag_arena_release(&device->arena);
 
 	if (device->udev_device)
 		udev_device_unref(device->udev_device);
 
+	pthread_mutex_lock(&device->ratbag->lock);
 	list_remove(&device->link);
+	ratbag_device_data_unref(device->data);
+	pthread_mutex_unlock(&device->ratbag->lock);
 
+	pthread_mutex_destroy(&device->io_lock);
 	ratbag_unref(device->ratbag);
-	ratbag_device_data_unref(device->data);
 	free(device->name);
 	free(device->firmware_version);
 	free(device);
@@ -356,6 +657,7 @@ ratbag_try_driver(struct ratbag_device *device,
 			log_debug(ratbag,
 				  "driver match found: %s\n",
 				  device->driver->name);
+			device->probed = true;
 			return true;
 		}
 	}
@@ -417,12 +719,11 @@ get_product_id(struct udev_device *device, struct input_id *id)
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
-ratbag_device_new_from_udev_device(struct ratbag *ratbag,
-				   struct udev_device *udev_device,
-				   struct ratbag_device **device_out)
+ratbag_device_new_from_udev_device_unprobed(struct ratbag *ratbag,
+					    struct udev_device *udev_device,
+					    struct ratbag_device **device_out)
 {
 	struct ratbag_device *device = NULL;
-	enum ratbag_error_code error = RATBAG_ERROR_DEVICE;
 	_cleanup_free_ char *name = NULL;
 	struct input_id id;
 
@@ -431,24 +732,64 @@ ratbag_device_new_from_udev_device(struct ratbag *ratbag,
 	assert(device_out != NULL);
 
 	if (get_product_id(udev_device, &id) != 0)
-		goto out_err;
+		return RATBAG_ERROR_DEVICE;
 
 	if ((name = get_device_name(udev_device)) == 0)
-		goto out_err;
+		return RATBAG_ERROR_DEVICE;
 
 	log_debug(ratbag, "New device: %s\n", name);
 
 	device = ratbag_device_new(ratbag, udev_device, name, &id);
-	if (!device || !device->data)
-		goto out_err;
+	if (!device || !device->data) {
+		ratbag_device_destroy(device);
+		return RATBAG_ERROR_DEVICE;
+	}
+
+	*device_out = device;
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_probe(struct ratbag_device *device)
+{
+	if (device->probed)
+		return RATBAG_SUCCESS;
+
+	/* the driver stays assigned if the probe failed halfway, the
+	 * device is of no use then */
+	if (device->driver)
+		return RATBAG_ERROR_DEVICE;
 
 	if (!ratbag_assign_driver(device, &device->ids, NULL))
-		goto out_err;
+		return RATBAG_ERROR_DEVICE;
+
+	ratbag_device_init_sources(device);
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT bool
+ratbag_device_is_probed(const struct ratbag_device *device)
+{
+	return device->probed;
+}
 
-	error = RATBAG_SUCCESS;
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_new_from_udev_device(struct ratbag *ratbag,
+				   struct udev_device *udev_device,
+				   struct ratbag_device **device_out)
+{
+	struct ratbag_device *device = NULL;
+	enum ratbag_error_code error;
 
-out_err:
+	error = ratbag_device_new_from_udev_device_unprobed(ratbag,
+							    udev_device,
+							    &device);
+	if (error != RATBAG_SUCCESS)
+		return error_code(error);
 
+	error = ratbag_device_probe(device);
 	if (error != RATBAG_SUCCESS)
 		ratbag_device_destroy(device);
 	else
@@ -540,6 +881,139 @@ ratbag_register_driver(struct ratbag *ratbag, struct ratbag_driver *driver)
 	list_insert(&ratbag->drivers, &driver->link);
 }
 
+struct ratbag_source *
+ratbag_add_fd(struct ratbag *ratbag,
+	      int fd,
+	      ratbag_source_dispatch_t dispatch,
+	      void *user_data)
+{
+	struct ratbag_source *source;
+	struct epoll_event ep;
+
+	source = zalloc(sizeof(*source));
+	source->dispatch = dispatch;
+	source->user_data = user_data;
+	source->fd = fd;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = source;
+
+	if (epoll_ctl(ratbag->epoll_fd, EPOLL_CTL_ADD, fd, &ep) < 0) {
+		log_error(ratbag, "Failed to add fd %d to epoll: %s\n",
+			  fd, strerror(errno));
+		free(source);
+		return NULL;
+	}
+
+	return source;
+}
+
+void
+ratbag_source_set_enabled(struct ratbag *ratbag,
+			  struct ratbag_source *source,
+			  bool enabled)
+{
+	struct epoll_event ep;
+
+	if (source->fd == -1)
+		return;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = enabled ? EPOLLIN : 0;
+	ep.data.ptr = source;
+
+	epoll_ctl(ratbag->epoll_fd, EPOLL_CTL_MOD, source->fd, &ep);
+}
+
+void
+ratbag_remove_source(struct ratbag *ratbag,
+		     struct ratbag_source *source)
+{
+	if (!source)
+		return;
+
+	epoll_ctl(ratbag->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+	source->fd = -1;
+
+	/* The source may be removed from within its own dispatch function,
+	 * it is only freed once ratbag_dispatch() is done with it */
+	list_insert(&ratbag->source_destroy_list, &source->link);
+}
+
+static void
+ratbag_drop_destroyed_sources(struct ratbag *ratbag)
+{
+	struct ratbag_source *source, *tmp;
+
+	list_for_each_safe(source, tmp, &ratbag->source_destroy_list, link) {
+		list_remove(&source->link);
+		free(source);
+	}
+}
+
+LIBRATBAG_EXPORT int
+ratbag_get_fd(const struct ratbag *ratbag)
+{
+	return ratbag->epoll_fd;
+}
+
+LIBRATBAG_EXPORT int
+ratbag_dispatch(struct ratbag *ratbag)
+{
+	struct ratbag_source *source;
+	struct epoll_event ep[32];
+	int i, count;
+
+	count = epoll_wait(ratbag->epoll_fd, ep, ARRAY_LENGTH(ep), 0);
+	if (count < 0)
+		return -errno;
+
+	pthread_mutex_lock(&ratbag->lock);
+
+	for (i = 0; i < count; ++i) {
+		source = ep[i].data.ptr;
+		if (source->fd == -1)
+			continue;
+
+		source->dispatch(source->user_data);
+	}
+
+	ratbag_drop_destroyed_sources(ratbag);
+
+	/* The caller may drop the last reference to the device from the
+	 * callback, which needs the lock */
+	while (!list_empty(&ratbag->completions)) {
+		struct ratbag_completion *completion;
+
+		completion = container_of(ratbag->completions.next, completion, link);
+		list_remove(&completion->link);
+		pthread_mutex_unlock(&ratbag->lock);
+
+		ratbag->interface->preview_done(completion->device,
+						completion->rc,
+						ratbag->userdata);
+		ratbag_device_unref(completion->device);
+		free(completion);
+
+		pthread_mutex_lock(&ratbag->lock);
+	}
+
+	pthread_mutex_unlock(&ratbag->lock);
+
+	return 0;
+}
+
+static void
+ratbag_dispatch_wakeup(void *data)
+{
+	struct ratbag *ratbag = data;
+	uint64_t value;
+
+	/* the completions are reported at the end of ratbag_dispatch() */
+	(void) read(ratbag->wakeup_fd, &value, sizeof(value));
+}
+
 LIBRATBAG_EXPORT struct ratbag *
 ratbag_create_context(const struct ratbag_interface *interface,
 		      void *userdata)
@@ -557,8 +1031,41 @@ ratbag_create_context(const struct ratbag_interface *interface,
 
 	list_init(&ratbag->drivers);
 	list_init(&ratbag->devices);
+	list_init(&ratbag->source_destroy_list);
+	list_init(&ratbag->completions);
+	pthread_mutex_init(&ratbag->lock, NULL);
+	list_init(&ratbag->report_descriptor_cache);
+	ratbag_device_data_cache_init(ratbag);
+
+	ratbag->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (ratbag->epoll_fd < 0) {
+		pthread_mutex_destroy(&ratbag->lock);
+		free(ratbag);
+		return NULL;
+	}
+
+	ratbag->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ratbag->wakeup_fd >= 0)
+		ratbag->wakeup_source = ratbag_add_fd(ratbag,
+						      ratbag->wakeup_fd,
+						      ratbag_dispatch_wakeup,
+						      ratbag);
+	if (!ratbag->wakeup_source) {
+		if (ratbag->wakeup_fd >= 0)
+			close(ratbag->wakeup_fd);
+		close(ratbag->epoll_fd);
+		pthread_mutex_destroy(&ratbag->lock);
+		free(ratbag);
+		return NULL;
+	}
+
 	ratbag->udev = udev_new();
 	if (!ratbag->udev) {
+		ratbag_remove_source(ratbag, ratbag->wakeup_source);
+		ratbag_drop_destroyed_sources(ratbag);
+		close(ratbag->wakeup_fd);
+		close(ratbag->epoll_fd);
+		pthread_mutex_destroy(&ratbag->lock);
 		free(ratbag);
 		return NULL;
 	}
@@ -588,19 +1095,34 @@ ratbag_create_context(const struct ratbag_interface *interface,
 LIBRATBAG_EXPORT struct ratbag *
 ratbag_ref(struct ratbag *ratbag)
 {
+	pthread_mutex_lock(&ratbag->lock);
 	ratbag->refcount++;
+	pthread_mutex_unlock(&ratbag->lock);
+
 	return ratbag;
 }
 
 LIBRATBAG_EXPORT struct ratbag *
 ratbag_unref(struct ratbag *ratbag)
 {
+	int refcount;
+
 	if (ratbag == NULL)
 		return NULL;
 
+	pthread_mutex_lock(&ratbag->lock);
 	assert(ratbag->refcount > 0);
-	ratbag->refcount--;
-	if (ratbag->refcount == 0) {
+	refcount = --ratbag->refcount;
+	pthread_mutex_unlock(&ratbag->lock);
+
+	if (refcount == 0) {
+		ratbag_device_data_cache_release(ratbag);
+		ratbag_hidraw_cache_release(ratbag);
+		ratbag_remove_source(ratbag, ratbag->wakeup_source);
+		ratbag_drop_destroyed_sources(ratbag);
+		close(ratbag->wakeup_fd);
+		close(ratbag->epoll_fd);
+		pthread_mutex_destroy(&ratbag->lock);
 		ratbag->udev = udev_unref(ratbag->udev);
 		free(ratbag);
 	}
@@ -608,37 +1130,6 @@ ratbag_unref(struct ratbag *ratbag)
 	return NULL;
 }
 
-static struct ratbag_button *
-ratbag_create_button(struct ratbag_profile *profile, unsigned int index)
-{
-	struct ratbag_button *button;
-
-	button = zalloc(sizeof(*button));
-	button->refcount = 0;
-	button->profile = profile;
-	button->index = index;
-
-	list_append(&profile->buttons, &button->link);
-
-	return button;
-}
-
-static struct ratbag_led *
-ratbag_create_led(struct ratbag_profile *profile, unsigned int index)
-{
-	struct ratbag_led *led;
-
-	led = zalloc(sizeof(*led));
-	led->refcount = 0;
-	led->profile = profile;
-	led->index = index;
-	led->colordepth = RATBAG_LED_COLORDEPTH_RGB_888;
-
-	list_append(&profile->leds, &led->link);
-
-	return led;
-}
-
 LIBRATBAG_EXPORT bool
 ratbag_profile_has_capability(const struct ratbag_profile *profile,
 			      enum ratbag_profile_capability cap)
@@ -649,60 +1140,53 @@ ratbag_profile_has_capability(const struct ratbag_profile *profile,
 	return long_bit_is_set(profile->capabilities, cap);
 }
 
-static inline void
-ratbag_create_resolution(struct ratbag_profile *profile, int index)
-{
-	struct ratbag_resolution *res;
-
-	res = zalloc(sizeof(*res));
-	res->refcount = 0;
-	res->profile = profile;
-	res->index = index;
-
-	list_append(&profile->resolutions, &res->link);
-
-	profile->num_resolutions++;
-}
-
-
-static struct ratbag_profile *
-ratbag_create_profile(struct ratbag_device *device,
-		      unsigned int index,
-		      unsigned int num_resolutions,
-		      unsigned int num_buttons,
-		      unsigned int num_leds)
+static void
+ratbag_init_profile(struct ratbag_device *device,
+		    struct ratbag_profile *profile,
+		    unsigned int index,
+		    unsigned int num_resolutions,
+		    unsigned int num_buttons,
+		    unsigned int num_leds)
 {
-	struct ratbag_profile *profile;
 	unsigned i;
 
-	profile = zalloc(sizeof(*profile));
 	profile->refcount = 0;
 	profile->device = device;
 	profile->index = index;
-	profile->num_resolutions = 0;
+	profile->num_resolutions = num_resolutions;
 	profile->is_enabled = true;
 	profile->name = NULL;
 	profile->angle_snapping = -1;
 	profile->debounce = -1;
 
-	list_append(&device->profiles, &profile->link);
-	list_init(&profile->buttons);
-	list_init(&profile->leds);
-	list_init(&profile->resolutions);
+	profile->resolutions = ratbag_arena_alloc(&device->arena,
+						  num_resolutions * sizeof(*profile->resolutions));
+	profile->buttons = ratbag_arena_alloc(&device->arena,
+					      num_buttons * sizeof(*profile->buttons));
+	profile->leds = ratbag_arena_alloc(&device->arena,
+					   num_leds * sizeof(*profile->leds));
+
+	for (i = 0; i < num_resolutions; i++) {
+		struct ratbag_resolution *res = &profile->resolutions[i];
 
-	profile->device->num_buttons = num_buttons;
-	profile->device->num_leds = num_leds;
+		res->profile = profile;
+		res->index = i;
+	}
 
-	for (i = 0; i < num_resolutions; i++)
-		ratbag_create_resolution(profile, i);
+	for (i = 0; i < num_buttons; i++) {
+		struct ratbag_button *button = &profile->buttons[i];
 
-	for (i = 0; i < num_buttons; i++)
-		ratbag_create_button(profile, i);
+		button->profile = profile;
+		button->index = i;
+	}
 
-	for (i = 0; i < num_leds; i++)
-		ratbag_create_led(profile, i);
+	for (i = 0; i < num_leds; i++) {
+		struct ratbag_led *led = &profile->leds[i];
 
-	return profile;
+		led->profile = profile;
+		led->index = i;
+		led->colordepth = RATBAG_LED_COLORDEPTH_RGB_888;
+	}
 }
 
 int
@@ -714,15 +1198,50 @@ ratbag_device_init_profiles(struct ratbag_device *device,
 {
 	unsigned int i;
 
-	for (i = 0; i < num_profiles; i++) {
-		ratbag_create_profile(device, i, num_resolutions, num_buttons, num_leds);
-	}
+	assert(device->profiles == NULL);
+
+	/* Everything below lives as long as the device does, so it all goes
+	 * into the device arena rather than one allocation per object */
+	device->profiles = ratbag_arena_alloc(&device->arena,
+					      num_profiles * sizeof(*device->profiles));
+
+	for (i = 0; i < num_profiles; i++)
+		ratbag_init_profile(device, &device->profiles[i], i,
+				    num_resolutions, num_buttons, num_leds);
 
 	device->num_profiles = num_profiles;
+	device->num_buttons = num_buttons;
+	device->num_leds = num_leds;
 
 	return 0;
 }
 
+const unsigned int *
+ratbag_device_share_list(struct ratbag_device *device,
+			 const unsigned int *values,
+			 size_t count)
+{
+	struct ratbag_value_list *list;
+
+	for (size_t i = 1; i < count; i++)
+		assert(values[i - 1] < values[i]);
+
+	for (list = device->value_lists; list; list = list->next) {
+		if (list->count == count &&
+		    memcmp(list->values, values, count * sizeof(*values)) == 0)
+			return list->values;
+	}
+
+	list = ratbag_arena_alloc(&device->arena,
+				  sizeof(*list) + count * sizeof(*values));
+	list->count = count;
+	memcpy(list->values, values, count * sizeof(*values));
+	list->next = device->value_lists;
+	device->value_lists = list;
+
+	return list->values;
+}
+
 LIBRATBAG_EXPORT struct ratbag_profile *
 ratbag_profile_ref(struct ratbag_profile *profile)
 {
@@ -736,26 +1255,21 @@ ratbag_profile_ref(struct ratbag_profile *profile)
 static void
 ratbag_profile_destroy(struct ratbag_profile *profile)
 {
-	struct ratbag_button *button, *b_next;
-	struct ratbag_led *led, *l_next;
-	struct ratbag_resolution *res, *r_next;
+	struct ratbag_button *button;
 
 	/* if we get to the point where the profile is destroyed, buttons,
-	 * resolutions , etc. are at a refcount of 0, so we can destroy
-	 * everything */
-	list_for_each_safe(button, b_next, &profile->buttons, link)
-		ratbag_button_destroy(button);
-
-	list_for_each_safe(led, l_next, &profile->leds, link)
-		ratbag_led_destroy(led);
-
-	list_for_each_safe(res, r_next, &profile->resolutions, link)
-		ratbag_resolution_destroy(res);
+	 * resolutions , etc. are at a refcount of 0. The objects themselves
+	 * are in the device arena, only the macros and names are ours */
+	ratbag_profile_for_each_button(profile, button) {
+		if (button->action.macro) {
+			free(button->action.macro->name);
+			free(button->action.macro->group);
+			free(button->action.macro->events);
+			free(button->action.macro);
+		}
+	}
 
 	free(profile->name);
-
-	list_remove(&profile->link);
-	free(profile);
 }
 
 LIBRATBAG_EXPORT struct ratbag_profile *
@@ -775,21 +1289,12 @@ ratbag_profile_unref(struct ratbag_profile *profile)
 LIBRATBAG_EXPORT struct ratbag_profile *
 ratbag_device_get_profile(struct ratbag_device *device, unsigned int index)
 {
-	struct ratbag_profile *profile;
-
 	if (index >= ratbag_device_get_num_profiles(device)) {
 		log_bug_client(device->ratbag, "Requested invalid profile %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(profile, &device->profiles, link) {
-		if (profile->index == index)
-			return ratbag_profile_ref(profile);
-	}
-
-	log_bug_libratbag(device->ratbag, "Profile %d not found\n", index);
-
-	return NULL;
+	return ratbag_profile_ref(&device->profiles[index]);
 }
 
 LIBRATBAG_EXPORT enum ratbag_error_code
@@ -843,40 +1348,49 @@ ratbag_device_get_num_leds(const struct ratbag_device *device)
 	return device->num_leds;
 }
 
-LIBRATBAG_EXPORT enum ratbag_error_code
-ratbag_device_commit(struct ratbag_device *device)
+/* everything but is_active_dirty, see ratbag_device_write() */
+static void
+ratbag_profile_clear_dirty(struct ratbag_profile *profile)
 {
-	struct ratbag_profile *profile;
 	struct ratbag_button *button;
 	struct ratbag_led *led;
 	struct ratbag_resolution *resolution;
-	int rc;
 
-	if (device->driver->commit == NULL) {
-		log_error(device->ratbag,
-			  "Trying to commit with a driver that doesn't support committing\n");
-		return RATBAG_ERROR_CAPABILITY;
-	}
+	profile->dirty = false;
 
-	rc = device->driver->commit(device);
-	if (rc)
-		return RATBAG_ERROR_DEVICE;
+	profile->angle_snapping_dirty = false;
+	profile->debounce_dirty = false;
+	profile->rate_dirty = false;
+
+	ratbag_profile_for_each_button(profile, button)
+		button->dirty = false;
 
-	list_for_each(profile, &device->profiles, link) {
-		profile->dirty = false;
+	ratbag_profile_for_each_led(profile, led)
+		led->dirty = false;
 
-		profile->angle_snapping_dirty = false;
-		profile->debounce_dirty = false;
-		profile->rate_dirty = false;
+	ratbag_profile_for_each_resolution(profile, resolution)
+		resolution->dirty = false;
+}
 
-		list_for_each(button, &profile->buttons, link)
-			button->dirty = false;
+LIBRATBAG_EXPORT void
+ratbag_profile_mark_clean(struct ratbag_profile *profile)
+{
+	ratbag_profile_clear_dirty(profile);
+	profile->is_active_dirty = false;
+}
+
+static enum ratbag_error_code
+ratbag_device_write(struct ratbag_device *device)
+{
+	struct ratbag_profile *profile;
+	int rc;
 
-		list_for_each(led, &profile->leds, link)
-			led->dirty = false;
+	rc = device->driver->commit(device);
+	if (rc)
+		return RATBAG_ERROR_DEVICE;
 
-		list_for_each(resolution, &profile->resolutions, link)
-			resolution->dirty = false;
+	ratbag_device_for_each_profile(device, profile) {
+		ratbag_profile_clear_dirty(profile);
 
 		/* TODO: think if this should be moved into `driver-commit`. */
 		if (profile->is_active_dirty && profile->is_active) {
@@ -893,6 +1407,194 @@ ratbag_device_commit(struct ratbag_device *device)
 	return RATBAG_SUCCESS;
 }
 
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_commit(struct ratbag_device *device)
+{
+	enum ratbag_error_code rc;
+
+	if (!device->probed)
+		return RATBAG_ERROR_DEVICE;
+
+	if (device->driver->commit == NULL) {
+		log_error(device->ratbag,
+			  "Trying to commit with a driver that doesn't support committing\n");
+		return RATBAG_ERROR_CAPABILITY;
+	}
+
+	ratbag_device_io_begin(device);
+	rc = ratbag_device_write(device);
+	ratbag_device_io_end(device);
+
+	return rc;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_preview(struct ratbag_device *device)
+{
+	int rc;
+
+	if (!device->probed)
+		return RATBAG_ERROR_DEVICE;
+
+	if (device->driver->preview == NULL)
+		return RATBAG_ERROR_CAPABILITY;
+
+	ratbag_device_io_begin(device);
+	rc = device->driver->preview(device);
+	ratbag_device_io_end(device);
+	if (rc)
+		return RATBAG_ERROR_DEVICE;
+
+	return RATBAG_SUCCESS;
+}
+
+void
+ratbag_device_preview_done(struct ratbag_device *device, int rc)
+{
+	struct ratbag *ratbag = device->ratbag;
+	struct ratbag_completion *completion;
+	uint64_t one = 1;
+
+	if (rc)
+		log_debug(ratbag, "%s: preview failed (%d)\n", device->name, rc);
+
+	completion = zalloc(sizeof(*completion));
+	completion->device = device; /* the reference taken on start */
+	completion->rc = rc ? RATBAG_ERROR_DEVICE : RATBAG_SUCCESS;
+	list_append(&ratbag->completions, &completion->link);
+
+	(void) write(ratbag->wakeup_fd, &one, sizeof(one));
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_start_preview(struct ratbag_device *device)
+{
+	struct ratbag *ratbag = device->ratbag;
+	int rc;
+
+	if (!ratbag->interface->preview_done) {
+		log_bug_client(ratbag, "ratbag_interface.preview_done is not set\n");
+		return RATBAG_ERROR_VALUE;
+	}
+
+	if (!device->probed)
+		return RATBAG_ERROR_DEVICE;
+
+	if (device->driver->preview_async) {
+		ratbag_device_ref(device);
+		pthread_mutex_lock(&ratbag->lock);
+		rc = device->driver->preview_async(device);
+		pthread_mutex_unlock(&ratbag->lock);
+		if (rc) {
+			ratbag_device_unref(device);
+			return rc == -ENOTSUP ? RATBAG_ERROR_CAPABILITY : RATBAG_ERROR_DEVICE;
+		}
+		return RATBAG_SUCCESS;
+	}
+
+	if (device->driver->preview == NULL)
+		return RATBAG_ERROR_CAPABILITY;
+
+	/* no state machine in this driver, this one blocks */
+	ratbag_device_io_begin(device);
+	rc = device->driver->preview(device);
+	ratbag_device_io_end(device);
+
+	ratbag_device_ref(device);
+	pthread_mutex_lock(&ratbag->lock);
+	ratbag_device_preview_done(device, rc);
+	pthread_mutex_unlock(&ratbag->lock);
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT bool
+ratbag_device_has_battery(const struct ratbag_device *device)
+{
+	return device->battery.present;
+}
+
+LIBRATBAG_EXPORT bool
+ratbag_device_has_battery_notifications(const struct ratbag_device *device)
+{
+	/* the driver may handle the notifications but we don't read them
+	 * if the node is too busy, see ratbag_device_watch_notifications() */
+	return device->battery.present &&
+	       device->battery.notifies &&
+	       device->watch_notifications;
+}
+
+LIBRATBAG_EXPORT enum ratbag_error_code
+ratbag_device_update_battery(struct ratbag_device *device)
+{
+	int rc;
+
+	if (!device->battery.present || device->driver->read_battery == NULL)
+		return RATBAG_ERROR_CAPABILITY;
+
+	ratbag_device_io_begin(device);
+	rc = device->driver->read_battery(device);
+	ratbag_device_io_end(device);
+	if (rc)
+		return RATBAG_ERROR_DEVICE;
+
+	return RATBAG_SUCCESS;
+}
+
+LIBRATBAG_EXPORT int
+ratbag_device_get_battery_level(const struct ratbag_device *device)
+{
+	return device->battery.level;
+}
+
+LIBRATBAG_EXPORT unsigned int
+ratbag_device_get_battery_voltage(const struct ratbag_device *device)
+{
+	return device->battery.voltage;
+}
+
+LIBRATBAG_EXPORT enum ratbag_battery_state
+ratbag_device_get_battery_state(const struct ratbag_device *device)
+{
+	return device->battery.state;
+}
+
+LIBRATBAG_EXPORT uint64_t
+ratbag_device_get_stat(const struct ratbag_device *device,
+		       enum ratbag_stat stat)
+{
+	if (stat >= RATBAG_STAT_COUNT) {
+		log_bug_client(device->ratbag, "Invalid stat %d\n", stat);
+		return 0;
+	}
+
+	return __atomic_load_n(&device->stats.counters[stat], __ATOMIC_RELAXED);
+}
+
+LIBRATBAG_EXPORT uint64_t
+ratbag_device_get_protocol_error_count(const struct ratbag_device *device,
+				       uint8_t code)
+{
+	unsigned int slot = min(code, RATBAG_STATS_PROTOCOL_ERRORS - 1);
+
+	return __atomic_load_n(&device->stats.protocol_errors[slot],
+			       __ATOMIC_RELAXED);
+}
+
+LIBRATBAG_EXPORT unsigned int
+ratbag_device_get_latency_histogram(const struct ratbag_device *device,
+				    uint64_t *buckets,
+				    unsigned int nbuckets)
+{
+	unsigned int n = min(nbuckets, RATBAG_STATS_LATENCY_BUCKETS);
+
+	for (unsigned int i = 0; i < n; i++)
+		buckets[i] = __atomic_load_n(&device->stats.latency[i],
+					     __ATOMIC_RELAXED);
+
+	return n;
+}
+
 LIBRATBAG_EXPORT enum ratbag_error_code
 ratbag_profile_set_active(struct ratbag_profile *profile)
 {
@@ -905,7 +1607,7 @@ ratbag_profile_set_active(struct ratbag_profile *profile)
 	if (device->num_profiles == 1)
 		return RATBAG_SUCCESS;
 
-	list_for_each(p, &device->profiles, link) {
+	ratbag_device_for_each_profile(device, p) {
 		if (p->is_active) {
 			p->is_active = false;
 			p->is_active_dirty = true;
@@ -928,8 +1630,6 @@ ratbag_profile_get_num_resolutions(const struct ratbag_profile *profile)
 LIBRATBAG_EXPORT struct ratbag_resolution *
 ratbag_profile_get_resolution(struct ratbag_profile *profile, unsigned int idx)
 {
-	struct ratbag_device *device = profile->device;
-	struct ratbag_resolution *res;
 	unsigned max = ratbag_profile_get_num_resolutions(profile);
 
 	if (idx >= max) {
@@ -938,15 +1638,7 @@ ratbag_profile_get_resolution(struct ratbag_profile *profile, unsigned int idx)
 		return NULL;
 	}
 
-	ratbag_profile_for_each_resolution(profile, res) {
-		if (res->index == idx)
-			return ratbag_resolution_ref(res);
-	}
-
-	log_bug_libratbag(device->ratbag, "Resolution %d, profile %d not found\n",
-			  idx, profile->index);
-
-	return NULL;
+	return ratbag_resolution_ref(&profile->resolutions[idx]);
 }
 
 LIBRATBAG_EXPORT struct ratbag_resolution *
@@ -1267,22 +1959,13 @@ ratbag_profile_get_button(struct ratbag_profile *profile,
 				   unsigned int index)
 {
 	struct ratbag_device *device = profile->device;
-	struct ratbag_button *button;
 
 	if (index >= ratbag_device_get_num_buttons(device)) {
 		log_bug_client(device->ratbag, "Requested invalid button %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(button, &profile->buttons, link) {
-		if (button->index == index)
-			return ratbag_button_ref(button);
-	}
-
-	log_bug_libratbag(device->ratbag, "Button %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ratbag_button_ref(&profile->buttons[index]);
 }
 
 LIBRATBAG_EXPORT enum ratbag_button_action_type
@@ -1447,32 +2130,6 @@ ratbag_led_ref(struct ratbag_led *led)
 	return led;
 }
 
-static void
-ratbag_button_destroy(struct ratbag_button *button)
-{
-	list_remove(&button->link);
-	if (button->action.macro) {
-		free(button->action.macro->name);
-		free(button->action.macro->group);
-		free(button->action.macro);
-	}
-	free(button);
-}
-
-static void
-ratbag_led_destroy(struct ratbag_led *led)
-{
-	list_remove(&led->link);
-	free(led);
-}
-
-static void
-ratbag_resolution_destroy(struct ratbag_resolution *res)
-{
-	list_remove(&res->link);
-	free(res);
-}
-
 LIBRATBAG_EXPORT struct ratbag_button *
 ratbag_button_unref(struct ratbag_button *button)
 {
@@ -1584,22 +2241,13 @@ ratbag_profile_get_led(struct ratbag_profile *profile,
 		       unsigned int index)
 {
 	struct ratbag_device *device = profile->device;
-	struct ratbag_led *led;
 
 	if (index >= ratbag_device_get_num_leds(device)) {
 		log_bug_client(device->ratbag, "Requested invalid led %d\n", index);
 		return NULL;
 	}
 
-	list_for_each(led, &profile->leds, link) {
-		if (led->index == index)
-			return ratbag_led_ref(led);
-	}
-
-	log_bug_libratbag(device->ratbag, "Led %d, profile %d not found\n",
-			  index, profile->index);
-
-	return NULL;
+	return ratbag_led_ref(&profile->leds[index]);
 }
 
 LIBRATBAG_EXPORT const char *
@@ -1711,7 +2359,7 @@ ratbag_button_get_macro(struct ratbag_button *button)
 	macro = ratbag_button_macro_new(button->action.macro->name);
 	memcpy(macro->macro.events,
 	       button->action.macro->events,
-	       sizeof(macro->macro.events));
+	       button->action.macro->nevents * sizeof(*macro->macro.events));
 
 	return macro;
 }
@@ -1720,18 +2368,30 @@ void
 ratbag_button_copy_macro(struct ratbag_button *button,
 			 const struct ratbag_button_macro *macro)
 {
+	unsigned int nevents = 0;
+
+	while (nevents < MAX_MACRO_EVENTS &&
+	       macro->events[nevents].type != RATBAG_MACRO_EVENT_NONE)
+		nevents++;
+
 	if (!button->action.macro)
 		button->action.macro = zalloc(sizeof(struct ratbag_macro));
 	else {
 		free(button->action.macro->name);
 		free(button->action.macro->group);
+		free(button->action.macro->events);
 		memset(button->action.macro, 0, sizeof(struct ratbag_macro));
 	}
 
 	button->action.type = RATBAG_BUTTON_ACTION_TYPE_MACRO;
+	/* keep a RATBAG_MACRO_EVENT_NONE terminator unless the macro is full */
+	button->action.macro->events =
+		zalloc((nevents < MAX_MACRO_EVENTS ? nevents + 1 : nevents) *
+		       sizeof(*button->action.macro->events));
 	memcpy(button->action.macro->events,
-	       macro->macro.events,
-	       sizeof(macro->macro.events));
+	       macro->events,
+	       nevents * sizeof(*macro->events));
+	button->action.macro->nevents = nevents;
 	button->action.macro->name = strdup_safe(macro->macro.name);
 	button->action.macro->group = strdup_safe(macro->macro.group);
 }
@@ -1875,6 +2535,8 @@ ratbag_button_macro_new(const char *name)
 	macro = zalloc(sizeof *macro);
 	macro->refcount = 1;
 	macro->macro.name = strdup_safe(name);
+	macro->macro.events = macro->events;
+	macro->macro.nevents = MAX_MACRO_EVENTS;
 
 	return macro;
 }
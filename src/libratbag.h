@@ -280,6 +280,32 @@ struct ratbag_interface {
 	 * ratbag_create_context()
 	 */
 	void (*close_restricted)(int fd, void *user_data);
+	/**
+	 * Called from within ratbag_dispatch() when the device changed its
+	 * state on its own, e.g. because the user switched to another
+	 * profile or resolution with a button on the device. The device's
+	 * profiles and resolutions are updated already. Optional, may be
+	 * NULL.
+	 *
+	 * @param device The device that changed
+	 * @param user_data The user_data provided in
+	 * ratbag_create_context()
+	 */
+	void (*device_changed)(struct ratbag_device *device, void *user_data);
+	/**
+	 * Called from within ratbag_dispatch() when a preview started with
+	 * ratbag_device_start_preview() is finished. Required for
+	 * ratbag_device_start_preview(), may be NULL otherwise.
+	 *
+	 * @param device The device
+	 * @param rc RATBAG_SUCCESS or the error code, as
+	 * ratbag_device_preview() returns it
+	 * @param user_data The user_data provided in
+	 * ratbag_create_context()
+	 */
+	void (*preview_done)(struct ratbag_device *device,
+			     enum ratbag_error_code rc,
+			     void *user_data);
 };
 
 /**
@@ -349,6 +375,45 @@ ratbag_ref(struct ratbag *ratbag);
 struct ratbag *
 ratbag_unref(struct ratbag *ratbag);
 
+/**
+ * @ingroup base
+ *
+ * libratbag keeps a single file descriptor for all events. Call
+ * ratbag_dispatch() whenever this fd is readable. The fd must not be
+ * read from or closed by the caller.
+ *
+ * The events a device sends on its own, e.g. a profile switch or a
+ * battery update, changes to the device data files and the replies to
+ * asynchronous calls like ratbag_device_start_preview() come through
+ * this fd. Probing a device, ratbag_device_commit() and the other calls
+ * that talk to the device do their I/O synchronously and do not return
+ * before the device answered. They may run on another thread, but not on
+ * the one calling ratbag_dispatch() while an asynchronous call for the
+ * same device is pending.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @return The file descriptor used to notify the caller of pending events
+ *
+ * @see ratbag_dispatch
+ */
+int
+ratbag_get_fd(const struct ratbag *ratbag);
+
+/**
+ * @ingroup base
+ *
+ * Process all events pending on the fd returned by ratbag_get_fd().
+ * This function does not wait for new events, but it may wait for
+ * another thread that is currently calling into this context.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @return 0 on success, or a negative errno on failure
+ *
+ * @see ratbag_get_fd
+ */
+int
+ratbag_dispatch(struct ratbag *ratbag);
+
 /**
  * @ingroup base
  *
@@ -357,6 +422,11 @@ ratbag_unref(struct ratbag *ratbag);
  * The device is refcounted with an initial value of at least 1.
  * Use ratbag_device_unref() to release the device.
  *
+ * This function may be called from several threads at the same time for
+ * different physical devices, provided each thread uses its own udev
+ * context. All other functions operating on the resulting device must
+ * only be called from one thread at a time.
+ *
  * @param ratbag A previously initialized ratbag context
  * @param udev_device The udev device that points at the device
  * @param device Set to a new device based on the udev device.
@@ -370,6 +440,62 @@ ratbag_device_new_from_udev_device(struct ratbag *ratbag,
 				   struct udev_device *udev_device,
 				   struct ratbag_device **device);
 
+/**
+ * @ingroup base
+ *
+ * Like ratbag_device_new_from_udev_device() but the device is only looked
+ * up in the device database, nothing is sent to the device. Call
+ * ratbag_device_probe() before using it.
+ *
+ * Until then, only the name, the device type and the bus and product ids
+ * are known. The device has no profiles, buttons or LEDs and
+ * ratbag_device_commit() fails.
+ *
+ * @param ratbag A previously initialized ratbag context
+ * @param udev_device The udev device that points at the device
+ * @param device Set to a new device based on the udev device.
+ *
+ * @return 0 on success or the error.
+ * @retval RATBAG_ERROR_DEVICE The given device does not exist or is not
+ * supported by libratbag.
+ *
+ * @see ratbag_device_probe
+ */
+enum ratbag_error_code
+ratbag_device_new_from_udev_device_unprobed(struct ratbag *ratbag,
+					    struct udev_device *udev_device,
+					    struct ratbag_device **device);
+
+/**
+ * @ingroup device
+ *
+ * Run the driver probe on a device created with
+ * ratbag_device_new_from_udev_device_unprobed(), this reads the profiles
+ * from the device. Nothing happens if the device was probed before.
+ *
+ * If the probe fails, the device is not supported after all and should be
+ * released with ratbag_device_unref().
+ *
+ * @param device A previously initialized ratbag device
+ *
+ * @return 0 on success or the error.
+ * @retval RATBAG_ERROR_DEVICE The device is not supported by libratbag.
+ */
+enum ratbag_error_code
+ratbag_device_probe(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ *
+ * @return true if the device was successfully probed
+ *
+ * @see ratbag_device_probe
+ */
+bool
+ratbag_device_is_probed(const struct ratbag_device *device);
+
 /**
  * @ingroup device
  *
@@ -512,6 +638,164 @@ ratbag_device_get_product_version(const struct ratbag_device *device);
 enum ratbag_error_code
 ratbag_device_commit(struct ratbag_device *device);
 
+/**
+ * @ingroup device
+ *
+ * Apply the changes to the active profile without writing them to the
+ * device's persistent memory. This is much faster than
+ * ratbag_device_commit() and does not wear down the device's flash, it is
+ * intended for previewing a setting while the user adjusts it.
+ *
+ * Depending on the device, only some settings can be previewed, typically
+ * the active resolution, the report rate and the LEDs. Previewed settings
+ * are lost when the device is power-cycled or switches profiles, call
+ * ratbag_device_commit() to store them.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success, RATBAG_ERROR_CAPABILITY if the device does not
+ * support previews or an error code otherwise
+ */
+enum ratbag_error_code
+ratbag_device_preview(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Like ratbag_device_preview() but without waiting for the device: the
+ * requests are sent and their replies read from within ratbag_dispatch(),
+ * which calls ratbag_interface.preview_done() once they're done. The
+ * settings are read when this is called, later changes are not part of
+ * the preview.
+ *
+ * Drivers that can't do this asynchronously fall back to
+ * ratbag_device_preview() and only report the result asynchronously.
+ *
+ * @param device A previously initialized ratbag device
+ * @return RATBAG_SUCCESS if the preview was started,
+ * RATBAG_ERROR_CAPABILITY if the device does not support previews or an
+ * error code otherwise. ratbag_interface.preview_done() is only called
+ * on success.
+ */
+enum ratbag_error_code
+ratbag_device_start_preview(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @return true if the device runs on a battery whose state libratbag can
+ * read, false otherwise
+ */
+bool
+ratbag_device_has_battery(const struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Some devices report changes to their battery state on their own. For
+ * those, the battery state is updated from within ratbag_dispatch() and
+ * the ratbag_interface.device_changed() callback is called, there is no
+ * need to call ratbag_device_update_battery() periodically.
+ *
+ * @param device A previously initialized ratbag device
+ * @return true if the device notifies about battery changes
+ */
+bool
+ratbag_device_has_battery_notifications(const struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * Read the battery state from the device. The getters below only return
+ * the state read last, either by this function, during the probe or
+ * through a notification.
+ *
+ * This talks to the device: a wireless device that went to sleep may be
+ * woken up by it, or the request times out. Call it sparingly.
+ *
+ * @param device A previously initialized ratbag device
+ * @return 0 on success, RATBAG_ERROR_CAPABILITY if the device has no
+ * battery or an error code otherwise
+ */
+enum ratbag_error_code
+ratbag_device_update_battery(struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @return The battery level in percent or -1 if unknown. Some devices
+ * only report their battery voltage, see
+ * ratbag_device_get_battery_voltage().
+ */
+int
+ratbag_device_get_battery_level(const struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @return The battery voltage in mV or 0 if unknown
+ */
+unsigned int
+ratbag_device_get_battery_voltage(const struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * @param device A previously initialized ratbag device
+ * @return The charging state of the battery
+ */
+enum ratbag_battery_state
+ratbag_device_get_battery_state(const struct ratbag_device *device);
+
+/**
+ * @ingroup device
+ *
+ * The counters are updated by the transport while talking to the device
+ * and never reset. They may be read at any time, from any thread.
+ *
+ * @param device A previously initialized ratbag device
+ * @param stat The counter to read
+ * @return The current value of the counter
+ */
+uint64_t
+ratbag_device_get_stat(const struct ratbag_device *device,
+		       enum ratbag_stat stat);
+
+/**
+ * @ingroup device
+ *
+ * Protocol specific error codes are counted separately, this is only
+ * implemented for HID++ devices. Codes above 31 are counted together
+ * with 31.
+ *
+ * @param device A previously initialized ratbag device
+ * @param code The error code as sent by the device
+ * @return The number of requests the device replied to with this error
+ */
+uint64_t
+ratbag_device_get_protocol_error_count(const struct ratbag_device *device,
+				       uint8_t code);
+
+/**
+ * @ingroup device
+ *
+ * Copy the latency histogram of the requests into buckets. The count of
+ * the requests that took from 2^i up to 2^(i+1) microseconds is stored
+ * in buckets[i], the first bucket also counts all faster requests and
+ * the last bucket all slower ones.
+ *
+ * @param device A previously initialized ratbag device
+ * @param buckets The array to fill in
+ * @param nbuckets The number of elements in buckets
+ * @return The number of buckets filled in
+ */
+unsigned int
+ratbag_device_get_latency_histogram(const struct ratbag_device *device,
+				    uint64_t *buckets,
+				    unsigned int nbuckets);
+
 /**
  * @ingroup device
  *
@@ -715,6 +999,20 @@ ratbag_profile_is_active(const struct ratbag_profile *profile);
 bool
 ratbag_profile_is_dirty(const struct ratbag_profile *profile);
 
+/**
+ * @ingroup profile
+ *
+ * Forget that the profile was changed since the last commit. The
+ * settings are not reverted, the caller asserts they match what the
+ * device has, e.g. because it has just set them back to what they were.
+ * The next ratbag_device_commit() won't write the profile unless it is
+ * changed again.
+ *
+ * @param profile A previously initialized ratbag profile
+ */
+void
+ratbag_profile_mark_clean(struct ratbag_profile *profile);
+
 /**
  * @ingroup profile
  *
@@ -538,6 +538,39 @@ START_TEST(device_resolutions_num_0)
 }
 END_TEST
 
+START_TEST(device_resolutions_shared_lists)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p, *p0;
+	struct ratbag_resolution *res, *res0;
+
+	struct ratbag_test_device td = sane_device;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+
+	p0 = &d->profiles[0];
+	res0 = &p0->resolutions[0];
+	ck_assert_int_gt(res0->ndpis, 0);
+	ck_assert_int_gt(p0->nrates, 0);
+
+	/* the test device uses the same lists everywhere, so there
+	 * must only be one copy of each */
+	ratbag_device_for_each_profile(d, p) {
+		ck_assert(p->rates == p0->rates);
+
+		ratbag_profile_for_each_resolution(p, res) {
+			ck_assert(res->dpis == res0->dpis);
+			ck_assert_int_eq(res->ndpis, res0->ndpis);
+		}
+	}
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
 START_TEST(device_freed_before_profile)
 {
 	struct ratbag *r;
@@ -964,6 +997,222 @@ START_TEST(device_leds_set)
 }
 END_TEST
 
+START_TEST(device_preview)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	int device_freed_count = 0;
+	enum ratbag_error_code rc;
+
+	struct ratbag_test_device td = sane_device;
+	td.destroyed_data = &device_freed_count;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+
+	p = ratbag_device_get_profile(d, 0);
+	ck_assert(p != NULL);
+	ck_assert(!ratbag_profile_is_dirty(p));
+
+	res = ratbag_profile_get_resolution(p, 0);
+	rc = ratbag_resolution_set_dpi(res, 800);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert(ratbag_profile_is_dirty(p));
+
+	/* a preview doesn't store anything, the profile stays dirty */
+	rc = ratbag_device_preview(d);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert(ratbag_profile_is_dirty(p));
+	ck_assert_int_eq(ratbag_resolution_get_dpi(res), 800);
+
+	rc = ratbag_device_commit(d);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert(!ratbag_profile_is_dirty(p));
+
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
+START_TEST(device_mark_clean)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	struct ratbag_profile *p;
+	struct ratbag_resolution *res;
+	int device_freed_count = 0;
+	enum ratbag_error_code rc;
+
+	struct ratbag_test_device td = sane_device;
+	td.destroyed_data = &device_freed_count;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+
+	p = ratbag_device_get_profile(d, 0);
+	res = ratbag_profile_get_resolution(p, 0);
+	rc = ratbag_resolution_set_dpi(res, 800);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert(ratbag_profile_is_dirty(p));
+
+	/* the setting stays, only the dirty state goes */
+	ratbag_profile_mark_clean(p);
+	ck_assert(!ratbag_profile_is_dirty(p));
+	ck_assert_int_eq(ratbag_resolution_get_dpi(res), 800);
+
+	ratbag_resolution_unref(res);
+	ratbag_profile_unref(p);
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
+static void
+preview_done(struct ratbag_device *device, enum ratbag_error_code rc,
+	     void *user_data)
+{
+	int *preview_done_count = user_data;
+
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	(*preview_done_count)++;
+}
+
+struct ratbag_interface preview_iface = {
+	.open_restricted = open_restricted,
+	.close_restricted = close_restricted,
+	.preview_done = preview_done,
+};
+
+START_TEST(device_start_preview)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	int device_freed_count = 0;
+	int preview_done_count = 0;
+	enum ratbag_error_code rc;
+
+	struct ratbag_test_device td = sane_device;
+	td.destroyed_data = &device_freed_count;
+
+	r = ratbag_create_context(&preview_iface, &preview_done_count);
+	d = ratbag_device_new_test_device(r, &td);
+
+	/* the result is only reported from within ratbag_dispatch() */
+	rc = ratbag_device_start_preview(d);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert_int_eq(preview_done_count, 0);
+
+	rc = ratbag_dispatch(r);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(preview_done_count, 1);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+	ck_assert_int_eq(device_freed_count, 1);
+}
+END_TEST
+
+START_TEST(device_battery)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	int device_freed_count = 0;
+	enum ratbag_error_code rc;
+
+	struct ratbag_test_device td = sane_device;
+	td.destroyed_data = &device_freed_count;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+
+	ck_assert(!ratbag_device_has_battery(d));
+	rc = ratbag_device_update_battery(d);
+	ck_assert_int_eq(rc, RATBAG_ERROR_CAPABILITY);
+	ck_assert_int_eq(ratbag_device_get_battery_level(d), -1);
+	ratbag_device_unref(d);
+
+	td.battery.present = true;
+	td.battery.level = 42;
+	td.battery.state = RATBAG_BATTERY_STATE_DISCHARGING;
+	d = ratbag_device_new_test_device(r, &td);
+
+	/* nothing is known until the battery is read */
+	ck_assert(ratbag_device_has_battery(d));
+	ck_assert(!ratbag_device_has_battery_notifications(d));
+	ck_assert_int_eq(ratbag_device_get_battery_level(d), -1);
+	ck_assert_int_eq(ratbag_device_get_battery_state(d),
+			 RATBAG_BATTERY_STATE_UNKNOWN);
+
+	rc = ratbag_device_update_battery(d);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert_int_eq(ratbag_device_get_battery_level(d), 42);
+	ck_assert_int_eq(ratbag_device_get_battery_voltage(d), 0);
+	ck_assert_int_eq(ratbag_device_get_battery_state(d),
+			 RATBAG_BATTERY_STATE_DISCHARGING);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+	ck_assert_int_eq(device_freed_count, 2);
+}
+END_TEST
+
+START_TEST(device_stats)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	uint64_t buckets[64];
+	unsigned int n;
+
+	struct ratbag_test_device td = sane_device;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+
+	/* the test device has no transport, nothing is ever counted */
+	ck_assert_int_eq(ratbag_device_get_stat(d, RATBAG_STAT_REQUESTS), 0);
+	ck_assert_int_eq(ratbag_device_get_stat(d, RATBAG_STAT_PROTOCOL_ERRORS), 0);
+	ck_assert_int_eq(ratbag_device_get_protocol_error_count(d, 0xff), 0);
+
+	n = ratbag_device_get_latency_histogram(d, buckets, 4);
+	ck_assert_int_eq(n, 4);
+	n = ratbag_device_get_latency_histogram(d, buckets, ARRAY_LENGTH(buckets));
+	ck_assert_int_lt(n, ARRAY_LENGTH(buckets));
+	for (unsigned int i = 0; i < n; i++)
+		ck_assert_int_eq(buckets[i], 0);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
+START_TEST(device_probed)
+{
+	struct ratbag *r;
+	struct ratbag_device *d;
+	enum ratbag_error_code rc;
+
+	struct ratbag_test_device td = sane_device;
+
+	r = ratbag_create_context(&abort_iface, NULL);
+	d = ratbag_device_new_test_device(r, &td);
+	ck_assert(ratbag_device_is_probed(d));
+
+	/* a second probe doesn't talk to the device again */
+	rc = ratbag_device_probe(d);
+	ck_assert_int_eq(rc, RATBAG_SUCCESS);
+	ck_assert_int_eq(ratbag_device_get_num_profiles(d), td.num_profiles);
+
+	ratbag_device_unref(d);
+	ratbag_unref(r);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -975,6 +1224,12 @@ test_context_suite(void)
 	tcase_add_test(tc, device_init);
 	tcase_add_test(tc, device_ref_unref);
 	tcase_add_test(tc, device_free_context_before_device);
+	tcase_add_test(tc, device_preview);
+	tcase_add_test(tc, device_start_preview);
+	tcase_add_test(tc, device_mark_clean);
+	tcase_add_test(tc, device_battery);
+	tcase_add_test(tc, device_stats);
+	tcase_add_test(tc, device_probed);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("profiles");
@@ -996,6 +1251,7 @@ test_context_suite(void)
 	tcase_add_test(tc, device_resolutions);
 	tcase_add_test(tc, device_resolutions_ref_unref);
 	tcase_add_test(tc, device_resolutions_num_0);
+	tcase_add_test(tc, device_resolutions_shared_lists);
 	suite_add_tcase(s, tc);
 
 	tc = tcase_create("buttons");
@@ -31,9 +31,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <linux/input.h>
 #include <sys/resource.h>
 
 #include "libratbag-util.h"
+#include "libratbag-hidraw.h"
 
 START_TEST(dpi_range_parser)
 {
@@ -122,6 +124,164 @@ START_TEST(dpi_list_parser)
 }
 END_TEST
 
+START_TEST(hid_report_descriptor_parser)
+{
+	/* HID++ short and long reports */
+	const uint8_t hidpp[] = {
+		0x06, 0x00, 0xff,	/* Usage Page (Vendor 0xff00) */
+		0x09, 0x01,		/* Usage (1) */
+		0xa1, 0x01,		/* Collection (Application) */
+		0x85, 0x10,		/*  Report ID (0x10) */
+		0x75, 0x08,		/*  Report Size (8) */
+		0x95, 0x06,		/*  Report Count (6) */
+		0x15, 0x00,		/*  Logical Minimum (0) */
+		0x26, 0xff, 0x00,	/*  Logical Maximum (255) */
+		0x09, 0x01,		/*  Usage (1) */
+		0x81, 0x00,		/*  Input */
+		0x09, 0x01,		/*  Usage (1) */
+		0x91, 0x00,		/*  Output */
+		0xc0,			/* End Collection */
+		0x06, 0x00, 0xff,	/* Usage Page (Vendor 0xff00) */
+		0x09, 0x02,		/* Usage (2) */
+		0xa1, 0x01,		/* Collection (Application) */
+		0x85, 0x11,		/*  Report ID (0x11) */
+		0xa4,			/*  Push */
+		0x75, 0x08,		/*  Report Size (8) */
+		0x95, 0x13,		/*  Report Count (19) */
+		0x09, 0x02,		/*  Usage (2) */
+		0x81, 0x00,		/*  Input */
+		0xb4,			/*  Pop */
+		0xfe, 0x01, 0x00, 0xff,	/*  long item, ignored */
+		0x75, 0x08,		/*  Report Size (8) */
+		0x95, 0x13,		/*  Report Count (19) */
+		0x09, 0x02,		/*  Usage (2) */
+		0x91, 0x00,		/*  Output */
+		0xc0,			/* End Collection */
+	};
+	/* a mouse without report IDs */
+	const uint8_t mouse[] = {
+		0x05, 0x01,		/* Usage Page (Generic Desktop) */
+		0x09, 0x02,		/* Usage (Mouse) */
+		0xa1, 0x01,		/* Collection (Application) */
+		0x09, 0x01,		/*  Usage (Pointer) */
+		0xa1, 0x00,		/*  Collection (Physical) */
+		0x05, 0x09,		/*   Usage Page (Button) */
+		0x19, 0x01,		/*   Usage Minimum (1) */
+		0x29, 0x03,		/*   Usage Maximum (3) */
+		0x95, 0x03,		/*   Report Count (3) */
+		0x75, 0x01,		/*   Report Size (1) */
+		0x81, 0x02,		/*   Input (Data,Var,Abs) */
+		0x95, 0x01,		/*   Report Count (1) */
+		0x75, 0x05,		/*   Report Size (5) */
+		0x81, 0x03,		/*   Input (Cnst) */
+		0xc0,			/*  End Collection */
+		0xc0,			/* End Collection */
+	};
+	struct ratbag_hid_report *reports;
+	unsigned int num_reports;
+	int rc;
+
+	rc = ratbag_hid_parse_report_descriptor(hidpp, sizeof(hidpp),
+						&reports, &num_reports);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(num_reports, 2);
+	ck_assert_int_eq(reports[0].report_id, 0x10);
+	ck_assert_int_eq(reports[0].usage_page, 0xff00);
+	ck_assert_int_eq(reports[0].usage, 0x01);
+	ck_assert_int_eq(reports[0].size[HID_INPUT_REPORT], 48);
+	ck_assert_int_eq(reports[0].size[HID_OUTPUT_REPORT], 48);
+	ck_assert_int_eq(reports[0].size[HID_FEATURE_REPORT], 0);
+	ck_assert_int_eq(reports[1].report_id, 0x11);
+	ck_assert_int_eq(reports[1].usage, 0x02);
+	ck_assert_int_eq(reports[1].size[HID_INPUT_REPORT], 152);
+	ck_assert_int_eq(reports[1].size[HID_OUTPUT_REPORT], 152);
+	free(reports);
+
+	rc = ratbag_hid_parse_report_descriptor(mouse, sizeof(mouse),
+						&reports, &num_reports);
+	ck_assert_int_eq(rc, 0);
+	ck_assert_int_eq(num_reports, 1);
+	ck_assert_int_eq(reports[0].report_id, 0);
+	ck_assert_int_eq(reports[0].usage_page, 0x01);
+	ck_assert_int_eq(reports[0].usage, 0x02);
+	ck_assert_int_eq(reports[0].size[HID_INPUT_REPORT], 8);
+	ck_assert_int_eq(reports[0].size[HID_OUTPUT_REPORT], 0);
+	free(reports);
+
+	/* truncated in the middle of an item */
+	rc = ratbag_hid_parse_report_descriptor(hidpp, 2,
+						&reports, &num_reports);
+	ck_assert_int_eq(rc, -EPROTO);
+}
+END_TEST
+
+START_TEST(hid_keymap)
+{
+	unsigned int keycode;
+
+	ck_assert_int_eq(ratbag_hidraw_get_keycode_from_keyboard_usage(NULL, 0x04), KEY_A);
+	ck_assert_int_eq(ratbag_hidraw_get_keycode_from_keyboard_usage(NULL, 0xe7), KEY_RIGHTMETA);
+	ck_assert_int_eq(ratbag_hidraw_get_keycode_from_keyboard_usage(NULL, 0xff), 0);
+	ck_assert_int_eq(ratbag_hidraw_get_keycode_from_consumer_usage(NULL, 0xcd), KEY_PLAYPAUSE);
+	ck_assert_int_eq(ratbag_hidraw_get_keycode_from_consumer_usage(NULL, 0xffff), 0);
+
+	/* listed twice, maps back to the first usage */
+	ck_assert_int_eq(ratbag_hidraw_get_keyboard_usage_from_keycode(NULL, KEY_BACKSLASH), 0x31);
+	ck_assert_int_eq(ratbag_hidraw_get_consumer_usage_from_keycode(NULL, KEY_STOP), 0xb7);
+
+	ck_assert_int_eq(ratbag_hidraw_get_keyboard_usage_from_keycode(NULL, KEY_RESERVED), 0);
+	ck_assert_int_eq(ratbag_hidraw_get_keyboard_usage_from_keycode(NULL, KEY_PLAYPAUSE), 0);
+	ck_assert_int_eq(ratbag_hidraw_get_keyboard_usage_from_keycode(NULL, KEY_MAX + 1), 0);
+	ck_assert_int_eq(ratbag_hidraw_get_consumer_usage_from_keycode(NULL, KEY_MAX + 1), 0);
+
+	/* every usage a keycode maps to maps back to that keycode */
+	for (keycode = 1; keycode <= KEY_MAX; keycode++) {
+		uint8_t kbd = ratbag_hidraw_get_keyboard_usage_from_keycode(NULL, keycode);
+		uint16_t cc = ratbag_hidraw_get_consumer_usage_from_keycode(NULL, keycode);
+
+		if (kbd)
+			ck_assert_int_eq(ratbag_hidraw_get_keycode_from_keyboard_usage(NULL, kbd), keycode);
+		if (cc)
+			ck_assert_int_eq(ratbag_hidraw_get_keycode_from_consumer_usage(NULL, cc), keycode);
+	}
+}
+END_TEST
+
+START_TEST(arena_alloc)
+{
+	struct ratbag_arena arena = { 0 };
+	uint8_t *small, *big, *next;
+
+	small = ratbag_arena_alloc(&arena, 3);
+	ck_assert(small != NULL);
+	ck_assert_int_eq((uintptr_t)small % sizeof(long long), 0);
+	ck_assert_int_eq(small[0] | small[1] | small[2], 0);
+	memset(small, 0xff, 3);
+
+	/* too big for a chunk, must not take the place of the current one */
+	big = ratbag_arena_alloc(&arena, 16384);
+	ck_assert(big != NULL);
+	ck_assert_int_eq(big[0] | big[16383], 0);
+	memset(big, 0xff, 16384);
+
+	next = ratbag_arena_alloc(&arena, 8);
+	ck_assert(next != NULL);
+	ck_assert_int_eq((uintptr_t)next % sizeof(long long), 0);
+	ck_assert(next > small && next < small + 4096);
+	ck_assert_int_eq(next[0] | next[7], 0);
+
+	for (int i = 0; i < 1000; i++) {
+		next = ratbag_arena_alloc(&arena, 24);
+		ck_assert(next != NULL);
+		ck_assert_int_eq(next[0] | next[23], 0);
+		memset(next, 0xff, 24);
+	}
+
+	ratbag_arena_release(&arena);
+	ck_assert(arena.chunks == NULL);
+}
+END_TEST
+
 static Suite *
 test_context_suite(void)
 {
@@ -132,6 +292,9 @@ test_context_suite(void)
 	tc = tcase_create("util");
 	tcase_add_test(tc, dpi_range_parser);
 	tcase_add_test(tc, dpi_list_parser);
+	tcase_add_test(tc, hid_report_descriptor_parser);
+	tcase_add_test(tc, hid_keymap);
+	tcase_add_test(tc, arena_alloc);
 
 	suite_add_tcase(s, tc);
 	return s;
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+#
+# Generates the devices.index file libratbag uses to look up the .device
+# file for a bus:vid:pid without parsing every data file.
+#
+# The layout (all integers little endian) is:
+#   char     magic[8]      "RBDEVIDX"
+#   uint32   version       1
+#   uint32   count         number of entries
+#   count x {
+#     uint16 bustype       BUS_USB or BUS_BLUETOOTH
+#     uint16 vendor
+#     uint16 product
+#     uint16 reserved
+#     uint32 name_offset   offset of the file name in the string table
+#   }
+#   char     strings[]     nul-terminated file names
+#
+# Entries are sorted by (bustype, vendor, product).
+#
+# When run as a meson install script, the directory is prefixed with
+# $DESTDIR and the index is written into that directory.
+
+import argparse
+import configparser
+import os
+import pathlib
+import struct
+import sys
+
+MAGIC = b"RBDEVIDX"
+VERSION = 1
+INDEX_FILENAME = "devices.index"
+
+BUSTYPES = {
+    "usb": 0x03,
+    "bluetooth": 0x05,
+}
+
+
+def parse_data_file(path):
+    data = configparser.ConfigParser(strict=True)
+    # Don't convert to lowercase
+    data.optionxform = lambda option: option
+    data.read(path)
+
+    matches = data["Device"]["DeviceMatch"]
+    return [m for m in matches.split(";") if m]
+
+
+def build_index(directory):
+    entries = {}
+    for path in sorted(pathlib.Path(directory).glob("*.device")):
+        for m in parse_data_file(path):
+            bus, vid, pid = m.split(":")
+            key = (BUSTYPES[bus], int(vid, 16), int(pid, 16))
+            if key in entries:
+                print(
+                    f"Duplicate DeviceMatch={m} in {path.name} and {entries[key]}",
+                    file=sys.stderr,
+                )
+                sys.exit(1)
+            entries[key] = path.name
+
+    strings = bytearray()
+    offsets = {}
+    for name in sorted(set(entries.values())):
+        offsets[name] = len(strings)
+        strings += name.encode("utf-8") + b"\0"
+
+    blob = bytearray(MAGIC)
+    blob += struct.pack("<II", VERSION, len(entries))
+    for key in sorted(entries):
+        bus, vid, pid = key
+        blob += struct.pack("<HHHHI", bus, vid, pid, 0, offsets[entries[key]])
+    blob += strings
+
+    return bytes(blob)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Device file index generator")
+    parser.add_argument("directory")
+    parser.add_argument(
+        "--output", help="Output file (default: <directory>/devices.index)"
+    )
+    args = parser.parse_args()
+
+    directory = args.directory
+    destdir = os.environ.get("DESTDIR")
+    if destdir and "MESON_INSTALL_PREFIX" in os.environ:
+        directory = destdir + os.path.abspath(directory)
+
+    output = args.output or os.path.join(directory, INDEX_FILENAME)
+    blob = build_index(directory)
+
+    # Write and rename so a concurrent reader never sees a partial index
+    tmp = f"{output}.tmp"
+    with open(tmp, "wb") as fd:
+        fd.write(blob)
+    os.chmod(tmp, 0o644)
+    os.replace(tmp, output)
+
+    # libratbag considers the index stale once the directory is newer than
+    # the index, our own rename above must not count as such a change
+    dir_mtime = os.stat(os.path.dirname(os.path.abspath(output))).st_mtime_ns
+    os.utime(output, ns=(dir_mtime, dir_mtime))
@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+# DEALINGS IN THE SOFTWARE.
+
+#
+# Generates the keycode lookup tables from src/libratbag-keymap.txt.
+#
+# For every [section] of the keymap, the header declares
+#   RATBAG_KEYMAP_<SECTION>_USAGE_COUNT    one past the highest usage
+#   ratbag_keymap_<section>_keycodes[]     indexed by usage, the event code
+#   ratbag_keymap_<section>_usages[]       indexed by event code, the usage
+# and the C file defines the tables. Both lookups are a bounds check and an
+# array access, the callers don't need to search.
+#
+# The [fallback] section lists event codes that older kernel headers don't
+# have, those are defined in the header unless linux/input.h does.
+
+import argparse
+import os
+import re
+import sys
+
+LINE = re.compile(r"^(?P<key>\S+)\s+(?P<value>\S+)$")
+CODE = re.compile(r"^(KEY|BTN)_[A-Z0-9_]+$")
+
+
+class KeymapError(Exception):
+    pass
+
+
+def parse_keymap(path):
+    sections = {}
+    fallbacks = []
+    current = None
+
+    with open(path) as fd:
+        for lineno, line in enumerate(fd, start=1):
+            where = f"{os.path.basename(path)}:{lineno}"
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+
+            if line.startswith("[") and line.endswith("]"):
+                name = line[1:-1]
+                if not re.match(r"^[a-z][a-z0-9_]*$", name):
+                    raise KeymapError(f"{where}: invalid section name '{name}'")
+                if name in sections or (name == "fallback" and fallbacks):
+                    raise KeymapError(f"{where}: duplicate section [{name}]")
+                current = name
+                if name != "fallback":
+                    sections[name] = {}
+                continue
+
+            m = LINE.match(line)
+            if current is None or not m:
+                raise KeymapError(f"{where}: expected '<usage> <code>'")
+
+            key, value = m.group("key"), m.group("value")
+            if current == "fallback":
+                if not CODE.match(key):
+                    raise KeymapError(f"{where}: invalid event code '{key}'")
+                fallbacks.append((key, int(value, 16)))
+                continue
+
+            if not CODE.match(value):
+                raise KeymapError(f"{where}: invalid event code '{value}'")
+            usage = int(key, 16)
+            if usage in sections[current]:
+                raise KeymapError(f"{where}: usage {key} listed twice")
+            sections[current][usage] = value
+
+    return sections, fallbacks
+
+
+def usage_type(mapping):
+    return "uint8_t" if max(mapping, default=0) <= 0xFF else "uint16_t"
+
+
+def generate_header(sections, fallbacks):
+    out = [
+        "/* Generated by gen-keymap.py from libratbag-keymap.txt, do not edit */",
+        "",
+        "#pragma once",
+        "",
+        "#include <linux/input.h>",
+        "#include <stdint.h>",
+        "",
+    ]
+
+    for code, value in fallbacks:
+        out += [f"#ifndef {code}", f"#define {code}\t0x{value:x}", "#endif"]
+
+    for name, mapping in sections.items():
+        count = max(mapping, default=0) + 1
+        out += [
+            "",
+            f"#define RATBAG_KEYMAP_{name.upper()}_USAGE_COUNT\t0x{count:x}",
+            f"extern const uint16_t ratbag_keymap_{name}_keycodes[RATBAG_KEYMAP_{name.upper()}_USAGE_COUNT];",
+            f"extern const {usage_type(mapping)} ratbag_keymap_{name}_usages[KEY_CNT];",
+        ]
+
+    return "\n".join(out) + "\n"
+
+
+def generate_source(sections):
+    out = [
+        "/* Generated by gen-keymap.py from libratbag-keymap.txt, do not edit */",
+        "",
+        '#include "libratbag-keymap.h"',
+    ]
+
+    for name, mapping in sections.items():
+        count = max(mapping, default=0) + 1
+        width = 2 if count <= 0x100 else 3
+
+        out += [
+            "",
+            f"const uint16_t ratbag_keymap_{name}_keycodes[RATBAG_KEYMAP_{name.upper()}_USAGE_COUNT] = {{",
+        ]
+        for usage in sorted(mapping):
+            out.append(f"\t[0x{usage:0{width}x}] = {mapping[usage]},")
+        out.append("};")
+
+        # the first usage of an event code is the one it maps back to
+        inverse = {}
+        for usage in sorted(mapping):
+            inverse.setdefault(mapping[usage], usage)
+
+        out += [
+            "",
+            f"const {usage_type(mapping)} ratbag_keymap_{name}_usages[KEY_CNT] = {{",
+        ]
+        for code, usage in inverse.items():
+            out.append(f"\t[{code}] = 0x{usage:0{width}x},")
+        out.append("};")
+
+    return "\n".join(out) + "\n"
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Keycode lookup table generator")
+    parser.add_argument("keymap")
+    parser.add_argument("--header", required=True, help="Output header file")
+    parser.add_argument("--source", required=True, help="Output C file")
+    args = parser.parse_args()
+
+    try:
+        sections, fallbacks = parse_keymap(args.keymap)
+    except (KeymapError, ValueError) as e:
+        print(f"{args.keymap}: {e}", file=sys.stderr)
+        sys.exit(1)
+
+    with open(args.header, "w") as fd:
+        fd.write(generate_header(sections, fallbacks))
+    with open(args.source, "w") as fd:
+        fd.write(generate_source(sections))
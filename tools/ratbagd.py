@@ -22,12 +22,13 @@
 import os
 import sys
 import hashlib
+import weakref
 
 from enum import IntEnum
 from evdev import ecodes
 from gettext import gettext as _
 from gi.repository import Gio, GLib, GObject
-from typing import List, Optional, Tuple, Union
+from typing import Any, Dict, List, Optional, Tuple, Union
 
 
 # Deferred translations, see https://docs.python.org/3/library/gettext.html#deferred-translations
@@ -85,6 +86,15 @@ class RatbagDeviceType(IntEnum):
     KEYBOARD = 3
 
 
+class RatbagBatteryState(IntEnum):
+    """State property of a RatbagdBattery"""
+
+    UNKNOWN = 0
+    DISCHARGING = 1
+    CHARGING = 2
+    FULL = 3
+
+
 class RatbagdIncompatibleError(Exception):
     """ratbagd is incompatible with this client"""
 
@@ -142,6 +152,15 @@ EXCEPTION_TABLE = {
 
 class _RatbagdDBus(GObject.GObject):
     _dbus = None
+    _subscription = None
+
+    # Object path -> {interface: {property: value}} for every object below
+    # the manager. Filled by a single GetManagedObjects call and kept up to
+    # date from the signals, so reading a property never hits the bus.
+    _snapshot: Dict[str, Dict[str, Dict[str, Any]]] = {}
+
+    # Object path -> the objects that want the signals for that path
+    _objects: Dict[str, "weakref.WeakSet[_RatbagdDBus]"] = {}
 
     def __init__(self, interface, object_path):
         super().__init__()
@@ -159,27 +178,108 @@ class _RatbagdDBus(GObject.GObject):
         if object_path is None:
             object_path = "/" + ratbag1.replace(".", "/")
 
+        self._bus_name = ratbag1
         self._object_path = object_path
         self._interface = f"{ratbag1}.{interface}"
 
+        # We don't create a Gio.DBusProxy per object, it costs a round-trip
+        # each and ratbagctl creates hundreds of them. All signals from
+        # ratbagd go through one subscription instead and are dispatched by
+        # object path.
+        if _RatbagdDBus._subscription is None:
+            _RatbagdDBus._subscription = _RatbagdDBus._dbus.signal_subscribe(
+                ratbag1,
+                None,
+                None,
+                None,
+                None,
+                Gio.DBusSignalFlags.NONE,
+                _RatbagdDBus._on_dbus_signal,
+            )
+        _RatbagdDBus._objects.setdefault(object_path, weakref.WeakSet()).add(self)
+
+    @staticmethod
+    def _on_dbus_signal(
+        connection, sender_name, object_path, interface_name, signal_name, parameters
+    ):
+        snapshot = _RatbagdDBus._snapshot
+        objects = list(_RatbagdDBus._objects.get(object_path, []))
+
+        if interface_name == "org.freedesktop.DBus.Properties":
+            if signal_name != "PropertiesChanged":
+                return
+            interface, changed_props, invalidated_props = parameters.unpack()
+            props = snapshot.get(object_path, {}).get(interface)
+            if props is not None:
+                props.update(changed_props)
+                for property in invalidated_props:
+                    props.pop(property, None)
+            for obj in objects:
+                if obj._interface == interface:
+                    obj._on_properties_changed(None, changed_props, invalidated_props)
+        elif interface_name == "org.freedesktop.DBus.ObjectManager":
+            if signal_name == "InterfacesAdded":
+                path, interfaces = parameters.unpack()
+                snapshot.setdefault(path, {}).update(interfaces)
+            elif signal_name == "InterfacesRemoved":
+                path, interfaces = parameters.unpack()
+                for interface in interfaces:
+                    snapshot.get(path, {}).pop(interface, None)
+                if not snapshot.get(path, True):
+                    del snapshot[path]
+        else:
+            for obj in objects:
+                if obj._interface == interface_name:
+                    obj._on_signal_received(None, sender_name, signal_name, parameters)
+
+    def _load_snapshot(self):
+        # Fetches the properties of all objects below us in one call. If
+        # that fails we fall back to fetching each object on first use.
+        _RatbagdDBus._snapshot.clear()
         try:
-            self._proxy = Gio.DBusProxy.new_sync(
-                _RatbagdDBus._dbus,
-                Gio.DBusProxyFlags.NONE,
+            res = self._dbus.call_sync(
+                self._bus_name,
+                self._object_path,
+                "org.freedesktop.DBus.ObjectManager",
+                "GetManagedObjects",
                 None,
-                ratbag1,
-                object_path,
-                self._interface,
+                GLib.VariantType("(a{oa{sa{sv}}})"),
+                Gio.DBusCallFlags.NO_AUTO_START,
+                2000,
+                None,
+            )
+        except GLib.Error:
+            return
+        _RatbagdDBus._snapshot.update(res.unpack()[0])
+
+    def _load_properties(self):
+        # Fetches all properties of this object, for objects missing from
+        # the snapshot.
+        try:
+            res = self._dbus.call_sync(
+                self._bus_name,
+                self._object_path,
+                "org.freedesktop.DBus.Properties",
+                "GetAll",
+                GLib.Variant("(s)", (self._interface,)),
+                GLib.VariantType("(a{sv})"),
+                Gio.DBusCallFlags.NO_AUTO_START,
+                2000,
                 None,
             )
         except GLib.Error as e:
             raise RatbagdUnavailableError(e.message) from e
 
-        if self._proxy.get_name_owner() is None:
-            raise RatbagdUnavailableError(f"No one currently owns {ratbag1}")
+        props = res.unpack()[0]
+        interfaces = _RatbagdDBus._snapshot.setdefault(self._object_path, {})
+        interfaces[self._interface] = props
+        return props
 
-        self._proxy.connect("g-properties-changed", self._on_properties_changed)
-        self._proxy.connect("g-signal", self._on_signal_received)
+    def _properties(self):
+        props = _RatbagdDBus._snapshot.get(self._object_path, {}).get(self._interface)
+        if props is None:
+            props = self._load_properties()
+        return props
 
     def _on_properties_changed(self, proxy, changed_props, invalidated_props):
         # Implement this in derived classes to respond to property changes.
@@ -198,11 +298,8 @@ class _RatbagdDBus(GObject.GObject):
         return -1
 
     def _get_dbus_property(self, property):
-        # Retrieves a cached property from the bus, or None.
-        p = self._proxy.get_cached_property(property)
-        if p is not None:
-            return p.unpack()
-        return p
+        # Retrieves a cached property from the snapshot, or None.
+        return self._properties().get(property)
 
     def _get_dbus_property_nonnull(self, property: str):
         p = self._get_dbus_property(property)
@@ -220,9 +317,13 @@ class _RatbagdDBus(GObject.GObject):
         val = GLib.Variant(f"{type}", value)
         if readwrite:
             pval = GLib.Variant("(ssv)", (self._interface, property, val))
-            self._proxy.call_sync(
-                "org.freedesktop.DBus.Properties.Set",
+            self._dbus.call_sync(
+                self._bus_name,
+                self._object_path,
+                "org.freedesktop.DBus.Properties",
+                "Set",
                 pval,
+                None,
                 Gio.DBusCallFlags.NO_AUTO_START,
                 2000,
                 None,
@@ -230,7 +331,7 @@ class _RatbagdDBus(GObject.GObject):
 
         # This is our local copy, so we don't have to wait for the async
         # update
-        self._proxy.set_cached_property(property, val)
+        self._properties()[property] = val.unpack()
 
     def _dbus_call(self, method, type, *value):
         # Calls a method synchronously on the bus, using the given method name,
@@ -242,8 +343,16 @@ class _RatbagdDBus(GObject.GObject):
         # the UI.
         val = GLib.Variant(f"({type})", value)
         try:
-            res = self._proxy.call_sync(
-                method, val, Gio.DBusCallFlags.NO_AUTO_START, 2000, None
+            res = self._dbus.call_sync(
+                self._bus_name,
+                self._object_path,
+                self._interface,
+                method,
+                val,
+                None,
+                Gio.DBusCallFlags.NO_AUTO_START,
+                2000,
+                None,
             )
             if res in EXCEPTION_TABLE:
                 raise EXCEPTION_TABLE[res]
@@ -280,11 +389,36 @@ class Ratbagd(_RatbagdDBus):
 
     def __init__(self, api_version):
         super().__init__("Manager", None)
-        result = self._get_dbus_property("Devices")
-        if result is None and not self._proxy.get_cached_property_names():
+
+        # The manager is the only object we keep a proxy for, it tells us
+        # when the daemon goes away. Properties and signals go through the
+        # shared subscription like for every other object.
+        try:
+            self._proxy = Gio.DBusProxy.new_sync(
+                self._dbus,
+                Gio.DBusProxyFlags.DO_NOT_LOAD_PROPERTIES
+                | Gio.DBusProxyFlags.DO_NOT_CONNECT_SIGNALS,
+                None,
+                self._bus_name,
+                self._object_path,
+                self._interface,
+                None,
+            )
+        except GLib.Error as e:
+            raise RatbagdUnavailableError(e.message) from e
+
+        if self._proxy.get_name_owner() is None:
+            raise RatbagdUnavailableError(f"No one currently owns {self._bus_name}")
+
+        self._load_snapshot()
+        try:
+            self._load_properties()
+        except RatbagdUnavailableError as e:
             raise RatbagdUnavailableError(
                 "Make sure it is running and your user is in the required groups."
-            )
+            ) from e
+
+        result = self._get_dbus_property("Devices")
         if self.api_version != api_version:
             raise RatbagdIncompatibleError(self.api_version or -1, api_version)
         self._devices = [RatbagdDevice(objpath) for objpath in result or []]
@@ -357,6 +491,18 @@ class RatbagdDevice(_RatbagdDBus):
         for profile in self._profiles:
             profile.connect("notify::is-active", self._on_active_profile_changed)
 
+        # Only devices with a battery implement the Battery interface
+        self._battery = None
+        interfaces = _RatbagdDBus._snapshot.get(object_path)
+        battery_interface = self._interface.replace(".Device", ".Battery")
+        if interfaces is None or battery_interface in interfaces:
+            try:
+                battery = RatbagdBattery(object_path)
+                battery._properties()
+                self._battery = battery
+            except RatbagdUnavailableError:
+                pass
+
         # Use a SHA1 of our object path as our device's ID
         self._id = hashlib.sha1(object_path.encode("utf-8")).hexdigest()
 
@@ -401,6 +547,22 @@ class RatbagdDevice(_RatbagdDBus):
         """A list of RatbagdProfile objects provided by this device."""
         return self._profiles
 
+    @GObject.Property
+    def battery(self):
+        """The RatbagdBattery of this device or None if it has none."""
+        return self._battery
+
+    @GObject.Property
+    def stats(self):
+        """The RatbagdStats of this device."""
+        return RatbagdStats(self._object_path)
+
+    @GObject.Property
+    def committed_generation(self):
+        """The generation of the last commit that was written to the device,
+        see commit()."""
+        return self._get_dbus_property("CommittedGeneration")
+
     @GObject.Property
     def active_profile(self):
         """The currently active profile. This is a non-DBus property computed
@@ -423,8 +585,98 @@ class RatbagdDevice(_RatbagdDBus):
         this method and always succeed.  Any failure is handled inside ratbagd
         by emitting the Resync signal, which automatically resynchronizes the
         device. No further interaction is required by the client.
+
+        @return The generation of this commit, it is written to the device
+                once committed_generation reaches this value
         """
-        self._dbus_call("Commit", "")
+        return self._dbus_call("Commit", "")
+
+    def preview(self):
+        """Applies the changes to the active profile to the device without
+        storing them, see commit() to store them.
+
+        @return 0 on success or a RatbagErrorCode, RatbagErrorCode.CAPABILITY
+                if the device cannot preview changes
+        """
+        return self._dbus_call("Preview", "")
+
+    def apply_configuration(self, configuration):
+        """Applies the complete configuration in one call and commits it.
+        Nothing is changed if any setting is invalid.
+
+        @param configuration The configuration as dict of GLib.Variant, see
+                             the ApplyConfiguration() documentation.
+        @return A dict mapping each invalid setting to its RatbagErrorCode,
+                empty on success
+        """
+        return self._dbus_call("ApplyConfiguration", "a{sv}", configuration)
+
+
+class RatbagdBattery(_RatbagdDBus):
+    """Represents the battery of a ratbagd device. The values are the ones
+    ratbagd read last, reading them never talks to the device."""
+
+    def __init__(self, object_path):
+        super().__init__("Battery", object_path)
+
+    def _on_properties_changed(self, proxy, changed_props, invalidated_props):
+        for dbus_name, name in (
+            ("Level", "level"),
+            ("Voltage", "voltage"),
+            ("State", "state"),
+        ):
+            if dbus_name in changed_props:
+                self.notify(name)
+
+    @GObject.Property
+    def level(self):
+        """The battery level in percent or -1 if unknown."""
+        return self._get_dbus_property("Level")
+
+    @GObject.Property
+    def voltage(self):
+        """The battery voltage in mV or 0 if unknown."""
+        return self._get_dbus_property("Voltage")
+
+    @GObject.Property
+    def state(self):
+        """The charging state, see RatbagBatteryState."""
+        return RatbagBatteryState(self._get_dbus_property("State"))
+
+
+class RatbagdStats(_RatbagdDBus):
+    """Represents the communication counters of a ratbagd device. ratbagd
+    doesn't signal changes to them, call refresh() to fetch the current
+    values."""
+
+    def __init__(self, object_path):
+        super().__init__("Stats", object_path)
+
+    def refresh(self):
+        """Fetches the current values of all counters."""
+        self._load_properties()
+
+    @GObject.Property
+    def counters(self):
+        """A dict of counter name to value, in the order ratbagd exports
+        them."""
+        return {
+            name: value
+            for name, value in self._properties().items()
+            if name not in ("ErrorCodes", "LatencyHistogram")
+        }
+
+    @GObject.Property
+    def error_codes(self):
+        """A dict of protocol error code to the number of times the device
+        sent it."""
+        return self._get_dbus_property("ErrorCodes") or {}
+
+    @GObject.Property
+    def latency_histogram(self):
+        """A list of request counts, element i counts the requests that
+        took from 2**i up to 2**(i+1) microseconds."""
+        return self._get_dbus_property("LatencyHistogram") or []
 
 
 class RatbagdProfile(_RatbagdDBus):